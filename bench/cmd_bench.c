@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+/* piccflight headers */
+#include "controller.h"
+#include "handle_command.h"
+#include "cmd_table.h"
+
+/**************************************************************/
+/* CMD_BENCH                                                  */
+/*  - Replays a command file through handle_command           */
+/*  - Runs against a private zeroed sm_t, not the flight      */
+/*    shared memory, so only use commands without hardware    */
+/*    side effects (see bench/cmd_replay.txt)                 */
+/*  - Reports table lookup and full dispatch time per line    */
+/*    and the cost of a full legacy chain scan                */
+/*  - Build: make cmdbench                                    */
+/*  - Usage: bin/cmdbench [file] [nreps]                      */
+/**************************************************************/
+
+#define MAX_LINES 1024
+
+int handle_command(char *line, sm_t *sm_p);
+
+/**************************************************************/
+/* ELAPSED                                                    */
+/*  - Seconds between two timespecs                           */
+/**************************************************************/
+static double elapsed(struct timespec *start, struct timespec *end){
+  return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec)/1e9;
+}
+
+/**************************************************************/
+/* TIME_DISPATCH                                              */
+/*  - Mean handle_command time for one line [s]               */
+/**************************************************************/
+static double time_dispatch(char *cmdline, sm_t *sm_p, int nreps, int *retval){
+  char line[CMD_MAX_LENGTH];
+  struct timespec start,end;
+  double t=0;
+  int i;
+  for(i=0;i<nreps;i++){
+    //handle_command may modify the line
+    strcpy(line,cmdline);
+    clock_gettime(CLOCK_MONOTONIC,&start);
+    *retval = handle_command(line,sm_p);
+    clock_gettime(CLOCK_MONOTONIC,&end);
+    t += elapsed(&start,&end);
+  }
+  return t/nreps;
+}
+
+/**************************************************************/
+/* TIME_LOOKUP                                                */
+/*  - Mean cmd_lookup time for one line [s]                   */
+/**************************************************************/
+static double time_lookup(char *cmdline, int nreps, int *index){
+  struct timespec start,end;
+  int i;
+  clock_gettime(CLOCK_MONOTONIC,&start);
+  for(i=0;i<nreps;i++)
+    *index = cmd_lookup(cmdline);
+  clock_gettime(CLOCK_MONOTONIC,&end);
+  return elapsed(&start,&end)/nreps;
+}
+
+int main(int argc, char **argv){
+  char *file = "bench/cmd_replay.txt";
+  char *lines[MAX_LINES];
+  char buf[CMD_MAX_LENGTH];
+  char miss[] = "bench miss\n";
+  double tlook[MAX_LINES],tdisp[MAX_LINES],tmiss;
+  double sum_table=0,sum_legacy=0,sum_look=0;
+  int    index[MAX_LINES],ret[MAX_LINES];
+  int    nlines=0,ntable=0,nlegacy=0,nreps=1000;
+  int    i,stdout_fd,null_fd;
+  FILE  *fd;
+  sm_t  *sm_p;
+
+  if(argc > 1) file  = argv[1];
+  if(argc > 2) nreps = atoi(argv[2]);
+  if(nreps < 1){
+    printf("usage: %s [file] [nreps]\n",argv[0]);
+    return 1;
+  }
+
+  //Read command file
+  if((fd = fopen(file,"r")) == NULL){
+    perror("CMD: fopen");
+    printf("CMD: %s\n",file);
+    return 1;
+  }
+  while(nlines < MAX_LINES && fgets(buf,sizeof(buf),fd) != NULL){
+    if(buf[0] == '#' || buf[0] == '\n') continue;
+    lines[nlines++] = strdup(buf);
+  }
+  fclose(fd);
+  if(nlines == 0){
+    printf("CMD: No commands in %s\n",file);
+    printf("usage: %s [file] [nreps]\n",argv[0]);
+    return 1;
+  }
+
+  //Private shared memory image
+  if((sm_p = calloc(1,sizeof(sm_t))) == NULL){
+    printf("CMD: calloc failed\n");
+    return 1;
+  }
+
+  //Silence command output while timing
+  fflush(stdout);
+  stdout_fd = dup(STDOUT_FILENO);
+  null_fd   = open("/dev/null",O_WRONLY);
+  dup2(null_fd,STDOUT_FILENO);
+
+  //First call compiles the command table
+  time_dispatch(lines[0],sm_p,1,&ret[0]);
+  for(i=0;i<nlines;i++){
+    tlook[i] = time_lookup(lines[i],nreps,&index[i]);
+    tdisp[i] = time_dispatch(lines[i],sm_p,nreps,&ret[i]);
+  }
+  tmiss = time_dispatch(miss,sm_p,nreps,&i);
+
+  //Restore output
+  fflush(stdout);
+  dup2(stdout_fd,STDOUT_FILENO);
+  close(null_fd);
+
+  //Report
+  printf("CMD: %s, %d commands, %d reps\n",file,nlines,nreps);
+  printf("%-40s %-7s %12s %12s\n","command","path","lookup[ns]","dispatch[us]");
+  for(i=0;i<nlines;i++){
+    lines[i][strcspn(lines[i],"\r\n")] = 0;
+    printf("%-40s %-7s %12.1f %12.3f%s\n",lines[i],index[i] >= 0 ? "table" : "legacy",
+	   tlook[i]*1e9,tdisp[i]*1e6,ret[i] == CMD_NOT_FOUND ? "  (not found)" : "");
+    sum_look += tlook[i];
+    if(index[i] >= 0){
+      sum_table += tdisp[i];
+      ntable++;
+    }
+    else{
+      sum_legacy += tdisp[i];
+      nlegacy++;
+    }
+  }
+  printf("\n");
+  printf("CMD: mean lookup           %10.1f ns\n",sum_look/nlines*1e9);
+  if(ntable)  printf("CMD: mean table dispatch   %10.3f us (%d commands)\n",sum_table/ntable*1e6,ntable);
+  if(nlegacy) printf("CMD: mean legacy dispatch  %10.3f us (%d commands)\n",sum_legacy/nlegacy*1e6,nlegacy);
+  printf("CMD: full legacy scan      %10.3f us (unknown command)\n",tmiss*1e6);
+  return 0;
+}
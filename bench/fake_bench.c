@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <phx_api.h>
+
+/* piccflight headers */
+#include "controller.h"
+#include "watchdog.h"
+#include "common_functions.h"
+#include "numeric.h"
+#include "fakemodes.h"
+#include "frm_functions.h"
+
+/**************************************************************/
+/* FAKE_BENCH                                                 */
+/*  - Load test of SHK and LYT processing with synthetic      */
+/*    frames (FAKEMODE_ZERNIKE) at a multiple of the flight   */
+/*    frame rate, no cameras or shared memory needed          */
+/*  - Frames are paced to absolute deadlines and run through  */
+/*    shk_process_image and lyt_process_image in              */
+/*    STATE_STANDBY (centroiding and zernike fitting, no DM   */
+/*    or hexapod commands) against a private zeroed sm_t      */
+/*  - Reports frame accounting: processing time, frames that  */
+/*    overran the period and the achieved rate               */
+/*  - Build: make fakebench                                   */
+/*  - Usage: bin/fakebench [speedup] [seconds]                */
+/**************************************************************/
+
+int shk_process_image(stImageBuff *buffer,sm_t *sm_p);
+int lyt_process_image(stImageBuff *buffer,sm_t *sm_p);
+void init_state(int state_number, state_t *state);
+
+/**************************************************************/
+/* RUN_CAMERA                                                 */
+/*  - Drive one process_image function at a fixed period      */
+/**************************************************************/
+static void run_camera(sm_t *sm_p, int id, int (*process)(stImageBuff *,sm_t *), void *frame, double period, double seconds){
+  stImageBuff buffer;
+  struct timespec start,deadline;
+  long nsec;
+  uint32 n,nframes = seconds/period;
+  frmstat_t *f = (frmstat_t *)&sm_p->frmstat[id];
+
+  memset(&buffer,0,sizeof(buffer));
+  buffer.pvAddress = frame;
+  frm_restart(sm_p,id);
+  clock_gettime(CLOCK_MONOTONIC,&start);
+  for(n=0;n<nframes;n++){
+    //Wait for the next frame time
+    nsec = start.tv_nsec + (long)(n*period*ONE_BILLION);
+    deadline.tv_sec  = start.tv_sec + nsec/ONE_BILLION;
+    deadline.tv_nsec = nsec%ONE_BILLION;
+    while(clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&deadline,NULL) == EINTR);
+    //Process frame
+    frm_arrive(sm_p,id,n);
+    if(process(&buffer,sm_p))
+      frm_skip(sm_p,id,FRM_SKIP_ERROR);
+    frm_done(sm_p,id,period);
+  }
+  printf("%-4s %9.1f %9lu %9lu %7lu %10.1f %10.1f %8.1f\n",id == SHKID ? "SHK" : "LYT",1/period,
+	 (unsigned long)f->nframes,(unsigned long)f->nprocessed,(unsigned long)f->noverrun,
+	 f->proc_time*ONE_MILLION,f->proc_time_max*ONE_MILLION,f->rate);
+}
+
+int main(int argc, char **argv){
+  static uint8  shkframe[SHKXS*SHKYS];
+  static uint16 lytframe[LYTREADXS*LYTREADYS];
+  double speedup=2,seconds=10;
+  sm_t *sm_p;
+  int i;
+
+  if(argc > 1) speedup = atof(argv[1]);
+  if(argc > 2) seconds = atof(argv[2]);
+  if(speedup <= 0 || seconds <= 0){
+    printf("usage: %s [speedup] [seconds]\n",argv[0]);
+    return 1;
+  }
+
+  //Private shared memory
+  if((sm_p = calloc(1,sizeof(sm_t))) == NULL){
+    perror("calloc");
+    return 1;
+  }
+  init_state(STATE_STANDBY,(state_t *)&sm_p->state_array[STATE_STANDBY]);
+  sm_p->state           = STATE_STANDBY;
+  sm_p->shk_frmtime     = SHK_FRMTIME_DEFAULT;
+  sm_p->shk_exptime     = SHK_EXPTIME_DEFAULT;
+  sm_p->lyt_frmtime     = LYT_FRMTIME_DEFAULT;
+  sm_p->lyt_exptime     = LYT_EXPTIME_DEFAULT;
+  sm_p->shk_boxsize     = SHK_BOXSIZE_DEFAULT;
+  sm_p->shk_pinv_method = SHK_PINV_METHOD_DEFAULT;
+  sm_p->shk_pinv_thresh = SHK_PINV_THRESH_DEFAULT;
+  sm_p->shk_pinv_nmodes = SHK_PINV_NMODES_DEFAULT;
+  sm_p->shk_pinv_alpha  = SHK_PINV_ALPHA_DEFAULT;
+  sm_p->shk_bkg_mode    = SHK_BKG_MODE_DEFAULT;
+  for(i=0;i<NCLIENTS;i++)
+    sm_p->w[i].precision = NUM_PRECISION_DOUBLE;
+  sm_p->w[SHKID].fakemode = FAKEMODE_ZERNIKE;
+  sm_p->w[LYTID].fakemode = FAKEMODE_ZERNIKE;
+
+  //Synthetic frame settings: defaults plus some low order error
+  sm_p->fakecfg.shk_flux   = FAKE_SHK_FLUX_DEFAULT;
+  sm_p->fakecfg.lyt_flux   = FAKE_LYT_FLUX_DEFAULT;
+  sm_p->fakecfg.read_noise = FAKE_READ_NOISE_DEFAULT;
+  sm_p->fakecfg.background = FAKE_BACKGROUND_DEFAULT;
+  sm_p->fakecfg.xgradient  = 0.02;
+  sm_p->fakecfg.ygradient  = -0.01;
+  sm_p->fakecfg.dropout    = 0.01;
+  sm_p->fakecfg.zernike[0] = 0.05;
+  sm_p->fakecfg.zernike[1] = -0.03;
+  sm_p->fakecfg.zernike[2] = 0.02;
+
+  //Run cameras
+  printf("FAKE: %.1fx flight frame rate for %.1f seconds per camera\n",speedup,seconds);
+  printf("%-4s %9s %9s %9s %7s %10s %10s %8s\n","Proc","Rate[Hz]","Frames","Proc","Overrun","Last[us]","Max[us]","Achieved");
+  run_camera(sm_p,SHKID,shk_process_image,shkframe,SHK_FRMTIME_DEFAULT/speedup,seconds);
+  run_camera(sm_p,LYTID,lyt_process_image,lytframe,LYT_FRMTIME_DEFAULT/speedup,seconds);
+
+  free((void *)sm_p);
+  return 0;
+}
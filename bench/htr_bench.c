@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* piccflight headers */
+#include "controller.h"
+#include "common_functions.h"
+#include "htr_functions.h"
+
+/**************************************************************/
+/* HTR_BENCH                                                  */
+/*  - Replays heater power patterns through htr_schedule and  */
+/*    htr_run against the simulated SSR port                  */
+/*  - Checks the duty cycle measured by the port against the  */
+/*    commanded power and against the htr stats duty error,   */
+/*    and the wakeup count against the edge schedule          */
+/*  - Build: make htrbench THMSIM=1                           */
+/*  - Usage: bin/htrbench [nloops]                            */
+/**************************************************************/
+
+#ifndef THM_SIM
+#error "htr_bench needs the simulated SSR port, build with THMSIM=1"
+#endif
+
+#define DUTY_TOL  1.0  //[%] allowed duty error per heater (one PWM step)
+#define STATS_TOL 0.05 //[%] allowed difference to the htr stats duty error
+
+//Power pattern
+typedef struct pattern_struct{
+  char *name;
+  int   power[SSR_NCHAN];
+} pattern_t;
+
+static pattern_t patterns[] = {
+  {"all off",  {0}},
+  {"all on",   {100,100,100,100,100,100,100,100,100,100,100,100,100,100,100,100}},
+  {"one 50%",  {50}},
+  {"ramp",     {0,7,13,20,27,33,40,47,53,60,67,73,80,87,93,100}},
+  {"mixed",    {1,99,50,25,75,10,90,0,100,33,66,5,95,45,55,20}},
+};
+#define NPATTERN (sizeof(patterns)/sizeof(patterns[0]))
+
+/**************************************************************/
+/* EXPECTED_WAKEUPS                                           */
+/*  - Timed wakeups htr_run needs for a schedule: one per     */
+/*    changed word over all cycles, plus the end of the loop  */
+/**************************************************************/
+static uint32 expected_wakeups(htrsched_t *sched){
+  uint16 word = sched->word[0];
+  uint32 n=1;
+  int c,e;
+  for(c=0;c<HTR_NCYCLES;c++){
+    for(e=0;e<sched->nedge;e++){
+      if(sched->word[e] != word) n++;
+      word = sched->word[e];
+    }
+  }
+  return n;
+}
+
+int main(int argc, char **argv){
+  static int pulse_index[HTR_NSTEPS];
+  htr_t htr[SSR_NCHAN];
+  htrsched_t sched;
+  double duty[SSR_NCHAN],err;
+  uint64 nwrite;
+  uint32 nwake;
+  sm_t *sm_p;
+  int nloops=1;
+  int i,p,l,fail,nfail=0;
+
+  if(argc > 1) nloops = atoi(argv[1]);
+  if(nloops < 1){
+    printf("usage: %s [nloops]\n",argv[0]);
+    return 1;
+  }
+
+  //Dither order as in thm_proc
+  if(ditherfill(pulse_index,HTR_NSTEPS)){
+    printf("HTR: ditherfill error. Using default.\n");
+    for(i=0;i<HTR_NSTEPS;i++)
+      pulse_index[i] = i;
+  }
+
+  //Private shared memory image
+  if((sm_p = calloc(1,sizeof(sm_t))) == NULL){
+    printf("HTR: calloc failed\n");
+    return 1;
+  }
+
+  printf("HTR: %d PWM cycles of %d steps per loop, %d loops per pattern\n",HTR_NCYCLES,HTR_NSTEPS,nloops);
+  printf("%-8s %5s %8s %8s %8s %10s %10s %10s  %s\n","pattern","edges","wakeups","expected","writes","port-err","stats-err","late","result");
+  printf("%-8s %5s %8s %8s %8s %10s %10s %10s\n","","","","","","[%]","[%]","[us]");
+  for(p=0;p<NPATTERN;p++){
+    memset(htr,0,sizeof(htr));
+    for(i=0;i<SSR_NCHAN;i++)
+      htr[i].power = patterns[p].power[i];
+    htr_schedule(&sched,htr,pulse_index);
+
+    for(l=0;l<nloops;l++){
+      //Run one control loop and read back the simulated port
+      htr_sim_reset();
+      htr_run(sm_p,&sched,htr);
+      nwrite = htr_sim_read(duty);
+      nwake  = sm_p->htr_nwake;
+
+      //Largest duty error seen by the port
+      err = 0;
+      for(i=0;i<SSR_NCHAN;i++)
+	if(fabs(duty[i] - htr[i].power) > err) err = fabs(duty[i] - htr[i].power);
+
+      //Wakeups match the schedule, one port write per wakeup (first write replaces the final wait)
+      fail  = nwake != expected_wakeups(&sched);
+      fail |= nwrite != nwake;
+      fail |= err > DUTY_TOL;
+      fail |= fabs(err - sm_p->htr_duty_error) > STATS_TOL;
+      nfail += fail;
+
+      printf("%-8s %5d %8u %8u %8lu %10.3f %10.3f %10.1f  %s\n",patterns[p].name,sched.nedge,nwake,expected_wakeups(&sched),
+	     (unsigned long)nwrite,err,sm_p->htr_duty_error,sm_p->htr_late*ONE_MILLION,fail ? "FAIL" : "ok");
+    }
+  }
+
+  printf("HTR: loops %lu, max wakeups %u, max late %.1f us, max duty error %.3f%%\n",(unsigned long)sm_p->htr_nloop,
+	 sm_p->htr_nwake_max,sm_p->htr_late_max*ONE_MILLION,sm_p->htr_duty_error_max);
+  free((void *)sm_p);
+  return nfail > 0;
+}
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* piccflight headers */
+#include "controller.h"
+#include "img_functions.h"
+
+/**************************************************************/
+/* IMG_BENCH                                                  */
+/*  - Times the full image transposes of the camera processes */
+/*  - Legacy: per pixel loop as in the original xxx_full code */
+/*  - Tiled: img_transpose8/16 from img_functions.c           */
+/*  - Reports MB/s of image data moved and checks the results */
+/*  - Build: make imgbench                                    */
+/*  - Usage: bin/imgbench [ntrials]                           */
+/**************************************************************/
+
+typedef struct shape_struct{
+  int   nx;
+  int   ny;
+  int   bytes;
+  char *name;
+} shape_t;
+
+//Image shapes [x x y]
+static shape_t shapes[] = {
+  {SHKXS,     SHKYS,     1, "shkfull"},
+  {ACQREADXS, ACQREADYS, 1, "acqfull"},
+  {SCIXS,     SCIYS,     2, "sciband"},
+  {LYTREADXS, LYTREADYS, 2, "lytread"},
+  {1024,      1024,      2, "16bit-1k"},
+};
+#define NSHAPES (sizeof(shapes)/sizeof(shapes[0]))
+
+/**************************************************************/
+/* ELAPSED                                                    */
+/*  - Seconds between two timespecs                           */
+/**************************************************************/
+static double elapsed(struct timespec *start, struct timespec *end){
+  return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec)/1e9;
+}
+
+/**************************************************************/
+/* LEGACY8/16                                                 */
+/*  - Column order copy: data[i][j] = image[xy2index(i,j)]    */
+/**************************************************************/
+static void legacy8(uint8 *dst, const uint8 *src, int nx, int ny){
+  int i,j;
+  for(i=0;i<nx;i++)
+    for(j=0;j<ny;j++)
+      dst[i*ny + j] = src[i + j*nx];
+}
+
+static void legacy16(uint16 *dst, const uint16 *src, int nx, int ny){
+  int i,j;
+  for(i=0;i<nx;i++)
+    for(j=0;j<ny;j++)
+      dst[i*ny + j] = src[i + j*nx];
+}
+
+int main(int argc, char **argv){
+  struct timespec start,end;
+  double tlegacy,ttiled,mbytes;
+  void *src,*ref,*dst;
+  int ntrials=200,s,t,n;
+  shape_t *sh;
+
+  if(argc > 1) ntrials = atoi(argv[1]);
+  if(ntrials <= 0){
+    printf("usage: %s [ntrials]\n",argv[0]);
+    return 1;
+  }
+
+  printf("IMG: %d trials, %d pixel tiles%s\n",ntrials,IMG_TILE,
+#ifdef __SSE2__
+	 ", SSE2 blocks"
+#else
+	 ""
+#endif
+	 );
+  printf("%-10s %10s %12s %12s %8s %6s\n","image","size","legacy MB/s","tiled MB/s","speedup","check");
+  for(s=0;s<NSHAPES;s++){
+    sh = &shapes[s];
+    n  = sh->nx*sh->ny;
+    src = malloc(n*sh->bytes);
+    ref = malloc(n*sh->bytes);
+    dst = malloc(n*sh->bytes);
+    for(t=0;t<n*sh->bytes;t++)
+      ((uint8 *)src)[t] = rand();
+
+    //Legacy
+    clock_gettime(CLOCK_MONOTONIC,&start);
+    for(t=0;t<ntrials;t++){
+      if(sh->bytes == 1) legacy8(ref,src,sh->nx,sh->ny);
+      else               legacy16(ref,src,sh->nx,sh->ny);
+    }
+    clock_gettime(CLOCK_MONOTONIC,&end);
+    tlegacy = elapsed(&start,&end);
+
+    //Tiled
+    clock_gettime(CLOCK_MONOTONIC,&start);
+    for(t=0;t<ntrials;t++){
+      if(sh->bytes == 1) img_transpose8(dst,sh->ny,src,sh->nx,sh->nx,sh->ny);
+      else               img_transpose16(dst,sh->ny,src,sh->nx,sh->nx,sh->ny);
+    }
+    clock_gettime(CLOCK_MONOTONIC,&end);
+    ttiled = elapsed(&start,&end);
+
+    mbytes = (double)ntrials*n*sh->bytes/1e6;
+    printf("%-10s %4dx%-5d %12.0f %12.0f %8.2f %6s\n",sh->name,sh->nx,sh->ny,
+	   mbytes/tlegacy,mbytes/ttiled,tlegacy/ttiled,memcmp(ref,dst,n*sh->bytes) ? "FAIL" : "ok");
+    free(src);
+    free(ref);
+    free(dst);
+  }
+  return 0;
+}
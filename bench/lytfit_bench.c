@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+/* piccflight headers */
+#include "controller.h"
+#include "watchdog.h"
+#include "common_functions.h"
+#include "numeric.h"
+#include "lyt_functions.h"
+
+/**************************************************************/
+/* LYT_FIT_BENCH                                              */
+/*  - Times the legacy and fused LYT processing stages on     */
+/*    synthetic pupil frames and compares their results       */
+/*  - Legacy: transposing copy, ROI cut and lyt_zernike_fit   */
+/*  - Fused: lyt_read_roi and lyt_fit_zernikes, also timed in */
+/*    single precision                                        */
+/*  - Magnification: per pixel bilinear vs lyt_mag_apply      */
+/*  - Uses the reference & fitting matrix files if present    */
+/*  - Build: make lytbench                                    */
+/*  - Usage: bin/lytbench [nframes]                           */
+/**************************************************************/
+
+void lyt_initref(lytref_t *lytref);
+int  lyt_zernike_fit(lyt_t *image, lytref_t *lytref, double *zernikes, double *xcentroid, double *ycentroid, int reset);
+
+int main(int argc, char **argv){
+  static uint16 buffer[LYTREADXS*LYTREADYS];
+  static lytread_t readimage;
+  static lytdark_t darkimage;
+  static lytref_t lytref;
+  static lytfit_t lytfit;
+  static lytmag_t lytmag;
+  lyt_t legacy,fused,magleg,magfus;
+  struct timespec t[8],delta;
+  double dt,tstage[7]={0},tfloat=0;
+  double zleg[LOWFS_N_ZERNIKE],zfus[LOWFS_N_ZERNIKE],zflt[LOWFS_N_ZERNIKE];
+  double xleg,yleg,xfus,yfus,bleg,bfus;
+  double dzer=0,dcen=0,dbkg=0,dimg=0,dmag=0,dflt=0;
+  double xc,yc,r,background;
+  const double mag=1.1,xoff=0.3,yoff=-0.2;
+  double x,y,f_x_y1,f_x_y2;
+  int x1,x2,y1,y2;
+  unsigned int seed=1;
+  int i,j,k,n,s,noref,nomatrix;
+  int nframes=1000,xorigin=LYT_XORIGIN_DEFAULT,yorigin=LYT_YORIGIN_DEFAULT;
+
+  if(argc > 1) nframes = atoi(argv[1]);
+  if(nframes < 1){
+    printf("usage: %s [nframes]\n",argv[0]);
+    return 1;
+  }
+
+  //Load reference structure, synthesize mask & reference if missing
+  lyt_initref(&lytref);
+  k=0;
+  noref=1;
+  for(i=0;i<LYTXS;i++){
+    for(j=0;j<LYTYS;j++){
+      k     += lytref.pxmask[i][j] != 0;
+      noref &= lytref.refimg[i][j] == 0;
+    }
+  }
+  for(i=0;i<LYTXS;i++){
+    for(j=0;j<LYTYS;j++){
+      r = sqrt((i-LYTXS/2+0.5)*(i-LYTXS/2+0.5) + (j-LYTYS/2+0.5)*(j-LYTYS/2+0.5));
+      if(k == 0) lytref.pxmask[i][j] = r < LYTXS/2;
+      if(noref)  lytref.refimg[i][j] = 3000*exp(-(r-4.5)*(r-4.5)/2);
+    }
+  }
+
+  //Initialize both fitters
+  lyt_zernike_fit(NULL,&lytref,NULL,NULL,NULL,FUNCTION_RESET_RETURN);
+  nomatrix = lyt_fit_init(&lytfit,&lytref);
+  memset(&darkimage,0,sizeof(darkimage));
+
+  //Build magnification plan
+  lyt_mag_plan(&lytmag,mag,xoff,yoff,xorigin,yorigin);
+
+  //Legacy & fused stages run in double precision
+  num_set_precision(NUM_PRECISION_DOUBLE);
+
+  for(n=0;n<nframes;n++){
+    //Synthetic frame: noisy background plus jittered pupil inside ROI
+    for(k=0;k<LYTREADXS*LYTREADYS;k++)
+      buffer[k] = 100 + rand_r(&seed) % 20;
+    xc = LYTXS/2 - 0.5 + (rand_r(&seed) % 100)/100.0 - 0.5;
+    yc = LYTYS/2 - 0.5 + (rand_r(&seed) % 100)/100.0 - 0.5;
+    for(i=0;i<LYTXS;i++){
+      for(j=0;j<LYTYS;j++){
+	r = sqrt((i-xc)*(i-xc) + (j-yc)*(j-yc));
+	buffer[lyt_xy2index(xorigin+i,yorigin+j)] += 3000*exp(-(r-4.5)*(r-4.5)/2);
+      }
+    }
+
+    clock_gettime(CLOCK_REALTIME,&t[0]);
+
+    //Legacy: transposing copy
+    for(i=0;i<LYTREADXS;i++)
+      for(j=0;j<LYTREADYS;j++)
+	readimage.data[i][j]=buffer[lyt_xy2index(i,j)];
+    clock_gettime(CLOCK_REALTIME,&t[1]);
+
+    //Legacy: ROI cut, dark subtraction & background
+    background=0;
+    for(i=0;i<LYTREADXS;i++){
+      for(j=0;j<LYTREADYS;j++){
+	if((i >= xorigin) && (i < xorigin+LYTXS) && (j >= yorigin) && (j < yorigin+LYTYS)){
+	  legacy.data[i-xorigin][j-yorigin]  = (double)readimage.data[i][j];
+	  legacy.data[i-xorigin][j-yorigin] -= darkimage.data[i][j];
+	}
+	else{
+	  background += readimage.data[i][j];
+	}
+      }
+    }
+    bleg = background / (LYTREADXS*LYTREADYS - LYTXS*LYTYS);
+    clock_gettime(CLOCK_REALTIME,&t[2]);
+
+    //Legacy: zernike fit
+    lyt_zernike_fit(&legacy,&lytref,zleg,&xleg,&yleg,FUNCTION_NO_RESET);
+    clock_gettime(CLOCK_REALTIME,&t[3]);
+
+    //Fused: ROI cut, dark subtraction & background
+    bfus = lyt_read_roi(buffer,xorigin,yorigin,&darkimage,&fused);
+    clock_gettime(CLOCK_REALTIME,&t[4]);
+
+    //Fused: zernike fit
+    lyt_fit_zernikes(&lytfit,&fused,zfus,&xfus,&yfus);
+    clock_gettime(CLOCK_REALTIME,&t[5]);
+
+    //Legacy: image magnification
+    for(i=0;i<LYTXS;i++){
+      for(j=0;j<LYTYS;j++){
+	x  = (i - LYTXS/2)/mag + (LYTREADXS/2) + xorigin + xoff - (LYTREADXS-LYTXS)/2;
+	y  = (j - LYTYS/2)/mag + (LYTREADYS/2) + yorigin + yoff - (LYTREADYS-LYTYS)/2;
+	x1 = (int)x;
+	x2 = x1 + 1;
+	y1 = (int)y;
+	y2 = y1 + 1;
+	if(x1 >= 0 && x1 < LYTREADXS && x2 >= 0 && x2 < LYTREADXS && y1 >= 0 && y1 < LYTREADYS && y2 >= 0 && y2 < LYTREADYS){
+	  f_x_y1  = (x2 - x) * readimage.data[x1][y1] / (x2 - x1) + (x - x1) * readimage.data[x2][y1] / (x2 - x1);
+	  f_x_y2  = (x2 - x) * readimage.data[x1][y2] / (x2 - x1) + (x - x1) * readimage.data[x2][y2] / (x2 - x1);
+	  magleg.data[i][j] = (y2 - y) * f_x_y1 / (y2 - y1) + (y - y1) * f_x_y2 / (y2-y1);
+	}else{
+	  x = x < 0 ? 0 : x;
+	  y = y < 0 ? 0 : y;
+	  x = x >= LYTREADXS ? LYTREADXS-1 : x;
+	  y = y >= LYTREADYS ? LYTREADYS-1 : y;
+	  magleg.data[i][j] = readimage.data[(int)x][(int)y];
+	}
+      }
+    }
+    clock_gettime(CLOCK_REALTIME,&t[6]);
+
+    //Plan: image magnification
+    lyt_mag_apply(&lytmag,buffer,&magfus);
+    clock_gettime(CLOCK_REALTIME,&t[7]);
+
+    //Accumulate stage times
+    for(s=0;s<7;s++){
+      if(timespec_subtract(&delta,&t[s+1],&t[s]))
+	printf("LYT: lyt_fit_bench --> timespec_subtract error!\n");
+      ts2double(&delta,&dt);
+      tstage[s] += dt;
+    }
+
+    //Fused: zernike fit in single precision
+    num_set_precision(NUM_PRECISION_FLOAT);
+    clock_gettime(CLOCK_REALTIME,&t[0]);
+    lyt_fit_zernikes(&lytfit,&fused,zflt,&xfus,&yfus);
+    clock_gettime(CLOCK_REALTIME,&t[1]);
+    num_set_precision(NUM_PRECISION_DOUBLE);
+    if(timespec_subtract(&delta,&t[1],&t[0]))
+      printf("LYT: lyt_fit_bench --> timespec_subtract error!\n");
+    ts2double(&delta,&dt);
+    tfloat += dt;
+
+    //Compare results
+    for(i=0;i<LOWFS_N_ZERNIKE;i++){
+      dzer = fabs(zleg[i]-zfus[i]) > dzer ? fabs(zleg[i]-zfus[i]) : dzer;
+      dflt = fabs(zleg[i]-zflt[i]) > dflt ? fabs(zleg[i]-zflt[i]) : dflt;
+    }
+    dcen = fabs(xleg-xfus) > dcen ? fabs(xleg-xfus) : dcen;
+    dcen = fabs(yleg-yfus) > dcen ? fabs(yleg-yfus) : dcen;
+    dbkg = fabs(bleg-bfus) > dbkg ? fabs(bleg-bfus) : dbkg;
+    for(i=0;i<LYTXS;i++)
+      for(j=0;j<LYTYS;j++)
+	dimg = fabs(legacy.data[i][j]-fused.data[i][j]) > dimg ? fabs(legacy.data[i][j]-fused.data[i][j]) : dimg;
+    for(i=0;i<LYTXS;i++)
+      for(j=0;j<LYTYS;j++)
+	dmag = fabs(magleg.data[i][j]-magfus.data[i][j]) > dmag ? fabs(magleg.data[i][j]-magfus.data[i][j]) : dmag;
+  }
+
+  printf("LYT: Fit benchmark: %d frames, %d controlled pixels%s\n",nframes,lytfit.npix,nomatrix ? " (no fitting matrix)" : "");
+  printf("LYT: legacy copy %8.2f  roi %8.2f  fit %8.2f  total %8.2f us/frame\n",
+	 1e6*tstage[0]/nframes,1e6*tstage[1]/nframes,1e6*tstage[2]/nframes,1e6*(tstage[0]+tstage[1]+tstage[2])/nframes);
+  printf("LYT: fused                 roi %8.2f  fit %8.2f  total %8.2f us/frame\n",
+	 1e6*tstage[3]/nframes,1e6*tstage[4]/nframes,1e6*(tstage[3]+tstage[4])/nframes);
+  printf("LYT: max diff: image %g  background %g  centroid %g  zernike %g\n",dimg,dbkg,dcen,dzer);
+  printf("LYT: float fit %8.2f us/frame  max zernike diff %g\n",1e6*tfloat/nframes,dflt);
+  printf("LYT: mag %.2f legacy %8.2f  plan %8.2f us/frame  max diff %g\n",mag,1e6*tstage[5]/nframes,1e6*tstage[6]/nframes,dmag);
+
+  return 0;
+}
@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+/* piccflight headers */
+#include "numeric.h"
+
+/**************************************************************/
+/* NUMERIC_BENCH                                              */
+/*  - Standalone benchmark of the numeric.c backend           */
+/*  - Times every matrix shape used by the flight code        */
+/*  - Build: make numeric [NUMERIC=mkl|openblas|ref]          */
+/*  - Usage: bin/numeric [ntrials]                            */
+/**************************************************************/
+
+typedef struct shape_struct{
+  int   mm;
+  int   nn;
+  char *name;
+} shape_t;
+
+//Matrix-vector shapes [rows x columns]
+static shape_t gemv_shapes[] = {
+  {  23,  296, "shk2zern"},
+  {  23,  709, "lyt2zern"},
+  {  97,   23, "zern2alp"},
+  {  97,  296, "cells2alp"},
+  { 856, 1456, "efc"},
+};
+#define NGEMV (sizeof(gemv_shapes)/sizeof(gemv_shapes[0]))
+
+//Matrix-matrix shapes [rows x inner x columns], non-square to catch leading dimension errors
+typedef struct gemm_shape_struct{
+  int   mm;
+  int   kk;
+  int   nn;
+  char *name;
+} gemm_shape_t;
+
+static gemm_shape_t gemm_shapes[] = {
+  {  97,   23,  296, "zern2cells"},
+  {  23,  296,   97, "cells2zern"},
+};
+#define NGEMM (sizeof(gemm_shapes)/sizeof(gemm_shapes[0]))
+
+//SVD shapes [rows x columns]
+static shape_t svd_shapes[] = {
+  { 296,   23, "dz_dxdy"},
+};
+#define NSVD (sizeof(svd_shapes)/sizeof(svd_shapes[0]))
+
+/**************************************************************/
+/* ELAPSED                                                    */
+/*  - Seconds between two timespecs                           */
+/**************************************************************/
+static double elapsed(struct timespec *start, struct timespec *end){
+  return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec)/1e9;
+}
+
+/**************************************************************/
+/* RELERR                                                     */
+/*  - Max absolute difference relative to largest reference   */
+/**************************************************************/
+static double relerr(double *ref, double *y, int n){
+  double err=0,ymax=0;
+  int i;
+  for(i=0;i<n;i++){
+    err  = fabs(ref[i]-y[i]) > err  ? fabs(ref[i]-y[i]) : err;
+    ymax = fabs(ref[i])      > ymax ? fabs(ref[i])      : ymax;
+  }
+  return ymax > 0 ? err/ymax : err;
+}
+
+/**************************************************************/
+/* BENCH_GEMV                                                 */
+/*  - Time backend, reference, fixed and float kernels        */
+/**************************************************************/
+static void bench_gemv(shape_t *shape, int ntrials){
+  int mm=shape->mm, nn=shape->nn;
+  double *A,*b,*yref,*y;
+  double tback,tref,tfix=-1,tflt,efix=0;
+  num_recon_t R = {0};
+  struct timespec start,end;
+  unsigned int seed=1;
+  int i,n;
+
+  //Scale trials so every shape does similar work
+  ntrials = ntrials * 10000.0 / (mm*nn) + 1;
+
+  A    = malloc(mm*nn*sizeof(double));
+  b    = malloc(nn*sizeof(double));
+  yref = malloc(mm*sizeof(double));
+  y    = malloc(mm*sizeof(double));
+  for(i=0;i<mm*nn;i++) A[i] = (double)rand_r(&seed)/RAND_MAX - 0.5;
+  for(i=0;i<nn;i++)    b[i] = (double)rand_r(&seed)/RAND_MAX - 0.5;
+
+  //Reference C
+  clock_gettime(CLOCK_REALTIME,&start);
+  for(n=0;n<ntrials;n++)
+    num_ref_dgemv(A,b,yref,mm,nn);
+  clock_gettime(CLOCK_REALTIME,&end);
+  tref = elapsed(&start,&end);
+
+  //Backend
+  clock_gettime(CLOCK_REALTIME,&start);
+  for(n=0;n<ntrials;n++)
+    num_dgemv(A,b,y,mm,nn);
+  clock_gettime(CLOCK_REALTIME,&end);
+  tback = elapsed(&start,&end);
+
+  //Fixed shape kernel
+  if(num_fixed_dgemv(A,b,y,mm,nn)){
+    clock_gettime(CLOCK_REALTIME,&start);
+    for(n=0;n<ntrials;n++)
+      num_fixed_dgemv(A,b,y,mm,nn);
+    clock_gettime(CLOCK_REALTIME,&end);
+    tfix = elapsed(&start,&end);
+    efix = relerr(yref,y,mm);
+  }
+
+  //Single precision
+  num_recon_init(&R,A,mm,nn);
+  num_set_precision(NUM_PRECISION_FLOAT);
+  clock_gettime(CLOCK_REALTIME,&start);
+  for(n=0;n<ntrials;n++)
+    num_recon(&R,b,y);
+  clock_gettime(CLOCK_REALTIME,&end);
+  num_set_precision(NUM_PRECISION_DOUBLE);
+  tflt = elapsed(&start,&end);
+
+  printf("%-10s %4d x %-5d %10.3f %10.3f ",shape->name,mm,nn,1e6*tback/ntrials,1e6*tref/ntrials);
+  if(tfix >= 0) printf("%10.3f ",1e6*tfix/ntrials);
+  else          printf("%10s ","-");
+  printf("%10.3f   %.1e %.1e\n",1e6*tflt/ntrials,efix,relerr(yref,y,mm));
+
+  free(R.S);
+  free(A);
+  free(b);
+  free(yref);
+  free(y);
+}
+
+/**************************************************************/
+/* BENCH_GEMM                                                 */
+/*  - Time backend dgemm and check it column by column        */
+/*    against the reference dgemv                             */
+/**************************************************************/
+static void bench_gemm(gemm_shape_t *shape, int ntrials){
+  int mm=shape->mm, kk=shape->kk, nn=shape->nn;
+  double *A,*B,*C,*yref;
+  double tback,err=0,e;
+  struct timespec start,end;
+  unsigned int seed=1;
+  int i,j,n;
+
+  //Scale trials so every shape does similar work
+  ntrials = ntrials * 10000.0 / ((double)mm*kk*nn) + 1;
+
+  A    = malloc(mm*kk*sizeof(double));
+  B    = malloc(kk*nn*sizeof(double));
+  C    = malloc(mm*nn*sizeof(double));
+  yref = malloc(mm*sizeof(double));
+  for(i=0;i<mm*kk;i++) A[i] = (double)rand_r(&seed)/RAND_MAX - 0.5;
+  for(i=0;i<kk*nn;i++) B[i] = (double)rand_r(&seed)/RAND_MAX - 0.5;
+
+  //Backend
+  clock_gettime(CLOCK_REALTIME,&start);
+  for(n=0;n<ntrials;n++)
+    num_dgemm(A,B,C,mm,kk,nn);
+  clock_gettime(CLOCK_REALTIME,&end);
+  tback = elapsed(&start,&end);
+
+  //Column j of C must equal A * (column j of B)
+  for(j=0;j<nn;j++){
+    num_ref_dgemv(A,&B[j*kk],yref,mm,kk);
+    e   = relerr(yref,&C[j*mm],mm);
+    err = e > err ? e : err;
+  }
+
+  printf("%-10s %4d x %-4d x %-4d %10.3f   %.1e\n",shape->name,mm,kk,nn,1e6*tback/ntrials,err);
+
+  free(A);
+  free(B);
+  free(C);
+  free(yref);
+}
+
+/**************************************************************/
+/* SVD_RESIDUAL                                               */
+/*  - Max |A - u.diag(s).vt| relative to max |A|              */
+/**************************************************************/
+static double svd_residual(double *A, int mm, int nn, double *s, double *u, double *vt){
+  double err=0,amax=0,sum;
+  int i,j,k;
+  for(j=0;j<nn;j++){
+    for(i=0;i<mm;i++){
+      sum=0;
+      for(k=0;k<nn;k++)
+	sum += u[k*mm+i] * s[k] * vt[j*nn+k];
+      err  = fabs(A[j*mm+i]-sum) > err  ? fabs(A[j*mm+i]-sum) : err;
+      amax = fabs(A[j*mm+i])     > amax ? fabs(A[j*mm+i])     : amax;
+    }
+  }
+  return amax > 0 ? err/amax : err;
+}
+
+/**************************************************************/
+/* BENCH_SVD                                                  */
+/*  - Time backend and reference SVD and num_dgesvdi          */
+/**************************************************************/
+static void bench_svd(shape_t *shape, int ntrials){
+  int mm=shape->mm, nn=shape->nn;
+  double *A,*work,*s,*u,*vt,*inv;
+  double tback,tref,tinv,eback,eref;
+  struct timespec start,end;
+  unsigned int seed=1;
+  int i,n;
+
+  //SVD is much slower than gemv
+  ntrials = ntrials/100 + 1;
+
+  A    = malloc(mm*nn*sizeof(double));
+  work = malloc(mm*nn*sizeof(double));
+  s    = malloc(nn*sizeof(double));
+  u    = malloc(mm*nn*sizeof(double));
+  vt   = malloc(nn*nn*sizeof(double));
+  inv  = malloc(mm*nn*sizeof(double));
+  for(i=0;i<mm*nn;i++) A[i] = (double)rand_r(&seed)/RAND_MAX - 0.5;
+
+  //Backend (A is overwritten, copy each time)
+  clock_gettime(CLOCK_REALTIME,&start);
+  for(n=0;n<ntrials;n++){
+    memcpy(work,A,mm*nn*sizeof(double));
+    num_svd(work,mm,nn,s,u,vt);
+  }
+  clock_gettime(CLOCK_REALTIME,&end);
+  tback = elapsed(&start,&end);
+  eback = svd_residual(A,mm,nn,s,u,vt);
+
+  //Reference C
+  clock_gettime(CLOCK_REALTIME,&start);
+  for(n=0;n<ntrials;n++){
+    memcpy(work,A,mm*nn*sizeof(double));
+    num_ref_svd(work,mm,nn,s,u,vt);
+  }
+  clock_gettime(CLOCK_REALTIME,&end);
+  tref = elapsed(&start,&end);
+  eref = svd_residual(A,mm,nn,s,u,vt);
+
+  //Pseudo inverse
+  clock_gettime(CLOCK_REALTIME,&start);
+  for(n=0;n<ntrials;n++){
+    memcpy(work,A,mm*nn*sizeof(double));
+    num_dgesvdi(work,inv,mm,nn);
+  }
+  clock_gettime(CLOCK_REALTIME,&end);
+  tinv = elapsed(&start,&end);
+
+  printf("%-10s %4d x %-5d %10.1f %10.1f %10.1f   %.1e %.1e\n",shape->name,mm,nn,
+	 1e6*tback/ntrials,1e6*tref/ntrials,1e6*tinv/ntrials,eback,eref);
+
+  free(A);
+  free(work);
+  free(s);
+  free(u);
+  free(vt);
+  free(inv);
+}
+
+int main(int argc, char **argv){
+  int ntrials=10000;
+  int i;
+
+  if(argc > 1) ntrials = atoi(argv[1]);
+  if(ntrials < 1){
+    printf("usage: %s [ntrials]\n",argv[0]);
+    return 1;
+  }
+
+  printf("NUM: backend %s, %d trials (scaled by shape)\n",num_backend(),ntrials);
+  printf("%-10s %-12s %10s %10s %10s %10s   %-7s %-7s\n","gemv","shape","backend","ref","fixed","float","err-fix","err-flt");
+  printf("%-10s %-12s %10s %10s %10s %10s\n","","","[us]","[us]","[us]","[us]");
+  for(i=0;i<NGEMV;i++)
+    bench_gemv(&gemv_shapes[i],ntrials);
+
+  printf("\n%-10s %-18s %10s   %-7s\n","gemm","shape","backend","err-ref");
+  printf("%-10s %-18s %10s\n","","","[us]");
+  for(i=0;i<NGEMM;i++)
+    bench_gemm(&gemm_shapes[i],ntrials);
+
+  printf("\n%-10s %-12s %10s %10s %10s   %-7s %-7s\n","svd","shape","backend","ref","dgesvdi","res-bk","res-ref");
+  printf("%-10s %-12s %10s %10s %10s\n","","","[us]","[us]","[us]");
+  for(i=0;i<NSVD;i++)
+    bench_svd(&svd_shapes[i],ntrials);
+
+  return 0;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_randist.h>
+
+/* piccflight headers */
+#include "controller.h"
+#include "sinefit.h"
+
+/**************************************************************/
+/* SINEFIT_BENCH                                              */
+/*  - Compares the linear and nonlinear speckle sine fitters  */
+/*    on noisy, evenly stepped synthetic data                 */
+/*  - Reports us/fit and the max amplitude, phase and offset  */
+/*    error of each fitter                                    */
+/*  - Build: make sinebench                                   */
+/*  - Usage: bin/sinebench [nfits] [nsamples]                 */
+/**************************************************************/
+
+/**************************************************************/
+/* SINEFIT_NOW                                                */
+/*  - Return current time [s]                                 */
+/**************************************************************/
+static double sinefit_now(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME,&ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+/**************************************************************/
+/* SINEFIT_DPHASE                                             */
+/*  - Absolute phase difference wrapped to [0,pi]             */
+/**************************************************************/
+static double sinefit_dphase(double p1, double p2){
+  return fabs(remainder(p1 - p2, 2*M_PI));
+}
+
+int main(int argc, char **argv){
+  sinefit_data_t data;
+  sinefit_fit_t  lin,nln;
+  sinefit_plan_t plan;
+  gsl_rng *r;
+  double t[SINEFIT_NMAX],y[SINEFIT_NMAX],guess[3];
+  double a,p,b,noise=0.01;
+  double tlin=0,tnln=0,start;
+  double elin[3]={0},enln[3]={0};
+  size_t n=SCI_SPECKLE_NPHASE,j;
+  int i,nfail=0,nfits=1000;
+
+  if(argc > 1) nfits = atoi(argv[1]);
+  if(argc > 2) n = atoi(argv[2]);
+  if(nfits < 1 || n < 3 || n > SINEFIT_NMAX){
+    printf("usage: %s [nfits] [nsamples 3-%d]\n",argv[0],SINEFIT_NMAX);
+    return 1;
+  }
+  
+  gsl_rng_env_setup();
+  r = gsl_rng_alloc(gsl_rng_default);
+  
+  for(j=0;j<n;j++)
+    t[j] = 2*M_PI*(double)j / (double)n;
+  data.n = n;
+  data.t = t;
+  data.y = y;
+  sinefit_plan(&plan,t,n);
+  
+  for(i=0;i<nfits;i++){
+    /* Random truth */
+    a = 1 + 9*gsl_rng_uniform(r);
+    p = 2*M_PI*gsl_rng_uniform(r);
+    b = a*gsl_rng_uniform(r);
+    for(j=0;j<n;j++)
+      y[j] = a*sin(t[j]+p) + b + gsl_ran_gaussian(r,noise*a);
+    
+    /* Linear */
+    start = sinefit_now();
+    sinefit_linear(&plan,y,&lin);
+    tlin += sinefit_now() - start;
+
+    /* Nonlinear */
+    guess[0] = a;
+    guess[1] = 0;
+    guess[2] = b;
+    start = sinefit_now();
+    if(sinefit(&data,&nln,guess)) nfail++;
+    tnln += sinefit_now() - start;
+    if(nln.a < 0){
+      nln.a *= -1;
+      nln.p += M_PI;
+    }
+    
+    /* Errors */
+    if(fabs(lin.a-a) > elin[0]) elin[0] = fabs(lin.a-a);
+    if(sinefit_dphase(lin.p,p) > elin[1]) elin[1] = sinefit_dphase(lin.p,p);
+    if(fabs(lin.b-b) > elin[2]) elin[2] = fabs(lin.b-b);
+    if(fabs(nln.a-a) > enln[0]) enln[0] = fabs(nln.a-a);
+    if(sinefit_dphase(nln.p,p) > enln[1]) enln[1] = sinefit_dphase(nln.p,p);
+    if(fabs(nln.b-b) > enln[2]) enln[2] = fabs(nln.b-b);
+  }
+  gsl_rng_free(r);
+
+  printf("SINEFIT: %d fits, %lu samples, noise %.1f%% of amplitude\n",nfits,(unsigned long)n,noise*100);
+  printf("SINEFIT: linear    %10.3f us/fit  max err a=%.2e p=%.2e b=%.2e\n",1e6*tlin/nfits,elin[0],elin[1],elin[2]);
+  printf("SINEFIT: nonlinear %10.3f us/fit  max err a=%.2e p=%.2e b=%.2e  failures=%d\n",1e6*tnln/nfits,enln[0],enln[1],enln[2],nfail);
+  return 0;
+}
@@ -0,0 +1,158 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <dscud.h>
+
+/* piccflight headers */
+#include "controller.h"
+#include "adc_functions.h"
+
+/**************************************************************/
+/* THM_BENCH                                                  */
+/*  - Times one thermal ADC read with the scan engine in      */
+/*    adc_functions.c against the legacy polled path          */
+/*    (dscADScan x ADC_NAVG, dscADCodeToVoltage per sample)   */
+/*  - Reports wall and CPU time per read of this thread and   */
+/*    the largest temperature difference between the paths    */
+/*  - Build: make thmbench THMSIM=1 (or on the flight stack)  */
+/*  - Usage: bin/thmbench [nreads]                            */
+/**************************************************************/
+
+/**************************************************************/
+/* ELAPSED                                                    */
+/*  - Seconds between two timespecs                           */
+/**************************************************************/
+static double elapsed(struct timespec *start, struct timespec *end){
+  return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec)/1e9;
+}
+
+/**************************************************************/
+/* CPUTIME                                                    */
+/*  - CPU seconds used by the calling thread                  */
+/**************************************************************/
+static double cputime(void){
+  struct rusage ru;
+  getrusage(RUSAGE_THREAD,&ru);
+  return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec)/1e6;
+}
+
+/**************************************************************/
+/* LEGACY_READ                                                */
+/*  - Polled acquisition as thm_proc did before adc_read      */
+/*  - Return 1 on error, 0 on success                         */
+/**************************************************************/
+static int legacy_read(DSCB *board, DSCADSETTINGS *settings, thmevent_t *thmevent){
+  const int    nchan[ADC_NBOARDS] = {ADC1_NCHAN,ADC2_NCHAN,ADC3_NCHAN};
+  const double r1[ADC_NBOARDS]    = {ADC1_R1,ADC2_R1,ADC3_R1};
+  float *temp[ADC_NBOARDS] = {thmevent->adc1_temp,thmevent->adc2_temp,thmevent->adc3_temp};
+  DSCSAMPLE samples[ADC_MAX_NCHAN];
+  DFLOAT volt[ADC_NBOARDS][ADC_MAX_NCHAN]={{0}};
+  DFLOAT voltage,resistance;
+  DSCADSCAN scan;
+  int b,i,iavg;
+
+  for(iavg=0;iavg<ADC_NAVG;iavg++){
+    for(b=0;b<ADC_NBOARDS;b++){
+      scan.low_channel  = 0;
+      scan.high_channel = nchan[b]-1;
+      scan.gain         = settings[b].gain;
+      if(dscADScan(board[b],&scan,samples) != DE_NONE) return 1;
+      for(i=0;i<nchan[b];i++){
+	if(dscADCodeToVoltage(board[b],settings[b],scan.sample_values[i],&voltage) != DE_NONE) return 1;
+	volt[b][i] += voltage/ADC_NAVG;
+      }
+    }
+  }
+  for(b=0;b<ADC_NBOARDS;b++){
+    for(i=0;i<nchan[b];i++){
+      resistance = (volt[b][i] * r1[b]) / (VREF_DEFAULT - volt[b][i]);
+      temp[b][i] = (resistance - RTD_OHMS) / (RTD_ALPHA * RTD_OHMS);
+    }
+  }
+  return 0;
+}
+
+/**************************************************************/
+/* MAXDIFF                                                    */
+/*  - Largest temperature difference, skipping the vref slot  */
+/**************************************************************/
+static double maxdiff(thmevent_t *a, thmevent_t *b){
+  double d=0;
+  int i;
+  for(i=0;i<ADC1_NCHAN;i++)
+    if(i != ADC_VREF_SENSOR && fabs(a->adc1_temp[i]-b->adc1_temp[i]) > d) d = fabs(a->adc1_temp[i]-b->adc1_temp[i]);
+  for(i=0;i<ADC2_NCHAN;i++)
+    if(fabs(a->adc2_temp[i]-b->adc2_temp[i]) > d) d = fabs(a->adc2_temp[i]-b->adc2_temp[i]);
+  for(i=0;i<ADC3_NCHAN;i++)
+    if(fabs(a->adc3_temp[i]-b->adc3_temp[i]) > d) d = fabs(a->adc3_temp[i]-b->adc3_temp[i]);
+  return d;
+}
+
+int main(int argc, char **argv){
+  const WORD base[ADC_NBOARDS] = {ADC1_BASE,ADC2_BASE,ADC3_BASE};
+  static thmevent_t scanevent,legacyevent;
+  struct timespec start,end;
+  DSCB board[ADC_NBOARDS];
+  DSCCB dsccb[ADC_NBOARDS];
+  DSCADSETTINGS settings[ADC_NBOARDS];
+  double twall_scan,twall_legacy,tcpu_scan,tcpu_legacy;
+  int nreads=1000,b,i;
+
+  if(argc > 1) nreads = atoi(argv[1]);
+  if(nreads <= 0){
+    printf("usage: %s [nreads]\n",argv[0]);
+    return 1;
+  }
+
+  /* Scan engine */
+  if(adc_init()) return 1;
+  //let the scan buffers fill
+  usleep(2*ONE_MILLION*ADC_NAVG/ADC_SCAN_RATE);
+  tcpu_scan = cputime();
+  clock_gettime(CLOCK_MONOTONIC,&start);
+  for(i=0;i<nreads;i++)
+    if(adc_read(&scanevent,0)) return 1;
+  clock_gettime(CLOCK_MONOTONIC,&end);
+  twall_scan = elapsed(&start,&end);
+  tcpu_scan  = cputime() - tcpu_scan;
+  adc_cleanup();
+
+  /* Legacy polled path */
+  if(dscInit(DSC_VERSION) != DE_NONE) return 1;
+  for(b=0;b<ADC_NBOARDS;b++){
+    memset(&dsccb[b],0,sizeof(DSCCB));
+    memset(&settings[b],0,sizeof(DSCADSETTINGS));
+    dsccb[b].base_address = base[b];
+    dsccb[b].int_level    = 5;
+    settings[b].range         = RANGE_5;
+    settings[b].polarity      = BIPOLAR;
+    settings[b].gain          = GAIN_8;
+    settings[b].load_cal      = (BYTE)TRUE;
+    settings[b].scan_interval = SCAN_INTERVAL_10;
+    if(dscInitBoard(DSC_DMM32X,&dsccb[b],&board[b]) != DE_NONE) return 1;
+    if(dscADSetSettings(board[b],&settings[b]) != DE_NONE) return 1;
+  }
+  tcpu_legacy = cputime();
+  clock_gettime(CLOCK_MONOTONIC,&start);
+  for(i=0;i<nreads;i++)
+    if(legacy_read(board,settings,&legacyevent)) return 1;
+  clock_gettime(CLOCK_MONOTONIC,&end);
+  twall_legacy = elapsed(&start,&end);
+  tcpu_legacy  = cputime() - tcpu_legacy;
+  for(b=0;b<ADC_NBOARDS;b++)
+    dscFreeBoard(board[b]);
+  dscFree();
+
+  /* Report */
+  printf("THM: %d reads, %d boards, %d scan average\n",nreads,ADC_NBOARDS,ADC_NAVG);
+  printf("%-8s %12s %12s %12s\n","path","wall [us]","cpu [us]","rate [Hz]");
+  printf("%-8s %12.2f %12.2f %12.0f\n","scan",1e6*twall_scan/nreads,1e6*tcpu_scan/nreads,nreads/twall_scan);
+  printf("%-8s %12.2f %12.2f %12.0f\n","legacy",1e6*twall_legacy/nreads,1e6*tcpu_legacy/nreads,nreads/twall_legacy);
+  printf("THM: max temperature difference %.3f C\n",maxdiff(&scanevent,&legacyevent));
+  return 0;
+}
@@ -15,9 +15,12 @@
 /* piccflight headers */
 #include "controller.h"
 #include "common_functions.h"
+#include "log_functions.h"
 #include "fakemodes.h"
 #include "acq_proc.h"
 #include "hex_functions.h"
+#include "img_functions.h"
+#include "frm_functions.h"
 
 #define ACQ_FPS 3  //valid fps = 15 10 7 5 3 
 
@@ -105,8 +108,10 @@ void acq_process_image(uvc_frame_t *frame, sm_t *sm_p) {
   clock_gettime(CLOCK_REALTIME,&start);
 
   //Get one frame per second
-  if(frame->sequence % (ACQ_FPS+1) != 0)
+  if(frame->sequence % (ACQ_FPS+1) != 0){
+    frm_skip(sm_p,ACQID,FRM_SKIP_DECIMATE);
     return;
+  }
   
   //Get state
   state = sm_p->state;
@@ -137,7 +142,7 @@ void acq_process_image(uvc_frame_t *frame, sm_t *sm_p) {
   
   //Measure exposure time
   if(timespec_subtract(&delta,&start,&last))
-    printf("ACQ: call back --> timespec_subtract error!\n");
+    log_msg(LOG_LVL_WARN,"ACQ: call back --> timespec_subtract error!\n");
   ts2double(&delta,&dt);
 
   //Save time
@@ -156,6 +161,7 @@ void acq_process_image(uvc_frame_t *frame, sm_t *sm_p) {
   acqevent.hed.bmc_commander = sm_p->state_array[state].bmc_commander;
   acqevent.hed.start_sec    = start.tv_sec;
   acqevent.hed.start_nsec   = start.tv_nsec;
+  frm_header(sm_p,ACQID,&acqevent.hed);
   
   //Save calmodes
   acqevent.hed.hex_calmode = sm_p->hex_calmode;
@@ -212,7 +218,7 @@ void acq_process_image(uvc_frame_t *frame, sm_t *sm_p) {
   
   //Check time since last command
   if(timespec_subtract(&delta,&start,&hex_last))
-    printf("ACQ: acq_process_image --> timespec_subtract error!\n");
+    log_msg(LOG_LVL_WARN,"ACQ: acq_process_image --> timespec_subtract error!\n");
   ts2double(&delta,&dt);
   
   //Check if we will send a command
@@ -220,6 +226,7 @@ void acq_process_image(uvc_frame_t *frame, sm_t *sm_p) {
     //Get last HEX command -- everytime through for event packets
     if(hex_get_command(sm_p,&hex)){
       //Skip this image
+      frm_skip(sm_p,ACQID,FRM_SKIP_LOCK);
       return;
     }
     memcpy(&hex_try,&hex,sizeof(hex_t));
@@ -253,7 +260,7 @@ void acq_process_image(uvc_frame_t *frame, sm_t *sm_p) {
   /*************************************************************/
   if(sm_p->circbuf[BUFFER_ACQFULL].write){
     if(timespec_subtract(&delta,&start,&full_last))
-      printf("ACQ: acq_process_image --> timespec_subtract error!\n");
+      log_msg(LOG_LVL_WARN,"ACQ: acq_process_image --> timespec_subtract error!\n");
     ts2double(&delta,&dt);
     if(dt > ACQ_FULL_IMAGE_TIME){
       //Debugging 
@@ -279,9 +286,7 @@ void acq_process_image(uvc_frame_t *frame, sm_t *sm_p) {
       }
       else{
 	//Copy full image
-	for(i=0;i<ACQREADYS;i++)
-	  for(j=0;j<ACQREADXS;j++)
-	    acqfull.image.data[j][i] = full_image[i][j];
+	img_transpose8(&acqfull.image.data[0][0],ACQREADYS,&full_image[0][0],ACQREADXS,ACQREADXS,ACQREADYS);
       }
 
       //Write ACQFULL to circular buffer
@@ -299,7 +304,9 @@ void acq_process_image(uvc_frame_t *frame, sm_t *sm_p) {
 /**************************************************************/
 void acq_callback(uvc_frame_t *frame, void *ptr) {
   sm_t *sm_p = (sm_t *)ptr;
+  frm_arrive(sm_p,ACQID,frame->sequence);
   acq_process_image(frame,sm_p);
+  frm_done(sm_p,ACQID,sm_p->acq_frmtime);
 }
 
 /**************************************************************/
@@ -317,6 +324,9 @@ void acq_proc(void){
     printf("openshm fail: acq_proc\n");
     acqctrlC(0);
   }
+
+  /* Attach to event log ring */
+  log_attach(sm_p,ACQID);
   
   /* Set soft interrupt handler */
   sigset(SIGINT, acqctrlC);	/* usually ^C */
@@ -379,6 +389,7 @@ void acq_proc(void){
       /* Check if camera should start */
       if(!camera_running){
 	/* START stream */
+	frm_restart(sm_p,ACQID);
 	if((res = uvc_start_streaming(devh, &ctrl, acq_callback, (void *)sm_p, 0))<0){
 	  uvc_perror(res, "start_streaming"); /* unable to start stream */
 	  acqctrlC(0);
@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <stdint.h>
+#include <dscud.h>
+
+/* piccflight headers */
+#include "controller.h"
+#include "common_functions.h"
+#include "adc_functions.h"
+#include "../drivers/phxdrv/picc_dio.h"
+
+/* Thermal ADC acquisition engine
+ *
+ *  - Each Diamond DMM-32X board runs a continuous interrupt driven
+ *    scan of all its channels with the FIFO enabled. The driver
+ *    writes the last ADC_NAVG scans into a cycling sample buffer.
+ *  - adc_read does not touch the hardware. It sums the buffer per
+ *    channel and converts the averages to temperature with
+ *    coefficients computed once in adc_init.
+ *  - A board that stops transferring for ADC_STALL_TIME is
+ *    restarted.
+ *  - After every start adc_read reports not ready until each board
+ *    has transferred ADC_NAVG full scans, so the zeroed buffer is
+ *    never converted.
+ *  - Build with "make THMSIM=1" to replace the DSCUD library with the
+ *    synthetic boards in src/adc_sim.c
+ */
+
+//Board descriptor
+typedef struct adcboard_struct{
+  int           enable;     //board in use
+  int           nchan;      //channels scanned
+  double        r1;         //RTD bridge resistor [ohms]
+  DSCB          board;      //DSCUD handle
+  DSCCB         dsccb;      //board settings
+  DSCADSETTINGS settings;   //A/D settings
+  DSCAUTOCAL    autocal;    //auto-calibration settings
+  DSCAIOINT     aioint;     //interrupt scan settings
+  double        slope;      //code to voltage [V/code]
+  double        offset;     //code to voltage [V]
+  unsigned long transfers;  //transfers at last check
+  int           filled;     //buffer holds ADC_NAVG scans since start
+  double        tcheck;     //time of last transfer change [s]
+  DSCSAMPLE     sample[ADC_NAVG*ADC_MAX_NCHAN]; //cycling scan buffer
+} adcboard_t;
+
+static adcboard_t adcboard[ADC_NBOARDS];
+static int adcinit=0;
+
+/**************************************************************/
+/* ADC_NOW                                                    */
+/*  - Return monotonic time [s]                               */
+/**************************************************************/
+static double adc_now(void){
+  struct timespec now;
+  double t;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  ts2double(&now,&t);
+  return t;
+}
+
+/**************************************************************/
+/* ADC_ERROR                                                  */
+/*  - Print last DSCUD error                                  */
+/*  - Return 1                                                */
+/**************************************************************/
+static int adc_error(int b, char *call){
+  ERRPARAMS errorParams;
+  dscGetLastError(&errorParams);
+  fprintf(stderr, "THM: Board ADC%d %s error: %s %s\n",b+1,call,dscGetErrorString(errorParams.ErrCode),errorParams.errstring);
+  return 1;
+}
+
+/**************************************************************/
+/* ADC_START                                                  */
+/*  - Start continuous interrupt scan of one board            */
+/*  - Return 1 on error, 0 on success                         */
+/**************************************************************/
+static int adc_start(int b){
+  adcboard_t *adc = &adcboard[b];
+
+  memset(&adc->aioint,0,sizeof(DSCAIOINT));
+  memset(adc->sample,0,sizeof(adc->sample));
+  adc->aioint.num_conversions = ADC_NAVG*adc->nchan;
+  adc->aioint.conversion_rate = ADC_SCAN_RATE;
+  adc->aioint.cycle           = TRUE;
+  adc->aioint.internal_clock  = TRUE;
+  adc->aioint.low_channel     = 0;
+  adc->aioint.high_channel    = adc->nchan-1;
+  adc->aioint.sample_values   = adc->sample;
+  adc->aioint.fifo_enab       = TRUE;
+  adc->aioint.fifo_depth      = ADC_FIFO_SCANS*adc->nchan;
+  adc->aioint.dump_threshold  = ADC_NAVG*adc->nchan;
+  adc->aioint.channel_align   = TRUE;
+  if(dscADScanInt(adc->board,&adc->aioint) != DE_NONE)
+    return adc_error(b,"dscADScanInt");
+  adc->transfers = 0;
+  adc->filled    = 0;
+  adc->tcheck    = adc_now();
+  return 0;
+}
+
+/**************************************************************/
+/* ADC_INIT                                                   */
+/*  - Configure boards and start acquisition                  */
+/*  - Return 1 on error, 0 on success                         */
+/**************************************************************/
+int adc_init(void){
+  const WORD   base[ADC_NBOARDS]  = {ADC1_BASE,ADC2_BASE,ADC3_BASE};
+  const int    nchan[ADC_NBOARDS] = {ADC1_NCHAN,ADC2_NCHAN,ADC3_NCHAN};
+  const double r1[ADC_NBOARDS]    = {ADC1_R1,ADC2_R1,ADC3_R1};
+  DFLOAT v0,v1;
+  adcboard_t *adc;
+  int b;
+
+  //Init library
+  memset(adcboard,0,sizeof(adcboard));
+  if(dscInit(DSC_VERSION) != DE_NONE)
+    return adc_error(-1,"dscInit");
+  adcinit = 1;
+
+  for(b=0;b<ADC_NBOARDS;b++){
+    adc = &adcboard[b];
+    adc->nchan = nchan[b];
+    adc->r1    = r1[b];
+    #if PICC_DIO_ENABLE
+    //Board 1 shares its port with the PICC DIO
+    if(b == 0){
+      printf("THM: ADC Board 1 disabled for PICC_DIO\n");
+      continue;
+    }
+    #endif
+
+    //Init board
+    adc->dsccb.base_address = base[b];
+    adc->dsccb.int_level    = 5;
+    if(dscInitBoard(DSC_DMM32X,&adc->dsccb,&adc->board) != DE_NONE)
+      return adc_error(b,"dscInitBoard");
+
+    //A/D settings
+    adc->settings.range           = RANGE_5;
+    adc->settings.polarity        = BIPOLAR;
+    adc->settings.gain            = GAIN_8;
+    adc->settings.load_cal        = (BYTE)TRUE;
+    adc->settings.current_channel = 0;
+    adc->settings.scan_interval   = SCAN_INTERVAL_10; //10 us channel switching
+    if(dscADSetSettings(adc->board,&adc->settings) != DE_NONE)
+      return adc_error(b,"dscADSetSettings");
+
+    //Auto calibration
+    adc->autocal.adrange      = AD_RANGE_CODE;
+    adc->autocal.boot_adrange = AD_RANGE_CODE;
+    if(dscADAutoCal(adc->board,&adc->autocal) != DE_NONE)
+      return adc_error(b,"dscADAutoCal");
+    if(dscADCalVerify(adc->board,&adc->autocal) != DE_NONE)
+      return adc_error(b,"dscADCalVerify");
+    if((fabs(adc->autocal.ad_offset) > MAX_AD_OFFSET) || (fabs(adc->autocal.ad_gain) > MAX_AD_GAIN)){
+      fprintf(stderr, "THM: Board %d Configuration Mode: %d, Offset Error: %9.3f, Gain Error: %9.3f\n",b+1,AD_CONFIG_MODE,adc->autocal.ad_offset,adc->autocal.ad_gain);
+      fprintf(stderr, "THM: Board %d values for offset or gain exceeded specified tolerance\n",b+1);
+      return 1;
+    }
+
+    //Code to voltage is linear, get the coefficients once
+    if(dscADCodeToVoltage(adc->board,adc->settings,0,&v0) != DE_NONE ||
+       dscADCodeToVoltage(adc->board,adc->settings,16384,&v1) != DE_NONE)
+      return adc_error(b,"dscADCodeToVoltage");
+    adc->offset = v0;
+    adc->slope  = (v1 - v0)/16384.0;
+
+    //Start acquisition
+    if(adc_start(b))
+      return 1;
+    adc->enable = 1;
+  }
+  printf("THM: ADC boards scanning at %.0f Hz, %d scan average\n",ADC_SCAN_RATE,ADC_NAVG);
+  return 0;
+}
+
+/**************************************************************/
+/* ADC_CHECK                                                  */
+/*  - Restart a board that has stopped transferring           */
+/*  - Return 1 on error, 0 on success                         */
+/**************************************************************/
+static int adc_check(int b){
+  adcboard_t *adc = &adcboard[b];
+  DSCS status;
+  double t = adc_now();
+
+  if(dscGetStatus(adc->board,&status) != DE_NONE)
+    return adc_error(b,"dscGetStatus");
+  if(status.total_transfers != adc->transfers){
+    adc->transfers = status.total_transfers;
+    adc->tcheck    = t;
+    if(adc->transfers >= ADC_NAVG*adc->nchan)
+      adc->filled = 1;
+    return 0;
+  }
+  if((t - adc->tcheck) > ADC_STALL_TIME){
+    printf("THM: ADC%d scan stalled, restarting\n",b+1);
+    dscCancelOp(adc->board);
+    return adc_start(b);
+  }
+  return 0;
+}
+
+/**************************************************************/
+/* ADC_READ                                                   */
+/*  - Average scan buffers and convert to temperature         */
+/*  - Return 1 on error, 0 on success, -1 if a buffer is      */
+/*    still filling (thmevent temperatures are not changed)   */
+/**************************************************************/
+int adc_read(thmevent_t *thmevent, int use_vref){
+  float *temp[ADC_NBOARDS] = {thmevent->adc1_temp,thmevent->adc2_temp,thmevent->adc3_temp};
+  double volt[ADC_NBOARDS][ADC_MAX_NCHAN]={{0}};
+  int32_t sum[ADC_MAX_NCHAN];
+  double vref=VREF_DEFAULT,k,c,scale;
+  adcboard_t *adc;
+  int b,i,j,n,filled=1;
+
+  //Check boards, wait for full buffers after a start
+  for(b=0;b<ADC_NBOARDS;b++){
+    adc = &adcboard[b];
+    if(!adc->enable) continue;
+    if(adc_check(b)) return 1;
+    filled &= adc->filled;
+  }
+  if(!filled) return -1;
+
+  //Average scans into voltages
+  for(b=0;b<ADC_NBOARDS;b++){
+    adc = &adcboard[b];
+    if(!adc->enable) continue;
+    n = adc->nchan;
+    memset(sum,0,sizeof(sum));
+    for(j=0;j<ADC_NAVG;j++)
+      for(i=0;i<n;i++)
+	sum[i] += adc->sample[j*n+i];
+    scale = adc->slope/ADC_NAVG;
+    for(i=0;i<n;i++)
+      volt[b][i] = adc->offset + scale*sum[i];
+  }
+
+  //Reference voltage from the ADC1 reference resistor
+  if(use_vref && adcboard[0].enable)
+    vref = volt[0][ADC_VREF_SENSOR]*(ADC1_R1+RTD_OHMS)/RTD_OHMS;
+
+  //Convert voltage to temperature
+  //  R = V*R1/(vref-V), T = (R-R0)/(alpha*R0) = k*V/(vref-V) - c
+  c = 1.0/RTD_ALPHA;
+  for(b=0;b<ADC_NBOARDS;b++){
+    adc = &adcboard[b];
+    if(!adc->enable) continue;
+    k = adc->r1/(RTD_ALPHA*RTD_OHMS);
+    for(i=0;i<adc->nchan;i++)
+      temp[b][i] = k*volt[b][i]/(vref - volt[b][i]) - c;
+  }
+  thmevent->adc1_temp[ADC_VREF_SENSOR] = vref;
+  return 0;
+}
+
+/**************************************************************/
+/* ADC_CLEANUP                                                */
+/*  - Stop acquisition and release boards                     */
+/**************************************************************/
+void adc_cleanup(void){
+  int b;
+  if(!adcinit) return;
+  for(b=0;b<ADC_NBOARDS;b++){
+    if(adcboard[b].enable){
+      dscCancelOp(adcboard[b].board);
+      dscFreeBoard(adcboard[b].board);
+      adcboard[b].enable = 0;
+    }
+  }
+  dscFree();
+  adcinit = 0;
+}
@@ -0,0 +1,9 @@
+#ifndef _ADC_FUNCTIONS
+#define _ADC_FUNCTIONS
+
+//Function prototypes
+int  adc_init(void);
+int  adc_read(thmevent_t *thmevent, int use_vref);
+void adc_cleanup(void);
+
+#endif
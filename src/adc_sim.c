@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+#include <dscud.h>
+
+/* piccflight headers */
+#include "controller.h"
+#include "common_functions.h"
+
+/* Software thermal ADC simulator
+ *
+ *  - Build with "make THMSIM=1" to replace the DSCUD library with
+ *    the calls used by adc_functions.c and thm_bench.c
+ *  - Each RTD follows ADC_SIM_TEMP + ADC_SIM_SWING*sin(2*pi*t/ADC_SIM_PERIOD)
+ *    with a per-channel phase and ADC_SIM_NOISE rms noise, seen through
+ *    the same bridge (R1 from the board base address) as the flight boards
+ *  - dscADScanInt starts a thread per board that fills the cycling
+ *    sample buffer at the programmed scan rate
+ *  - dscADScan waits the channel switching time of one scan
+ */
+#ifdef THM_SIM
+
+#define ADCSIM_NBOARDS   8
+
+/* Simulated board */
+typedef struct adcsim_struct{
+  int            used;
+  int            running;
+  double         r1;          //bridge resistor [ohms]
+  DSCADSETTINGS  settings;
+  DSCAIOINT      aioint;
+  unsigned long  transfers;
+  pthread_t      thread;
+  pthread_mutex_t lock;
+  unsigned int   seed;
+} adcsim_t;
+
+static adcsim_t adcsim[ADCSIM_NBOARDS];
+static BYTE adcsim_error = DE_NONE;
+
+/**************************************************************/
+/* ADCSIM_NOW                                                 */
+/*  - Return current time [s]                                 */
+/**************************************************************/
+static double adcsim_now(void){
+  struct timespec now;
+  double t;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  ts2double(&now,&t);
+  return t;
+}
+
+/**************************************************************/
+/* ADCSIM_CHECK                                               */
+/*  - Check board handle                                      */
+/**************************************************************/
+static adcsim_t *adcsim_check(DSCB board){
+  if(board < 0 || board >= ADCSIM_NBOARDS || !adcsim[board].used){
+    adcsim_error = DE_INVALID_PARM;
+    return NULL;
+  }
+  return &adcsim[board];
+}
+
+/**************************************************************/
+/* ADCSIM_CODE                                                */
+/*  - Return simulated A/D code of one channel                */
+/**************************************************************/
+static DSCSAMPLE adcsim_code(adcsim_t *sim, int ch, double t){
+  double fs = 10.0/(1 << sim->settings.gain) / (sim->settings.range ? 1.0 : 2.0);
+  double temp,r,v,n;
+
+  //Box-Muller noise
+  n = sqrt(-2*log((rand_r(&sim->seed)+1.0)/(RAND_MAX+1.0)))*cos(2*M_PI*rand_r(&sim->seed)/(double)RAND_MAX);
+
+  //RTD resistance
+  temp = ADC_SIM_TEMP + ADC_SIM_SWING*sin(2*M_PI*t/ADC_SIM_PERIOD + ch) + ADC_SIM_NOISE*n;
+  r    = RTD_OHMS*(1 + RTD_ALPHA*temp);
+
+  //Reference resistor on ADC1
+  if(sim->r1 == ADC1_R1 && ch == ADC_VREF_SENSOR)
+    r = RTD_OHMS;
+
+  //Bridge voltage to code
+  v = VREF_DEFAULT*r/(sim->r1 + r);
+  if(v >  fs) v =  fs;
+  if(v < -fs) v = -fs;
+  return (DSCSAMPLE)lround(v/fs*32767);
+}
+
+/**************************************************************/
+/* ADCSIM_THREAD                                              */
+/*  - Fill cycling scan buffer at the scan rate               */
+/**************************************************************/
+static void *adcsim_thread(void *arg){
+  adcsim_t *sim = (adcsim_t *)arg;
+  int nchan = sim->aioint.high_channel - sim->aioint.low_channel + 1;
+  int nscan = sim->aioint.num_conversions / nchan;
+  const long period = ONE_MILLION/sim->aioint.conversion_rate; //us
+  int scan=0,i;
+  double t;
+
+  while(sim->running){
+    t = adcsim_now();
+    pthread_mutex_lock(&sim->lock);
+    for(i=0;i<nchan;i++)
+      sim->aioint.sample_values[scan*nchan+i] = adcsim_code(sim,sim->aioint.low_channel+i,t);
+    sim->transfers += nchan;
+    pthread_mutex_unlock(&sim->lock);
+    if(++scan == nscan){
+      scan = 0;
+      if(!sim->aioint.cycle) break;
+    }
+    usleep(period);
+  }
+  return NULL;
+}
+
+/**************************************************************/
+/* DSCUD LIBRARY                                              */
+/**************************************************************/
+BYTE dscInit(WORD version){
+  memset(adcsim,0,sizeof(adcsim));
+  adcsim_error = DE_NONE;
+  printf("THMSIM: Using simulated ADC boards\n");
+  return DE_NONE;
+}
+
+BYTE dscFree(void){
+  return DE_NONE;
+}
+
+BYTE dscGetLastError(ERRPARAMS* errparams){
+  errparams->ErrCode   = adcsim_error;
+  errparams->errstring = "(sim)";
+  return DE_NONE;
+}
+
+char* dscGetErrorString(BYTE error_code){
+  if(error_code == DE_NONE)              return STR_DE_NONE;
+  if(error_code == DE_INVALID_PARM)      return STR_DE_INVALID_PARM;
+  if(error_code == DE_NONE_IN_PROGRESS)  return STR_DE_NONE_IN_PROGRESS;
+  if(error_code == DE_BOARD_BUSY)        return STR_DE_BOARD_BUSY;
+  return "UNKNOWN ERROR";
+}
+
+/**************************************************************/
+/* DSCUD BOARD                                                */
+/**************************************************************/
+BYTE dscInitBoard(BYTE boardtype, DSCCB* dsccb, DSCB* board){
+  int b;
+  for(b=0;b<ADCSIM_NBOARDS;b++)
+    if(!adcsim[b].used) break;
+  if(b == ADCSIM_NBOARDS){
+    adcsim_error = DE_INVALID_PARM;
+    return adcsim_error;
+  }
+  memset(&adcsim[b],0,sizeof(adcsim_t));
+  adcsim[b].used = 1;
+  adcsim[b].seed = dsccb->base_address;
+  adcsim[b].r1   = (dsccb->base_address == ADC1_BASE) ? ADC1_R1 : (dsccb->base_address == ADC2_BASE) ? ADC2_R1 : ADC3_R1;
+  pthread_mutex_init(&adcsim[b].lock,NULL);
+  dsccb->boardtype = boardtype;
+  dsccb->boardnum  = b;
+  *board = b;
+  return DE_NONE;
+}
+
+BYTE dscFreeBoard(DSCB board){
+  adcsim_t *sim;
+  if((sim = adcsim_check(board)) == NULL) return adcsim_error;
+  if(sim->running) dscCancelOp(board);
+  sim->used = 0;
+  return DE_NONE;
+}
+
+/**************************************************************/
+/* DSCUD A/D                                                  */
+/**************************************************************/
+BYTE dscADSetSettings(DSCB board, DSCADSETTINGS* settings){
+  adcsim_t *sim;
+  if((sim = adcsim_check(board)) == NULL) return adcsim_error;
+  memcpy(&sim->settings,settings,sizeof(DSCADSETTINGS));
+  return DE_NONE;
+}
+
+BYTE dscADAutoCal(DSCB board, DSCADCALPARAMS* params){
+  if(adcsim_check(board) == NULL) return adcsim_error;
+  return DE_NONE;
+}
+
+BYTE dscADCalVerify(DSCB board, DSCADCALPARAMS* params){
+  if(adcsim_check(board) == NULL) return adcsim_error;
+  params->ad_offset = 0;
+  params->ad_gain   = 0;
+  return DE_NONE;
+}
+
+BYTE dscADCodeToVoltage(DSCB board, DSCADSETTINGS adsettings, DSCSAMPLE adcode, DFLOAT *voltage){
+  double fs = 10.0/(1 << adsettings.gain) / (adsettings.range ? 1.0 : 2.0);
+  if(adcsim_check(board) == NULL) return adcsim_error;
+  *voltage = adcode*fs/32767;
+  return DE_NONE;
+}
+
+BYTE dscADScan(DSCB board, DSCADSCAN* dscadscan, DSCSAMPLE* sample_values){
+  adcsim_t *sim;
+  double t;
+  int i,nchan;
+  if((sim = adcsim_check(board)) == NULL) return adcsim_error;
+  if(sim->running){
+    adcsim_error = DE_BOARD_BUSY;
+    return adcsim_error;
+  }
+  nchan = dscadscan->high_channel - dscadscan->low_channel + 1;
+  usleep(nchan*10); //SCAN_INTERVAL_10
+  t = adcsim_now();
+  dscadscan->sample_values = sample_values;
+  for(i=0;i<nchan;i++)
+    sample_values[i] = adcsim_code(sim,dscadscan->low_channel+i,t);
+  return DE_NONE;
+}
+
+BYTE dscADScanInt(DSCB board, DSCAIOINT* dscaioint){
+  adcsim_t *sim;
+  int nchan;
+  if((sim = adcsim_check(board)) == NULL) return adcsim_error;
+  nchan = dscaioint->high_channel - dscaioint->low_channel + 1;
+  if(sim->running || nchan <= 0 || dscaioint->conversion_rate <= 0 ||
+     dscaioint->sample_values == NULL || dscaioint->num_conversions < nchan){
+    adcsim_error = sim->running ? DE_BOARD_BUSY : DE_INVALID_PARM;
+    return adcsim_error;
+  }
+  memcpy(&sim->aioint,dscaioint,sizeof(DSCAIOINT));
+  dscaioint->conversion_rate_final = dscaioint->conversion_rate;
+  sim->transfers = 0;
+  sim->running   = 1;
+  if(pthread_create(&sim->thread,NULL,adcsim_thread,sim)){
+    sim->running = 0;
+    adcsim_error = DE_INVALID_PARM;
+    return adcsim_error;
+  }
+  return DE_NONE;
+}
+
+BYTE dscGetStatus(DSCB board, DSCS* status){
+  adcsim_t *sim;
+  if((sim = adcsim_check(board)) == NULL) return adcsim_error;
+  memset(status,0,sizeof(DSCS));
+  pthread_mutex_lock(&sim->lock);
+  status->op_type         = sim->running ? OP_TYPE_INT : OP_TYPE_NONE;
+  status->total_transfers = sim->transfers;
+  pthread_mutex_unlock(&sim->lock);
+  return DE_NONE;
+}
+
+BYTE dscCancelOp(DSCB board){
+  adcsim_t *sim;
+  if((sim = adcsim_check(board)) == NULL) return adcsim_error;
+  if(!sim->running){
+    adcsim_error = DE_NONE_IN_PROGRESS;
+    return adcsim_error;
+  }
+  sim->running = 0;
+  pthread_join(sim->thread,NULL);
+  return DE_NONE;
+}
+
+#endif
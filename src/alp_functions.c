@@ -4,6 +4,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <stddef.h>
 #include <fcntl.h>
 #include <ctype.h>
 #include <time.h>
@@ -15,10 +16,14 @@
 /* piccflight headers */
 #include "controller.h"
 #include "common_functions.h"
+#include "log_functions.h"
 #include "numeric.h"
 #include "alp_functions.h"
 #include "alpao_map.h"
 #include "rtd_functions.h"
+#include "calstore.h"
+#include "calsnap.h"
+#include "plant_functions.h"
 #include "../drivers/phxdrv/picc_dio.h"
 
 /**************************************************************/
@@ -128,14 +133,19 @@ void alp_init_calmode(int calmode, calmode_t *alp){
 int alp_zern2alp(double *zernikes,double *actuators,int reset){
   static int init=0;
   static double zern2alp_matrix[LOWFS_N_ZERNIKE*ALP_NACT]={0};
+  static num_recon_t zern2alp_recon={0};
+  static uint32 version=0;
 
-  if(!init || reset){
-    //Read matrix file
-    if(read_file(SHKZER2ALPACT_FILE,zern2alp_matrix,sizeof(zern2alp_matrix))){
+  if(!init || reset || version != cal_version(CAL_SHKZER2ALPACT)){
+    //Copy matrix from calibration store
+    if(cal_read(CAL_SHKZER2ALPACT,zern2alp_matrix,sizeof(zern2alp_matrix),&version)){
       memset(zern2alp_matrix,0,sizeof(zern2alp_matrix));
       return 1;
     }
-    printf("ALP: Read zern2alp file\n");
+    printf("ALP: Read zern2alp matrix v%u\n",version);
+
+    //Build reconstructor
+    num_recon_init(&zern2alp_recon,zern2alp_matrix,ALP_NACT,LOWFS_N_ZERNIKE);
     
     //Set init flag
     init=1;
@@ -145,7 +155,7 @@ int alp_zern2alp(double *zernikes,double *actuators,int reset){
   }
 
   //Do Matrix Multiply
-  num_dgemv(zern2alp_matrix,zernikes,actuators, ALP_NACT, LOWFS_N_ZERNIKE);
+  num_recon(&zern2alp_recon,zernikes,actuators);
 
   return 0;
 }
@@ -157,14 +167,19 @@ int alp_zern2alp(double *zernikes,double *actuators,int reset){
 int alp_alp2zern(double *actuators, double *zernikes,int reset){
   static int init=0;
   static double alp2zern_matrix[LOWFS_N_ZERNIKE*ALP_NACT]={0};
+  static num_recon_t alp2zern_recon={0};
+  static uint32 version=0;
 
-  if(!init || reset){
-    //Read matrix file
-    if(read_file(SHKZER2ALPACT_FILE,alp2zern_matrix,sizeof(alp2zern_matrix))){
+  if(!init || reset || version != cal_version(CAL_SHKZER2ALPACT)){
+    //Copy matrix from calibration store
+    if(cal_read(CAL_SHKZER2ALPACT,alp2zern_matrix,sizeof(alp2zern_matrix),&version)){
       memset(alp2zern_matrix,0,sizeof(alp2zern_matrix));
       return 1;
     }
-    printf("ALP: Read alp2zern file\n");
+    printf("ALP: Read alp2zern matrix v%u\n",version);
+
+    //Build reconstructor
+    num_recon_init(&alp2zern_recon,alp2zern_matrix,LOWFS_N_ZERNIKE,ALP_NACT);
     
     //Set init flag
     init=1;
@@ -174,7 +189,7 @@ int alp_alp2zern(double *actuators, double *zernikes,int reset){
   }
 
   //Do Matrix Multiply
-  num_dgemv(alp2zern_matrix,actuators,zernikes, LOWFS_N_ZERNIKE, ALP_NACT);
+  num_recon(&alp2zern_recon,actuators,zernikes);
 
   return 0;
 }
@@ -296,6 +311,10 @@ int alp_send_command(sm_t *sm_p, alp_t *cmd, int proc_id, int n_dither){
       if(!rtd_send_alp(sm_p->p_rtd_alp_board,cmd->acmd)){
 	//Copy command to current position
 	memcpy((alp_t *)&sm_p->alp_command,cmd,sizeof(alp_t));
+	//Optical plant latency
+	plant_command(sm_p,PLANT_ALP,proc_id);
+	//Startup timing
+	calsnap_mark(sm_p,proc_id,CALSNAP_EVENT_LOOP);
 	//Set retval for good command
 	retval = 0;
       }
@@ -461,6 +480,23 @@ int alp_load_flat(sm_t *sm_p,int proc_id){
 }
 
 
+/**************************************************************/
+/* ALP_LOAD_ZERNIKE_ERRORS                                    */
+/* - Read Zernike errors file into shared memory              */
+/* - Called once by the watchdog, the table is shared by all  */
+/*   processes                                                */
+/* - Return 1 on error, 0 on success                          */
+/**************************************************************/
+int alp_load_zernike_errors(sm_t *sm_p){
+  sm_p->alpcal.zernike_errors_loaded = 0;
+  if(read_file(ZERNIKE_ERRORS_FILE,(void *)sm_p->alpcal.zernike_errors,sizeof(sm_p->alpcal.zernike_errors))){
+    memset((void *)sm_p->alpcal.zernike_errors,0,sizeof(sm_p->alpcal.zernike_errors));
+    return 1;
+  }
+  sm_p->alpcal.zernike_errors_loaded = 1;
+  return 0;
+}
+
 /**************************************************************/
 /* ALP_INIT_CALIBRATION                                       */
 /* - Initialize calibration structure                         */
@@ -468,12 +504,12 @@ int alp_load_flat(sm_t *sm_p,int proc_id){
 void alp_init_calibration(sm_t *sm_p){
   int i;
 
-  //Zero out calibration struct
-  memset((void *)&sm_p->alpcal,0,sizeof(alpcal_t));
+  //Zero out calibration struct up to the Zernike errors table
+  memset((void *)&sm_p->alpcal,0,offsetof(alpcal_t,zernike_errors));
 
-  //Read Zernike errors file
-  if(read_file(ZERNIKE_ERRORS_FILE,sm_p->alpcal.zernike_errors,sizeof(sm_p->alpcal.zernike_errors)))
-    memset(sm_p->alpcal.zernike_errors,0,sizeof(sm_p->alpcal.zernike_errors));
+  //Read Zernike errors file if the watchdog could not
+  if(!sm_p->alpcal.zernike_errors_loaded)
+    alp_load_zernike_errors(sm_p);
     
   return; 
 }
@@ -551,7 +587,7 @@ int alp_calibrate(sm_t *sm_p, int calmode, alp_t *alp, uint32_t *step, double *z
   if(calmode==ALP_CALMODE_TIMER){
     //Get time delta
     if(timespec_subtract(&delta,&this,(struct timespec *)&sm_p->alpcal.start[calmode]))
-      printf("ALP: alp_calibrate --> timespec_subtract error!\n");
+      log_msg(LOG_LVL_WARN,"ALP: alp_calibrate --> timespec_subtract error!\n");
     ts2double(&delta,&dt);
     
     if(dt > sm_p->alp_cal_timer_length){
@@ -840,7 +876,7 @@ int alp_calibrate(sm_t *sm_p, int calmode, alp_t *alp, uint32_t *step, double *z
   if(calmode == ALP_CALMODE_FLIGHT){
     //Get time delta
     if(timespec_subtract(&delta,&this,(struct timespec *)&sm_p->alpcal.start[calmode]))
-      printf("ALP: alp_calibrate --> timespec_subtract error!\n");
+      log_msg(LOG_LVL_WARN,"ALP: alp_calibrate --> timespec_subtract error!\n");
     ts2double(&delta,&dt);
     //Set data index
     index = (uint64_t)(dt/zernike_timestep);
@@ -17,6 +17,7 @@ int  alp_load_flat(sm_t *sm_p,int proc_id);
 int  alp_set_bias(sm_t *sm_p, double bias, int proc_id);
 int  alp_set_random(sm_t *sm_p,int proc_id);
 int  alp_set_zrandom(sm_t *sm_p,int proc_id);
+int alp_load_zernike_errors(sm_t *sm_p);
 void alp_init_calibration(sm_t *sm_p);
 int  alp_calibrate(sm_t *sm_p, int calmode, alp_t *alp, uint32_t *step, double *zoutput, int procid, int reset);
 
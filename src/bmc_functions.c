@@ -11,12 +11,15 @@
 #include <libgen.h>
 #include <sys/stat.h>
 #include <sys/io.h>
+#include <pthread.h>
 
 /* piccflight headers */
 #include "controller.h"
 #include "common_functions.h"
+#include "log_functions.h"
 #include "numeric.h"
 #include "bmc_functions.h"
+#include "plant_functions.h"
 
 /**************************************************************/
 /* BMC_FUNCTION_RESET                                         */
@@ -180,16 +183,13 @@ int bmc_get_flat(sm_t *sm_p, bmc_t *cmd, int iflat){
 }
 
 /**************************************************************/
-/* BMC_SEND_COMMAND                                           */
-/* - Function to command the BMC DM                           */
-/* - Use atomic operations to prevent two processes from      */
-/*   sending commands at the same time                        */
-/* - Return 0 if the command was sent and 1 if it wasn't      */
+/* BMC_PREPARE_COMMAND                                        */
+/* - Set test points, apply limits and rotation               */
+/* - Test points and limits are preserved in cmd              */
+/* - Rotated command is written to rot                        */
 /**************************************************************/
-int bmc_send_command(sm_t *sm_p, bmc_t *cmd, int proc_id, int set_flat){
-  int retval = 1;
+static void bmc_prepare_command(bmc_t *cmd, bmc_t *rot){
   int i;
-  bmc_t bmc_rotate;
 
   //Set test points -- preserved in command
   for(i=0;i<BMC_NTEST;i++)
@@ -199,8 +199,22 @@ int bmc_send_command(sm_t *sm_p, bmc_t *cmd, int proc_id, int set_flat){
   bmc_limit_command(cmd);
   
   //Apply rotation -- not preserved in command
-  memcpy(&bmc_rotate,cmd,sizeof(bmc_t));
-  bmc_rotate_command(&bmc_rotate,FUNCTION_NO_RESET);
+  memcpy(rot,cmd,sizeof(bmc_t));
+  bmc_rotate_command(rot,FUNCTION_NO_RESET);
+}
+
+/**************************************************************/
+/* BMC_WRITE_COMMAND                                          */
+/* - Write a prepared command to the BMC controller           */
+/* - Use atomic operations to prevent two processes from      */
+/*   sending commands at the same time                        */
+/* - Record the command round trip time                       */
+/* - Return 0 if the command was sent and 1 if it wasn't      */
+/**************************************************************/
+static int bmc_write_command(sm_t *sm_p, bmc_t *cmd, bmc_t *rot, int proc_id, int set_flat){
+  struct timespec start,end,delta;
+  double dt;
+  int retval = 1;
   
   //Check if controller is ready
   if(sm_p->bmc_ready && sm_p->bmc_hv_on){
@@ -210,14 +224,30 @@ int bmc_send_command(sm_t *sm_p, bmc_t *cmd, int proc_id, int set_flat){
     
       //Check if the commanding process is the BMC commander
       if(proc_id == sm_p->state_array[sm_p->state].bmc_commander){
-      
+
+	//Get start time
+	clock_gettime(CLOCK_REALTIME,&start);
+
 	//Send the command
-	if(!libbmc_set_acts_tstpnts((libbmc_device_t *)&sm_p->libbmc_device, bmc_rotate.acmd, bmc_rotate.tcmd)){
+	if(!libbmc_set_acts_tstpnts((libbmc_device_t *)&sm_p->libbmc_device, rot->acmd, rot->tcmd)){
+	  //Get end time
+	  clock_gettime(CLOCK_REALTIME,&end);
+	  if(timespec_subtract(&delta,&end,&start))
+	    log_msg(LOG_LVL_WARN,"BMC: timespec_subtract error!\n");
+	  ts2double(&delta,&dt);
+	  //Record round trip time
+	  if((sm_p->bmc_time.count == 0) || (dt < sm_p->bmc_time.min)) sm_p->bmc_time.min = dt;
+	  if((sm_p->bmc_time.count == 0) || (dt > sm_p->bmc_time.max)) sm_p->bmc_time.max = dt;
+	  sm_p->bmc_time.last = dt;
+	  sm_p->bmc_time.sum += dt;
+	  sm_p->bmc_time.count++;
 	  //Copy command to current position
 	  memcpy((bmc_t *)&sm_p->bmc_command,cmd,sizeof(bmc_t));
 	  //Set flat
 	  if(set_flat == BMC_SET_FLAT) memcpy((bmc_t *)&sm_p->bmc_flat[++sm_p->bmc_iflat % BMC_NFLAT],cmd,sizeof(bmc_t));
 	  if(set_flat == BMC_OW_FLAT)  memcpy((bmc_t *)&sm_p->bmc_flat[sm_p->bmc_iflat % BMC_NFLAT],cmd,sizeof(bmc_t));
+	  //Optical plant latency
+	  plant_command(sm_p,PLANT_BMC,proc_id);
 	  //Set retval for good command
 	  retval = 0;
 	}
@@ -228,8 +258,193 @@ int bmc_send_command(sm_t *sm_p, bmc_t *cmd, int proc_id, int set_flat){
     }
   }
 
-    //Return
-    return retval;
+  //Return
+  return retval;
+}
+
+/**************************************************************/
+/* BMC_SEND_COMMAND                                           */
+/* - Function to command the BMC DM                           */
+/* - Blocks until the controller acknowledges the command     */
+/* - Return 0 if the command was sent and 1 if it wasn't      */
+/**************************************************************/
+int bmc_send_command(sm_t *sm_p, bmc_t *cmd, int proc_id, int set_flat){
+  bmc_t bmc_rotate;
+
+  //Prepare command
+  bmc_prepare_command(cmd,&bmc_rotate);
+
+  //Write command
+  return(bmc_write_command(sm_p,cmd,&bmc_rotate,proc_id,set_flat));
+}
+
+/**************************************************************/
+/* Asynchronous sender state                                  */
+/* - Local to the process that queues commands (SCI)          */
+/* - One command may be queued while another is in flight     */
+/**************************************************************/
+static pthread_mutex_t bmc_async_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  bmc_async_cond  = PTHREAD_COND_INITIALIZER;
+static pthread_t       bmc_async_thread;
+static int             bmc_async_running  = 0; //sender thread started
+static int             bmc_async_pending  = 0; //command waiting in slot
+static int             bmc_async_retval   = 0; //result of last completed command
+static uint32_t        bmc_async_done     = 0; //sequence of last completed command
+static int             bmc_async_proc_id;
+static int             bmc_async_set_flat;
+static uint32_t        bmc_async_seq;
+static bmc_t           bmc_async_cmd;
+static bmc_t           bmc_async_rot;
+static bmc_status_t    bmc_async_status;
+
+/**************************************************************/
+/* BMC_SENDER                                                 */
+/* - Sender thread: owns all BMC USB traffic from its process */
+/* - Writes queued commands, then reads controller status     */
+/**************************************************************/
+static void *bmc_sender(void *arg){
+  sm_t *sm_p = (sm_t *)arg;
+  bmc_t cmd,rot;
+  int proc_id,set_flat,retval;
+  uint32_t seq;
+  
+  while(1){
+    //Wait for a command
+    pthread_mutex_lock(&bmc_async_mutex);
+    while(!bmc_async_pending)
+      pthread_cond_wait(&bmc_async_cond,&bmc_async_mutex);
+    memcpy(&cmd,&bmc_async_cmd,sizeof(bmc_t));
+    memcpy(&rot,&bmc_async_rot,sizeof(bmc_t));
+    proc_id  = bmc_async_proc_id;
+    set_flat = bmc_async_set_flat;
+    seq      = bmc_async_seq;
+    //Free the slot for the next command
+    bmc_async_pending = 0;
+    pthread_cond_broadcast(&bmc_async_cond);
+    pthread_mutex_unlock(&bmc_async_mutex);
+
+    //Write command
+    retval = bmc_write_command(sm_p,&cmd,&rot,proc_id,set_flat);
+
+    //Get controller status
+    if(sm_p->bmc_ready){
+      if(libbmc_get_status((libbmc_device_t *)&sm_p->libbmc_device))
+	printf("BMC: Failed to get BMC status\n");
+    }
+    
+    //Report completion
+    pthread_mutex_lock(&bmc_async_mutex);
+    memcpy(&bmc_async_status,(void *)&sm_p->libbmc_device.status,sizeof(bmc_status_t));
+    bmc_async_retval   = retval;
+    bmc_async_done     = seq;
+    sm_p->bmc_seq_done = seq;
+    pthread_cond_broadcast(&bmc_async_cond);
+    pthread_mutex_unlock(&bmc_async_mutex);
+  }
+
+  return NULL;
+}
+
+/**************************************************************/
+/* BMC_SEND_COMMAND_ASYNC                                     */
+/* - Queue a command for the sender thread and return         */
+/* - Blocks only if a previous command is still queued        */
+/* - Sequence number of the queued command returned in seq    */
+/* - Falls back to bmc_send_command if the thread won't start */
+/* - Return 0 if the command was queued and 1 if it wasn't    */
+/**************************************************************/
+int bmc_send_command_async(sm_t *sm_p, bmc_t *cmd, int proc_id, int set_flat, uint32_t *seq){
+  bmc_t bmc_rotate;
+
+  //Start sender thread
+  if(!bmc_async_running){
+    if(pthread_create(&bmc_async_thread,NULL,bmc_sender,(void *)sm_p)){
+      printf("BMC: Failed to start sender thread\n");
+      *seq = sm_p->bmc_seq_sent;
+      return(bmc_send_command(sm_p,cmd,proc_id,set_flat));
+    }
+    bmc_async_running = 1;
+    printf("BMC: Started sender thread\n");
+  }
+  
+  //Prepare command
+  bmc_prepare_command(cmd,&bmc_rotate);
+
+  //Queue command
+  pthread_mutex_lock(&bmc_async_mutex);
+  while(bmc_async_pending)
+    pthread_cond_wait(&bmc_async_cond,&bmc_async_mutex);
+  memcpy(&bmc_async_cmd,cmd,sizeof(bmc_t));
+  memcpy(&bmc_async_rot,&bmc_rotate,sizeof(bmc_t));
+  bmc_async_proc_id  = proc_id;
+  bmc_async_set_flat = set_flat;
+  bmc_async_seq      = ++sm_p->bmc_seq_sent;
+  bmc_async_pending  = 1;
+  *seq = bmc_async_seq;
+  pthread_cond_broadcast(&bmc_async_cond);
+  pthread_mutex_unlock(&bmc_async_mutex);
+
+  return 0;
+}
+
+/**************************************************************/
+/* BMC_WAIT_COMMAND                                           */
+/* - Wait for an asynchronous command to complete             */
+/* - Returns immediately if the sender thread is not running  */
+/* - Return 0 if command seq was sent, 1 on failure/timeout   */
+/**************************************************************/
+int bmc_wait_command(sm_t *sm_p, uint32_t seq, double timeout){
+  struct timespec deadline;
+  double dt;
+  int retval = 0;
+  
+  //Check if sender thread is running
+  if(!bmc_async_running)
+    return 0;
+
+  //Set deadline
+  clock_gettime(CLOCK_REALTIME,&deadline);
+  ts2double(&deadline,&dt);
+  dt += timeout;
+  double2ts(&dt,&deadline);
+  
+  //Wait for completion -- sequence comparison handles rollover
+  pthread_mutex_lock(&bmc_async_mutex);
+  while((int32_t)(bmc_async_done - seq) < 0){
+    if(pthread_cond_timedwait(&bmc_async_cond,&bmc_async_mutex,&deadline)){
+      printf("BMC: Timeout waiting for command %u\n",seq);
+      retval = 1;
+      break;
+    }
+  }
+  if(!retval && (bmc_async_done == seq))
+    retval = bmc_async_retval;
+  pthread_mutex_unlock(&bmc_async_mutex);
+
+  return retval;
+}
+
+/**************************************************************/
+/* BMC_GET_STATUS                                             */
+/* - Get BMC controller status                                */
+/* - Uses the sender thread copy while async mode is on so    */
+/*   that only one thread talks to the controller             */
+/* - With async mode off, waits for the last queued command   */
+/*   and reads the controller directly                        */
+/* - Return 0 on success and 1 on failure                     */
+/**************************************************************/
+int bmc_get_status(sm_t *sm_p, bmc_status_t *status){
+  if(bmc_async_running && sm_p->bmc_async){
+    pthread_mutex_lock(&bmc_async_mutex);
+    memcpy(status,&bmc_async_status,sizeof(bmc_status_t));
+    pthread_mutex_unlock(&bmc_async_mutex);
+    return 0;
+  }
+  bmc_wait_command(sm_p,sm_p->bmc_seq_sent,BMC_ASYNC_TIMEOUT);
+  if(libbmc_get_status((libbmc_device_t *)&sm_p->libbmc_device))
+    return 1;
+  memcpy(status,(void *)&sm_p->libbmc_device.status,sizeof(bmc_status_t));
+  return 0;
 }
 
 /**************************************************************/
@@ -569,7 +784,7 @@ int bmc_calibrate(sm_t *sm_p, int calmode, bmc_t *bmc, uint32_t *step, int advan
   if(calmode==BMC_CALMODE_TIMER){
     //Get time delta
     if(timespec_subtract(&delta,&this,(struct timespec *)&sm_p->bmccal.start[calmode]))
-      printf("BMC: bmc_calibrate --> timespec_subtract error!\n");
+      log_msg(LOG_LVL_WARN,"BMC: bmc_calibrate --> timespec_subtract error!\n");
     ts2double(&delta,&dt);
     //Print status
     printf("BMC: %f/%f seconds\n",dt,sm_p->bmc_cal_timer_length);
@@ -9,6 +9,9 @@ void bmc_rotate_command(bmc_t *cmd, int reset);
 int bmc_get_command(sm_t *sm_p, bmc_t *cmd);
 int bmc_get_flat(sm_t *sm_p, bmc_t *cmd,int iflat);
 int bmc_send_command(sm_t *sm_p, bmc_t *cmd, int proc_id, int set_flat);
+int bmc_send_command_async(sm_t *sm_p, bmc_t *cmd, int proc_id, int set_flat, uint32_t *seq);
+int bmc_wait_command(sm_t *sm_p, uint32_t seq, double timeout);
+int bmc_get_status(sm_t *sm_p, bmc_status_t *status);
 int bmc_set_bias(sm_t *sm_p, float bias, int proc_id);
 int bmc_set_random(sm_t *sm_p, int proc_id);
 int bmc_zero_flat(sm_t *sm_p, int proc_id);
@@ -0,0 +1,474 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+/* piccflight headers */
+#include "controller.h"
+#include "common_functions.h"
+#include "calstore.h"
+#include "calsnap.h"
+
+/* Calibration snapshot
+ *
+ *  - Derived calibration state is written to CALSNAP_FILE once it has
+ *    been built and restored from it on the next boot, so processes
+ *    skip the file reads and matrix inversions they would otherwise
+ *    repeat on every start.
+ *  - Sections: the calibration matrix store, the SHK Zernike fitting
+ *    matrices and the SCI dark/bias/flat cutouts.
+ *  - The file is a header followed by page aligned sections, each with
+ *    its own checksum and the size and modification time of the files
+ *    it was derived from. A section is only restored when its checksum
+ *    is good and every source file is unchanged. Anything else falls
+ *    back to the normal init path.
+ *  - In shared memory each derived section has a sequence number that
+ *    is odd while it is being written. The owning process publishes
+ *    with calsnap_put, readers copy with calsnap_get.
+ *  - The watchdog saves the snapshot CALSNAP_SAVE_DELAY after the last
+ *    change, the file is replaced atomically.
+ */
+
+static const char *calsnap_name[CALSNAP_NSECTION] = {"calstore","shkzmat","scical"};
+
+/**************************************************************/
+/* CALSNAP_NOW                                                */
+/*  - Return monotonic time [s]                               */
+/**************************************************************/
+static double calsnap_now(void){
+  struct timespec now;
+  double t;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  ts2double(&now,&t);
+  return t;
+}
+
+/**************************************************************/
+/* CALSNAP_SECTION                                            */
+/*  - Return shared memory address and size of a section      */
+/**************************************************************/
+static void *calsnap_section(sm_t *sm_p, int sec, uint64 *nbytes){
+  switch(sec){
+  case CALSNAP_CALSTORE:
+    *nbytes = sizeof(calstore_t);
+    return (void *)&sm_p->calstore;
+  case CALSNAP_SHKZMAT:
+    *nbytes = sizeof(shkzmat_t);
+    return (void *)&sm_p->calsnap.shkzmat;
+  case CALSNAP_SCICAL:
+    *nbytes = sizeof(scicalsnap_t);
+    return (void *)&sm_p->calsnap.scical;
+  }
+  *nbytes = 0;
+  return NULL;
+}
+
+/**************************************************************/
+/* CALSNAP_SEQ                                                */
+/*  - Return section sequence number                          */
+/*  - The calibration store uses its generation counter       */
+/**************************************************************/
+static uint32 calsnap_seq(sm_t *sm_p, int sec){
+  if(sec == CALSNAP_CALSTORE) return sm_p->calstore.generation;
+  return sm_p->calsnap.seq[sec];
+}
+
+/**************************************************************/
+/* CALSNAP_CHECKSUM                                           */
+/*  - Fletcher-64 checksum over 32-bit words                  */
+/**************************************************************/
+uint64 calsnap_checksum(const void *buf, uint64 nbytes){
+  const uint8 *p = (const uint8 *)buf;
+  uint64 a=0,b=0,n;
+  uint32 word;
+
+  for(n=0;n<nbytes;n+=sizeof(word)){
+    word = 0;
+    memcpy(&word,p+n,(nbytes-n) < sizeof(word) ? (nbytes-n) : sizeof(word));
+    a += word;
+    b += a;
+    //Reduce every 4096 words, well before b can overflow
+    if(((n/sizeof(word)) & 0xFFF) == 0xFFF){
+      a %= 0xFFFFFFFF;
+      b %= 0xFFFFFFFF;
+    }
+  }
+  a %= 0xFFFFFFFF;
+  b %= 0xFFFFFFFF;
+  return (b << 32) | a;
+}
+
+/**************************************************************/
+/* CALSNAP_STAMP                                              */
+/*  - Record size and modification time of a file            */
+/**************************************************************/
+void calsnap_stamp(const char *file, filestamp_t *stamp){
+  struct stat st;
+  memset(stamp,0,sizeof(filestamp_t));
+  if(stat(file,&st)){
+    stamp->size = -1;
+    return;
+  }
+  stamp->size = st.st_size;
+  stamp->sec  = st.st_mtim.tv_sec;
+  stamp->nsec = st.st_mtim.tv_nsec;
+}
+
+/**************************************************************/
+/* CALSNAP_SOURCE_OK                                          */
+/*  - Check that a source file has not changed                */
+/*  - Return 1 if unchanged, 0 if changed                     */
+/**************************************************************/
+static int calsnap_source_ok(const calsnap_source_t *src){
+  filestamp_t stamp;
+  calsnap_stamp(src->file,&stamp);
+  return stamp.size == src->stamp.size && stamp.sec == src->stamp.sec && stamp.nsec == src->stamp.nsec;
+}
+
+/**************************************************************/
+/* CALSNAP_GET                                                */
+/*  - Copy a section out of shared memory                     */
+/*  - Return 1 if empty or written during the copy, 0 on OK  */
+/**************************************************************/
+int calsnap_get(sm_t *sm_p, int sec, void *dst){
+  uint64 nbytes;
+  uint32 seq;
+  void *src;
+
+  if((src = calsnap_section(sm_p,sec,&nbytes)) == NULL) return 1;
+  seq = calsnap_seq(sm_p,sec);
+  if(seq == 0 || (sec != CALSNAP_CALSTORE && (seq & 1))) return 1;
+  __sync_synchronize();
+  memcpy(dst,src,nbytes);
+  __sync_synchronize();
+  return calsnap_seq(sm_p,sec) != seq;
+}
+
+/**************************************************************/
+/* CALSNAP_PUT                                                */
+/*  - Publish a derived section to shared memory              */
+/*  - Only the owning process may call this                   */
+/**************************************************************/
+void calsnap_put(sm_t *sm_p, int sec, const void *src){
+  volatile calsnap_t *snap = &sm_p->calsnap;
+  uint64 nbytes;
+  uint32 seq;
+  void *dst;
+
+  if(sec == CALSNAP_CALSTORE) return;
+  if((dst = calsnap_section(sm_p,sec,&nbytes)) == NULL) return;
+  seq = snap->seq[sec] & ~1;
+  snap->seq[sec] = seq + 1;
+  __sync_synchronize();
+  memcpy(dst,src,nbytes);
+  __sync_synchronize();
+  snap->seq[sec] = seq + 2;
+}
+
+/**************************************************************/
+/* CALSNAP_SOURCES                                            */
+/*  - Fill out the source files of a section copy             */
+/**************************************************************/
+static uint32 calsnap_sources(int sec, const void *data, calsnap_source_t *source){
+  const calstore_t   *cal = (const calstore_t *)data;
+  const scicalsnap_t *sci = (const scicalsnap_t *)data;
+  uint32 i,n=0;
+
+  switch(sec){
+  case CALSNAP_CALSTORE:
+    for(i=0;i<CAL_NMATRIX;i++){
+      strncpy(source[n].file,cal_file(i),sizeof(source[n].file)-1);
+      source[n++].stamp = cal->stamp[i];
+    }
+    break;
+  case CALSNAP_SCICAL:
+    for(i=0;i<sizeof(sci->source)/sizeof(sci->source[0]);i++)
+      source[n++] = sci->source[i];
+    break;
+  }
+  return n;
+}
+
+/**************************************************************/
+/* CALSNAP_SAVE                                               */
+/*  - Write all published sections to CALSNAP_FILE            */
+/*  - Return 1 on error, 0 on success                         */
+/**************************************************************/
+int calsnap_save(sm_t *sm_p){
+  volatile calsnap_t *snap = &sm_p->calsnap;
+  calsnap_header_t hed;
+  calsnap_section_t *s;
+  char tmpfile[MAX_FILENAME];
+  void *data[CALSNAP_NSECTION]={NULL};
+  uint32 seq[CALSNAP_NSECTION]={0};
+  uint64 nbytes,offset;
+  double t0 = calsnap_now();
+  FILE *fd=NULL;
+  int sec,retval=1;
+
+  //Copy sections out of shared memory
+  memset(&hed,0,sizeof(hed));
+  offset = ((sizeof(hed) + CALSNAP_PAGE - 1)/CALSNAP_PAGE)*CALSNAP_PAGE;
+  for(sec=0;sec<CALSNAP_NSECTION;sec++){
+    s = &hed.section[sec];
+    calsnap_section(sm_p,sec,&nbytes);
+    if((data[sec] = malloc(nbytes)) == NULL){
+      printf("CSN: Failed to malloc %s copy\n",calsnap_name[sec]);
+      goto cleanup;
+    }
+    if((seq[sec] = calsnap_seq(sm_p,sec)) == 0){
+      //Never built: leave out
+      free(data[sec]);
+      data[sec] = NULL;
+      continue;
+    }
+    if(calsnap_get(sm_p,sec,data[sec])){
+      printf("CSN: %s changed during save, try again\n",calsnap_name[sec]);
+      goto cleanup;
+    }
+    s->offset   = offset;
+    s->nbytes   = nbytes;
+    s->checksum = calsnap_checksum(data[sec],nbytes);
+    s->nsource  = calsnap_sources(sec,data[sec],s->source);
+    offset     += ((nbytes + CALSNAP_PAGE - 1)/CALSNAP_PAGE)*CALSNAP_PAGE;
+  }
+
+  //Finish header
+  hed.magic    = CALSNAP_MAGIC;
+  hed.version  = CALSNAP_VERSION;
+  hed.tsave    = time(NULL);
+  hed.nbytes   = 0;
+  for(sec=0;sec<CALSNAP_NSECTION;sec++)
+    if(hed.section[sec].nbytes)
+      hed.nbytes = hed.section[sec].offset + hed.section[sec].nbytes;
+  if(hed.nbytes == 0){
+    printf("CSN: Nothing to save\n");
+    goto cleanup;
+  }
+  hed.checksum = calsnap_checksum(&hed,sizeof(hed));
+
+  //Write temporary file
+  check_and_mkdir(CALSNAP_FILE);
+  snprintf(tmpfile,sizeof(tmpfile),"%s.tmp",CALSNAP_FILE);
+  if((fd = fopen(tmpfile,"w")) == NULL){
+    perror("CSN: fopen");
+    printf("CSN: %s\n",tmpfile);
+    goto cleanup;
+  }
+  if(fwrite(&hed,sizeof(hed),1,fd) != 1){
+    perror("CSN: fwrite");
+    goto cleanup;
+  }
+  for(sec=0;sec<CALSNAP_NSECTION;sec++){
+    s = &hed.section[sec];
+    if(s->nbytes == 0) continue;
+    if(fseek(fd,s->offset,SEEK_SET) || fwrite(data[sec],s->nbytes,1,fd) != 1){
+      perror("CSN: fwrite");
+      goto cleanup;
+    }
+  }
+  if(fflush(fd) || fsync(fileno(fd))){
+    perror("CSN: fsync");
+    goto cleanup;
+  }
+  fclose(fd);
+  fd = NULL;
+
+  //Replace snapshot
+  if(rename(tmpfile,CALSNAP_FILE)){
+    perror("CSN: rename");
+    goto cleanup;
+  }
+  for(sec=0;sec<CALSNAP_NSECTION;sec++)
+    if(hed.section[sec].nbytes)
+      snap->saved[sec] = seq[sec];
+  printf("CSN: Saved %s (%lu bytes) in %.1f ms\n",CALSNAP_FILE,hed.nbytes,(calsnap_now()-t0)*1000);
+  retval = 0;
+
+ cleanup:
+  if(fd != NULL){
+    fclose(fd);
+    unlink(tmpfile);
+  }
+  for(sec=0;sec<CALSNAP_NSECTION;sec++)
+    free(data[sec]);
+  return retval;
+}
+
+/**************************************************************/
+/* CALSNAP_RESTORE                                            */
+/*  - Restore valid sections from CALSNAP_FILE                */
+/*  - Call from the watchdog before starting processes        */
+/*  - Return number of sections restored                      */
+/**************************************************************/
+int calsnap_restore(sm_t *sm_p){
+  volatile calsnap_t *snap = &sm_p->calsnap;
+  calsnap_header_t hed;
+  const calsnap_section_t *s;
+  struct stat st;
+  uint8 *map=MAP_FAILED;
+  uint64 nbytes,checksum;
+  double t0 = calsnap_now();
+  void *dst;
+  int fd,sec,i,nrestored=0;
+
+  //Map snapshot
+  if((fd = open(CALSNAP_FILE,O_RDONLY)) < 0){
+    printf("CSN: No snapshot, cold start\n");
+    return 0;
+  }
+  if(fstat(fd,&st) || st.st_size < (off_t)sizeof(hed) ||
+     (map = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0)) == MAP_FAILED){
+    printf("CSN: Unreadable snapshot, cold start\n");
+    close(fd);
+    return 0;
+  }
+  close(fd);
+
+  //Check header
+  memcpy(&hed,map,sizeof(hed));
+  checksum     = hed.checksum;
+  hed.checksum = 0;
+  if(hed.magic != CALSNAP_MAGIC || hed.version != CALSNAP_VERSION ||
+     hed.nbytes != (uint64)st.st_size || checksum != calsnap_checksum(&hed,sizeof(hed))){
+    printf("CSN: Bad snapshot header (version %u), cold start\n",hed.version);
+    munmap(map,st.st_size);
+    return 0;
+  }
+
+  //Restore sections
+  for(sec=0;sec<CALSNAP_NSECTION;sec++){
+    s = &hed.section[sec];
+    dst = calsnap_section(sm_p,sec,&nbytes);
+    if(s->nbytes == 0) continue;
+    if(s->nbytes != nbytes || s->offset % CALSNAP_PAGE || s->offset + s->nbytes > hed.nbytes || s->nsource > CALSNAP_NSOURCE){
+      printf("CSN: Bad %s section\n",calsnap_name[sec]);
+      continue;
+    }
+    if(calsnap_checksum(map+s->offset,s->nbytes) != s->checksum){
+      printf("CSN: Bad %s checksum\n",calsnap_name[sec]);
+      continue;
+    }
+    for(i=0;i<s->nsource;i++)
+      if(!calsnap_source_ok(&s->source[i]))
+	break;
+    if(i < s->nsource){
+      printf("CSN: Stale %s, %s changed\n",calsnap_name[sec],s->source[i].file);
+      continue;
+    }
+    memcpy(dst,map+s->offset,nbytes);
+    snap->seq[sec]      = 2;
+    snap->saved[sec]    = calsnap_seq(sm_p,sec);
+    snap->restored[sec] = 1;
+    nrestored++;
+    printf("CSN: Restored %s\n",calsnap_name[sec]);
+  }
+  munmap(map,st.st_size);
+  printf("CSN: Restored %d/%d sections in %.1f ms\n",nrestored,CALSNAP_NSECTION,(calsnap_now()-t0)*1000);
+  return nrestored;
+}
+
+/**************************************************************/
+/* CALSNAP_AUTOSAVE                                           */
+/*  - Save once sections have been quiet CALSNAP_SAVE_DELAY   */
+/*  - Call periodically from the watchdog                     */
+/**************************************************************/
+void calsnap_autosave(sm_t *sm_p){
+  static double tchange=0;
+  double t;
+  uint32 seq;
+  int sec,changed=0;
+
+  for(sec=0;sec<CALSNAP_NSECTION;sec++){
+    seq = calsnap_seq(sm_p,sec);
+    if(seq && seq != sm_p->calsnap.saved[sec]) changed = 1;
+  }
+  if(!changed){
+    tchange = 0;
+    return;
+  }
+  t = calsnap_now();
+  if(tchange == 0) tchange = t;
+  if((t - tchange) >= CALSNAP_SAVE_DELAY){
+    calsnap_save(sm_p);
+    tchange = 0;
+  }
+}
+
+/**************************************************************/
+/* CALSNAP_CLEAR                                              */
+/*  - Delete the snapshot, next boot is a cold start          */
+/**************************************************************/
+void calsnap_clear(void){
+  if(unlink(CALSNAP_FILE))
+    perror("CSN: unlink");
+  else
+    printf("CSN: Deleted %s\n",CALSNAP_FILE);
+}
+
+/**************************************************************/
+/* CALSNAP_MARK                                               */
+/*  - Record startup timing events                            */
+/*  - Only the first event of each kind is kept               */
+/**************************************************************/
+void calsnap_mark(sm_t *sm_p, int id, int event){
+  volatile calsnap_t *snap = &sm_p->calsnap;
+  const char *start;
+  int sec,nrestored=0;
+
+  //Skip events already recorded, this runs every frame
+  if(event == CALSNAP_EVENT_FRAME && snap->tframe[id] != 0) return;
+  if(event == CALSNAP_EVENT_LOOP  && snap->tloop[id]  != 0) return;
+
+  for(sec=0;sec<CALSNAP_NSECTION;sec++)
+    nrestored += snap->restored[sec];
+  start = nrestored ? "warm" : "cold";
+
+  switch(event){
+  case CALSNAP_EVENT_BOOT:
+    snap->tboot = calsnap_now();
+    break;
+  case CALSNAP_EVENT_CAL:
+    snap->tcal = calsnap_now();
+    printf("CSN: Calibration ready %.0f ms after boot (%s)\n",(snap->tcal-snap->tboot)*1000,start);
+    break;
+  case CALSNAP_EVENT_FRAME:
+    snap->tframe[id] = calsnap_now();
+    printf("CSN: %s first frame %.0f ms after boot (%s)\n",sm_p->w[id].name,(snap->tframe[id]-snap->tboot)*1000,start);
+    break;
+  case CALSNAP_EVENT_LOOP:
+    snap->tloop[id] = calsnap_now();
+    printf("CSN: %s first DM command %.0f ms after boot (%s)\n",sm_p->w[id].name,(snap->tloop[id]-snap->tboot)*1000,start);
+    break;
+  }
+}
+
+/**************************************************************/
+/* CALSNAP_STATUS                                             */
+/*  - Print snapshot sections and startup timing              */
+/**************************************************************/
+void calsnap_status(sm_t *sm_p){
+  volatile calsnap_t *snap = &sm_p->calsnap;
+  struct stat st;
+  int sec,i;
+
+  if(stat(CALSNAP_FILE,&st))
+    printf("CSN: %s not found\n",CALSNAP_FILE);
+  else
+    printf("CSN: %s %ld bytes\n",CALSNAP_FILE,(long)st.st_size);
+  for(sec=0;sec<CALSNAP_NSECTION;sec++)
+    printf("CSN: %-9s seq %-5u saved %-5u %s\n",calsnap_name[sec],calsnap_seq(sm_p,sec),snap->saved[sec],
+	   snap->restored[sec] ? "restored" : (calsnap_seq(sm_p,sec) ? "built" : "empty"));
+  if(snap->tcal) printf("CSN: Calibration ready %8.0f ms\n",(snap->tcal-snap->tboot)*1000);
+  for(i=0;i<NCLIENTS;i++){
+    if(snap->tframe[i] == 0 && snap->tloop[i] == 0) continue;
+    printf("CSN: %s first frame %8.0f ms",sm_p->w[i].name,snap->tframe[i] ? (snap->tframe[i]-snap->tboot)*1000 : 0);
+    if(snap->tloop[i]) printf(", first DM command %8.0f ms",(snap->tloop[i]-snap->tboot)*1000);
+    printf("\n");
+  }
+}
@@ -0,0 +1,16 @@
+#ifndef _CALSNAP
+#define _CALSNAP
+
+//Function prototypes
+uint64 calsnap_checksum(const void *buf, uint64 nbytes);
+void   calsnap_stamp(const char *file, filestamp_t *stamp);
+int    calsnap_get(sm_t *sm_p, int sec, void *dst);
+void   calsnap_put(sm_t *sm_p, int sec, const void *src);
+int    calsnap_save(sm_t *sm_p);
+int    calsnap_restore(sm_t *sm_p);
+void   calsnap_autosave(sm_t *sm_p);
+void   calsnap_clear(void);
+void   calsnap_mark(sm_t *sm_p, int id, int event);
+void   calsnap_status(sm_t *sm_p);
+
+#endif
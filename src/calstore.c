@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/* piccflight headers */
+#include "controller.h"
+#include "common_functions.h"
+#include "calstore.h"
+#include "calsnap.h"
+
+/* Calibration matrix store
+ *
+ *  - Each matrix is loaded from disk once by the watchdog into the
+ *    calstore section of shared memory. Processes copy from the store
+ *    on init and reset instead of re-reading the files.
+ *  - Every matrix has CAL_NSLOT slots. A new version is written into
+ *    the inactive slot and then made active, so readers never see a
+ *    partially written matrix.
+ *  - The watchdog is the only writer (startup and cal commands).
+ *  - Readers compare cal_version() with the version they last copied
+ *    to pick up hot-swapped matrices.
+ */
+
+//Matrix table (order must match CAL_* ids)
+typedef struct caldef_struct{
+  char   *name;     //command name
+  char   *file;     //calibration file
+  uint64 maxbytes;  //maximum matrix size
+} caldef_t;
+
+static const caldef_t caldef[CAL_NMATRIX] = {
+  {"shkzer2alpact", SHKZER2ALPACT_FILE, LOWFS_N_ZERNIKE*ALP_NACT*sizeof(double)},
+  {"shkzer2hexact", SHKZER2HEXACT_FILE, LOWFS_N_HEX_ZERNIKE*HEX_NAXES*sizeof(double)},
+  {"shkcel2alpact", SHKCEL2ALPACT_FILE, 2*SHK_BEAM_NCELLS*ALP_NACT*sizeof(double)},
+  {"lytpix2alpzer", LYTPIX2ALPZER_FILE, LYTXS*LYTYS*LOWFS_N_ZERNIKE*sizeof(double)}};
+
+//Attached store (NULL --> read directly from disk)
+static calstore_t *calstore = NULL;
+
+/**************************************************************/
+/* CAL_OFFSET                                                 */
+/*  - Return pool offset of a matrix slot in doubles          */
+/**************************************************************/
+static uint64 cal_offset(int id, int slot){
+  uint64 offset=0;
+  int i;
+  for(i=0;i<id;i++)
+    offset += CAL_NSLOT*CAL_ALIGN(caldef[i].maxbytes/sizeof(double));
+  return offset + slot*CAL_ALIGN(caldef[id].maxbytes/sizeof(double));
+}
+
+/**************************************************************/
+/* CAL_NBYTES                                                 */
+/*  - Return expected matrix file size, 0 on error            */
+/*  - lytpix2alpzer has LOWFS_N_ZERNIKE values per pixel set  */
+/*    in the LYT pixel mask                                   */
+/**************************************************************/
+static uint64 cal_nbytes(int id){
+  uint16 pxmask[LYTXS][LYTYS];
+  uint64 npix=0;
+  int i,j;
+
+  //Fixed size matrices
+  if(id != CAL_LYTPIX2ALPZER)
+    return caldef[id].maxbytes;
+
+  //Count controlled pixels
+  if(read_file(LYTPIX2ALPZER_PXMASK_FILE,&pxmask[0][0],sizeof(pxmask)))
+    return 0;
+  for(i=0;i<LYTXS;i++)
+    for(j=0;j<LYTYS;j++)
+      if(pxmask[i][j])
+	npix++;
+  if(npix == 0)
+    printf("CAL: Empty pixel mask: %s\n",LYTPIX2ALPZER_PXMASK_FILE);
+  return npix*LOWFS_N_ZERNIKE*sizeof(double);
+}
+
+/**************************************************************/
+/* CAL_ATTACH                                                 */
+/*  - Attach this process to the shared memory store          */
+/**************************************************************/
+void cal_attach(sm_t *sm_p){
+  calstore = (calstore_t *)&sm_p->calstore;
+}
+
+/**************************************************************/
+/* CAL_NAME                                                   */
+/*  - Return matrix name                                      */
+/**************************************************************/
+const char *cal_name(int id){
+  if(id < 0 || id >= CAL_NMATRIX) return "unknown";
+  return caldef[id].name;
+}
+
+/**************************************************************/
+/* CAL_FILE                                                   */
+/*  - Return matrix file                                      */
+/**************************************************************/
+const char *cal_file(int id){
+  if(id < 0 || id >= CAL_NMATRIX) return "unknown";
+  return caldef[id].file;
+}
+
+/**************************************************************/
+/* CAL_LOOKUP                                                 */
+/*  - Return matrix id from name, -1 if not found             */
+/**************************************************************/
+int cal_lookup(char *name){
+  int i;
+  for(i=0;i<CAL_NMATRIX;i++)
+    if(!strncasecmp(name,caldef[i].name,strlen(caldef[i].name)))
+      return i;
+  return -1;
+}
+
+/**************************************************************/
+/* CAL_LOAD                                                   */
+/*  - Load matrix file into the inactive slot and swap        */
+/*  - The active version is untouched on error                */
+/*  - Return 1 on error, 0 on success                         */
+/**************************************************************/
+int cal_load(int id){
+  FILE   *fd=NULL;
+  uint64 fsize,nbytes;
+  double *dst;
+  int    slot;
+  filestamp_t stamp;
+
+  //Check arguments
+  if(id < 0 || id >= CAL_NMATRIX){
+    printf("CAL: Bad matrix id %d\n",id);
+    return 1;
+  }
+  if(calstore == NULL){
+    printf("CAL: Store not attached\n");
+    return 1;
+  }
+  if(cal_offset(CAL_NMATRIX,0) > CAL_POOL_NDOUBLES){
+    printf("CAL: Pool too small %lu > %d\n",cal_offset(CAL_NMATRIX,0),CAL_POOL_NDOUBLES);
+    return 1;
+  }
+
+  //Expected size
+  if((nbytes = cal_nbytes(id)) == 0 || nbytes > caldef[id].maxbytes){
+    printf("CAL: Bad expected size %lu (max %lu): %s\n",nbytes,caldef[id].maxbytes,caldef[id].name);
+    return 1;
+  }
+
+  //Stamp the file before reading, a file changed during the read
+  //then fails the snapshot check instead of passing it
+  calsnap_stamp(caldef[id].file,&stamp);
+
+  //Open file
+  if((fd = fopen(caldef[id].file,"r")) == NULL){
+    perror("CAL: fopen");
+    printf("CAL: %s\n",caldef[id].file);
+    return 1;
+  }
+
+  //Check file size
+  fseek(fd, 0L, SEEK_END);
+  fsize = ftell(fd);
+  rewind(fd);
+  if(fsize != nbytes){
+    printf("CAL: Bad file size %lu != %lu: %s\n",fsize,nbytes,caldef[id].file);
+    fclose(fd);
+    return 1;
+  }
+
+  //Select slot
+  slot = calstore->version[id] ? !calstore->active[id] : calstore->active[id];
+  dst  = &calstore->pool[cal_offset(id,slot)];
+
+  //Read matrix
+  if(fread(dst,fsize,1,fd) != 1){
+    perror("CAL: fread");
+    printf("CAL: %s\n",caldef[id].file);
+    fclose(fd);
+    return 1;
+  }
+  fclose(fd);
+
+  //Swap: publish data before the slot, and the slot before the version
+  calstore->nbytes[id][slot] = fsize;
+  calstore->stamp[id] = stamp;
+  __sync_synchronize();
+  calstore->active[id] = slot;
+  __sync_synchronize();
+  calstore->version[id]++;
+  calstore->generation++;
+
+  printf("CAL: Loaded %s v%u (%lu bytes)\n",caldef[id].name,calstore->version[id],fsize);
+  return 0;
+}
+
+/**************************************************************/
+/* CAL_LOAD_ALL                                               */
+/*  - Load all matrix files                                   */
+/*  - Return number of errors                                 */
+/**************************************************************/
+int cal_load_all(void){
+  int i,nerr=0;
+  for(i=0;i<CAL_NMATRIX;i++)
+    nerr += cal_load(i);
+  return nerr;
+}
+
+/**************************************************************/
+/* CAL_VERSION                                                */
+/*  - Return current matrix version (0 = not loaded)          */
+/**************************************************************/
+uint32 cal_version(int id){
+  if(calstore == NULL || id < 0 || id >= CAL_NMATRIX) return 0;
+  return calstore->version[id];
+}
+
+/**************************************************************/
+/* CAL_MATRIX                                                 */
+/*  - Return read-only handle to the active matrix            */
+/*  - Handle is valid until the next swap of this matrix,     */
+/*    check cal_version() against *version before trusting   */
+/*    data read through it                                    */
+/**************************************************************/
+const double *cal_matrix(int id, uint64 *nbytes, uint32 *version){
+  int slot;
+  if(calstore == NULL || id < 0 || id >= CAL_NMATRIX) return NULL;
+  *version = calstore->version[id];
+  __sync_synchronize();
+  slot     = calstore->active[id];
+  *nbytes  = calstore->nbytes[id][slot];
+  if(*version == 0) return NULL;
+  return &calstore->pool[cal_offset(id,slot)];
+}
+
+/**************************************************************/
+/* CAL_READ                                                   */
+/*  - Copy active matrix into caller array                    */
+/*  - Falls back to the file when no store is attached        */
+/*  - Return 1 on error, 0 on success                         */
+/**************************************************************/
+int cal_read(int id, double *dst, uint64 nbytes, uint32 *version){
+  const double *src;
+  uint64 size;
+
+  //Read from disk
+  if(calstore == NULL){
+    *version = 0;
+    return read_file(caldef[id].file,dst,nbytes);
+  }
+
+  //Copy from store, retry if swapped during the copy
+  do{
+    if((src = cal_matrix(id,&size,version)) == NULL){
+      printf("CAL: %s not loaded\n",cal_name(id));
+      return 1;
+    }
+    if(size != nbytes){
+      printf("CAL: %s size %lu != %lu\n",cal_name(id),size,nbytes);
+      return 1;
+    }
+    memcpy(dst,src,nbytes);
+    __sync_synchronize();
+  }while(*version != calstore->version[id]);
+
+  return 0;
+}
+
+/**************************************************************/
+/* CAL_STATUS                                                 */
+/*  - Print store contents                                    */
+/**************************************************************/
+void cal_status(void){
+  int i;
+  if(calstore == NULL){
+    printf("CAL: Store not attached\n");
+    return;
+  }
+  printf("CAL: Generation %u\n",calstore->generation);
+  for(i=0;i<CAL_NMATRIX;i++)
+    printf("CAL: %-14s v%-4u slot %d %7lu bytes  %s\n",caldef[i].name,calstore->version[i],
+	   calstore->active[i],calstore->nbytes[i][calstore->active[i]],caldef[i].file);
+}
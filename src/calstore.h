@@ -0,0 +1,16 @@
+#ifndef _CALSTORE
+#define _CALSTORE
+
+//Function prototypes
+void          cal_attach(sm_t *sm_p);
+const char   *cal_name(int id);
+const char   *cal_file(int id);
+int           cal_lookup(char *name);
+int           cal_load(int id);
+int           cal_load_all(void);
+uint32        cal_version(int id);
+const double *cal_matrix(int id, uint64 *nbytes, uint32 *version);
+int           cal_read(int id, double *dst, uint64 nbytes, uint32 *version);
+void          cal_status(void);
+
+#endif
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/* piccflight headers */
+#include "controller.h"
+#include "handle_command.h"
+#include "cmd_table.h"
+
+/* Command dispatch table
+ *
+ *  - handle_command registers a table of commands at startup. The names
+ *    are compiled into a character trie so the lookup cost depends only
+ *    on the length of the command, not on its position in the list.
+ *  - The longest registered name that ends on a word boundary wins, so
+ *    "shk target reset" and "shk target" can both be registered.
+ *  - Arguments are parsed by one shared parser from the entry schema
+ *    before the handler is called. State and commander restrictions are
+ *    checked here too.
+ *  - Lines that match no entry return CMD_NOT_FOUND and fall through to
+ *    the legacy strncasecmp chain in handle_command.
+ */
+
+//Trie node
+typedef struct cmdnode_struct{
+  char c;      //character (lower case)
+  int  child;  //first child node (-1 = none)
+  int  next;   //next sibling node (-1 = none)
+  int  entry;  //table entry ending here (-1 = none)
+} cmdnode_t;
+
+static cmdnode_t cmdtrie[CMD_TRIE_NODES];
+static int       cmdnnode=0;
+static cmdent_t *cmdtable=NULL;
+static int       cmdntable=0;
+
+//Commander names for messages
+static const char *cmdrname[] = {"", "ALP", "HEX", "BMC", "TGT"};
+
+//Word boundary after a command name
+#define CMD_ENDWORD(c) ((c) == 0 || (c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r')
+
+/**************************************************************/
+/* CMD_NODE                                                   */
+/*  - Allocate a trie node                                    */
+/**************************************************************/
+static int cmd_node(char c){
+  if(cmdnnode == CMD_TRIE_NODES) return -1;
+  cmdtrie[cmdnnode].c     = c;
+  cmdtrie[cmdnnode].child = -1;
+  cmdtrie[cmdnnode].next  = -1;
+  cmdtrie[cmdnnode].entry = -1;
+  return cmdnnode++;
+}
+
+/**************************************************************/
+/* CMD_TABLE_INIT                                             */
+/*  - Compile command table into the lookup trie              */
+/*  - Return 1 on error, 0 on success                         */
+/**************************************************************/
+int cmd_table_init(cmdent_t *table, int ntable){
+  int i,node,child;
+  char *p,c;
+
+  cmdnnode  = 0;
+  cmdtable  = table;
+  cmdntable = 0;
+  cmd_node(0);
+
+  for(i=0;i<ntable;i++){
+    node = 0;
+    for(p=table[i].name;*p;p++){
+      c = tolower(*p);
+      for(child=cmdtrie[node].child;child >= 0 && cmdtrie[child].c != c;child=cmdtrie[child].next);
+      if(child < 0){
+	if((child = cmd_node(c)) < 0){
+	  printf("CMD: Command trie full (%d nodes)\n",CMD_TRIE_NODES);
+	  return 1;
+	}
+	cmdtrie[child].next = cmdtrie[node].child;
+	cmdtrie[node].child = child;
+      }
+      node = child;
+    }
+    if(cmdtrie[node].entry >= 0){
+      printf("CMD: Duplicate command: %s\n",table[i].name);
+      return 1;
+    }
+    cmdtrie[node].entry = i;
+  }
+  cmdntable = ntable;
+  return 0;
+}
+
+/**************************************************************/
+/* CMD_LOOKUP                                                 */
+/*  - Return table index of the command in line, -1 if none   */
+/**************************************************************/
+int cmd_lookup(char *line){
+  int node=0,child,match=-1;
+  char *p;
+
+  if(cmdntable == 0) return -1;
+  for(p=line;*p;p++){
+    for(child=cmdtrie[node].child;child >= 0 && cmdtrie[child].c != tolower(*p);child=cmdtrie[child].next);
+    if(child < 0) break;
+    node = child;
+    if(cmdtrie[node].entry >= 0 && CMD_ENDWORD(p[1]))
+      match = cmdtrie[node].entry;
+  }
+  return match;
+}
+
+/**************************************************************/
+/* CMD_USAGE                                                  */
+/*  - Print command usage from the argument schema            */
+/**************************************************************/
+static void cmd_usage(cmdent_t *ent){
+  char *p;
+  printf("CMD: Bad command format. Usage: %s",ent->name);
+  for(p=ent->args;*p;p++){
+    if(*p == 'i') printf(" <int>");
+    if(*p == 'f') printf(" <float>");
+    if(*p == 's') printf(" <name>");
+  }
+  printf("\n");
+}
+
+/**************************************************************/
+/* CMD_PARSE                                                  */
+/*  - Parse arguments in rest per schema into arg[]           */
+/*  - Words are copied into buf                               */
+/*  - Return 1 on error, 0 on success                         */
+/**************************************************************/
+static int cmd_parse(char *rest, char *schema, cmdarg_t *arg, char *buf){
+  char *pch,*end,*save=NULL;
+  int n;
+
+  strncpy(buf,rest,CMD_MAX_LENGTH-1);
+  buf[CMD_MAX_LENGTH-1] = 0;
+  pch = strtok_r(buf," \t\r\n",&save);
+  for(n=0;schema[n];n++){
+    if(pch == NULL || n == CMD_MAX_ARGS) return 1;
+    switch(schema[n]){
+    case 'i':
+      arg[n].i = strtol(pch,&end,0);
+      arg[n].f = arg[n].i;
+      if(*end) return 1;
+      break;
+    case 'f':
+      arg[n].f = strtod(pch,&end);
+      arg[n].i = arg[n].f;
+      if(*end) return 1;
+      break;
+    case 's':
+      break;
+    default:
+      return 1;
+    }
+    arg[n].s = pch;
+    pch = strtok_r(NULL," \t\r\n",&save);
+  }
+  return 0;
+}
+
+/**************************************************************/
+/* CMD_DISPATCH                                               */
+/*  - Run a table command                                     */
+/*  - Return handler result, CMD_NOT_FOUND if not in table    */
+/**************************************************************/
+int cmd_dispatch(char *line, sm_t *sm_p){
+  cmdarg_t arg[CMD_MAX_ARGS];
+  char buf[CMD_MAX_LENGTH];
+  cmdent_t *ent;
+  state_t *state;
+  char *rest;
+  int index,cmdr=WATID;
+
+  //Find command
+  if((index = cmd_lookup(line)) < 0)
+    return(CMD_NOT_FOUND);
+  ent   = &cmdtable[index];
+  rest  = line + strlen(ent->name);
+  state = (state_t *)&sm_p->state_array[sm_p->state];
+
+  //Check state
+  if(ent->states != CMD_STATE_ANY && !(ent->states & CMD_STATE(sm_p->state))){
+    printf("CMD: %s not allowed in state %s\n",ent->name,state->name);
+    return(CMD_NORMAL);
+  }
+
+  //Check commander
+  if(ent->cmdr == CMD_CMDR_ALP) cmdr = state->alp_commander;
+  if(ent->cmdr == CMD_CMDR_HEX) cmdr = state->hex_commander;
+  if(ent->cmdr == CMD_CMDR_BMC) cmdr = state->bmc_commander;
+  if(ent->cmdr == CMD_CMDR_TGT) cmdr = state->tgt_commander;
+  if(cmdr != WATID){
+    printf("CMD: Manual %s control disabled in this state\n",cmdrname[ent->cmdr]);
+    return(CMD_NORMAL);
+  }
+
+  //Parse arguments
+  memset(arg,0,sizeof(arg));
+  if(cmd_parse(rest,ent->args,arg,buf)){
+    cmd_usage(ent);
+    return(CMD_NORMAL);
+  }
+
+  //Run handler
+  return ent->func(rest,arg,sm_p);
+}
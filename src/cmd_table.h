@@ -0,0 +1,36 @@
+#ifndef _CMD_TABLE
+#define _CMD_TABLE
+
+#define CMD_MAX_ARGS      4      //max arguments per table command
+#define CMD_TRIE_NODES    4096   //command trie node pool
+#define CMD_STATE_ANY     0      //no state restriction
+#define CMD_STATE(s)      (1U << (s))
+
+//Commander required to run a command
+enum cmdrs {CMD_CMDR_NONE, CMD_CMDR_ALP, CMD_CMDR_HEX, CMD_CMDR_BMC, CMD_CMDR_TGT};
+
+//Parsed argument
+typedef struct cmdarg_struct{
+  int    i;  //schema 'i'
+  double f;  //schema 'f'
+  char  *s;  //schema 's'
+} cmdarg_t;
+
+//Command handler (rest = line after the command name)
+typedef int (*cmdfunc_t)(char *rest, cmdarg_t *arg, sm_t *sm_p);
+
+//Command table entry
+typedef struct cmdent_struct{
+  char      *name;    //command name
+  char      *args;    //argument schema: i=int, f=double, s=word
+  cmdfunc_t  func;    //handler
+  uint32     states;  //allowed states (CMD_STATE_ANY or CMD_STATE() mask)
+  int        cmdr;    //required commander (CMD_CMDR_*)
+} cmdent_t;
+
+//Function prototypes
+int cmd_table_init(cmdent_t *table, int ntable);
+int cmd_lookup(char *line);
+int cmd_dispatch(char *line, sm_t *sm_p);
+
+#endif
@@ -26,6 +26,7 @@
 /* piccflight headers */
 #include "controller.h"
 #include "common_functions.h"
+#include "calstore.h"
 
 
 
@@ -54,6 +55,9 @@ sm_t *openshm(int *mainfd){
     return NULL;
   }
 
+  /* attach calibration matrix store */
+  cal_attach(sm_p);
+
   /* on success, return the shared memory pointer */
   return sm_p;
   
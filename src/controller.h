@@ -74,12 +74,15 @@ typedef int8_t int8;
 #define REBOOT    "REBOOT...REBOOT...REBOOT...REBOOT\n"
 #define EXIT_TIMEOUT    25  //procwait exit timeout
 #define PROC_TIMEOUT    5   //procwait process timeout
+#define WAT_TICK_PERIOD     0.1 //[s] watchdog control flag polling period
+#define WAT_RESTART_HOLDOFF 1.0 //[s] minimum time between launches of a process
+#define WAT_MAX_EVENTS      32  //watchdog events handled per wakeup
 #define ERASE_TIMEOUT   25  //Time to wait for TLM to exit on command: erase flight data
 
 /*************************************************
  * Process ID Numbers
  *************************************************/
-enum procids {WATID, SCIID, SHKID, LYTID, TLMID, ACQID, MTRID, THMID, MSGID, DIAID, NCLIENTS};
+enum procids {WATID, SCIID, SHKID, LYTID, TLMID, ACQID, MTRID, THMID, MSGID, DIAID, HEXID, NCLIENTS};
 
 /*************************************************
  * States
@@ -129,6 +132,11 @@ enum hexcalmodes {HEX_CALMODE_NONE,
 		  HEX_CALMODE_SPIRAL,
 		  HEX_NCALMODES};
 
+enum hexreqs {HEX_REQ_MOVE,
+	      HEX_REQ_INIT,
+	      HEX_REQ_ERROR,
+	      HEX_NREQS};
+
 enum tgtcalmodes {TGT_CALMODE_NONE,
 		  TGT_CALMODE_ZPOKE,
 		  TGT_CALMODE_ZRAMP,
@@ -240,6 +248,7 @@ enum scioptmodes {SCI_OPTMODE_STEEPEST_DESCENT,
 #define SCI_FAKE_PROBE_FILE    "config/sci_fakedata_probe_%d.dat"
 #define SCI_DARK_FILE          "config/sci_dark_%d.dat"
 #define SCI_BIAS_FILE          "config/sci_bias_%d.dat"
+#define SCI_FLAT_FILE          "config/sci_flat.dat"
 #define SCI_PHASE_TARGET_A_FILE "config/sci_phase_target_a.dat"
 #define SCI_PHASE_TARGET_B_FILE "config/sci_phase_target_b.dat"
 #define SCI_PHASE_TARGET_C_FILE "config/sci_phase_target_c.dat"
@@ -311,7 +320,8 @@ enum bufids {BUFFER_SCIEVENT, BUFFER_SHKEVENT,
 	     BUFFER_THMEVENT, BUFFER_MTREVENT,
 	     BUFFER_SHKPKT,   BUFFER_LYTPKT,
 	     BUFFER_SHKFULL,  BUFFER_ACQFULL,
-	     BUFFER_WFSEVENT, BUFFER_MSGEVENT, NCIRCBUF};
+	     BUFFER_WFSEVENT, BUFFER_MSGEVENT,
+	     BUFFER_FRMEVENT, NCIRCBUF};
 
 #define SCIEVENTSIZE     5
 #define SHKEVENTSIZE     20
@@ -325,6 +335,7 @@ enum bufids {BUFFER_SCIEVENT, BUFFER_SHKEVENT,
 #define ACQFULLSIZE      5
 #define WFSEVENTSIZE     5
 #define MSGEVENTSIZE     100
+#define FRMEVENTSIZE     10
 
 /*************************************************
  * LOWFS Settings
@@ -379,6 +390,50 @@ enum bufids {BUFFER_SCIEVENT, BUFFER_SHKEVENT,
 #define SHK_FULL_IMAGE_TIME   0.5    //[seconds] period that full images are written to circbuf
 #define ACQ_FULL_IMAGE_TIME   0.0    //[seconds] period that full images are written to circbuf
 
+/*************************************************
+ * Image Transfer
+ *************************************************/
+#define IMG_TILE              64     //[pixels] cache tile edge for image transposes
+
+/*************************************************
+ * Frame Accounting
+ *************************************************/
+#define FRM_SKIP_LOCK         0      //command lock held by another process
+#define FRM_SKIP_DECIMATE     1      //frame not used at the configured rate
+#define FRM_SKIP_ERROR        2      //processing error
+#define FRM_NSKIP             3
+#define FRM_EVENT_TIME        1.0    //[seconds] period that frmevents are written to circbuf
+#define FRM_MAX_GAP           100000 //[frames] larger sequence jumps are counter restarts
+
+/*************************************************
+ * Synthetic Frames (FAKEMODE_ZERNIKE & FAKEMODE_PLANT)
+ *************************************************/
+#define FAKE_SPOT_SIGMA       3.0    //[pixels] SHK spot gaussian sigma (unbinned)
+#define FAKE_SPOT_NSIGMA      4      //[sigma] SHK spot render half width
+#define FAKE_PHOTON_GAIN      1.0    //[photons/ADU] shot noise scale
+#define FAKE_NOISE_NPOOL      262144 //unit normal samples drawn once (power of 2, >= SHKXS*SHKYS)
+#define FAKE_ZERNIKE_MAX      2.0    //[microns] largest fake zernike coefficient
+#define FAKE_FLUX_MAX         65535  //[ADU] largest fake peak
+#define FAKE_NOISE_MAX        100    //[ADU] largest fake read noise
+#define FAKE_SCI_PEAK         1.0e6  //[ADU/s] unocculted SCI star peak
+#define FAKE_SCI_SIGMA        2.0    //[pixels] SCI star gaussian sigma
+#define FAKE_SCI_LEAK         1.0e-3 //SCI coronagraph core leak fraction
+#define FAKE_SCI_CONTRAST     1.0e-6 //SCI static halo contrast
+#define FAKE_SCI_HALO         20.0   //[pixels] SCI halo e-folding radius
+#define FAKE_SCI_LAMBDA       0.6    //[microns] SCI wavelength
+#define FAKE_SCI_TT_SCALE     10.0   //[pixels/micron] SCI image motion per tip/tilt zernike
+
+/*************************************************
+ * Optical Plant (FAKEMODE_PLANT, make PLANTSIM=1)
+ *************************************************/
+#define PLANT_ALP             0      //DM index for latency statistics
+#define PLANT_BMC             1      //DM index for latency statistics
+#define PLANT_NDM             2
+#define PLANT_BMC_SCALE       0.01   //[microns/V] BMC surface per volt from the flat
+#define PLANT_SPEEDUP_MAX     20.0   //largest simulated frame rate multiple
+#define PLANT_DIST_SCALE_MAX  10.0   //largest disturbance time series scale
+#define PLANT_SINE_AMP_MAX    2.0    //[microns] largest sine disturbance
+
 /*************************************************
  * Camera Exposure Time Limits
  *************************************************/
@@ -459,6 +514,11 @@ enum bufids {BUFFER_SCIEVENT, BUFFER_SHKEVENT,
 #define SHK_XMAX              (SHKXS-1)
 #define SHK_YMIN              0
 #define SHK_YMAX              (SHKYS-1)
+#define SHK_ROI_MARGIN        4  //[binned pixels] readout margin around the beam cells
+#define SHK_ROI_ALIGN         8  //[binned pixels] readout window alignment
+#define SHK_BKG_GLOBAL        0  //background from a fixed detector region
+#define SHK_BKG_LOCAL         1  //background from each cell's own border
+#define SHK_BKG_NFRAMES       10 //frames between local background updates
 #define SHK_BOXSIZE_CMD_STD   0  //use the current runtime boxsize
 #define SHK_BOXSIZE_CMD_MAX   1  //use the maximum boxsize
 #define SHK_ALP_CELL_INT_MAX  1
@@ -487,6 +547,10 @@ enum bufids {BUFFER_SCIEVENT, BUFFER_SHKEVENT,
       0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}
 #define SHK_BEAM_NCELLS 148
 #define SHK_ZFIT_MIN_CELLS 4
+#define SHK_PINV_THRESH_MIN 0.0
+#define SHK_PINV_THRESH_MAX 1.0
+#define SHK_PINV_ALPHA_MIN  0.0
+#define SHK_PINV_ALPHA_MAX  1.0
 
 /*************************************************
  * Lyot-LOWFS Parameters
@@ -503,6 +567,7 @@ enum bufids {BUFFER_SCIEVENT, BUFFER_SHKEVENT,
 #define LYT_YORIGIN_MIN       0
 #define LYT_YORIGIN_MAX       (LYTREADYS-LYTYS)
 #define LYT_PIXEL_THRESH      200 //Maximum pixel threshold for control [ADU]
+#define LYT_SMATRIX_LD        32  //LOWFS_N_ZERNIKE padded to NUM_SGEMV_PAD for float reconstructor (checked in lyt_functions.c)
 #define LYT_MAG_MIN           0.1
 #define LYT_MAG_MAX           10.0
 #define LYT_ROI_MIN           0
@@ -535,6 +600,9 @@ enum bufids {BUFFER_SCIEVENT, BUFFER_SHKEVENT,
 #define SCI_EXP_RETURN_FAIL     1
 #define SCI_EXP_RETURN_KILL     2
 #define SCI_EXP_RETURN_ABORT    3
+#define SCI_EXP_MINSLEEP     1000 //[us] guard added to predicted exposure end
+#define SCI_EXP_MAXSLEEP   100000 //[us] max sleep between exposure status checks
+#define SCI_NFRAMEBUF           2 //number of frame buffers in pipelined mode
 #define SCI_MODE_10MHZ          0
 #define SCI_MODE_1_7MHZ         1
 #define SCI_SEARCH            400 //px search diameter to find star in each band
@@ -579,6 +647,7 @@ enum bufids {BUFFER_SCIEVENT, BUFFER_SHKEVENT,
 #define BMC_NSINE      108
 #define BMC_SPECKLE_AMP  5 //nm
 #define BMC_SPECKLE_DAMP 1 //nm
+#define BMC_ASYNC_TIMEOUT 1.0 //[s] max wait for an asynchronous command
 
 /*************************************************
  * ALPAO DM Parameters
@@ -668,6 +737,15 @@ enum bufids {BUFFER_SCIEVENT, BUFFER_SHKEVENT,
 #define HEX_REF_TIMEOUT   20  //seconds
 #define HEX_MOVE_TIMEOUT  5   //seconds
 #define HEX_PERIOD        0.5 //seconds, time between commands
+#define HEX_QUEUE_SIZE    16    //hexapod request queue length
+#define HEX_ENGINE_SLEEP  10000 //[us] hexapod engine loop sleep
+#define HEX_POLL_PERIOD   0.2   //[s] hexapod position polling period
+#define HEX_SIM_IO_DELAY  2000  //[us] simulated GCS serial round trip
+#define HEX_SIM_VEL_TRL   0.5   //[mm/s] simulated translation velocity
+#define HEX_SIM_VEL_ROT   0.5   //[deg/s] simulated rotation velocity
+#define HEX_SIM_REF_TIME  3.0   //[s] simulated referencing time
+#define HEX_SIM_TRL_LIMIT 20.0  //[mm] simulated translation limit
+#define HEX_SIM_ROT_LIMIT 10.0  //[deg] simulated rotation limit
 
 /*************************************************
  * Target Parameters
@@ -723,6 +801,34 @@ enum bufids {BUFFER_SCIEVENT, BUFFER_SHKEVENT,
 #define HTR_GAIN_MAX       100
 #define HTR_ADC_MIN        1
 #define HTR_ADC_MAX        3
+#define HTR_NSTEPS         100     //PWM resolution (0-100%)
+#define HTR_NCYCLES        10      //PWM cycles per control loop
+#define HTR_STEP_NS        (ONE_BILLION/HTR_NSTEPS/HTR_NCYCLES) //[ns] PWM step (1 ms)
+
+/*************************************************
+ * Thermal ADC Parameters
+ *************************************************/
+#define ADC_NBOARDS        3
+#define ADC_MAX_NCHAN      32      //largest board channel count
+#define ADC_NAVG           10      //scans averaged per temperature reading
+#define ADC_SCAN_RATE      100.0   //[scans/s] hardware scan clock
+#define ADC_FIFO_SCANS     1       //scans per FIFO interrupt
+#define ADC_STALL_TIME     1.0     //[s] restart a scan that stops transferring
+#define ADC_VREF_SENSOR    15      //ADC1 reference resistor channel
+#define MAX_AD_OFFSET      2       //autocal offset tolerance
+#define MAX_AD_GAIN        2       //autocal gain tolerance
+#define AD_CONFIG_MODE     3
+#define AD_RANGE_CODE      3
+#define VREF_DEFAULT       5.0     //volts
+#define ADC1_R1            1000.0  //ohms
+#define ADC2_R1            2000.0  //ohms
+#define ADC3_R1            2000.0  //ohms
+#define RTD_ALPHA          0.00385 //ohms/ohms/degC
+#define RTD_OHMS           100.0   //ohms
+#define ADC_SIM_TEMP       20.0    //[C] simulated mean temperature
+#define ADC_SIM_SWING      2.0     //[C] simulated temperature swing
+#define ADC_SIM_PERIOD     600.0   //[s] simulated temperature period
+#define ADC_SIM_NOISE      0.05    //[C] simulated RTD noise (rms)
 
 /*************************************************
  * Command Uplink Parameters
@@ -730,6 +836,17 @@ enum bufids {BUFFER_SCIEVENT, BUFFER_SHKEVENT,
 #define UPLINK_DEVICE   "/dev/ttyS1"
 #define UPLINK_BAUD     1200
 
+/*************************************************
+ * Command Script Parameters
+ *************************************************/
+#define SCR_PATH          "config/scripts/" //script directory
+#define SCR_MAX_SIZE      16384 //max script size [bytes]
+#define SCR_MAX_STEPS     512   //max script statements
+#define SCR_MAX_DEPTH     8     //max loop nesting
+#define SCR_POLL_PERIOD   0.01  //[s] condition polling period
+#define SCR_WAIT_TIMEOUT  600   //[s] default waitfor/waitframes timeout
+#define SCR_WAIT_MAX      86400 //[s] max wait or timeout
+
 /*************************************************
  * Humidity Sensors
  *************************************************/
@@ -768,7 +885,17 @@ typedef struct procinfo_struct{
   uint32 rec; //# recipts of checkin
   int    cnt; //# missed checkins 
   int    fakemode; //Process fake mode
+  int    precision; //Process reconstructor precision
   void (*launch)(void);
+  //Supervision statistics
+  uint32 nstart;       //# launches
+  uint32 ncrash;       //# unexpected exits
+  uint32 ntimeout;     //# checkin timeouts
+  uint32 nrestart;     //# relaunches after going down
+  double tdown;        //time process went down (0 = up)
+  double restart_last; //last down-to-relaunch time [s]
+  double restart_max;  //max down-to-relaunch time [s]
+  double restart_sum;  //sum of down-to-relaunch times [s]
 } procinfo_t;
 
 /*************************************************
@@ -843,8 +970,13 @@ typedef struct sci_field_struct{
 } sci_field_t;
 
 typedef struct sci_cal{
-  double *dark;
-  double *bias;
+  float  dark[SCI_NBANDS][SCIXS][SCIYS]; //dark cutouts [ADU/s]
+  float  bias[SCI_NBANDS][SCIXS][SCIYS]; //bias cutouts [ADU]
+  float  gain[SCI_NBANDS][SCIXS][SCIYS]; //inverse flat cutouts
+  uint32 xorigin[SCI_NBANDS];            //band origins of cutouts
+  uint32 yorigin[SCI_NBANDS];            //band origins of cutouts
+  int    temp;                           //calibration temperature [C]
+  int    init;                           //cutouts loaded
 } sci_cal_t;
 
 typedef struct shk_struct{
@@ -870,6 +1002,31 @@ typedef struct lytref_struct{
   uint16 pxmask[LYTXS][LYTYS]; //pixel mask
 } lytref_t;
 
+typedef struct lytfit_struct{
+  int    npix;                                //number of controlled pixels
+  int    index[LYTXS*LYTYS];                  //ROI offset of each controlled pixel (row majority to match IDL matrix)
+  double xw[LYTXS*LYTYS];                     //centroid x weight of each controlled pixel
+  double yw[LYTXS*LYTYS];                     //centroid y weight of each controlled pixel
+  double matrix[LYTXS*LYTYS*LOWFS_N_ZERNIKE]; //zernike fitting matrix (column major)
+  float  smatrix[LYTXS*LYTYS*LYT_SMATRIX_LD] __attribute__((aligned(64))); //float fitting matrix (column major, padded)
+  double ref_total;                           //reference image total inside pixel mask
+  double xref;                                //reference image x centroid
+  double yref;                                //reference image y centroid
+  double zref[LOWFS_N_ZERNIKE];               //zernikes of normalized reference image
+  uint32 version;                             //calibration store matrix version
+} lytfit_t;
+
+typedef struct lytmag_struct{
+  int    init;                                //plan has been built
+  double mag;                                 //magnification the plan was built for
+  double xoff;                                //x offset the plan was built for
+  double yoff;                                //y offset the plan was built for
+  int    xorigin;                             //x origin the plan was built for
+  int    yorigin;                             //y origin the plan was built for
+  uint32 index[LYTXS*LYTYS][4];               //readout buffer index of the 4 source pixels
+  double weight[LYTXS*LYTYS][4];              //bilinear weight of the 4 source pixels
+} lytmag_t;
+
 typedef struct acq_struct{
   uint8 data[ACQXS][ACQYS];
 } acq_t;
@@ -892,12 +1049,26 @@ typedef struct hex_struct{
   double zcmd[LOWFS_N_ZERNIKE];
 } hex_t;
 
+typedef struct hexreq_struct{
+  int    type;              //request type (HEX_REQ_*)
+  double acmd[HEX_NAXES];   //move target (scope coords)
+  double post;              //time request was posted [s]
+} hexreq_t;
+
 typedef struct bmc_struct{
   float acmd[BMC_NACT];
   float tcmd[BMC_NTEST];
   float pad;
 } bmc_t;
 
+typedef struct bmctime_struct{
+  uint64 count; //number of timed commands
+  double last;  //last command round trip [s]
+  double min;   //min command round trip [s]
+  double max;   //max command round trip [s]
+  double sum;   //sum of command round trips [s]
+} bmctime_t;
+
 typedef struct tgt_struct{
   double zcmd[LOWFS_N_ZERNIKE];
 } tgt_t;
@@ -926,6 +1097,12 @@ typedef struct htr_struct{
   float padding;
 } htr_t;
 
+typedef struct htrsched_struct{
+  int    nedge;            //port writes per PWM cycle
+  int    step[HTR_NSTEPS]; //PWM step of each edge
+  uint16 word[HTR_NSTEPS]; //heater word from this edge (1 = ON)
+} htrsched_t;
+
 typedef struct hum_struct{
   float humidity;
   float temp;
@@ -1008,6 +1185,7 @@ typedef struct alpcal_struct{
   struct timespec start[ALP_NCALMODES];
   double last_zernike[LOWFS_N_ZERNIKE];
   double zernike_errors[LOWFS_N_ZERNIKE][ZERNIKE_ERRORS_NUMBER];
+  int    zernike_errors_loaded;   //keep after zernike_errors, see alp_init_calibration
 } alpcal_t;
 
 typedef struct bmccal_struct{
@@ -1043,7 +1221,7 @@ typedef struct optmode_struct{
 /*************************************************
  * Packet Header
  *************************************************/
-#define PICC_PKT_VERSION     49  //packet version number
+#define PICC_PKT_VERSION     52  //packet version number
 typedef struct pkthed_struct{
   uint16  version;       //packet version number
   uint16  type;          //packet ID word
@@ -1067,6 +1245,11 @@ typedef struct pkthed_struct{
   uint32  bmc_calstep;   //bmc calstep
   uint32  tgt_calstep;   //tgt calstep
 
+  uint32  frame_seq;     //hardware frame sequence number
+  uint32  frame_drop;    //frames missing from the hardware sequence
+  uint32  frame_skip;    //frames received but not processed
+  uint32  frame_overrun; //frames processed slower than the frame period
+
   int64   start_sec;     //event start time
   int64   start_nsec;    //event start time
   int64   end_sec;       //event end time
@@ -1076,6 +1259,13 @@ typedef struct pkthed_struct{
 /*************************************************
  * Event Structures
  *************************************************/
+typedef struct shkroi_struct{
+  int32     xoff;   //[binned pixels] readout window X offset
+  int32     yoff;   //[binned pixels] readout window Y offset
+  int32     xs;     //[binned pixels] readout window X size
+  int32     ys;     //[binned pixels] readout window Y size
+} shkroi_t;
+
 typedef struct shkcell_struct{
   uint16    spot_found;
   uint16    spot_captured;
@@ -1145,7 +1335,7 @@ typedef struct shkpkt_struct{
   float     hex_acmd[HEX_NAXES];
   float     hex_zcmd[LOWFS_N_ZERNIKE];
   uint8     zernike_control[LOWFS_N_ZERNIKE];
-  uint8     padding1;
+  uint8     background_mode;
   uint32    nsamples;
 } shkpkt_t;
 
@@ -1208,6 +1398,8 @@ typedef struct scievent_struct{
   uint16       speckle_pixel;
   float        speckle_brightness;
   float        phasemerit;
+  float        readtime;      //camera readout time [s]
+  float        dutycycle;     //exposure time / frame time
   uint32       xorigin[SCI_NBANDS];
   uint32       yorigin[SCI_NBANDS];
   double       refmax[SCI_NBANDS];       
@@ -1247,11 +1439,69 @@ typedef struct mtrevent_struct{
   uint16_t  door_status[MTR_NDOORS];
 } mtrevent_t;
 
+typedef struct frmstat_struct{
+  uint64    nframes;              //frames delivered to the callback
+  uint64    nprocessed;           //frames fully processed
+  uint64    ndropped;             //frames missing from the hardware sequence
+  uint64    ngaps;                //sequence gaps
+  uint64    nlost;                //grabber frame lost & FIFO overflow interrupts
+  uint64    nskip[FRM_NSKIP];     //frames received but not processed (FRM_SKIP_*)
+  uint64    noverrun;             //frames processed slower than the frame period
+  uint64    nrestart;             //camera restarts
+  uint32    seq;                  //last hardware frame sequence number
+  uint32    gap_max;              //largest sequence gap [frames]
+  double    proc_time;            //last processing time [s]
+  double    proc_time_max;        //maximum processing time [s]
+  double    rate;                 //processed frame rate over the last FRM_EVENT_TIME [Hz]
+} frmstat_t;
+
+typedef struct fakecfg_struct{
+  double    zernike[LOWFS_N_ZERNIKE]; //[microns] wavefront error
+  double    shk_flux;             //[ADU] SHK spot peak
+  double    lyt_flux;             //[ADU] LYT reference image peak (0 = reference as is)
+  double    read_noise;           //[ADU] rms read noise
+  double    background;           //[ADU] background at the window center
+  double    xgradient;            //[ADU/pixel] background x slope
+  double    ygradient;            //[ADU/pixel] background y slope
+  double    dropout;              //fraction of SHK spots missing from each frame
+} fakecfg_t;
+
+typedef struct plantcfg_struct{
+  double    speedup;              //PLANTSIM frame rate multiple, also the disturbance clock rate
+  double    dist_scale;           //ZERNIKE_ERRORS_FILE disturbance scale (0 = off)
+  int       sine_zernike;         //sine disturbance zernike (-1 = off)
+  double    sine_amp;             //[microns] sine disturbance amplitude
+  double    sine_freq;            //[Hz] sine disturbance frequency on the disturbance clock
+} plantcfg_t;
+
+typedef struct plantstat_struct{
+  double    tstart;                        //[s] disturbance clock start (CLOCK_MONOTONIC)
+  double    treset;                        //[s] statistics start (CLOCK_MONOTONIC)
+  uint64    nsample;                       //wavefront samples
+  double    dist_ss[LOWFS_N_ZERNIKE];      //[um^2] disturbance sum of squares
+  double    resid_ss[LOWFS_N_ZERNIKE];     //[um^2] residual sum of squares
+  double    tframe[NCLIENTS];              //[s] last plant frame rendered by each process
+  double    tcount[PLANT_NDM];             //[s] frame time of the last timed command
+  uint64    ncmd[PLANT_NDM];               //timed DM commands
+  double    latency[PLANT_NDM];            //[s] last frame to command latency
+  double    latency_sum[PLANT_NDM];        //[s] latency sum
+  double    latency_max[PLANT_NDM];        //[s] maximum latency
+  int       pid0[NCLIENTS];                //process ID at reset
+  double    cpu0[NCLIENTS];                //[s] process CPU time at reset
+} plantstat_t;
+
 typedef struct msgevent_struct{
   pkthed_t  hed;
   char      message[MAX_LINE];
 } msgevent_t;
 
+typedef struct frmevent_struct{
+  pkthed_t  hed;
+  uint32    procid;
+  uint32    padding;
+  frmstat_t stat;
+} frmevent_t;
+
 /*************************************************
  * Full Frame Structures
  *************************************************/
@@ -1283,6 +1533,141 @@ typedef struct circbuf_struct{
   char   name[128]; //name of buffer
 } circbuf_t;
 
+/*************************************************
+ * Calibration Matrix Store
+ *************************************************/
+#define CAL_SHKZER2ALPACT   0
+#define CAL_SHKZER2HEXACT   1
+#define CAL_SHKCEL2ALPACT   2
+#define CAL_LYTPIX2ALPZER   3
+#define CAL_NMATRIX         4
+#define CAL_NSLOT           2 //slots per matrix for hot-swap
+#define CAL_ALIGN(n)        ((((n)+7)/8)*8) //round number of doubles to 64 bytes
+#define CAL_POOL_NDOUBLES   (CAL_NSLOT*(CAL_ALIGN(LOWFS_N_ZERNIKE*ALP_NACT)       + \
+				    CAL_ALIGN(LOWFS_N_HEX_ZERNIKE*HEX_NAXES)   + \
+				    CAL_ALIGN(2*SHK_BEAM_NCELLS*ALP_NACT)      + \
+				    CAL_ALIGN(LYTXS*LYTYS*LOWFS_N_ZERNIKE)))
+
+typedef struct filestamp_struct{
+  int64  size;                                //[bytes] -1 = missing
+  int64  sec;                                 //modification time
+  int64  nsec;
+} filestamp_t;
+
+typedef struct calstore_struct{
+  volatile uint32 generation;                 //incremented on every matrix swap
+  volatile uint32 version[CAL_NMATRIX];       //matrix version (0 = not loaded)
+  volatile int    active[CAL_NMATRIX];        //active slot
+  volatile uint64 nbytes[CAL_NMATRIX][CAL_NSLOT]; //bytes loaded in each slot
+  filestamp_t     stamp[CAL_NMATRIX];         //source file of the active slot
+  double pool[CAL_POOL_NDOUBLES] __attribute__((aligned(64))); //matrix slots
+} calstore_t;
+
+/*************************************************
+ * Calibration Snapshot
+ *************************************************/
+#define CALSNAP_FILE        "output/settings/calsnap.dat"
+#define CALSNAP_MAGIC       0x50534E43 //"CNSP"
+#define CALSNAP_VERSION     1          //increment when a section layout changes
+#define CALSNAP_PAGE        4096       //[bytes] section alignment in the file
+#define CALSNAP_SAVE_DELAY  5.0        //[s] quiet time after a change before saving
+#define CALSNAP_NSOURCE     4          //max source files per section
+#define CALSNAP_CALSTORE    0
+#define CALSNAP_SHKZMAT     1
+#define CALSNAP_SCICAL      2
+#define CALSNAP_NSECTION    3
+#define CALSNAP_EVENT_BOOT  0          //watchdog start
+#define CALSNAP_EVENT_CAL   1          //calibration ready
+#define CALSNAP_EVENT_FRAME 2          //first processed frame
+#define CALSNAP_EVENT_LOOP  3          //first DM command
+
+typedef struct calsnap_source_struct{
+  char        file[MAX_FILENAME];
+  filestamp_t stamp;
+} calsnap_source_t;
+
+typedef struct calsnap_section_struct{
+  uint64 offset;                              //[bytes] from start of file
+  uint64 nbytes;                              //0 = not saved
+  uint64 checksum;
+  uint32 nsource;
+  calsnap_source_t source[CALSNAP_NSOURCE];   //files the section was derived from
+} calsnap_section_t;
+
+typedef struct calsnap_header_struct{
+  uint32 magic;
+  uint32 version;
+  uint64 nbytes;                              //[bytes] file size
+  uint64 tsave;                               //[s] CLOCK_REALTIME of save
+  calsnap_section_t section[CALSNAP_NSECTION];
+  uint64 checksum;                            //header checksum (computed with this field 0)
+} calsnap_header_t;
+
+typedef struct shkzmat_struct{
+  uint64 key;                                 //checksum of cell origins & pinv settings
+  double cond;                                //pinv diagnostics
+  double gain;
+  int    nused;
+  double fwd[2*SHK_BEAM_NCELLS*LOWFS_N_ZERNIKE]; //zernikes --> cell deviations
+  double inv[2*SHK_BEAM_NCELLS*LOWFS_N_ZERNIKE]; //cell deviations --> zernikes
+} shkzmat_t;
+
+typedef struct scicalsnap_struct{
+  calsnap_source_t source[3];                 //dark, bias & flat files when read
+  sci_cal_t        cal;                       //cutouts for cal.temp & cal.origin
+} scicalsnap_t;
+
+typedef struct calsnap_struct{
+  //Startup timing [s, CLOCK_MONOTONIC]
+  double tboot;                               //watchdog start
+  double tcal;                                //calibration ready
+  double tframe[NCLIENTS];                    //first processed frame
+  double tloop[NCLIENTS];                     //first DM command
+  int    restored[CALSNAP_NSECTION];          //section restored from the snapshot
+  //Section sequence numbers (odd while writing, 0 = empty)
+  volatile uint32 seq[CALSNAP_NSECTION];
+  uint32 saved[CALSNAP_NSECTION];             //seq at last save
+  //Derived calibration state
+  shkzmat_t    shkzmat;
+  scicalsnap_t scical;
+} calsnap_t;
+
+/*************************************************
+ * Event Log Rings
+ *************************************************/
+#define LOG_RING_SIZE       256   //records per process ring (power of 2)
+#define LOG_MAX_ARGS        6     //max numeric arguments per record
+#define LOG_STR_LEN         48    //max length of the %s argument
+#define LOG_POLL_PERIOD     0.02  //[s] msg_proc idle polling period (ring holds LOG_RING_SIZE records)
+#define LOG_RATE_PERIOD     1.0   //[s] repeated message window
+#define LOG_RATE_MAX        5     //messages per format per window
+#define LOG_RATE_NFMT       64    //formats tracked for rate limiting
+enum loglevels {LOG_LVL_INFO, LOG_LVL_WARN, LOG_LVL_ERROR, LOG_NLEVELS};
+
+typedef union logarg_union{
+  int64  i;
+  double f;
+} logarg_t;
+
+typedef struct logrec_struct{
+  volatile uint32 seq;        //slot sequence (ring state)
+  uint16      procid;         //logging process
+  uint16      level;          //log level
+  uint32      sec;            //timestamp [s]
+  uint32      nsec;           //timestamp [ns]
+  const char *fmt;            //format string, same address in every forked process
+  logarg_t    arg[LOG_MAX_ARGS]; //numeric arguments
+  char        str[LOG_STR_LEN];  //string argument
+} logrec_t;
+
+typedef struct logring_struct{
+  volatile uint32 head;       //next write position
+  volatile uint32 tail;       //next read position
+  volatile uint32 nwrite;     //records written
+  volatile uint32 ndrop;      //records dropped on a full ring
+  logrec_t rec[LOG_RING_SIZE];
+} logring_t;
+
 /*************************************************
  * Shared Memory Layout
  *************************************************/
@@ -1341,10 +1726,31 @@ typedef volatile struct {
   bmc_t bmc_flat[BMC_NFLAT];
   uint32_t bmc_iflat;
 
+  //BMC Asynchronous Command
+  int       bmc_async;     //Send SCI commands through the sender thread
+  uint32_t  bmc_seq_sent;  //Sequence number of the last queued command
+  uint32_t  bmc_seq_done;  //Sequence number of the last completed command
+  bmctime_t bmc_time;      //Command round trip times
+
   //HEX Command
   int   hex_command_lock;
   hex_t hex_command;
 
+  //HEX Engine
+  hexreq_t hex_queue[HEX_QUEUE_SIZE];  //request queue (protected by hex_command_lock)
+  uint32   hex_queue_write;            //requests posted
+  uint32   hex_queue_read;             //requests taken by the engine
+  double   hex_position[HEX_NAXES];    //polled position (scope coords)
+  double   hex_position_time;          //time of last position poll [s]
+  int      hex_moving;                 //hexapod moving at last poll
+  uint32   hex_nmove;                  //moves sent to the hexapod
+  uint32   hex_ncoalesce;              //moves replaced by a newer target before being sent
+  uint32   hex_nerror;                 //failed GCS calls
+  double   hex_latency_cmd;            //last move: post to MOV accepted [s]
+  double   hex_latency_move;           //last move: post to motion complete [s]
+  double   hex_latency_cmd_max;        //maximum post to MOV accepted [s]
+  double   hex_latency_move_max;       //maximum post to motion complete [s]
+
   //Calibration Modes
   int alp_calmode;
   int hex_calmode;
@@ -1369,9 +1775,19 @@ typedef volatile struct {
 
   //Shack-Hartmann Settings
   int shk_boxsize;                                         //SHK centroid boxsize
+  int shk_pinv_method;                                     //SHK Zernike pseudo-inverse regularization (NUM_PINV_*)
+  double shk_pinv_thresh;                                  //SHK pseudo-inverse relative singular value cutoff
+  int shk_pinv_nmodes;                                     //SHK pseudo-inverse number of modes kept
+  double shk_pinv_alpha;                                   //SHK pseudo-inverse relative Tikhonov parameter
+  double shk_pinv_cond;                                    //SHK Zernike matrix condition number
+  double shk_pinv_gain;                                    //SHK pseudo-inverse noise gain (largest 1/s used)
+  int shk_pinv_nused;                                      //SHK pseudo-inverse modes used
   double shk_gain_alp_cell[LOWFS_N_PID];                   //SHK ALP cell gains
   double shk_gain_alp_zern[LOWFS_N_ZERNIKE][LOWFS_N_PID];  //SHK ALP zern gains
   double shk_gain_hex_zern[LOWFS_N_PID];                   //SHK HEX zern gains
+  int    shk_bkg_mode;                                     //SHK centroid background mode (SHK_BKG_*)
+  int    shk_roimode;                                      //Run camera in beam footprint ROI readout mode
+  shkroi_t shk_roi;                                        //SHK active readout window (set by shk_proc)
 
   //Lyot LOWFS Settings
   double lyt_gain_alp_zern[LOWFS_N_ZERNIKE][LOWFS_N_PID];  //LYT ALP zernike PID gains
@@ -1394,6 +1810,9 @@ typedef volatile struct {
   int    sci_optmode;                                      //Phase flattening optimization mode
   int    sci_fastmode;                                     //Run camera in fast ROI readout mode
   int    sci_phase_testgrad;                               //Test gradient calculation
+  int    sci_pipeline;                                     //Process frames on a worker thread while exposing
+  double sci_readtime;                                     //Last camera readout time [s]
+  double sci_dutycycle;                                    //Last exposure time / frame time
   double sci_phasemerit;                                   //Phase flattening merit function value
   double sci_phase_expscale;                               //Scale factor for phase flattening defocus images
   
@@ -1408,6 +1827,16 @@ typedef volatile struct {
   int acq_reset_camera;
   int sci_reset_camera;
   int lyt_reset_camera;
+
+  //Camera Frame Accounting (written by the camera process)
+  frmstat_t frmstat[NCLIENTS];
+
+  //Synthetic Frame Settings (FAKEMODE_ZERNIKE)
+  fakecfg_t fakecfg;
+
+  //Optical Plant (FAKEMODE_PLANT)
+  plantcfg_t plantcfg;
+  plantstat_t plantstat;
   
   //SCI Commands
   int sci_setorigin;
@@ -1429,6 +1858,7 @@ typedef volatile struct {
   int shk_loadorigin;
   int shk_xshiftorigin;
   int shk_yshiftorigin;
+  int shk_pinv_update;
   
   //LYT Commands
   int lyt_setref;
@@ -1478,6 +1908,15 @@ typedef volatile struct {
   
   //Heater Settings
   htr_t htr[SSR_NCHAN];
+
+  //Heater PWM Scheduler
+  uint64 htr_nloop;          //PWM loops run
+  uint32 htr_nwake;          //last loop: timed wakeups
+  uint32 htr_nwake_max;      //maximum timed wakeups per loop
+  double htr_late;           //last loop: maximum wakeup lateness [s]
+  double htr_late_max;       //maximum wakeup lateness [s]
+  double htr_duty_error;     //last loop: maximum |measured - commanded| duty [%]
+  double htr_duty_error_max; //maximum duty error [%]
         
   //Zernike Targets
   double shk_zernike_target[LOWFS_N_ZERNIKE];
@@ -1497,6 +1936,7 @@ typedef volatile struct {
   thmevent_t thmevent[THMEVENTSIZE];
   mtrevent_t mtrevent[MTREVENTSIZE];
   msgevent_t msgevent[MSGEVENTSIZE];
+  frmevent_t frmevent[FRMEVENTSIZE];
   shkpkt_t   shkpkt[SHKPKTSIZE];
   lytpkt_t   lytpkt[LYTPKTSIZE];
 
@@ -1507,6 +1947,15 @@ typedef volatile struct {
   //Circular buffer package
   circbuf_t circbuf[NCIRCBUF];
 
+  //Calibration matrix store
+  calstore_t calstore;
+
+  //Calibration snapshot
+  calsnap_t calsnap;
+
+  //Event log rings
+  logring_t logring[NCLIENTS];
+
 } sm_t;
 
 
@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* piccflight headers */
+#include "controller.h"
+#include "common_functions.h"
+#include "fake_functions.h"
+
+/* Synthetic LOWFS frame generator (FAKEMODE_ZERNIKE)
+ *
+ *  - SHK: each beam cell gets a gaussian spot at its origin plus the
+ *    displacement of the fake zernike vector through the SHK forward
+ *    matrix. Spots are rendered into the current readout window in
+ *    binned pixels with the same indexing as the camera buffer.
+ *  - LYT: the reference image plus the zernike sensitivity of each
+ *    controlled pixel, scaled to the reference total.
+ *  - SCI: coronagraph core leak that moves with tip/tilt, on a halo
+ *    that grows with the Strehl loss of the remaining wavefront error.
+ *  - Both add a background level with an x/y gradient, shot noise and
+ *    read noise. SHK spots are dropped at random at the dropout rate.
+ *  - Noise is taken from a pool of unit normal samples drawn once, at
+ *    a random offset each frame. The SHK noiseless frame is cached,
+ *    so a frame costs a few operations per pixel and the generator
+ *    can run well above flight frame rates.
+ */
+
+//Noise pool
+static float noisepool[FAKE_NOISE_NPOOL];
+static unsigned int noiseseed=1;
+static int noiseinit=0;
+
+/**************************************************************/
+/* FAKE_NOISE_INIT                                            */
+/*  - Fill the unit normal noise pool                         */
+/**************************************************************/
+static void fake_noise_init(void){
+  double u1,u2;
+  int i;
+  //Box-Muller
+  for(i=0;i<FAKE_NOISE_NPOOL;i+=2){
+    u1 = (rand_r(&noiseseed)+1.0)/(RAND_MAX+1.0);
+    u2 = rand_r(&noiseseed)/(RAND_MAX+1.0);
+    noisepool[i]   = sqrt(-2*log(u1))*cos(2*M_PI*u2);
+    noisepool[i+1] = sqrt(-2*log(u1))*sin(2*M_PI*u2);
+  }
+  noiseinit=1;
+}
+
+/**************************************************************/
+/* FAKE_SHK_MODEL                                             */
+/*  - Render noiseless SHK frame and noise sigma per pixel    */
+/**************************************************************/
+static void fake_shk_model(shkroi_t *roi, double *cx, double *cy, fakecfg_t *cfg, float *model, float *sigma){
+  double gx[SHKXS],gy[SHKYS];
+  double xc,yc,dx,row;
+  const double s2 = 2*FAKE_SPOT_SIGMA*FAKE_SPOT_SIGMA;
+  const double hw = FAKE_SPOT_NSIGMA*FAKE_SPOT_SIGMA;
+  int i,x,y,blx,bly,trx,try;
+
+  //Background with gradient about the window center (binned pixels)
+  xc = roi->xoff + roi->xs/2.0;
+  yc = roi->yoff + roi->ys/2.0;
+  for(y=0;y<roi->ys;y++){
+    row = cfg->background + cfg->ygradient*(roi->yoff + y - yc) + cfg->xgradient*(roi->xoff - xc);
+    for(x=0;x<roi->xs;x++)
+      model[x + y*roi->xs] = row + cfg->xgradient*x;
+  }
+
+  //Spots
+  for(i=0;i<SHK_BEAM_NCELLS;i++){
+    //Dropout
+    if(cfg->dropout > 0 && rand_r(&noiseseed) < cfg->dropout*RAND_MAX) continue;
+
+    //Render box inside the readout window (binned pixels)
+    blx = floor((cx[i] - hw)/SHKBIN);
+    bly = floor((cy[i] - hw)/SHKBIN);
+    trx = floor((cx[i] + hw)/SHKBIN);
+    try = floor((cy[i] + hw)/SHKBIN);
+    blx = blx < roi->xoff ? roi->xoff : blx;
+    bly = bly < roi->yoff ? roi->yoff : bly;
+    trx = trx > roi->xoff + roi->xs - 1 ? roi->xoff + roi->xs - 1 : trx;
+    try = try > roi->yoff + roi->ys - 1 ? roi->yoff + roi->ys - 1 : try;
+    if(blx > trx || bly > try) continue;
+
+    //Separable gaussian sampled at binned pixel centers
+    for(x=blx;x<=trx;x++){
+      dx = (x + 0.5)*SHKBIN - cx[i];
+      gx[x-blx] = cfg->shk_flux*exp(-dx*dx/s2);
+    }
+    for(y=bly;y<=try;y++){
+      dx = (y + 0.5)*SHKBIN - cy[i];
+      gy[y-bly] = exp(-dx*dx/s2);
+    }
+    for(y=bly;y<=try;y++)
+      for(x=blx;x<=trx;x++)
+	model[(x-roi->xoff) + (y-roi->yoff)*roi->xs] += gx[x-blx]*gy[y-bly];
+  }
+
+  //Shot noise & read noise
+  for(i=0;i<roi->xs*roi->ys;i++)
+    sigma[i] = sqrt(cfg->read_noise*cfg->read_noise + (model[i] > 0 ? model[i] : 0)/FAKE_PHOTON_GAIN);
+}
+
+/**************************************************************/
+/* FAKE_SHK_IMAGE                                             */
+/*  - Render a SHK frame from the fake zernikes               */
+/*  - zfwd is the forward matrix from shk_zernike_fwd         */
+/*  - Return pointer to the frame, indexed like the camera    */
+/*    buffer for the readout window roi                       */
+/*  - The noiseless frame is kept until the spots, window or  */
+/*    settings change, each frame then only adds noise        */
+/**************************************************************/
+uint8 *fake_shk_image(shkroi_t *roi, shkcell_t *cells, double *zfwd, fakecfg_t *cfg){
+  static uint8 image[SHKXS*SHKYS];
+  static float model[SHKXS*SHKYS];
+  static float sigma[SHKXS*SHKYS];
+  static double last_cx[SHK_BEAM_NCELLS],last_cy[SHK_BEAM_NCELLS];
+  static shkroi_t last_roi;
+  static fakecfg_t last_cfg;
+  static int valid=0;
+  double cx[SHK_BEAM_NCELLS],cy[SHK_BEAM_NCELLS];
+  const float *m,*g,*p;
+  float value;
+  uint8 *d;
+  int i,z;
+  uint32 k,n,len;
+
+  //Init noise
+  if(!noiseinit) fake_noise_init();
+
+  //Spot centers (unbinned pixels)
+  for(i=0;i<SHK_BEAM_NCELLS;i++){
+    cx[i] = cells[i].xorigin;
+    cy[i] = cells[i].yorigin;
+    for(z=0;z<LOWFS_N_ZERNIKE;z++){
+      cx[i] += zfwd[2*i+0+z*2*SHK_BEAM_NCELLS]*cfg->zernike[z];
+      cy[i] += zfwd[2*i+1+z*2*SHK_BEAM_NCELLS]*cfg->zernike[z];
+    }
+  }
+
+  //Render noiseless frame if anything changed, dropouts change every frame
+  if(!valid || cfg->dropout > 0 ||
+     memcmp(roi,&last_roi,sizeof(shkroi_t)) || memcmp(cfg,&last_cfg,sizeof(fakecfg_t)) ||
+     memcmp(cx,last_cx,sizeof(cx)) || memcmp(cy,last_cy,sizeof(cy))){
+    fake_shk_model(roi,cx,cy,cfg,model,sigma);
+    memcpy(&last_roi,roi,sizeof(shkroi_t));
+    memcpy(&last_cfg,cfg,sizeof(fakecfg_t));
+    memcpy(last_cx,cx,sizeof(cx));
+    memcpy(last_cy,cy,sizeof(cy));
+    valid = 1;
+  }
+
+  //Add noise & digitize, pool read in contiguous runs from a random offset
+  n = roi->xs*roi->ys;
+  k = rand_r(&noiseseed) & (FAKE_NOISE_NPOOL-1);
+  for(i=0;i<n;i+=len){
+    len = (n - i) < (FAKE_NOISE_NPOOL - k) ? (n - i) : (FAKE_NOISE_NPOOL - k);
+    m = &model[i];
+    g = &sigma[i];
+    p = &noisepool[k];
+    d = &image[i];
+    for(z=0;z<len;z++){
+      value = m[z] + g[z]*p[z] + 0.5f;
+      value = value < 0   ? 0   : value;
+      value = value > 255 ? 255 : value;
+      d[z]  = (uint8)value;
+    }
+    k = 0;
+  }
+
+  return image;
+}
+
+/**************************************************************/
+/* FAKE_LYT_SENSITIVITY                                       */
+/*  - Normalized image change per unit zernike of each        */
+/*    controlled pixel (pixel major, like the fit matrix)     */
+/*  - Read from ALPZER2LYTPIX_FILE, otherwise built from the  */
+/*    fitting matrix (exact for orthogonal fitting rows)      */
+/**************************************************************/
+static void fake_lyt_sensitivity(lytfit_t *fit, double *sens){
+  double norm[LOWFS_N_ZERNIKE]={0};
+  int k,z;
+
+  if(read_file(ALPZER2LYTPIX_FILE,sens,fit->npix*LOWFS_N_ZERNIKE*sizeof(double)) == 0){
+    printf("LYT: Fake frames using %s\n",ALPZER2LYTPIX_FILE);
+    return;
+  }
+  for(k=0;k<fit->npix;k++)
+    for(z=0;z<LOWFS_N_ZERNIKE;z++)
+      norm[z] += fit->matrix[k*LOWFS_N_ZERNIKE+z]*fit->matrix[k*LOWFS_N_ZERNIKE+z];
+  for(k=0;k<fit->npix;k++)
+    for(z=0;z<LOWFS_N_ZERNIKE;z++)
+      sens[k*LOWFS_N_ZERNIKE+z] = norm[z] > 0 ? fit->matrix[k*LOWFS_N_ZERNIKE+z]/norm[z] : 0;
+  printf("LYT: Fake frames using fitting matrix sensitivities\n");
+}
+
+/**************************************************************/
+/* FAKE_LYT_IMAGE                                             */
+/*  - Render a LYT ROI image from the fake zernikes           */
+/**************************************************************/
+void fake_lyt_image(lyt_t *image, lytref_t *lytref, lytfit_t *fit, fakecfg_t *cfg){
+  static double sens[LYTXS*LYTYS*LOWFS_N_ZERNIKE];
+  static int    sens_npix=-1;
+  static uint32 sens_version=0;
+  double *data = &image->data[0][0];
+  double *ref  = &lytref->refimg[0][0];
+  double *col;
+  double scale=1,refmax=0,delta,value;
+  int    i,j,k,z;
+  uint32 n;
+
+  //Init noise
+  if(!noiseinit) fake_noise_init();
+
+  //Sensitivities follow the fitting plan
+  if(fit->npix != sens_npix || fit->version != sens_version){
+    fake_lyt_sensitivity(fit,sens);
+    sens_npix    = fit->npix;
+    sens_version = fit->version;
+  }
+
+  //Reference scale
+  for(k=0;k<LYTXS*LYTYS;k++)
+    if(ref[k] > refmax) refmax = ref[k];
+  if(cfg->lyt_flux > 0 && refmax > 0) scale = cfg->lyt_flux/refmax;
+
+  //Reference image
+  for(k=0;k<LYTXS*LYTYS;k++)
+    data[k] = scale*ref[k];
+
+  //Zernike response of the controlled pixels
+  for(k=0;k<fit->npix;k++){
+    col   = &sens[k*LOWFS_N_ZERNIKE];
+    delta = 0;
+    for(z=0;z<LOWFS_N_ZERNIKE;z++)
+      delta += col[z]*cfg->zernike[z];
+    data[fit->index[k]] += scale*fit->ref_total*delta;
+  }
+
+  //Background, shot noise & read noise
+  n = rand_r(&noiseseed);
+  for(i=0;i<LYTXS;i++){
+    for(j=0;j<LYTYS;j++){
+      value  = image->data[i][j] + cfg->background + cfg->xgradient*(i - LYTXS/2) + cfg->ygradient*(j - LYTYS/2);
+      value += sqrt(cfg->read_noise*cfg->read_noise + (value > 0 ? value : 0)/FAKE_PHOTON_GAIN)*noisepool[n++ & (FAKE_NOISE_NPOOL-1)];
+      image->data[i][j] = value;
+    }
+  }
+}
+
+/**************************************************************/
+/* FAKE_SCI_IMAGE                                             */
+/*  - Render SCI bands from a wavefront                       */
+/*  - zernike: residual wavefront [microns]                   */
+/*  - wfe: extra rms wavefront error (e.g. BMC) [microns]     */
+/**************************************************************/
+void fake_sci_image(sci_bands_t *bands, double *zernike, double wfe, double exptime, fakecfg_t *cfg){
+  double var=wfe*wfe,peak,halo,x0,y0,dx,dy,value;
+  int    b,i,j,z;
+  uint32 n;
+
+  //Init noise
+  if(!noiseinit) fake_noise_init();
+
+  //Strehl loss of everything above tip/tilt
+  for(z=2;z<LOWFS_N_ZERNIKE;z++)
+    var += zernike[z]*zernike[z];
+  halo = FAKE_SCI_CONTRAST + 1 - exp(-var*(2*M_PI/FAKE_SCI_LAMBDA)*(2*M_PI/FAKE_SCI_LAMBDA));
+  peak = FAKE_SCI_PEAK*exptime;
+
+  //Core position
+  x0 = SCIXS/2 + FAKE_SCI_TT_SCALE*zernike[0];
+  y0 = SCIYS/2 + FAKE_SCI_TT_SCALE*zernike[1];
+
+  for(b=0;b<SCI_NBANDS;b++){
+    n = rand_r(&noiseseed);
+    for(i=0;i<SCIXS;i++){
+      for(j=0;j<SCIYS;j++){
+	dx     = i - x0;
+	dy     = j - y0;
+	value  = cfg->background + cfg->xgradient*(i - SCIXS/2) + cfg->ygradient*(j - SCIYS/2);
+	value += peak*FAKE_SCI_LEAK*exp(-(dx*dx+dy*dy)/(2*FAKE_SCI_SIGMA*FAKE_SCI_SIGMA));
+	value += peak*halo*exp(-sqrt((i-SCIXS/2)*(i-SCIXS/2)+(j-SCIYS/2)*(j-SCIYS/2))/FAKE_SCI_HALO);
+	value += sqrt(cfg->read_noise*cfg->read_noise + (value > 0 ? value : 0)/FAKE_PHOTON_GAIN)*noisepool[n++ & (FAKE_NOISE_NPOOL-1)];
+	value  = value < 0 ? 0 : value;
+	value  = value > 65535 ? 65535 : value;
+	bands->band[b].data[i][j] = (uint16)(value + 0.5);
+      }
+    }
+  }
+}
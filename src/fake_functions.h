@@ -0,0 +1,9 @@
+#ifndef _FAKE_FUNCTIONS
+#define _FAKE_FUNCTIONS
+
+//Function prototypes
+uint8 *fake_shk_image(shkroi_t *roi, shkcell_t *cells, double *zfwd, fakecfg_t *cfg);
+void fake_lyt_image(lyt_t *image, lytref_t *lytref, lytfit_t *fit, fakecfg_t *cfg);
+void fake_sci_image(sci_bands_t *bands, double *zernike, double wfe, double exptime, fakecfg_t *cfg);
+
+#endif
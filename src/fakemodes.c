@@ -55,4 +55,14 @@ void init_fakemode(int fakemode, calmode_t *fake){
     sprintf(fake->name,"FAKEMODE_PHASE");
     sprintf(fake->cmd,"phase");
   }
+  //FAKEMODE_ZERNIKE
+  if(fakemode == FAKEMODE_ZERNIKE){
+    sprintf(fake->name,"FAKEMODE_ZERNIKE");
+    sprintf(fake->cmd,"zernike");
+  }
+  //FAKEMODE_PLANT
+  if(fakemode == FAKEMODE_PLANT){
+    sprintf(fake->name,"FAKEMODE_PLANT");
+    sprintf(fake->cmd,"plant");
+  }
 }
@@ -10,5 +10,7 @@ enum fakemodes{ FAKEMODE_NONE,
 		FAKEMODE_SCI_PROBE,     //Read fake HOWFS probe images
 		FAKEMODE_IMREG,         //Image registration pattern
 		FAKEMODE_PHASE,         //SCI phase flattening images
+		FAKEMODE_ZERNIKE,       //SHK & LYT frames rendered from fake zernikes
+		FAKEMODE_PLANT,         //SHK, LYT & SCI frames rendered from the optical plant
                 NFAKEMODES};
 		
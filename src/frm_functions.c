@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* piccflight headers */
+#include "controller.h"
+#include "common_functions.h"
+#include "frm_functions.h"
+#include "calsnap.h"
+
+/* Camera frame accounting
+ *
+ *  - Camera callbacks call frm_arrive with the hardware frame number
+ *    (Phoenix event counter or UVC sequence) before processing and
+ *    frm_done after. Gaps in the sequence are dropped frames.
+ *  - Processing code calls frm_skip when it discards a frame it has
+ *    received, with the reason (FRM_SKIP_*).
+ *  - frm_done counts frames processed slower than the frame period
+ *    and writes a frmevent every FRM_EVENT_TIME.
+ *  - Counters live in sm_p->frmstat[id] and are copied into every
+ *    event header by frm_header.
+ *  - Each camera has one callback thread, so the counters of one
+ *    id are only written by one thread.
+ */
+
+//Callback state
+typedef struct frmlocal_struct{
+  int    haveseq;   //seq is valid for gap detection
+  int    skipped;   //current frame was skipped
+  double tarrive;   //arrival time of current frame [s]
+  double tevent;    //time of last frmevent [s]
+  uint64 nevent;    //processed frames at last frmevent
+} frmlocal_t;
+
+static frmlocal_t frmlocal[NCLIENTS];
+
+/**************************************************************/
+/* FRM_NOW                                                    */
+/*  - Return monotonic time [s]                               */
+/**************************************************************/
+static double frm_now(void){
+  struct timespec now;
+  double t;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  ts2double(&now,&t);
+  return t;
+}
+
+/**************************************************************/
+/* FRM_RESTART                                                */
+/*  - Camera (re)started, the sequence starts over            */
+/**************************************************************/
+void frm_restart(sm_t *sm_p, int id){
+  frmlocal[id].haveseq = 0;
+  sm_p->frmstat[id].nrestart++;
+}
+
+/**************************************************************/
+/* FRM_ARRIVE                                                 */
+/*  - Frame delivered to the callback                         */
+/*  - seq: hardware frame number                              */
+/**************************************************************/
+void frm_arrive(sm_t *sm_p, int id, uint32 seq){
+  volatile frmstat_t *stat = &sm_p->frmstat[id];
+  frmlocal_t *local = &frmlocal[id];
+  uint32 gap;
+
+  local->tarrive = frm_now();
+  local->skipped = 0;
+  stat->nframes++;
+
+  //Sequence gap
+  if(local->haveseq){
+    gap = seq - stat->seq - 1;
+    if(gap > 0 && gap < FRM_MAX_GAP){
+      stat->ngaps++;
+      stat->ndropped += gap;
+      if(gap > stat->gap_max) stat->gap_max = gap;
+    }
+  }
+  stat->seq = seq;
+  local->haveseq = 1;
+}
+
+/**************************************************************/
+/* FRM_LOST                                                   */
+/*  - Grabber reported a lost frame or FIFO overflow          */
+/**************************************************************/
+void frm_lost(sm_t *sm_p, int id){
+  sm_p->frmstat[id].nlost++;
+}
+
+/**************************************************************/
+/* FRM_SKIP                                                   */
+/*  - Frame received but not processed                        */
+/**************************************************************/
+void frm_skip(sm_t *sm_p, int id, int reason){
+  if(reason < 0 || reason >= FRM_NSKIP) return;
+  if(frmlocal[id].skipped) return;
+  frmlocal[id].skipped = 1;
+  sm_p->frmstat[id].nskip[reason]++;
+}
+
+/**************************************************************/
+/* FRM_DONE                                                   */
+/*  - Frame finished, measure processing time                 */
+/*  - frmtime: configured frame period [s]                    */
+/*  - Write frmevent every FRM_EVENT_TIME                     */
+/**************************************************************/
+void frm_done(sm_t *sm_p, int id, double frmtime){
+  volatile frmstat_t *stat = &sm_p->frmstat[id];
+  frmlocal_t *local = &frmlocal[id];
+  static frmevent_t frmevent;
+  struct timespec now;
+  double t = frm_now();
+
+  //Processing time
+  stat->proc_time = t - local->tarrive;
+  if(stat->proc_time > stat->proc_time_max) stat->proc_time_max = stat->proc_time;
+  if(frmtime > 0 && stat->proc_time > frmtime) stat->noverrun++;
+  if(!local->skipped) stat->nprocessed++;
+
+  //Startup timing
+  if(!local->skipped) calsnap_mark(sm_p,id,CALSNAP_EVENT_FRAME);
+
+  //Write frmevent
+  if(local->tevent == 0) local->tevent = t;
+  if((t - local->tevent) >= FRM_EVENT_TIME){
+    stat->rate    = (stat->nprocessed - local->nevent)/(t - local->tevent);
+    local->tevent = t;
+    local->nevent = stat->nprocessed;
+    if(sm_p->circbuf[BUFFER_FRMEVENT].write){
+      memset(&frmevent,0,sizeof(frmevent_t));
+      frm_header(sm_p,id,&frmevent.hed);
+      clock_gettime(CLOCK_REALTIME,&now);
+      frmevent.hed.version      = PICC_PKT_VERSION;
+      frmevent.hed.type         = BUFFER_FRMEVENT;
+      frmevent.hed.frame_number = stat->nframes;
+      frmevent.hed.frmtime      = frmtime;
+      frmevent.hed.state        = sm_p->state;
+      frmevent.hed.start_sec    = now.tv_sec;
+      frmevent.hed.start_nsec   = now.tv_nsec;
+      frmevent.hed.end_sec      = now.tv_sec;
+      frmevent.hed.end_nsec     = now.tv_nsec;
+      frmevent.procid           = id;
+      memcpy(&frmevent.stat,(frmstat_t *)stat,sizeof(frmstat_t));
+      write_to_buffer(sm_p,&frmevent,BUFFER_FRMEVENT);
+    }
+  }
+}
+
+/**************************************************************/
+/* FRM_HEADER                                                 */
+/*  - Copy frame counters into an event header                */
+/**************************************************************/
+void frm_header(sm_t *sm_p, int id, pkthed_t *hed){
+  volatile frmstat_t *stat = &sm_p->frmstat[id];
+  int i;
+  hed->frame_seq     = stat->seq;
+  hed->frame_drop    = stat->ndropped;
+  hed->frame_overrun = stat->noverrun;
+  hed->frame_skip    = 0;
+  for(i=0;i<FRM_NSKIP;i++)
+    hed->frame_skip += stat->nskip[i];
+}
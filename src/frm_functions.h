@@ -0,0 +1,12 @@
+#ifndef _FRM_FUNCTIONS
+#define _FRM_FUNCTIONS
+
+//Function prototypes
+void frm_restart(sm_t *sm_p, int id);
+void frm_arrive(sm_t *sm_p, int id, uint32 seq);
+void frm_lost(sm_t *sm_p, int id);
+void frm_skip(sm_t *sm_p, int id, int reason);
+void frm_done(sm_t *sm_p, int id, double frmtime);
+void frm_header(sm_t *sm_p, int id, pkthed_t *hed);
+
+#endif
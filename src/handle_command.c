@@ -18,8 +18,16 @@
 #include "alp_functions.h"
 #include "bmc_functions.h"
 #include "tgt_functions.h"
+#include "lyt_functions.h"
 #include "common_functions.h"
 #include "fakemodes.h"
+#include "plant_functions.h"
+#include "numeric.h"
+#include "calstore.h"
+#include "calsnap.h"
+#include "cmd_table.h"
+#include "scr_functions.h"
+#include "log_functions.h"
 
 /* Prototypes */
 void getshk_proc(void); //get shkevents
@@ -48,6 +56,45 @@ void print_proc_status(sm_t *sm_p){
   printf("******************************************\n");
 }
 
+/**************************************************************/
+/* PRINT_PROC_STATS                                           */
+/*  - Print out watchdog supervision statistics               */
+/**************************************************************/
+void print_proc_stats(sm_t *sm_p){
+  int i;
+  double avg;
+  printf("***************************** Process Statistics *****************************\n");
+  printf("%-6s %7s %7s %7s %7s %7s %11s %11s %11s\n","Proc","PID","Starts","Crashes","Timeout","Restart","Last[ms]","Avg[ms]","Max[ms]");
+  for(i=0;i<NCLIENTS;i++){
+    if(i == WATID) continue;
+    avg = sm_p->w[i].nrestart ? sm_p->w[i].restart_sum / sm_p->w[i].nrestart : 0;
+    printf("%-6s %7d %7u %7u %7u %7u %11.3f %11.3f %11.3f\n",sm_p->w[i].name,sm_p->w[i].pid,
+	   sm_p->w[i].nstart,sm_p->w[i].ncrash,sm_p->w[i].ntimeout,sm_p->w[i].nrestart,
+	   sm_p->w[i].restart_last*1000,avg*1000,sm_p->w[i].restart_max*1000);
+  }
+  printf("******************************************************************************\n");
+}
+
+/**************************************************************/
+/* PRINT_FRM_STATS                                            */
+/*  - Print out camera frame accounting statistics            */
+/**************************************************************/
+void print_frm_stats(sm_t *sm_p){
+  const int id[] = {SHKID,LYTID,ACQID};
+  frmstat_t *f;
+  int i;
+  printf("******************************** Frame Statistics ********************************\n");
+  printf("%-4s %9s %9s %7s %7s %7s %7s %7s %7s %7s %8s %8s\n","Proc","Frames","Proc","Drop","Lost","Lock","Decim","Error","Overrun","Restart","Rate[Hz]","Max[ms]");
+  for(i=0;i<sizeof(id)/sizeof(id[0]);i++){
+    f = (frmstat_t *)&sm_p->frmstat[id[i]];
+    printf("%-4s %9lu %9lu %7lu %7lu %7lu %7lu %7lu %7lu %7lu %8.1f %8.3f\n",sm_p->w[id[i]].name,
+	   (unsigned long)f->nframes,(unsigned long)f->nprocessed,(unsigned long)f->ndropped,(unsigned long)f->nlost,
+	   (unsigned long)f->nskip[FRM_SKIP_LOCK],(unsigned long)f->nskip[FRM_SKIP_DECIMATE],(unsigned long)f->nskip[FRM_SKIP_ERROR],
+	   (unsigned long)f->noverrun,(unsigned long)f->nrestart,f->rate,f->proc_time_max*1000);
+  }
+  printf("**********************************************************************************\n");
+}
+
 /**************************************************************/
 /* PRINT_CIRCBUF_STATUS                                       */
 /*  - Print out current circular buffer status                */
@@ -106,6 +153,10 @@ void reset_circbuf(sm_t *sm_p){
   sm_p->circbuf[BUFFER_MTREVENT].read    = READ_MTREVENT_DEFAULT;
   sm_p->circbuf[BUFFER_MTREVENT].send    = SEND_MTREVENT_DEFAULT;
   sm_p->circbuf[BUFFER_MTREVENT].save    = SAVE_MTREVENT_DEFAULT;
+  sm_p->circbuf[BUFFER_FRMEVENT].write   = WRITE_FRMEVENT_DEFAULT;
+  sm_p->circbuf[BUFFER_FRMEVENT].read    = READ_FRMEVENT_DEFAULT;
+  sm_p->circbuf[BUFFER_FRMEVENT].send    = SEND_FRMEVENT_DEFAULT;
+  sm_p->circbuf[BUFFER_FRMEVENT].save    = SAVE_FRMEVENT_DEFAULT;
   sm_p->circbuf[BUFFER_SHKPKT].write     = WRITE_SHKPKT_DEFAULT;
   sm_p->circbuf[BUFFER_SHKPKT].read      = READ_SHKPKT_DEFAULT;
   sm_p->circbuf[BUFFER_SHKPKT].send      = SEND_SHKPKT_DEFAULT;
@@ -366,6 +417,679 @@ void print_htr_status(sm_t *sm_p){
 
 }
 
+/**************************************************************/
+/* TABLE COMMAND HANDLERS                                     */
+/*  - Commands registered in cmdtable and run by cmd_dispatch */
+/*  - arg[] holds the arguments parsed per the table schema   */
+/**************************************************************/
+
+//Process statistics
+static int cmd_proc_status(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  print_proc_status(sm_p);
+  return(CMD_NORMAL);
+}
+
+static int cmd_proc_stats(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  print_proc_stats(sm_p);
+  return(CMD_NORMAL);
+}
+
+static int cmd_frm_stats(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  print_frm_stats(sm_p);
+  return(CMD_NORMAL);
+}
+
+//Event log rings
+static int cmd_log_status(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  log_status(sm_p);
+  return(CMD_NORMAL);
+}
+
+//Calibration settings
+static int cmd_alp_timer_length(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  if(arg[0].f > 0 && arg[0].f <= ALP_CAL_TIMER_MAX){
+    sm_p->alp_cal_timer_length = arg[0].f;
+    printf("CMD: Changed ALP calibration timer length to %.1f seconds\n",sm_p->alp_cal_timer_length);
+  }else{
+    printf("CMD: ALP calibration timer out of bounds [%d,%f]\n",0,(double)ALP_CAL_TIMER_MAX);
+  }
+  return(CMD_NORMAL);
+}
+
+static int cmd_alp_cal_scale(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  if(arg[0].f >= 0 && arg[0].f <= ALP_CAL_SCALE_MAX){
+    sm_p->alp_cal_scale = arg[0].f;
+    printf("CMD: Changed ALP calibration scale to %.3f\n",sm_p->alp_cal_scale);
+  }else{
+    printf("CMD: ALP calibration scale out of bounds [%d,%d]\n",0,ALP_CAL_SCALE_MAX);
+  }
+  return(CMD_NORMAL);
+}
+
+static int cmd_bmc_timer_length(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  if(arg[0].f > 0 && arg[0].f <= BMC_CAL_TIMER_MAX){
+    sm_p->bmc_cal_timer_length = arg[0].f;
+    printf("CMD: Changed BMC calibration timer length to %.1f seconds\n",sm_p->bmc_cal_timer_length);
+  }else{
+    printf("CMD: BMC calibration timer out of bounds [%d,%f]\n",0,(double)BMC_CAL_TIMER_MAX);
+  }
+  return(CMD_NORMAL);
+}
+
+static int cmd_bmc_cal_scale(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  if(arg[0].f >= 0 && arg[0].f <= BMC_CAL_SCALE_MAX){
+    sm_p->bmc_cal_scale = arg[0].f;
+    printf("CMD: Changed BMC calibration scale to %.3f\n",sm_p->bmc_cal_scale);
+  }else{
+    printf("CMD: BMC calibration scale out of bounds [%d,%d]\n",0,BMC_CAL_SCALE_MAX);
+  }
+  return(CMD_NORMAL);
+}
+
+//Calibration matrix store
+static int cmd_cal_status(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  cal_status();
+  return(CMD_NORMAL);
+}
+
+static int cmd_cal_reload_all(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  printf("CMD: Reloading all calibration matrices\n");
+  if(cal_load_all())
+    printf("CMD: Some matrices failed to load, previous versions kept\n");
+  return(CMD_NORMAL);
+}
+
+static int cmd_cal_reload(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  int i,id;
+  if((id = cal_lookup(arg[0].s)) < 0){
+    printf("CMD: Bad matrix name. Options:");
+    for(i=0;i<CAL_NMATRIX;i++)
+      printf(" %s",cal_name(i));
+    printf("\n");
+    return(CMD_NORMAL);
+  }
+  printf("CMD: Reloading %s\n",cal_name(id));
+  if(cal_load(id))
+    printf("CMD: Load failed, previous version kept\n");
+  return(CMD_NORMAL);
+}
+
+//Calibration snapshot
+static int cmd_calsnap_status(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  calsnap_status(sm_p);
+  return(CMD_NORMAL);
+}
+
+static int cmd_calsnap_save(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  printf("CMD: Saving calibration snapshot\n");
+  calsnap_save(sm_p);
+  return(CMD_NORMAL);
+}
+
+static int cmd_calsnap_clear(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  printf("CMD: Clearing calibration snapshot\n");
+  calsnap_clear();
+  return(CMD_NORMAL);
+}
+
+//SHK origin
+static int cmd_shk_set_origin(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  printf("CMD: Setting SHK origin\n");
+  sm_p->shk_setorigin=1;
+  return(CMD_NORMAL);
+}
+
+static int cmd_shk_revert_origin(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  printf("CMD: Reverting SHK origin\n");
+  sm_p->shk_revertorigin=1;
+  return(CMD_NORMAL);
+}
+
+static int cmd_shk_save_origin(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  printf("CMD: Saving SHK origin\n");
+  sm_p->shk_saveorigin=1;
+  return(CMD_NORMAL);
+}
+
+static int cmd_shk_load_origin(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  printf("CMD: Loading SHK origin\n");
+  sm_p->shk_loadorigin=1;
+  return(CMD_NORMAL);
+}
+
+static int cmd_shk_shift_origin(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  //Argument is one of +x, -x, +y, -y
+  int step = (arg[0].s[0] == '-') ? -1 : 1;
+  if(strlen(arg[0].s) != 2 || (arg[0].s[0] != '+' && arg[0].s[0] != '-')){
+    printf("CMD: SHK origin shift must be +x, -x, +y or -y\n");
+    return(CMD_NORMAL);
+  }
+  if(tolower(arg[0].s[1]) == 'x'){
+    printf("CMD: SHK shift origin %+dpx in X\n",step);
+    sm_p->shk_xshiftorigin = step;
+  }
+  else if(tolower(arg[0].s[1]) == 'y'){
+    printf("CMD: SHK shift origin %+dpx in Y\n",step);
+    sm_p->shk_yshiftorigin = step;
+  }
+  else
+    printf("CMD: SHK origin shift must be +x, -x, +y or -y\n");
+  return(CMD_NORMAL);
+}
+
+//SHK Zernike pseudo-inverse regularization
+static int cmd_shk_pinv_none(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  printf("CMD: SHK pinv regularization disabled\n");
+  sm_p->shk_pinv_method = NUM_PINV_NONE;
+  sm_p->shk_pinv_update = 1;
+  return(CMD_NORMAL);
+}
+
+static int cmd_shk_pinv_thresh(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  if(arg[0].f > SHK_PINV_THRESH_MIN && arg[0].f < SHK_PINV_THRESH_MAX){
+    sm_p->shk_pinv_thresh = arg[0].f;
+    sm_p->shk_pinv_method = NUM_PINV_THRESH;
+    sm_p->shk_pinv_update = 1;
+    printf("CMD: SHK pinv dropping singular values below %.3e * s_max\n",sm_p->shk_pinv_thresh);
+  }
+  else
+    printf("CMD: SHK pinv thresh must be between %f and %f\n",SHK_PINV_THRESH_MIN,SHK_PINV_THRESH_MAX);
+  return(CMD_NORMAL);
+}
+
+static int cmd_shk_pinv_nmodes(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  if(arg[0].i > 0 && arg[0].i <= LOWFS_N_ZERNIKE){
+    sm_p->shk_pinv_nmodes = arg[0].i;
+    sm_p->shk_pinv_method = NUM_PINV_NMODES;
+    sm_p->shk_pinv_update = 1;
+    printf("CMD: SHK pinv keeping %d modes\n",sm_p->shk_pinv_nmodes);
+  }
+  else
+    printf("CMD: SHK pinv nmodes must be between %d and %d\n",1,LOWFS_N_ZERNIKE);
+  return(CMD_NORMAL);
+}
+
+static int cmd_shk_pinv_tikhonov(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  if(arg[0].f > SHK_PINV_ALPHA_MIN && arg[0].f < SHK_PINV_ALPHA_MAX){
+    sm_p->shk_pinv_alpha  = arg[0].f;
+    sm_p->shk_pinv_method = NUM_PINV_TIKHONOV;
+    sm_p->shk_pinv_update = 1;
+    printf("CMD: SHK pinv Tikhonov alpha = %.3e * s_max\n",sm_p->shk_pinv_alpha);
+  }
+  else
+    printf("CMD: SHK pinv alpha must be between %f and %f\n",SHK_PINV_ALPHA_MIN,SHK_PINV_ALPHA_MAX);
+  return(CMD_NORMAL);
+}
+
+static int cmd_shk_pinv_status(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  printf("CMD: SHK pinv method = %d [thresh = %.3e, nmodes = %d, alpha = %.3e]\n",
+	 sm_p->shk_pinv_method,sm_p->shk_pinv_thresh,sm_p->shk_pinv_nmodes,sm_p->shk_pinv_alpha);
+  printf("CMD: SHK pinv cond = %.3e, modes used = %d/%d, gain = %.3e\n",
+	 sm_p->shk_pinv_cond,sm_p->shk_pinv_nused,LOWFS_N_ZERNIKE,sm_p->shk_pinv_gain);
+  return(CMD_NORMAL);
+}
+
+static int cmd_shk_bkg_global(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  printf("CMD: Setting SHK background mode to GLOBAL\n");
+  sm_p->shk_bkg_mode = SHK_BKG_GLOBAL;
+  return(CMD_NORMAL);
+}
+
+static int cmd_shk_bkg_local(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  printf("CMD: Setting SHK background mode to LOCAL\n");
+  sm_p->shk_bkg_mode = SHK_BKG_LOCAL;
+  return(CMD_NORMAL);
+}
+
+static int cmd_shk_roi_on(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  printf("CMD: Turning SHK ROI readout mode ON\n");
+  sm_p->shk_roimode = 1;
+  sm_p->shk_reset_camera = 1;
+  return(CMD_NORMAL);
+}
+
+static int cmd_shk_roi_off(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  printf("CMD: Turning SHK ROI readout mode OFF\n");
+  sm_p->shk_roimode = 0;
+  sm_p->shk_reset_camera = 1;
+  return(CMD_NORMAL);
+}
+
+static int cmd_shk_roi_status(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  printf("CMD: SHK ROI mode = %s, window = [%d, %d, %d, %d] (%.1f%% of frame)\n",
+	 sm_p->shk_roimode ? "ON" : "OFF",sm_p->shk_roi.xoff,sm_p->shk_roi.yoff,sm_p->shk_roi.xs,sm_p->shk_roi.ys,
+	 100.0*sm_p->shk_roi.xs*sm_p->shk_roi.ys/(SHKXS*SHKYS));
+  return(CMD_NORMAL);
+}
+
+//Zernike targets
+static void cmd_zernike_target(volatile double *target, char *wfs, cmdarg_t *arg, int inc){
+  double min = inc ? ALP_DZERNIKE_MIN : ALP_ZERNIKE_MIN;
+  double max = inc ? ALP_DZERNIKE_MAX : ALP_ZERNIKE_MAX;
+  if(arg[0].i >= 0 && arg[0].i < LOWFS_N_ZERNIKE && arg[1].f >= min && arg[1].f <= max){
+    target[arg[0].i] = inc ? target[arg[0].i] + arg[1].f : arg[1].f;
+    printf("CMD: Setting %s target Z[%d] = %f microns\n",wfs,arg[0].i,target[arg[0].i]);
+  }
+  else{
+    printf("CMD: Zernike target out of bounds #[%d,%d] C[%f,%f]\n",0,LOWFS_N_ZERNIKE,min,max);
+  }
+}
+
+static int cmd_shk_target_reset(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  int i;
+  printf("CMD: Setting SHK Zernike targets to zero\n");
+  for(i=0;i<LOWFS_N_ZERNIKE;i++) sm_p->shk_zernike_target[i]=0;
+  return(CMD_NORMAL);
+}
+
+static int cmd_shk_target(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  cmd_zernike_target(sm_p->shk_zernike_target,"SHK",arg,0);
+  return(CMD_NORMAL);
+}
+
+static int cmd_shk_inc_target(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  cmd_zernike_target(sm_p->shk_zernike_target,"SHK",arg,1);
+  return(CMD_NORMAL);
+}
+
+static int cmd_lyt_target_reset(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  int i;
+  printf("CMD: Setting LYT Zernike targets to zero\n");
+  for(i=0;i<LOWFS_N_ZERNIKE;i++) sm_p->lyt_zernike_target[i]=0;
+  return(CMD_NORMAL);
+}
+
+static int cmd_lyt_target(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  cmd_zernike_target(sm_p->lyt_zernike_target,"LYT",arg,0);
+  return(CMD_NORMAL);
+}
+
+static int cmd_lyt_inc_target(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  cmd_zernike_target(sm_p->lyt_zernike_target,"LYT",arg,1);
+  return(CMD_NORMAL);
+}
+
+//Zernike control switches
+static void cmd_zernike_switch(volatile int *control, char *wfs, char *rest, int value){
+  char buf[CMD_MAX_LENGTH];
+  char *pch,*save=NULL;
+  int i,n=0;
+
+  strncpy(buf,rest,sizeof(buf)-1);
+  buf[sizeof(buf)-1] = 0;
+  pch = strtok_r(buf," \t\r\n",&save);
+  //All Zernikes
+  if(pch != NULL && !strcasecmp(pch,"all")){
+    printf("CMD: %s %s control of ALL Zernikes\n\n",value ? "Enabling" : "Disabling",wfs);
+    for(i=0;i<LOWFS_N_ZERNIKE;i++)
+      control[i]=value;
+    return;
+  }
+  //List of Zernikes
+  while(pch != NULL){
+    i = atoi(pch);
+    if(i >= 0 && i < LOWFS_N_ZERNIKE){
+      control[i]=value;
+      printf("CMD: %s %s control of Zernike %d\n",value ? "Enabling" : "Disabling",wfs,i);
+    }
+    else{
+      printf("CMD: Invalid Zernike %d\n",i);
+    }
+    pch = strtok_r(NULL," \t\r\n",&save);
+    n++;
+  }
+  if(n == 0) printf("CMD: Bad command format\n");
+}
+
+static int cmd_shk_zernike_status(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  print_shk_zernikes(sm_p);
+  return(CMD_NORMAL);
+}
+
+static int cmd_shk_zernike_enable(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  cmd_zernike_switch(sm_p->shk_zernike_control,"SHK",rest,1);
+  print_shk_zernikes(sm_p);
+  return(CMD_NORMAL);
+}
+
+static int cmd_shk_zernike_disable(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  cmd_zernike_switch(sm_p->shk_zernike_control,"SHK",rest,0);
+  print_shk_zernikes(sm_p);
+  return(CMD_NORMAL);
+}
+
+static int cmd_lyt_zernike_status(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  print_lyt_zernikes(sm_p);
+  return(CMD_NORMAL);
+}
+
+static int cmd_lyt_zernike_enable(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  cmd_zernike_switch(sm_p->lyt_zernike_control,"LYT",rest,1);
+  print_lyt_zernikes(sm_p);
+  return(CMD_NORMAL);
+}
+
+static int cmd_lyt_zernike_disable(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  cmd_zernike_switch(sm_p->lyt_zernike_control,"LYT",rest,0);
+  print_lyt_zernikes(sm_p);
+  return(CMD_NORMAL);
+}
+
+static int cmd_alp_zernike_status(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  print_alp_zernikes(sm_p);
+  return(CMD_NORMAL);
+}
+
+static int cmd_alp_zernike_enable(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  cmd_zernike_switch(sm_p->alp_zernike_control,"ALP",rest,1);
+  print_alp_zernikes(sm_p);
+  return(CMD_NORMAL);
+}
+
+static int cmd_alp_zernike_disable(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  cmd_zernike_switch(sm_p->alp_zernike_control,"ALP",rest,0);
+  print_alp_zernikes(sm_p);
+  return(CMD_NORMAL);
+}
+
+//Command scripts
+static int cmd_script_run(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  char name[CMD_MAX_LENGTH];
+  //Optional script name, otherwise run the loaded script
+  if(sscanf(rest,"%s",name) == 1)
+    if(scr_load(sm_p,name))
+      return(CMD_NORMAL);
+  scr_start(sm_p);
+  return(CMD_NORMAL);
+}
+
+static int cmd_script_load(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  scr_load(sm_p,arg[0].s);
+  return(CMD_NORMAL);
+}
+
+static int cmd_script_add(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  char *pch = rest;
+  //Add the raw text, statements are checked on load
+  while(isspace(*pch)) pch++;
+  while(*pch && isspace(pch[strlen(pch)-1])) pch[strlen(pch)-1] = 0;
+  if(*pch == 0){
+    printf("CMD: Bad command format. Usage: script add <statements>\n");
+    return(CMD_NORMAL);
+  }
+  scr_add(pch);
+  return(CMD_NORMAL);
+}
+
+static int cmd_script_clear(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  scr_clear();
+  printf("CMD: Cleared script upload buffer\n");
+  return(CMD_NORMAL);
+}
+
+static int cmd_script_save(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  scr_save(arg[0].s);
+  return(CMD_NORMAL);
+}
+
+static int cmd_script_list(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  scr_list();
+  return(CMD_NORMAL);
+}
+
+static int cmd_script_stop(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  scr_stop("user stop");
+  return(CMD_NORMAL);
+}
+
+static int cmd_script_status(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  scr_status();
+  return(CMD_NORMAL);
+}
+
+//Heater PWM scheduler
+static int cmd_htr_stats(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  printf("CMD: HTR PWM loops: %lu\n",(unsigned long)sm_p->htr_nloop);
+  printf("CMD: HTR wakeups per loop: last %u, max %u (%d steps)\n",sm_p->htr_nwake,sm_p->htr_nwake_max,HTR_NSTEPS*HTR_NCYCLES);
+  printf("CMD: HTR wakeup lateness: last %.1f us, max %.1f us\n",sm_p->htr_late*ONE_MILLION,sm_p->htr_late_max*ONE_MILLION);
+  printf("CMD: HTR duty error: last %.3f%%, max %.3f%%\n",sm_p->htr_duty_error,sm_p->htr_duty_error_max);
+  return(CMD_NORMAL);
+}
+
+//Synthetic frames (FAKEMODE_ZERNIKE)
+static int cmd_fake_zernike(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  if(arg[0].i < 0 || arg[0].i >= LOWFS_N_ZERNIKE){
+    printf("CMD: Zernike index out of bounds [%d,%d]\n",0,LOWFS_N_ZERNIKE-1);
+    return(CMD_NORMAL);
+  }
+  if(arg[1].f < -FAKE_ZERNIKE_MAX || arg[1].f > FAKE_ZERNIKE_MAX){
+    printf("CMD: Fake zernike out of bounds [%f,%f]\n",-FAKE_ZERNIKE_MAX,FAKE_ZERNIKE_MAX);
+    return(CMD_NORMAL);
+  }
+  sm_p->fakecfg.zernike[arg[0].i] = arg[1].f;
+  printf("CMD: Set fake zernike %d to %f microns\n",arg[0].i,arg[1].f);
+  return(CMD_NORMAL);
+}
+
+static int cmd_fake_zernike_reset(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  memset((void *)sm_p->fakecfg.zernike,0,sizeof(sm_p->fakecfg.zernike));
+  printf("CMD: Fake zernikes set to zero\n");
+  return(CMD_NORMAL);
+}
+
+static int cmd_fake_shk_flux(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  if(arg[0].f >= 0 && arg[0].f <= FAKE_FLUX_MAX){
+    sm_p->fakecfg.shk_flux = arg[0].f;
+    printf("CMD: Set fake SHK spot peak to %.1f ADU\n",sm_p->fakecfg.shk_flux);
+  }else{
+    printf("CMD: Fake flux out of bounds [%d,%d]\n",0,FAKE_FLUX_MAX);
+  }
+  return(CMD_NORMAL);
+}
+
+static int cmd_fake_lyt_flux(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  if(arg[0].f >= 0 && arg[0].f <= FAKE_FLUX_MAX){
+    sm_p->fakecfg.lyt_flux = arg[0].f;
+    printf("CMD: Set fake LYT reference peak to %.1f ADU\n",sm_p->fakecfg.lyt_flux);
+  }else{
+    printf("CMD: Fake flux out of bounds [%d,%d]\n",0,FAKE_FLUX_MAX);
+  }
+  return(CMD_NORMAL);
+}
+
+static int cmd_fake_noise(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  if(arg[0].f >= 0 && arg[0].f <= FAKE_NOISE_MAX){
+    sm_p->fakecfg.read_noise = arg[0].f;
+    printf("CMD: Set fake read noise to %.2f ADU\n",sm_p->fakecfg.read_noise);
+  }else{
+    printf("CMD: Fake read noise out of bounds [%d,%d]\n",0,FAKE_NOISE_MAX);
+  }
+  return(CMD_NORMAL);
+}
+
+static int cmd_fake_background(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  sm_p->fakecfg.background = arg[0].f;
+  printf("CMD: Set fake background to %.2f ADU\n",sm_p->fakecfg.background);
+  return(CMD_NORMAL);
+}
+
+static int cmd_fake_gradient(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  sm_p->fakecfg.xgradient = arg[0].f;
+  sm_p->fakecfg.ygradient = arg[1].f;
+  printf("CMD: Set fake background gradient to [%.3f, %.3f] ADU/pixel\n",sm_p->fakecfg.xgradient,sm_p->fakecfg.ygradient);
+  return(CMD_NORMAL);
+}
+
+static int cmd_fake_dropout(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  if(arg[0].f >= 0 && arg[0].f <= 1){
+    sm_p->fakecfg.dropout = arg[0].f;
+    printf("CMD: Set fake SHK spot dropout to %.3f\n",sm_p->fakecfg.dropout);
+  }else{
+    printf("CMD: Fake dropout out of bounds [%d,%d]\n",0,1);
+  }
+  return(CMD_NORMAL);
+}
+
+static int cmd_fake_status(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  int i;
+  printf("CMD: Fake SHK spot peak %.1f ADU, dropout %.3f\n",sm_p->fakecfg.shk_flux,sm_p->fakecfg.dropout);
+  printf("CMD: Fake LYT reference peak %.1f ADU\n",sm_p->fakecfg.lyt_flux);
+  printf("CMD: Fake read noise %.2f ADU, background %.2f ADU, gradient [%.3f, %.3f] ADU/pixel\n",
+	 sm_p->fakecfg.read_noise,sm_p->fakecfg.background,sm_p->fakecfg.xgradient,sm_p->fakecfg.ygradient);
+  for(i=0;i<LOWFS_N_ZERNIKE;i++)
+    if(sm_p->fakecfg.zernike[i] != 0)
+      printf("CMD: Fake zernike %2d: %f microns\n",i,sm_p->fakecfg.zernike[i]);
+  return(CMD_NORMAL);
+}
+
+//Optical plant (FAKEMODE_PLANT)
+static int cmd_plant_reset(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  alp_load_zernike_errors(sm_p);
+  plant_reset(sm_p);
+  return(CMD_NORMAL);
+}
+
+static int cmd_plant_speedup(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  if(arg[0].f > 0 && arg[0].f <= PLANT_SPEEDUP_MAX){
+    plant_set_speedup(sm_p,arg[0].f);
+    printf("CMD: Set plant speedup to %.2fx\n",sm_p->plantcfg.speedup);
+  }else{
+    printf("CMD: Plant speedup out of bounds (%d,%d]\n",0,(int)PLANT_SPEEDUP_MAX);
+  }
+  return(CMD_NORMAL);
+}
+
+static int cmd_plant_dist(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  if(arg[0].f >= 0 && arg[0].f <= PLANT_DIST_SCALE_MAX){
+    sm_p->plantcfg.dist_scale = arg[0].f;
+    printf("CMD: Set plant disturbance scale to %.2f\n",sm_p->plantcfg.dist_scale);
+  }else{
+    printf("CMD: Plant disturbance scale out of bounds [%d,%d]\n",0,(int)PLANT_DIST_SCALE_MAX);
+  }
+  return(CMD_NORMAL);
+}
+
+static int cmd_plant_sine_freq(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  if(arg[0].f >= 0){
+    sm_p->plantcfg.sine_freq = arg[0].f;
+    printf("CMD: Set plant sine frequency to %.2f Hz\n",sm_p->plantcfg.sine_freq);
+  }else{
+    printf("CMD: Plant sine frequency must be positive\n");
+  }
+  return(CMD_NORMAL);
+}
+
+static int cmd_plant_sine(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  if(arg[0].i < -1 || arg[0].i >= LOWFS_N_ZERNIKE){
+    printf("CMD: Zernike index out of bounds [%d,%d], -1 = off\n",-1,LOWFS_N_ZERNIKE-1);
+    return(CMD_NORMAL);
+  }
+  if(arg[1].f < -PLANT_SINE_AMP_MAX || arg[1].f > PLANT_SINE_AMP_MAX){
+    printf("CMD: Plant sine amplitude out of bounds [%f,%f]\n",-PLANT_SINE_AMP_MAX,PLANT_SINE_AMP_MAX);
+    return(CMD_NORMAL);
+  }
+  sm_p->plantcfg.sine_zernike = arg[0].i;
+  sm_p->plantcfg.sine_amp     = arg[1].f;
+  if(arg[0].i < 0)
+    printf("CMD: Plant sine disturbance off\n");
+  else
+    printf("CMD: Set plant sine on zernike %d to %f microns\n",arg[0].i,arg[1].f);
+  return(CMD_NORMAL);
+}
+
+static int cmd_plant_stats(char *rest, cmdarg_t *arg, sm_t *sm_p){
+  plant_status(sm_p);
+  return(CMD_NORMAL);
+}
+
+/**************************************************************/
+/* COMMAND TABLE                                              */
+/*  - Compiled into the dispatch trie on the first command    */
+/*  - Commands not listed here use the strncasecmp chain in   */
+/*    handle_command                                          */
+/**************************************************************/
+static cmdent_t cmdtable[] = {
+  //name                    args  handler                  states         commander
+  //--Process control
+  {"proc status",           "",   cmd_proc_status,         CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"proc stats",            "",   cmd_proc_stats,          CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"frm stats",             "",   cmd_frm_stats,           CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"log status",            "",   cmd_log_status,          CMD_STATE_ANY, CMD_CMDR_NONE},
+  //--Calibration settings
+  {"alp timer length",      "f",  cmd_alp_timer_length,    CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"alp cal scale",         "f",  cmd_alp_cal_scale,       CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"bmc timer length",      "f",  cmd_bmc_timer_length,    CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"bmc cal scale",         "f",  cmd_bmc_cal_scale,       CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"cal status",            "",   cmd_cal_status,          CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"cal reload all",        "",   cmd_cal_reload_all,      CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"cal reload",            "s",  cmd_cal_reload,          CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"calsnap status",        "",   cmd_calsnap_status,      CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"calsnap save",          "",   cmd_calsnap_save,        CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"calsnap clear",         "",   cmd_calsnap_clear,       CMD_STATE_ANY, CMD_CMDR_NONE},
+  //--Shack-Hartmann LOWFS settings
+  {"shk set origin",        "",   cmd_shk_set_origin,      CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"shk revert origin",     "",   cmd_shk_revert_origin,   CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"shk save origin",       "",   cmd_shk_save_origin,     CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"shk load origin",       "",   cmd_shk_load_origin,     CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"shk shift origin",      "s",  cmd_shk_shift_origin,    CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"shk pinv none",         "",   cmd_shk_pinv_none,       CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"shk pinv thresh",       "f",  cmd_shk_pinv_thresh,     CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"shk pinv nmodes",       "i",  cmd_shk_pinv_nmodes,     CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"shk pinv tikhonov",     "f",  cmd_shk_pinv_tikhonov,   CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"shk pinv status",       "",   cmd_shk_pinv_status,     CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"shk background global", "",   cmd_shk_bkg_global,      CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"shk background local",  "",   cmd_shk_bkg_local,       CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"shk roi on",            "",   cmd_shk_roi_on,          CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"shk roi off",           "",   cmd_shk_roi_off,         CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"shk roi status",        "",   cmd_shk_roi_status,      CMD_STATE_ANY, CMD_CMDR_NONE},
+  //--Zernike targets
+  {"shk target reset",      "",   cmd_shk_target_reset,    CMD_STATE_ANY, CMD_CMDR_TGT},
+  {"shk target",            "if", cmd_shk_target,          CMD_STATE_ANY, CMD_CMDR_TGT},
+  {"shk inc target",        "if", cmd_shk_inc_target,      CMD_STATE_ANY, CMD_CMDR_TGT},
+  {"lyt target reset",      "",   cmd_lyt_target_reset,    CMD_STATE_ANY, CMD_CMDR_TGT},
+  {"lyt target",            "if", cmd_lyt_target,          CMD_STATE_ANY, CMD_CMDR_TGT},
+  {"lyt inc target",        "if", cmd_lyt_inc_target,      CMD_STATE_ANY, CMD_CMDR_TGT},
+  //--Zernike control switches
+  {"shk zernike status",    "",   cmd_shk_zernike_status,  CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"shk zernike enable",    "",   cmd_shk_zernike_enable,  CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"shk zernike disable",   "",   cmd_shk_zernike_disable, CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"lyt zernike status",    "",   cmd_lyt_zernike_status,  CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"lyt zernike enable",    "",   cmd_lyt_zernike_enable,  CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"lyt zernike disable",   "",   cmd_lyt_zernike_disable, CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"alp zernike status",    "",   cmd_alp_zernike_status,  CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"alp zernike enable",    "",   cmd_alp_zernike_enable,  CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"alp zernike disable",   "",   cmd_alp_zernike_disable, CMD_STATE_ANY, CMD_CMDR_NONE},
+  //--Command scripts
+  {"script run",            "",   cmd_script_run,          CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"script load",           "s",  cmd_script_load,         CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"script add",            "",   cmd_script_add,          CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"script clear",          "",   cmd_script_clear,        CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"script save",           "s",  cmd_script_save,         CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"script list",           "",   cmd_script_list,         CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"script stop",           "",   cmd_script_stop,         CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"script status",         "",   cmd_script_status,       CMD_STATE_ANY, CMD_CMDR_NONE},
+  //--Heater control
+  {"htr stats",             "",   cmd_htr_stats,           CMD_STATE_ANY, CMD_CMDR_NONE},
+  //--Synthetic frames
+  {"fake zernike reset",    "",   cmd_fake_zernike_reset,  CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"fake zernike",          "if", cmd_fake_zernike,        CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"fake shk flux",         "f",  cmd_fake_shk_flux,       CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"fake lyt flux",         "f",  cmd_fake_lyt_flux,       CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"fake noise",            "f",  cmd_fake_noise,          CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"fake background",       "f",  cmd_fake_background,     CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"fake gradient",         "ff", cmd_fake_gradient,       CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"fake dropout",          "f",  cmd_fake_dropout,        CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"fake status",           "",   cmd_fake_status,         CMD_STATE_ANY, CMD_CMDR_NONE},
+  //--Optical plant
+  {"plant reset",           "",   cmd_plant_reset,         CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"plant speedup",         "f",  cmd_plant_speedup,       CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"plant dist",            "f",  cmd_plant_dist,          CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"plant sine freq",       "f",  cmd_plant_sine_freq,     CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"plant sine",            "if", cmd_plant_sine,          CMD_STATE_ANY, CMD_CMDR_NONE},
+  {"plant stats",           "",   cmd_plant_stats,         CMD_STATE_ANY, CMD_CMDR_NONE},
+};
+#define CMD_NTABLE (sizeof(cmdtable)/sizeof(cmdtable[0]))
+
 /**************************************************************/
 /* HANDLE_COMMAND                                             */
 /*  - Handle user commands                                    */
@@ -380,6 +1104,7 @@ int handle_command(char *line, sm_t *sm_p){
   double hex_poke=0;
   int    calmode=0,phasemode=0,optmode=0;
   uint16_t led;
+  struct timespec now;
   static double trl_poke = HEX_TRL_POKE;
   static double rot_poke = HEX_ROT_POKE;
   static calmode_t alpcalmodes[ALP_NCALMODES];
@@ -431,10 +1156,19 @@ int handle_command(char *line, sm_t *sm_p){
     //Init SCI optmodes
     for(i=0;i<SCI_NOPTMODES;i++)
       sci_init_optmode(i,&scioptmodes[i]);
+    //Compile command table
+    if(cmd_table_init(cmdtable,CMD_NTABLE))
+      printf("CMD: Command table init failed, using legacy commands only\n");
     //Set init flag
     init=1;
   }
 
+  /****************************************
+   * TABLE COMMANDS
+   ***************************************/
+  if((ret = cmd_dispatch(line,sm_p)) != CMD_NOT_FOUND)
+    return(ret);
+
   /****************************************
    * SYSTEM COMMANDS
    ***************************************/
@@ -602,13 +1336,6 @@ int handle_command(char *line, sm_t *sm_p){
     }
   }
 
-  //Get process status
-  sprintf(cmd,"proc status");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    print_proc_status(sm_p);
-    return(CMD_NORMAL);
-  }
-
   /****************************************
    * CIRCULAR BUFFER SETTINGS
    ***************************************/
@@ -721,6 +1448,30 @@ int handle_command(char *line, sm_t *sm_p){
       }
     }
   }
+
+  /****************************************
+   * RECONSTRUCTOR PRECISION
+   ***************************************/
+
+  //Reconstructor precision
+  for(i=0;i<NCLIENTS;i++){
+    if(i == SHKID || i == LYTID){
+      sprintf(cmd,"%s recon float",sm_p->w[i].name);
+      for(j=0;j<strlen(cmd);j++) cmd[j]=tolower(cmd[j]);
+      if(!strncasecmp(line,cmd,strlen(cmd))){
+	sm_p->w[i].precision = NUM_PRECISION_FLOAT;
+	printf("CMD: Changed %s reconstructor to single precision\n",sm_p->w[i].name);
+	return(CMD_NORMAL);
+      }
+      sprintf(cmd,"%s recon double",sm_p->w[i].name);
+      for(j=0;j<strlen(cmd);j++) cmd[j]=tolower(cmd[j]);
+      if(!strncasecmp(line,cmd,strlen(cmd))){
+	sm_p->w[i].precision = NUM_PRECISION_DOUBLE;
+	printf("CMD: Changed %s reconstructor to double precision\n",sm_p->w[i].name);
+	return(CMD_NORMAL);
+      }
+    }
+  }
   
   /****************************************
    * CALIBRATION MODES
@@ -794,63 +1545,6 @@ int handle_command(char *line, sm_t *sm_p){
     return(CMD_NORMAL);
   }
 
-  /****************************************
-   * CALIBRATION SETTINGS
-   ***************************************/
-
-  //ALP timer length
-  sprintf(cmd,"alp timer length");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    ftemp = atof(line+strlen(cmd)+1);
-    if(ftemp > 0 && ftemp <= ALP_CAL_TIMER_MAX){
-      sm_p->alp_cal_timer_length = ftemp;
-      printf("CMD: Changed ALP calibration timer length to %.1f seconds\n",sm_p->alp_cal_timer_length);
-    }else{
-      printf("CMD: ALP calibration timer out of bounds [%d,%f]\n",0,(double)ALP_CAL_TIMER_MAX);
-    }
-    return(CMD_NORMAL);
-  }
-  
-  //ALP calibration scale
-  sprintf(cmd,"alp cal scale");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    ftemp = atof(line+strlen(cmd)+1);
-    if(ftemp >= 0 && ftemp <= ALP_CAL_SCALE_MAX){
-      sm_p->alp_cal_scale = ftemp;
-      printf("CMD: Changed ALP calibration scale to %.3f\n",sm_p->alp_cal_scale);
-    }else{
-      printf("CMD: ALP calibration scale out of bounds [%d,%d]\n",0,ALP_CAL_SCALE_MAX);
-    }
-    return(CMD_NORMAL);
-  }
-  
-  //BMC timer length
-  sprintf(cmd,"bmc timer length");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    ftemp = atof(line+strlen(cmd)+1);
-    if(ftemp > 0 && ftemp <= BMC_CAL_TIMER_MAX){
-      sm_p->bmc_cal_timer_length = ftemp;
-      printf("CMD: Changed BMC calibration timer length to %.1f seconds\n",sm_p->bmc_cal_timer_length);
-    }else{
-      printf("CMD: BMC calibration timer out of bounds [%d,%f]\n",0,(double)BMC_CAL_TIMER_MAX);
-    }
-    return(CMD_NORMAL);
-  }
-  
-  //BMC calibration scale
-  sprintf(cmd,"bmc cal scale");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    ftemp = atof(line+strlen(cmd)+1);
-    if(ftemp >= 0 && ftemp <= BMC_CAL_SCALE_MAX){
-      sm_p->bmc_cal_scale = ftemp;
-      printf("CMD: Changed BMC calibration scale to %.3f\n",sm_p->bmc_cal_scale);
-    }else{
-      printf("CMD: BMC calibration scale out of bounds [%d,%d]\n",0,BMC_CAL_SCALE_MAX);
-    }
-    return(CMD_NORMAL);
-  }
-
-
   /****************************************
    * STATES
    ***************************************/
@@ -1039,8 +1733,10 @@ int handle_command(char *line, sm_t *sm_p){
       //Get hex error
       sprintf(cmd,"hex get error");
       if(!strncasecmp(line,cmd,strlen(cmd))){
-	if(sm_p->hex_ready)
-	  hex_get_error(sm_p->hexfd);
+	if(sm_p->hex_ready){
+	  if(hex_request(sm_p,HEX_REQ_ERROR))
+	    printf("CMD: hex_request failed\n");
+	}
 	else
 	  printf("CMD: HEX not ready\n");
 	return(CMD_NORMAL);
@@ -1049,15 +1745,9 @@ int handle_command(char *line, sm_t *sm_p){
       sprintf(cmd,"hex init");
       if(!strncasecmp(line,cmd,strlen(cmd))){
 	if(HEX_ENABLE){
-	  printf("CMD: Opening HEX driver\n");
-	  if(hex_init((int *)&sm_p->hexfd)){
-	    sm_p->hex_ready = 0;
-	    printf("CMD: ERROR: HEX init failed!\n");
-	  }
-	  else{
-	    sm_p->hex_ready = 1;
-	    printf("CMD: HEX ready\n");
-	  }
+	  printf("CMD: Requesting HEX init\n");
+	  if(hex_request(sm_p,HEX_REQ_INIT))
+	    printf("CMD: hex_request failed\n");
 	}
 	else{
 	  printf("CMD: HEX disabled\n");
@@ -1095,8 +1785,19 @@ int handle_command(char *line, sm_t *sm_p){
 	  printf("CMD: HEX not ready\n");
 	  return(CMD_NORMAL);
 	}
-	printf("CMD: Getting hexapod position\n");
-	hex_printpos(sm_p->hexfd);
+	clock_gettime(CLOCK_REALTIME,&now);
+	ts2double(&now,&ftemp);
+	printf("CMD: Hexapod position (polled %.2f s ago%s)\n",ftemp-sm_p->hex_position_time,sm_p->hex_moving ? ", moving" : "");
+	printf("CMD: {%f,%f,%f,%f,%f,%f}\n",sm_p->hex_position[0],sm_p->hex_position[1],sm_p->hex_position[2],
+	       sm_p->hex_position[3],sm_p->hex_position[4],sm_p->hex_position[5]);
+	return(CMD_NORMAL);
+      }
+      //Print engine statistics
+      sprintf(cmd,"hex stats");
+      if(!strncasecmp(line,cmd,strlen(cmd))){
+	printf("CMD: HEX moves: %u sent, %u coalesced, %u errors\n",sm_p->hex_nmove,sm_p->hex_ncoalesce,sm_p->hex_nerror);
+	printf("CMD: HEX post->MOV latency: last %.4f s, max %.4f s\n",sm_p->hex_latency_cmd,sm_p->hex_latency_cmd_max);
+	printf("CMD: HEX post->stop latency: last %.4f s, max %.4f s\n",sm_p->hex_latency_move,sm_p->hex_latency_move_max);
 	return(CMD_NORMAL);
       }
       //Set 6-axis position
@@ -1644,6 +2345,33 @@ int handle_command(char *line, sm_t *sm_p){
     }
     return(CMD_NORMAL);
   }
+
+  //Asynchronous SCI BMC commands
+  sprintf(cmd,"bmc async on");
+  if(!strncasecmp(line,cmd,strlen(cmd))){
+    printf("CMD: Turning BMC async commands ON\n");
+    sm_p->bmc_async=1;
+    return(CMD_NORMAL);
+  }
+  sprintf(cmd,"bmc async off");
+  if(!strncasecmp(line,cmd,strlen(cmd))){
+    printf("CMD: Turning BMC async commands OFF\n");
+    sm_p->bmc_async=0;
+    return(CMD_NORMAL);
+  }
+
+  //Print BMC command timing
+  sprintf(cmd,"bmc timing");
+  if(!strncasecmp(line,cmd,strlen(cmd))){
+    printf("CMD: BMC async: %s  Sent: %u  Done: %u\n",sm_p->bmc_async ? "ON" : "OFF",sm_p->bmc_seq_sent,sm_p->bmc_seq_done);
+    if(sm_p->bmc_time.count)
+      printf("CMD: BMC round trip [ms]: N=%lu  Last=%.3f  Min=%.3f  Max=%.3f  Avg=%.3f\n",
+	     (unsigned long)sm_p->bmc_time.count,sm_p->bmc_time.last*1000,sm_p->bmc_time.min*1000,sm_p->bmc_time.max*1000,
+	     sm_p->bmc_time.sum*1000/sm_p->bmc_time.count);
+    else
+      printf("CMD: BMC round trip: no commands timed\n");
+    return(CMD_NORMAL);
+  }
  
   
   //Set all BMC actuators to the same value
@@ -2592,67 +3320,6 @@ int handle_command(char *line, sm_t *sm_p){
     return(CMD_NORMAL);
   }
   
-  /****************************************
-   * SHACK-HARTMANN LOWFS SETTINGS
-   **************************************/
-  
-  //SHK Origin
-  sprintf(cmd,"shk set origin");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    printf("CMD: Setting SHK origin\n");
-    sm_p->shk_setorigin=1;
-    return(CMD_NORMAL);
-  }
-
-  sprintf(cmd,"shk revert origin");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    printf("CMD: Reverting SHK origin\n");
-    sm_p->shk_revertorigin=1;
-    return(CMD_NORMAL);
-  }
-
-  sprintf(cmd,"shk save origin");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    printf("CMD: Saving SHK origin\n");
-    sm_p->shk_saveorigin=1;
-    return(CMD_NORMAL);
-  }
-
-  sprintf(cmd,"shk load origin");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    printf("CMD: Loading SHK origin\n");
-    sm_p->shk_loadorigin=1;
-    return(CMD_NORMAL);
-  }
-  
-  sprintf(cmd,"shk shift origin +x");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    printf("CMD: SHK shift origin +1px in X\n");
-    sm_p->shk_xshiftorigin = 1;
-    return CMD_NORMAL;
-  }
-
-  sprintf(cmd,"shk shift origin -x");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    printf("CMD: SHK shift origin -1px in X\n");
-    sm_p->shk_xshiftorigin = -1;
-    return CMD_NORMAL;
-  }
-
-  sprintf(cmd,"shk shift origin +y");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    printf("CMD: SHK shift origin +1px in Y\n");
-    sm_p->shk_yshiftorigin = 1;
-    return CMD_NORMAL;
-  }
-
-  sprintf(cmd,"shk shift origin -y");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    printf("CMD: SHK shift origin -1px in Y\n");
-    sm_p->shk_yshiftorigin = -1;
-    return CMD_NORMAL;
-  }
-  
   /****************************************
    * LYOT LOWFS SETTINGS
    **************************************/
@@ -2910,326 +3577,6 @@ int handle_command(char *line, sm_t *sm_p){
     return(CMD_NORMAL);
   }
 
-  /****************************************
-   * ZERNIKE TARGETS
-   **************************************/
-
-  //SHK Zernike Targets
-  sprintf(cmd,"shk target reset");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    if(sm_p->state_array[sm_p->state].tgt_commander == WATID){
-      printf("CMD: Setting SHK Zernike targets to zero\n");
-      for(i=0;i<LOWFS_N_ZERNIKE;i++) sm_p->shk_zernike_target[i]=0;
-    }
-    else
-      printf("CMD: Manual TGT control disabled in this state\n");
-
-    return CMD_NORMAL;
-  }
-  
-  sprintf(cmd,"shk target");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    if(sm_p->state_array[sm_p->state].tgt_commander == WATID){
-      pch = strtok(line+strlen(cmd)," ");
-      if(pch == NULL){
-	printf("CMD: Bad command format\n");
-	return CMD_NORMAL;
-      }
-      itemp  = atoi(pch);
-      pch = strtok(NULL," ");
-      if(pch == NULL){
-	printf("CMD: Bad command format\n");
-	return CMD_NORMAL;
-      }
-      ftemp  = atof(pch);
-      if(itemp >= 0 && itemp < LOWFS_N_ZERNIKE && ftemp >= ALP_ZERNIKE_MIN && ftemp <= ALP_ZERNIKE_MAX){
-	sm_p->shk_zernike_target[itemp] = ftemp;
-	printf("CMD: Setting SHK target Z[%d] = %f microns\n",itemp,sm_p->shk_zernike_target[itemp]);
-      }
-      else{
-	printf("CMD: Zernike target out of bounds #[%d,%d] C[%f,%f]\n",0,LOWFS_N_ZERNIKE,ALP_ZERNIKE_MIN,ALP_ZERNIKE_MAX);
-	return CMD_NORMAL;
-      }
-    }
-    else
-      printf("CMD: Manual TGT control disabled in this state\n");
-    return CMD_NORMAL;
-  }
-  
-  sprintf(cmd,"shk inc target");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    if(sm_p->state_array[sm_p->state].tgt_commander == WATID){
-      pch = strtok(line+strlen(cmd)," ");
-      if(pch == NULL){
-	printf("CMD: Bad command format\n");
-	return CMD_NORMAL;
-      }
-      itemp  = atoi(pch);
-      pch = strtok(NULL," ");
-      if(pch == NULL){
-	printf("CMD: Bad command format\n");
-	return CMD_NORMAL;
-      }
-      ftemp  = atof(pch);
-      if(itemp >= 0 && itemp < LOWFS_N_ZERNIKE && ftemp >= ALP_DZERNIKE_MIN && ftemp <= ALP_DZERNIKE_MAX){
-	sm_p->shk_zernike_target[itemp] += ftemp;
-	printf("CMD: Setting SHK target Z[%d] = %f microns\n",itemp,sm_p->shk_zernike_target[itemp]);
-      }
-      else{
-	printf("CMD: Zernike target out of bounds #[%d,%d] C[%f,%f]\n",0,LOWFS_N_ZERNIKE,ALP_DZERNIKE_MIN,ALP_DZERNIKE_MAX);
-	return CMD_NORMAL;
-      }
-    }
-    else
-      printf("CMD: Manual TGT control disabled in this state\n");
-    return CMD_NORMAL;
-  }
-
-  //LYT Zernike Targets
-  sprintf(cmd,"lyt target reset");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    if(sm_p->state_array[sm_p->state].tgt_commander == WATID){
-      printf("CMD: Setting LYT Zernike targets to zero\n");
-      for(i=0;i<LOWFS_N_ZERNIKE;i++) sm_p->lyt_zernike_target[i]=0;
-    }
-    else
-      printf("CMD: Manual TGT control disabled in this state\n");
-    return CMD_NORMAL;
-  }
-
-  sprintf(cmd,"lyt target");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    if(sm_p->state_array[sm_p->state].tgt_commander == WATID){
-      pch = strtok(line+strlen(cmd)," ");
-      if(pch == NULL){
-	printf("CMD: Bad command format\n");
-	return CMD_NORMAL;
-      }
-      itemp  = atoi(pch);
-      pch = strtok(NULL," ");
-      if(pch == NULL){
-	printf("CMD: Bad command format\n");
-	return CMD_NORMAL;
-      }
-      ftemp  = atof(pch);
-      if(itemp >= 0 && itemp < LOWFS_N_ZERNIKE && ftemp >= ALP_ZERNIKE_MIN && ftemp <= ALP_ZERNIKE_MAX){
-	sm_p->lyt_zernike_target[itemp] = ftemp;
-	printf("CMD: Setting LYT target Z[%d] = %f microns\n",itemp,sm_p->lyt_zernike_target[itemp]);
-      }
-      else{
-	printf("CMD: Zernike target out of bounds #[%d,%d] C[%f,%f]\n",0,LOWFS_N_ZERNIKE,ALP_ZERNIKE_MIN,ALP_ZERNIKE_MAX);
-	return CMD_NORMAL;
-      }
-    }
-    else
-      printf("CMD: Manual TGT control disabled in this state\n");
-    return CMD_NORMAL;
-  }
-
-  sprintf(cmd,"lyt inc target");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    if(sm_p->state_array[sm_p->state].tgt_commander == WATID){
-      pch = strtok(line+strlen(cmd)," ");
-      if(pch == NULL){
-	printf("CMD: Bad command format\n");
-	return CMD_NORMAL;
-      }
-      itemp  = atoi(pch);
-      pch = strtok(NULL," ");
-      if(pch == NULL){
-	printf("CMD: Bad command format\n");
-	return CMD_NORMAL;
-      }
-      ftemp  = atof(pch);
-      if(itemp >= 0 && itemp < LOWFS_N_ZERNIKE && ftemp >= ALP_DZERNIKE_MIN && ftemp <= ALP_DZERNIKE_MAX){
-	sm_p->lyt_zernike_target[itemp] += ftemp;
-	printf("CMD: Setting LYT target Z[%d] = %f microns\n",itemp,sm_p->lyt_zernike_target[itemp]);
-      }
-      else{
-	printf("CMD: Zernike target out of bounds #[%d,%d] C[%f,%f]\n",0,LOWFS_N_ZERNIKE,ALP_DZERNIKE_MIN,ALP_DZERNIKE_MAX);
-	return CMD_NORMAL;
-      }
-    }
-    else
-      printf("CMD: Manual TGT control disabled in this state\n");
-    return CMD_NORMAL;
-  }
-  
-  /****************************************
-   * ZERNIKE CONTROL SWITCHES
-   **************************************/
-  
-  //SHK Zernike control commands
-  sprintf(cmd,"shk zernike status");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    print_shk_zernikes(sm_p);
-    return CMD_NORMAL;
-  }
-  sprintf(cmd,"shk zernike disable all");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    printf("CMD: Disabling SHK control of ALL Zernikes\n\n");
-    for(i=0;i<LOWFS_N_ZERNIKE;i++)
-      sm_p->shk_zernike_control[i]=0;
-    print_shk_zernikes(sm_p);
-    return CMD_NORMAL;
-  }
-  sprintf(cmd,"shk zernike enable all");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    printf("CMD: Enabling SHK control of ALL Zernikes\n\n");
-    for(i=0;i<LOWFS_N_ZERNIKE;i++)
-      sm_p->shk_zernike_control[i]=1;
-    print_shk_zernikes(sm_p);
-    return CMD_NORMAL;
-  }
-  sprintf(cmd,"shk zernike disable");
-  if(!strncasecmp(line,cmd,strlen(cmd)) && strlen(line) > strlen(cmd)){
-    pch = strtok(line+strlen(cmd)," ");
-    while(pch != NULL){
-      itemp  = atoi(pch);
-      if(itemp >= 0 && itemp < LOWFS_N_ZERNIKE){
-	sm_p->shk_zernike_control[itemp]=0;
-	printf("CMD: Disabling SHK control of Zernike %d\n",itemp);
-      }
-      else{
-	printf("CMD: Invalid Zernike %d\n",itemp);
-      }
-      pch = strtok(NULL," ");
-    }
-    print_shk_zernikes(sm_p);
-    return CMD_NORMAL;
-  }
-  sprintf(cmd,"shk zernike enable");
-  if(!strncasecmp(line,cmd,strlen(cmd)) && strlen(line) > strlen(cmd)){
-    pch = strtok(line+strlen(cmd)," ");
-    while(pch != NULL){
-      itemp  = atoi(pch);
-      if(itemp >= 0 && itemp < LOWFS_N_ZERNIKE){
-	sm_p->shk_zernike_control[itemp]=1;
-	printf("CMD: Enabling SHK control of Zernike %d\n",itemp);
-      }
-      else{
-	printf("CMD: Invalid Zernike %d\n",itemp);
-      }
-      pch = strtok(NULL," ");
-    }
-    print_shk_zernikes(sm_p);
-    return CMD_NORMAL;
-  }
-
-  //LYT Zernike control commands
-  sprintf(cmd,"lyt zernike status");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    print_lyt_zernikes(sm_p);
-    return CMD_NORMAL;
-  }
-  sprintf(cmd,"lyt zernike disable all");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    printf("CMD: Disabling LYT control of ALL Zernikes\n\n");
-    for(i=0;i<LOWFS_N_ZERNIKE;i++)
-      sm_p->lyt_zernike_control[i]=0;
-    print_lyt_zernikes(sm_p);
-    return CMD_NORMAL;
-  }
-  sprintf(cmd,"lyt zernike enable all");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    printf("CMD: Enabling LYT control of ALL Zernikes\n\n");
-    for(i=0;i<LOWFS_N_ZERNIKE;i++)
-      sm_p->lyt_zernike_control[i]=1;
-    print_lyt_zernikes(sm_p);
-    return CMD_NORMAL;
-  }
-  sprintf(cmd,"lyt zernike disable");
-  if(!strncasecmp(line,cmd,strlen(cmd)) && strlen(line) > strlen(cmd)){
-    pch = strtok(line+strlen(cmd)," ");
-    while(pch != NULL){
-      itemp  = atoi(pch);
-      if(itemp >= 0 && itemp < LOWFS_N_ZERNIKE){
-	sm_p->lyt_zernike_control[itemp]=0;
-	printf("CMD: Disabling LYT control of Zernike %d\n",itemp);
-      }
-      else{
-	printf("CMD: Invalid Zernike %d\n",itemp);
-      }
-      pch = strtok(NULL," ");
-    }
-    print_lyt_zernikes(sm_p);
-    return CMD_NORMAL;
-  }
-  sprintf(cmd,"lyt zernike enable");
-  if(!strncasecmp(line,cmd,strlen(cmd)) && strlen(line) > strlen(cmd)){
-    pch = strtok(line+strlen(cmd)," ");
-    while(pch != NULL){
-      itemp  = atoi(pch);
-      if(itemp >= 0 && itemp < LOWFS_N_ZERNIKE){
-	sm_p->lyt_zernike_control[itemp]=1;
-	printf("CMD: Enabling LYT control of Zernike %d\n",itemp);
-      }
-      else{
-	printf("CMD: Invalid Zernike %d\n",itemp);
-      }
-      pch = strtok(NULL," ");
-    }
-    print_lyt_zernikes(sm_p);
-    return CMD_NORMAL;
-  }
-  
-  //ALP Zernike control commands
-  sprintf(cmd,"alp zernike status");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    print_alp_zernikes(sm_p);
-    return CMD_NORMAL;
-  }
-  sprintf(cmd,"alp zernike disable all");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    printf("CMD: Disabling ALP control of ALL Zernikes\n\n");
-    for(i=0;i<LOWFS_N_ZERNIKE;i++)
-      sm_p->alp_zernike_control[i]=0;
-    print_alp_zernikes(sm_p);
-    return CMD_NORMAL;
-  }
-  sprintf(cmd,"alp zernike enable all");
-  if(!strncasecmp(line,cmd,strlen(cmd))){
-    printf("CMD: Enabling ALP control of ALL Zernikes\n\n");
-    for(i=0;i<LOWFS_N_ZERNIKE;i++)
-      sm_p->alp_zernike_control[i]=1;
-    print_alp_zernikes(sm_p);
-    return CMD_NORMAL;
-  }
-  sprintf(cmd,"alp zernike disable");
-  if(!strncasecmp(line,cmd,strlen(cmd)) && strlen(line) > strlen(cmd)){
-    pch = strtok(line+strlen(cmd)," ");
-    while(pch != NULL){
-      itemp  = atoi(pch);
-      if(itemp >= 0 && itemp < LOWFS_N_ZERNIKE){
-	sm_p->alp_zernike_control[itemp]=0;
-	printf("CMD: Disabling ALP control of Zernike %d\n",itemp);
-      }
-      else{
-	printf("CMD: Invalid Zernike %d\n",itemp);
-      }
-      pch = strtok(NULL," ");
-    }
-    print_alp_zernikes(sm_p);
-    return CMD_NORMAL;
-  }
-  sprintf(cmd,"alp zernike enable");
-  if(!strncasecmp(line,cmd,strlen(cmd)) && strlen(line) > strlen(cmd)){
-    pch = strtok(line+strlen(cmd)," ");
-    while(pch != NULL){
-      itemp  = atoi(pch);
-      if(itemp >= 0 && itemp < LOWFS_N_ZERNIKE){
-	sm_p->alp_zernike_control[itemp]=1;
-	printf("CMD: Enabling ALP control of Zernike %d\n",itemp);
-      }
-      else{
-	printf("CMD: Invalid Zernike %d\n",itemp);
-      }
-      pch = strtok(NULL," ");
-    }
-    print_alp_zernikes(sm_p);
-    return CMD_NORMAL;
-  }
-  
   /****************************************
    * GAIN SETTINGS
    **************************************/
@@ -3675,6 +4022,28 @@ int handle_command(char *line, sm_t *sm_p){
     return(CMD_NORMAL);
   }
 
+  //SCI Pipelined Processing
+  sprintf(cmd,"sci pipeline on");
+  if(!strncasecmp(line,cmd,strlen(cmd))){
+    printf("CMD: Turning SCI pipeline ON\n");
+    sm_p->sci_pipeline=1;
+    return(CMD_NORMAL);
+  }
+  sprintf(cmd,"sci pipeline off");
+  if(!strncasecmp(line,cmd,strlen(cmd))){
+    printf("CMD: Turning SCI pipeline OFF\n");
+    sm_p->sci_pipeline=0;
+    return(CMD_NORMAL);
+  }
+
+  //SCI Timing
+  sprintf(cmd,"sci timing");
+  if(!strncasecmp(line,cmd,strlen(cmd))){
+    printf("CMD: SCI pipeline: %s  Exptime: %.3f s  Readout: %.3f s  Duty cycle: %.1f%%\n",
+	   sm_p->sci_pipeline ? "ON" : "OFF",sm_p->sci_exptime,sm_p->sci_readtime,sm_p->sci_dutycycle*100);
+    return(CMD_NORMAL);
+  }
+
   
   //TEC control
   sprintf(cmd,"sci tec enable");
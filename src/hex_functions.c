@@ -15,6 +15,7 @@
 #include "common_functions.h"
 #include "numeric.h"
 #include "hex_functions.h"
+#include "calstore.h"
 
 /* Error messages */
 #define PI_ERR_LENGTH 128
@@ -239,11 +240,93 @@ int hex_get_command(sm_t *sm_p, hex_t *cmd){
   return retval;
 }
 
+/**************************************************************/
+/* HEX_ENQUEUE                                                */
+/* - Post a request to the hexapod engine queue               */
+/* - A move replaces a pending move at the end of the queue   */
+/* - Caller must hold hex_command_lock                        */
+/* - Return 0 if the request was queued and 1 if it wasn't    */
+/**************************************************************/
+static int hex_enqueue(sm_t *sm_p, int type, double *acmd){
+  struct timespec now;
+  hexreq_t *req;
+  uint32 pending = sm_p->hex_queue_write - sm_p->hex_queue_read;
+  
+  //Get post time
+  clock_gettime(CLOCK_REALTIME,&now);
+
+  //Coalesce with pending move
+  req = (hexreq_t *)&sm_p->hex_queue[(sm_p->hex_queue_write-1) % HEX_QUEUE_SIZE];
+  if(type == HEX_REQ_MOVE && pending && req->type == HEX_REQ_MOVE){
+    memcpy(req->acmd,acmd,sizeof(req->acmd));
+    ts2double(&now,&req->post);
+    sm_p->hex_ncoalesce++;
+    return 0;
+  }
+
+  //Check for space
+  if(pending >= HEX_QUEUE_SIZE){
+    printf("HEX: Request queue full\n");
+    return 1;
+  }
+
+  //Add request
+  req = (hexreq_t *)&sm_p->hex_queue[sm_p->hex_queue_write % HEX_QUEUE_SIZE];
+  req->type = type;
+  if(acmd) memcpy(req->acmd,acmd,sizeof(req->acmd));
+  ts2double(&now,&req->post);
+  sm_p->hex_queue_write++;
+  return 0;
+}
+
+/**************************************************************/
+/* HEX_REQUEST                                                */
+/* - Post a non-move request to the hexapod engine            */
+/* - Return 0 if the request was queued and 1 if it wasn't    */
+/**************************************************************/
+int hex_request(sm_t *sm_p, int type){
+  int retval = 1;
+  int i;
+
+  //Lock is only held for memory copies, retry briefly
+  for(i=0;i<1000;i++){
+    if(__sync_lock_test_and_set(&sm_p->hex_command_lock,1)==0){
+      retval = hex_enqueue(sm_p,type,NULL);
+      __sync_lock_release(&sm_p->hex_command_lock);
+      break;
+    }
+  }
+  
+  return retval;
+}
+
+/**************************************************************/
+/* HEX_DEQUEUE                                                */
+/* - Take all pending requests from the queue                 */
+/* - Return number of requests, -1 if the queue is busy       */
+/**************************************************************/
+int hex_dequeue(sm_t *sm_p, hexreq_t *reqs){
+  int n=0;
+
+  if(__sync_lock_test_and_set(&sm_p->hex_command_lock,1)==0){
+    while(sm_p->hex_queue_read != sm_p->hex_queue_write){
+      memcpy(&reqs[n++],(hexreq_t *)&sm_p->hex_queue[sm_p->hex_queue_read % HEX_QUEUE_SIZE],sizeof(hexreq_t));
+      sm_p->hex_queue_read++;
+    }
+    __sync_lock_release(&sm_p->hex_command_lock);
+    return n;
+  }
+  
+  return -1;
+}
+
 /**************************************************************/
 /* HEX_SEND_COMMAND                                           */
 /* - Function to command the HEX                              */
 /* - Use atomic operations to prevent two processes from      */
 /*   sending commands at the same time                        */
+/* - The move is queued for the hexapod engine (hex_proc),    */
+/*   the caller never waits on serial I/O                     */
 /* - Return 0 if the command was sent and 1 if it wasn't      */
 /**************************************************************/
 int hex_send_command(sm_t *sm_p, hex_t *cmd, int proc_id){
@@ -255,8 +338,8 @@ int hex_send_command(sm_t *sm_p, hex_t *cmd, int proc_id){
     //Check if the commanding process is the HEX commander
     if(proc_id == sm_p->state_array[sm_p->state].hex_commander){
       
-      //Send the command
-      if(!hex_move(sm_p->hexfd,cmd->acmd)){
+      //Queue the command
+      if(!hex_enqueue(sm_p,HEX_REQ_MOVE,cmd->acmd)){
 	//Copy command to current position
 	memcpy((hex_t *)&sm_p->hex_command,cmd,sizeof(hex_t));
 	//Set retval for good command
@@ -358,6 +441,22 @@ int hex_move(int id, double *pos){
   return 0;
 }
 
+/**************************************************************/
+/* HEX_ISMOVING                                               */
+/*  - Check if any hexapod axis is moving                     */
+/**************************************************************/
+int hex_ismoving(int id, int *moving){
+  char *chkaxis=""; //will check all axes
+  char msg[PI_ERR_LENGTH];
+  
+  if(!PI_IsMoving(id,chkaxis,moving)){
+    PI_TranslateError(PI_GetError(id),msg,PI_ERR_LENGTH);
+    printf("HEX: PI_IsMoving error: %s\n",msg);
+    return 1;
+  }
+  return 0;
+}
+
 /**************************************************************/
 /* HEX_REFERENCE                                              */
 /*  - Reference hexapod, if needed                            */
@@ -494,43 +593,19 @@ int hex_setpivot(int id, double *pivot){
 /*  - Convert from zernike commands to hexapod commands       */
 /**************************************************************/
 int hex_zern2hex(double *zernikes, double *axes){
-  FILE *fp=NULL;
-  char matrix_file[MAX_FILENAME];
   static int init=0;
   static double zern2hex_matrix[LOWFS_N_HEX_ZERNIKE*HEX_NAXES]={0};
-  uint64 fsize,rsize;
-  int c,i;
+  static uint32 version=0;
+  int i;
   double hex_zernikes[LOWFS_N_HEX_ZERNIKE]={0};
 
 
-  if(!init){
-    /* Open zern2hex matrix file */
-    //--setup filename
-    sprintf(matrix_file,SHKZER2HEXACT_FILE);
-    //--open file
-    if((fp = fopen(matrix_file,"r")) == NULL){
-      printf("zern2hex file\n");
-      perror("fopen");
-      return 1;
-    }
-    //--check file size
-    fseek(fp, 0L, SEEK_END);
-    fsize = ftell(fp);
-    rewind(fp);
-    rsize = (LOWFS_N_HEX_ZERNIKE)*HEX_NAXES*sizeof(double);
-    if(fsize != rsize){
-      printf("HEX: incorrect HEX matrix file size %lu != %lu\n",fsize,rsize);
+  if(!init || version != cal_version(CAL_SHKZER2HEXACT)){
+    //--copy matrix from calibration store
+    if(cal_read(CAL_SHKZER2HEXACT,zern2hex_matrix,sizeof(zern2hex_matrix),&version)){
+      printf("HEX: ERROR reading zern2hex matrix\n");
       return 1;
     }
-    //--read matrix
-    if(fread(zern2hex_matrix,(LOWFS_N_HEX_ZERNIKE)*HEX_NAXES*sizeof(double),1,fp) != 1){
-      printf("zern2hex file\r");
-      perror("fread");
-      return 1;
-    }
-    //--close file
-    fclose(fp);
-
     //--set init flag
     init=1;
   }
@@ -9,6 +9,9 @@ void hex_get_error(int id);
 int  hex_init(int *hexfd);
 int  hex_get_command(sm_t *sm_p, hex_t *cmd);
 int  hex_send_command(sm_t *sm_p, hex_t *cmd, int proc_id);
+int  hex_request(sm_t *sm_p, int type);
+int  hex_dequeue(sm_t *sm_p, hexreq_t *reqs);
+int  hex_ismoving(int id, int *moving);
 int  hex_savepos(sm_t *sm_p);
 int  hex_loadpos(sm_t *sm_p,int procid);
 int  hex_hex2scope(double *position, double *result);
@@ -0,0 +1,188 @@
+#define _XOPEN_SOURCE 500
+#include <signal.h>
+#include <stdio.h>
+#include <termios.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <time.h>
+
+/* piccflight headers */
+#include "controller.h"
+#include "common_functions.h"
+#include "log_functions.h"
+#include "hex_functions.h"
+
+/* Process File Descriptor */
+int hex_shmfd;
+
+/* Hexapod Connection */
+int hex_id=-1;
+
+/* CTRL-C Function */
+void hexctrlC(int sig)
+{
+  if(hex_id >= 0) hex_disconnect(hex_id);
+  close(hex_shmfd);
+#if MSG_CTRLC
+  printf("HEX: exiting\n");
+#endif
+  exit(sig);
+}
+
+/**************************************************************/
+/* HEX_PROC                                                   */
+/*  - Hexapod motion engine                                   */
+/*  - Owns the GCS serial link, all hexapod I/O happens here  */
+/*  - Camera processes queue moves with hex_send_command and  */
+/*    read the polled position from shared memory             */
+/**************************************************************/
+void hex_proc(void){
+  hexreq_t reqs[HEX_QUEUE_SIZE];
+  hexreq_t move;
+  struct timespec now;
+  double t,last_poll=0,hexpos[HEX_NAXES],scopepos[HEX_NAXES];
+  int i,n,moving=0;
+  int move_pending=0;   //move waiting to be sent
+  int move_active=0;    //move sent, waiting for completion
+  double move_post=0;   //post time of active move
+
+  /* Open Shared Memory */
+  sm_t *sm_p;
+  if((sm_p = openshm(&hex_shmfd)) == NULL){
+    printf("openshm fail: hex_proc\n");
+    hexctrlC(0);
+  }
+
+  /* Attach to event log ring */
+  log_attach(sm_p,HEXID);
+
+  /* Set soft interrupt handler */
+  sigset(SIGINT, hexctrlC);	/* usually ^C */
+
+  /* Connect to hexapod -- not ready until HEX_REQ_INIT references it */
+  sm_p->hex_ready = 0;
+  if(HEX_ENABLE){
+    if((hex_id = hex_connect()) < 0)
+      printf("HEX: hex_connect error!\n");
+    else
+      sm_p->hexfd = hex_id;
+    //Queue our own init so a restart by the watchdog needs no operator action
+    if(hex_request(sm_p,HEX_REQ_INIT))
+      printf("HEX: ERROR: HEX init request failed!\n");
+  }
+
+  /* Start main loop */
+  while(1){
+    /* Check if we've been asked to exit */
+    if(sm_p->w[HEXID].die)
+      hexctrlC(0);
+
+    /* Check in with the watchdog */
+    checkin(sm_p,HEXID);
+
+    /* Get time */
+    clock_gettime(CLOCK_REALTIME,&now);
+    ts2double(&now,&t);
+
+    /* Take requests */
+    if((n = hex_dequeue(sm_p,reqs)) > 0){
+      for(i=0;i<n;i++){
+	//Move: keep only the latest target
+	if(reqs[i].type == HEX_REQ_MOVE){
+	  if(move_pending) sm_p->hex_ncoalesce++;
+	  memcpy(&move,&reqs[i],sizeof(hexreq_t));
+	  move_pending = 1;
+	}
+	//Init: connect, reference and go home
+	if(reqs[i].type == HEX_REQ_INIT && HEX_ENABLE){
+	  printf("HEX: Initializing hexapod\n");
+	  if(hex_id >= 0) hex_disconnect(hex_id);
+	  sm_p->hex_ready = 0;
+	  if(hex_init(&hex_id)){
+	    printf("HEX: ERROR: HEX init failed!\n");
+	  }
+	  else{
+	    sm_p->hexfd = hex_id;
+	    sm_p->hex_ready = 1;
+	    printf("HEX: HEX ready\n");
+	  }
+	  //Init moves home, drop earlier targets
+	  move_pending = 0;
+	  move_active  = 0;
+	  checkin(sm_p,HEXID);
+	}
+	//Error: print controller error state
+	if(reqs[i].type == HEX_REQ_ERROR && sm_p->hex_ready)
+	  hex_get_error(hex_id);
+      }
+    }
+
+    if(sm_p->hex_ready){
+      /* Poll position */
+      if(((t - last_poll) > HEX_POLL_PERIOD) || move_pending || move_active){
+	if(hex_ismoving(hex_id,&moving)){
+	  sm_p->hex_nerror++;
+	}
+	else{
+	  sm_p->hex_moving = moving;
+	  //Motion complete
+	  if(move_active && !moving){
+	    clock_gettime(CLOCK_REALTIME,&now);
+	    ts2double(&now,&t);
+	    sm_p->hex_latency_move = t - move_post;
+	    if(sm_p->hex_latency_move > sm_p->hex_latency_move_max)
+	      sm_p->hex_latency_move_max = sm_p->hex_latency_move;
+	    move_active = 0;
+	  }
+	}
+	if((t - last_poll) > HEX_POLL_PERIOD){
+	  if(hex_getpos(hex_id,hexpos)){
+	    sm_p->hex_nerror++;
+	  }
+	  else{
+	    memset(scopepos,0,sizeof(scopepos));
+	    hex_hex2scope(hexpos,scopepos);
+	    for(i=0;i<HEX_NAXES;i++)
+	      sm_p->hex_position[i] = scopepos[i];
+	    sm_p->hex_position_time = t;
+	  }
+	  last_poll = t;
+	}
+      }
+
+      /* Send pending move once the hexapod has stopped */
+      if(move_pending && !moving){
+	if(hex_move(hex_id,move.acmd)){
+	  sm_p->hex_nerror++;
+	}
+	else{
+	  clock_gettime(CLOCK_REALTIME,&now);
+	  ts2double(&now,&t);
+	  sm_p->hex_latency_cmd = t - move.post;
+	  if(sm_p->hex_latency_cmd > sm_p->hex_latency_cmd_max)
+	    sm_p->hex_latency_cmd_max = sm_p->hex_latency_cmd;
+	  sm_p->hex_nmove++;
+	  move_post   = move.post;
+	  move_active = 1;
+	  moving      = 1;
+	}
+	move_pending = 0;
+      }
+    }
+    else{
+      //Nothing to do without a hexapod
+      move_pending = 0;
+      move_active  = 0;
+    }
+
+    /* Sleep */
+    usleep(HEX_ENGINE_SLEEP);
+  }
+
+  hexctrlC(0);
+  return;
+}
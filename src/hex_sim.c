@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <PI_GCS2_DLL.h>
+
+/* piccflight headers */
+#include "controller.h"
+#include "common_functions.h"
+
+/* Software hexapod simulator
+ *
+ *  - Build with "make HEXSIM=1" to replace the PI GCS2 library with
+ *    the GCS calls used by hex_functions.c
+ *  - Axes move linearly to the MOV target at HEX_SIM_VEL_TRL/ROT and
+ *    arrive together, FRF takes HEX_SIM_REF_TIME seconds
+ *  - Every call waits HEX_SIM_IO_DELAY to stand in for the serial link
+ */
+#ifdef HEX_SIM
+
+/* PI error codes used by the simulator */
+#define HEXSIM_ERR_NONE        0
+#define HEXSIM_ERR_PARAM       1  //parameter syntax error
+#define HEXSIM_ERR_UNREF       5  //move on unreferenced axis
+#define HEXSIM_ERR_LIMIT       7  //position out of limits
+#define HEXSIM_ERR_CONNECT    -9  //not connected
+#define HEXSIM_ID              1  //connection ID handed out
+
+/* Simulator state */
+static struct{
+  int    connected;
+  int    referenced;
+  int    error;
+  double start[HEX_NAXES];    //position at start of move
+  double target[HEX_NAXES];   //move target
+  double tmove;               //move start time [s]
+  double tlen;                //move duration [s]
+  double tref;                //reference start time [s]
+  double pivot[3];            //pivot point
+  int    nanswer;             //pending GCS answer lines
+} hexsim;
+
+/**************************************************************/
+/* HEXSIM_NOW                                                 */
+/*  - Return current time and wait for simulated serial I/O   */
+/**************************************************************/
+static double hexsim_now(void){
+  struct timespec now;
+  double t;
+  usleep(HEX_SIM_IO_DELAY);
+  clock_gettime(CLOCK_REALTIME,&now);
+  ts2double(&now,&t);
+  return t;
+}
+
+/**************************************************************/
+/* HEXSIM_POS                                                 */
+/*  - Interpolate current position                            */
+/**************************************************************/
+static void hexsim_pos(double t, double *pos){
+  double f = (hexsim.tlen > 0) ? (t - hexsim.tmove)/hexsim.tlen : 1;
+  int i;
+  if(f > 1) f = 1;
+  if(f < 0) f = 0;
+  for(i=0;i<HEX_NAXES;i++)
+    pos[i] = hexsim.start[i] + f*(hexsim.target[i] - hexsim.start[i]);
+}
+
+/**************************************************************/
+/* HEXSIM_AXES                                                */
+/*  - Parse GCS axis string into axis indices                 */
+/*  - Return number of axes, -1 on error                      */
+/**************************************************************/
+static int hexsim_axes(const char *szAxes, const char *names, int *index){
+  int n=0;
+  const char *p;
+  for(p=szAxes;*p;p++){
+    if(*p == ' ') continue;
+    if(strchr(names,*p) == NULL || n == HEX_NAXES) return -1;
+    index[n++] = strchr(names,*p) - names;
+  }
+  return n;
+}
+
+/**************************************************************/
+/* HEXSIM_CHECK                                               */
+/*  - Check connection                                        */
+/**************************************************************/
+static int hexsim_check(int ID){
+  if(ID != HEXSIM_ID || !hexsim.connected){
+    hexsim.error = HEXSIM_ERR_CONNECT;
+    return 0;
+  }
+  return 1;
+}
+
+/**************************************************************/
+/* GCS CONNECTION                                             */
+/**************************************************************/
+int PI_ConnectRS232ByDevName(const char* szDevName, int BaudRate){
+  hexsim_now();
+  hexsim.connected = 1;
+  hexsim.error     = HEXSIM_ERR_NONE;
+  printf("HEXSIM: Connected to simulated hexapod on %s @ %d\n",szDevName,BaudRate);
+  return HEXSIM_ID;
+}
+
+void PI_CloseConnection(int ID){
+  if(ID == HEXSIM_ID) hexsim.connected = 0;
+}
+
+int PI_GetError(int ID){
+  int error = hexsim.error;
+  hexsim.error = HEXSIM_ERR_NONE;
+  return error;
+}
+
+BOOL PI_TranslateError(int errNr, char* szBuffer, int iBufferSize){
+  const char *msg = "Unknown error";
+  if(errNr == HEXSIM_ERR_NONE)    msg = "No error";
+  if(errNr == HEXSIM_ERR_PARAM)   msg = "Parameter syntax error";
+  if(errNr == HEXSIM_ERR_UNREF)   msg = "Unallowable move attempted on unreferenced axis";
+  if(errNr == HEXSIM_ERR_LIMIT)   msg = "Position out of limits";
+  if(errNr == HEXSIM_ERR_CONNECT) msg = "Not connected";
+  snprintf(szBuffer,iBufferSize,"%s (sim)",msg);
+  return TRUE;
+}
+
+/**************************************************************/
+/* GCS REFERENCING                                            */
+/**************************************************************/
+BOOL PI_FRF(int ID, const char* szAxes){
+  double t = hexsim_now();
+  if(!hexsim_check(ID)) return FALSE;
+  memset(hexsim.start,0,sizeof(hexsim.start));
+  memset(hexsim.target,0,sizeof(hexsim.target));
+  hexsim.tlen = 0;
+  hexsim.tref = t;
+  hexsim.referenced = 1;
+  return TRUE;
+}
+
+BOOL PI_qFRF(int ID, const char* szAxes, BOOL* pbValueArray){
+  int index[HEX_NAXES],i,n;
+  hexsim_now();
+  if(!hexsim_check(ID)) return FALSE;
+  if((n = hexsim_axes(szAxes,"XYZUVW",index)) < 0){
+    hexsim.error = HEXSIM_ERR_PARAM;
+    return FALSE;
+  }
+  for(i=0;i<n;i++)
+    pbValueArray[i] = hexsim.referenced;
+  return TRUE;
+}
+
+BOOL PI_IsControllerReady(int ID, int* piControllerReady){
+  double t = hexsim_now();
+  if(!hexsim_check(ID)) return FALSE;
+  *piControllerReady = !hexsim.referenced || (t - hexsim.tref) > HEX_SIM_REF_TIME;
+  return TRUE;
+}
+
+/**************************************************************/
+/* GCS MOTION                                                 */
+/**************************************************************/
+BOOL PI_MOV(int ID, const char* szAxes, const double* pdValueArray){
+  double t = hexsim_now();
+  double limit[HEX_NAXES] = {HEX_SIM_TRL_LIMIT,HEX_SIM_TRL_LIMIT,HEX_SIM_TRL_LIMIT,HEX_SIM_ROT_LIMIT,HEX_SIM_ROT_LIMIT,HEX_SIM_ROT_LIMIT};
+  double vel[HEX_NAXES]   = {HEX_SIM_VEL_TRL,HEX_SIM_VEL_TRL,HEX_SIM_VEL_TRL,HEX_SIM_VEL_ROT,HEX_SIM_VEL_ROT,HEX_SIM_VEL_ROT};
+  double target[HEX_NAXES];
+  int index[HEX_NAXES],i,n;
+  if(!hexsim_check(ID)) return FALSE;
+  if(!hexsim.referenced){
+    hexsim.error = HEXSIM_ERR_UNREF;
+    return FALSE;
+  }
+  if((n = hexsim_axes(szAxes,"XYZUVW",index)) < 0){
+    hexsim.error = HEXSIM_ERR_PARAM;
+    return FALSE;
+  }
+  //Check limits, a rejected command does not change the motion
+  memcpy(target,hexsim.target,sizeof(target));
+  for(i=0;i<n;i++){
+    if(fabs(pdValueArray[i]) > limit[index[i]]){
+      hexsim.error = HEXSIM_ERR_LIMIT;
+      return FALSE;
+    }
+    target[index[i]] = pdValueArray[i];
+  }
+  //New move starts from the current position
+  hexsim_pos(t,hexsim.start);
+  memcpy(hexsim.target,target,sizeof(target));
+  hexsim.tmove = t;
+  hexsim.tlen  = 0;
+  for(i=0;i<HEX_NAXES;i++)
+    if(fabs(target[i]-hexsim.start[i])/vel[i] > hexsim.tlen)
+      hexsim.tlen = fabs(target[i]-hexsim.start[i])/vel[i];
+  return TRUE;
+}
+
+BOOL PI_IsMoving(int ID, const char* szAxes, BOOL* pbValueArray){
+  double t = hexsim_now();
+  int index[HEX_NAXES],i,n,moving;
+  if(!hexsim_check(ID)) return FALSE;
+  moving = (t - hexsim.tmove) < hexsim.tlen;
+  //Empty axis string returns one value for all axes
+  if(szAxes == NULL || szAxes[0] == 0){
+    pbValueArray[0] = moving;
+    return TRUE;
+  }
+  if((n = hexsim_axes(szAxes,"XYZUVW",index)) < 0){
+    hexsim.error = HEXSIM_ERR_PARAM;
+    return FALSE;
+  }
+  for(i=0;i<n;i++)
+    pbValueArray[i] = moving && (hexsim.target[index[i]] != hexsim.start[index[i]]);
+  return TRUE;
+}
+
+BOOL PI_qPOS(int ID, const char* szAxes, double* pdValueArray){
+  double t = hexsim_now();
+  double pos[HEX_NAXES];
+  int index[HEX_NAXES],i,n;
+  if(!hexsim_check(ID)) return FALSE;
+  if((n = hexsim_axes(szAxes,"XYZUVW",index)) < 0){
+    hexsim.error = HEXSIM_ERR_PARAM;
+    return FALSE;
+  }
+  hexsim_pos(t,pos);
+  for(i=0;i<n;i++)
+    pdValueArray[i] = pos[index[i]];
+  return TRUE;
+}
+
+BOOL PI_SPI(int ID, const char* szAxes, const double* pdValueArray){
+  int index[HEX_NAXES],i,n;
+  hexsim_now();
+  if(!hexsim_check(ID)) return FALSE;
+  if((n = hexsim_axes(szAxes,"RST",index)) < 0){
+    hexsim.error = HEXSIM_ERR_PARAM;
+    return FALSE;
+  }
+  for(i=0;i<n;i++)
+    hexsim.pivot[index[i]] = pdValueArray[i];
+  return TRUE;
+}
+
+/**************************************************************/
+/* GCS INFORMATION                                            */
+/**************************************************************/
+BOOL PI_qCST(int ID, const char* szAxes, char* szNames, int iBufferSize){
+  hexsim_now();
+  if(!hexsim_check(ID)) return FALSE;
+  snprintf(szNames,iBufferSize,"X=HEXSIM Y=HEXSIM Z=HEXSIM U=HEXSIM V=HEXSIM W=HEXSIM");
+  return TRUE;
+}
+
+BOOL PI_qVER(int ID, char* szBuffer, int iBufferSize){
+  hexsim_now();
+  if(!hexsim_check(ID)) return FALSE;
+  snprintf(szBuffer,iBufferSize,"piccflight hexapod simulator");
+  return TRUE;
+}
+
+BOOL PI_qIDN(int ID, char* szBuffer, int iBufferSize){
+  hexsim_now();
+  if(!hexsim_check(ID)) return FALSE;
+  snprintf(szBuffer,iBufferSize,"HEXSIM, Simulated Hexapod, 0, 1.0");
+  return TRUE;
+}
+
+BOOL PI_GcsCommandset(int ID, const char* szCommand){
+  hexsim_now();
+  if(!hexsim_check(ID)) return FALSE;
+  hexsim.nanswer = 1;
+  return TRUE;
+}
+
+BOOL PI_GcsGetAnswerSize(int ID, int* iAnswerSize){
+  if(!hexsim_check(ID)) return FALSE;
+  *iAnswerSize = hexsim.nanswer ? 32 : 0;
+  return TRUE;
+}
+
+BOOL PI_GcsGetAnswer(int ID, char* szAnswer, int iBufferSize){
+  if(!hexsim_check(ID)) return FALSE;
+  snprintf(szAnswer,iBufferSize,"%s",hexsim.nanswer ? "0 = simulated" : "");
+  hexsim.nanswer = 0;
+  return TRUE;
+}
+
+#endif
@@ -0,0 +1,200 @@
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <sys/io.h>
+
+/* piccflight headers */
+#include "controller.h"
+#include "common_functions.h"
+#include "htr_functions.h"
+
+/* Heater PWM scheduler
+ *
+ *  - Each control loop runs HTR_NCYCLES PWM cycles of HTR_NSTEPS steps.
+ *    The dithered on/off pattern is the same in every cycle.
+ *  - htr_schedule reduces the pattern to the steps where the SSR word
+ *    changes. htr_run sleeps to absolute CLOCK_MONOTONIC deadlines and
+ *    wakes only at those edges, so the loop does not accumulate sleep
+ *    jitter and does not wake on every step.
+ *  - Write timestamps give the measured on-time of each heater.
+ *    htr_run publishes the duty error, the wakeup count and the
+ *    wakeup lateness to shared memory.
+ *  - Build with "make THMSIM=1" to send port writes to a simulated
+ *    SSR board instead of the ISA port. The simulated board
+ *    timestamps every write and integrates the on-time of each
+ *    heater, so bench/htr_bench.c can check the schedule
+ *    independently of the htr_run statistics.
+ */
+
+#ifdef THM_SIM
+/* Simulated SSR port */
+static struct{
+  uint16 word;               //last heater word (1 = ON)
+  uint64 nwrite;             //port writes
+  double tfirst;             //time of first write [s]
+  double tlast;              //time of last write [s]
+  double ontime[SSR_NCHAN];  //integrated on-time [s]
+} htrsim;
+
+/**************************************************************/
+/* HTR_SIM_INTEGRATE                                          */
+/*  - Add on-time of the current word up to now               */
+/**************************************************************/
+static double htr_sim_integrate(void){
+  struct timespec now;
+  double t;
+  int i;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  ts2double(&now,&t);
+  if(htrsim.nwrite)
+    for(i=0;i<SSR_NCHAN;i++)
+      if(htrsim.word & (1 << i)) htrsim.ontime[i] += t - htrsim.tlast;
+  htrsim.tlast = t;
+  return t;
+}
+
+/**************************************************************/
+/* HTR_SIM_RESET                                              */
+/*  - Clear the simulated SSR port record                     */
+/**************************************************************/
+void htr_sim_reset(void){
+  memset(&htrsim,0,sizeof(htrsim));
+}
+
+/**************************************************************/
+/* HTR_SIM_READ                                               */
+/*  - Duty cycle [%] of each heater since the first write,    */
+/*    measured by the simulated SSR port                      */
+/*  - Return number of port writes                            */
+/**************************************************************/
+uint64 htr_sim_read(double *duty){
+  double span;
+  int i;
+  span = htr_sim_integrate() - htrsim.tfirst;
+  for(i=0;i<SSR_NCHAN;i++)
+    duty[i] = span > 0 ? 100*htrsim.ontime[i]/span : 0;
+  return htrsim.nwrite;
+}
+#endif
+
+/**************************************************************/
+/* HTR_PORT                                                   */
+/*  - Write heater word to the SSR board (1 = ON)             */
+/**************************************************************/
+void htr_port(uint16 command){
+#ifdef THM_SIM
+  if(htrsim.nwrite == 0)
+    htrsim.tfirst = htr_sim_integrate();
+  else
+    htr_sim_integrate();
+  htrsim.word = command;
+  htrsim.nwrite++;
+#else
+  //SSR Board: 1 = OFF, 0 = ON
+  //Take ones complement, send LSB and MSB
+  outb(~command & 0x00FF,SSR_BASE+0);
+  outb((~command & 0xFF00) >> 8,SSR_BASE+4);
+#endif
+}
+
+/**************************************************************/
+/* HTR_SCHEDULE                                               */
+/*  - Build PWM edge schedule from heater powers              */
+/*  - pulse_index is the dither order from ditherfill         */
+/*  - Return number of edges per cycle                        */
+/**************************************************************/
+int htr_schedule(htrsched_t *sched, htr_t *htr, const int *pulse_index){
+  uint16 word[HTR_NSTEPS];
+  int i,j;
+
+  //Heater word for every step
+  memset(word,0,sizeof(word));
+  for(i=0;i<SSR_NCHAN;i++)
+    for(j=0;j<htr[i].power && j<HTR_NSTEPS;j++)
+      word[pulse_index[j]] |= 1 << i;
+
+  //Keep steps where the word changes
+  sched->nedge = 0;
+  for(j=0;j<HTR_NSTEPS;j++){
+    if(j == 0 || word[j] != word[j-1]){
+      sched->step[sched->nedge] = j;
+      sched->word[sched->nedge] = word[j];
+      sched->nedge++;
+    }
+  }
+  return sched->nedge;
+}
+
+/**************************************************************/
+/* HTR_DEADLINE                                               */
+/*  - Absolute time of a PWM step after start                 */
+/**************************************************************/
+static void htr_deadline(struct timespec *start, long step, struct timespec *deadline){
+  long nsec = start->tv_nsec + step*HTR_STEP_NS;
+  deadline->tv_sec  = start->tv_sec + nsec/ONE_BILLION;
+  deadline->tv_nsec = nsec%ONE_BILLION;
+}
+
+/**************************************************************/
+/* HTR_RUN                                                    */
+/*  - Drive HTR_NCYCLES PWM cycles from an edge schedule      */
+/*  - Returns after the last cycle ends                       */
+/*  - Updates PWM statistics in shared memory                 */
+/**************************************************************/
+void htr_run(sm_t *sm_p, htrsched_t *sched, htr_t *htr){
+  struct timespec start,deadline,now;
+  double ontime[SSR_NCHAN]={0};
+  double tstart,tlast,tnow,tdead,duty,late=0,err=0;
+  uint16 word=0;
+  uint32 nwake=0;
+  int c,e,i;
+
+  //First edge is written immediately
+  clock_gettime(CLOCK_MONOTONIC,&start);
+  htr_port(sched->word[0]);
+  word = sched->word[0];
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  ts2double(&now,&tstart);
+  tlast = tstart;
+
+  //Sleep to each edge, the final pass waits for the end of the loop
+  for(c=0;c<=HTR_NCYCLES;c++){
+    for(e=0;e<sched->nedge;e++){
+      if(c == HTR_NCYCLES && e > 0) break;
+      //Skip unchanged words (first edge, or cycle wrap)
+      if(c < HTR_NCYCLES && sched->word[e] == word) continue;
+      htr_deadline(&start,(long)c*HTR_NSTEPS + sched->step[e],&deadline);
+      while(clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&deadline,NULL) == EINTR);
+      nwake++;
+      if(c < HTR_NCYCLES) htr_port(sched->word[e]);
+      clock_gettime(CLOCK_MONOTONIC,&now);
+      ts2double(&now,&tnow);
+      ts2double(&deadline,&tdead);
+      if(tnow - tdead > late) late = tnow - tdead;
+      //Integrate on-time of the previous word
+      for(i=0;i<SSR_NCHAN;i++)
+	if(word & (1 << i)) ontime[i] += tnow - tlast;
+      tlast = tnow;
+      word  = sched->word[e];
+    }
+  }
+
+  //Duty error
+  for(i=0;i<SSR_NCHAN;i++){
+    duty = 100*ontime[i]/(tlast - tstart);
+    if(fabs(duty - htr[i].power) > err) err = fabs(duty - htr[i].power);
+  }
+
+  //Statistics
+  sm_p->htr_nloop++;
+  sm_p->htr_nwake      = nwake;
+  sm_p->htr_late       = late;
+  sm_p->htr_duty_error = err;
+  if(nwake > sm_p->htr_nwake_max)     sm_p->htr_nwake_max      = nwake;
+  if(late  > sm_p->htr_late_max)      sm_p->htr_late_max       = late;
+  if(err   > sm_p->htr_duty_error_max) sm_p->htr_duty_error_max = err;
+}
@@ -0,0 +1,13 @@
+#ifndef _HTR_FUNCTIONS
+#define _HTR_FUNCTIONS
+
+//Function prototypes
+void htr_port(uint16 command);
+int  htr_schedule(htrsched_t *sched, htr_t *htr, const int *pulse_index);
+void htr_run(sm_t *sm_p, htrsched_t *sched, htr_t *htr);
+#ifdef THM_SIM
+void   htr_sim_reset(void);
+uint64 htr_sim_read(double *duty);
+#endif
+
+#endif
@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* piccflight headers */
+#include "controller.h"
+#include "img_functions.h"
+
+/* Image transfer
+ *
+ *  - Camera buffers are row-major (x fastest). Packet images are
+ *    stored [x][y] (y fastest), so every full image copy is a
+ *    transpose: dst[x*dstride + y] = src[y*sstride + x].
+ *  - The copy walks IMG_TILE x IMG_TILE tiles so the source rows
+ *    and destination columns of a tile both stay in cache.
+ *  - With SSE2 each tile is split into 16x16 (8-bit) or 8x8 (16-bit)
+ *    blocks that are transposed in registers. Block rows are
+ *    interleaved with their partner half a block away; log2(block)
+ *    passes leave register c holding column c. Edges that do not
+ *    fill a block use the scalar loop.
+ */
+
+/**************************************************************/
+/* IMG_SCALAR8                                                */
+/*  - Transpose the x0:x1, y0:y1 part of an 8-bit image       */
+/**************************************************************/
+static void img_scalar8(uint8 *dst, int dstride, const uint8 *src, int sstride, int x0, int x1, int y0, int y1){
+  int x,y;
+  for(x=x0;x<x1;x++)
+    for(y=y0;y<y1;y++)
+      dst[x*dstride + y] = src[y*sstride + x];
+}
+
+/**************************************************************/
+/* IMG_SCALAR16                                               */
+/*  - Transpose the x0:x1, y0:y1 part of a 16-bit image       */
+/**************************************************************/
+static void img_scalar16(uint16 *dst, int dstride, const uint16 *src, int sstride, int x0, int x1, int y0, int y1){
+  int x,y;
+  for(x=x0;x<x1;x++)
+    for(y=y0;y<y1;y++)
+      dst[x*dstride + y] = src[y*sstride + x];
+}
+
+#ifdef __SSE2__
+/**************************************************************/
+/* IMG_BLOCK8                                                 */
+/*  - Transpose one 16x16 8-bit block in registers            */
+/**************************************************************/
+static inline void img_block8(uint8 *dst, int dstride, const uint8 *src, int sstride){
+  __m128i r[16],t[16];
+  int i,pass;
+  for(i=0;i<16;i++)
+    r[i] = _mm_loadu_si128((const __m128i *)(src + i*sstride));
+  for(pass=0;pass<4;pass++){
+    for(i=0;i<8;i++){
+      t[2*i]   = _mm_unpacklo_epi8(r[i],r[i+8]);
+      t[2*i+1] = _mm_unpackhi_epi8(r[i],r[i+8]);
+    }
+    memcpy(r,t,sizeof(r));
+  }
+  for(i=0;i<16;i++)
+    _mm_storeu_si128((__m128i *)(dst + i*dstride),r[i]);
+}
+
+/**************************************************************/
+/* IMG_BLOCK16                                                */
+/*  - Transpose one 8x8 16-bit block in registers             */
+/**************************************************************/
+static inline void img_block16(uint16 *dst, int dstride, const uint16 *src, int sstride){
+  __m128i r[8],t[8];
+  int i,pass;
+  for(i=0;i<8;i++)
+    r[i] = _mm_loadu_si128((const __m128i *)(src + i*sstride));
+  for(pass=0;pass<3;pass++){
+    for(i=0;i<4;i++){
+      t[2*i]   = _mm_unpacklo_epi16(r[i],r[i+4]);
+      t[2*i+1] = _mm_unpackhi_epi16(r[i],r[i+4]);
+    }
+    memcpy(r,t,sizeof(r));
+  }
+  for(i=0;i<8;i++)
+    _mm_storeu_si128((__m128i *)(dst + i*dstride),r[i]);
+}
+#endif
+
+/**************************************************************/
+/* IMG_TRANSPOSE8                                             */
+/*  - Copy a row-major 8-bit image into [x][y] order          */
+/*  - nx,ny: image size, sstride,dstride: row lengths         */
+/**************************************************************/
+void img_transpose8(uint8 *dst, int dstride, const uint8 *src, int sstride, int nx, int ny){
+  int tx,ty,xe,ye,xb,yb,x,y;
+
+  for(ty=0;ty<ny;ty+=IMG_TILE){
+    ye = ty+IMG_TILE < ny ? ty+IMG_TILE : ny;
+    for(tx=0;tx<nx;tx+=IMG_TILE){
+      xe = tx+IMG_TILE < nx ? tx+IMG_TILE : nx;
+#ifdef __SSE2__
+      xb = tx + ((xe-tx)/16)*16;
+      yb = ty + ((ye-ty)/16)*16;
+      for(y=ty;y<yb;y+=16)
+	for(x=tx;x<xb;x+=16)
+	  img_block8(dst + x*dstride + y,dstride,src + y*sstride + x,sstride);
+      //Edges
+      img_scalar8(dst,dstride,src,sstride,xb,xe,ty,ye);
+      img_scalar8(dst,dstride,src,sstride,tx,xb,yb,ye);
+#else
+      img_scalar8(dst,dstride,src,sstride,tx,xe,ty,ye);
+#endif
+    }
+  }
+}
+
+/**************************************************************/
+/* IMG_TRANSPOSE16                                            */
+/*  - Copy a row-major 16-bit image into [x][y] order         */
+/*  - nx,ny: image size, sstride,dstride: row lengths         */
+/**************************************************************/
+void img_transpose16(uint16 *dst, int dstride, const uint16 *src, int sstride, int nx, int ny){
+  int tx,ty,xe,ye,xb,yb,x,y;
+
+  for(ty=0;ty<ny;ty+=IMG_TILE){
+    ye = ty+IMG_TILE < ny ? ty+IMG_TILE : ny;
+    for(tx=0;tx<nx;tx+=IMG_TILE){
+      xe = tx+IMG_TILE < nx ? tx+IMG_TILE : nx;
+#ifdef __SSE2__
+      xb = tx + ((xe-tx)/8)*8;
+      yb = ty + ((ye-ty)/8)*8;
+      for(y=ty;y<yb;y+=8)
+	for(x=tx;x<xb;x+=8)
+	  img_block16(dst + x*dstride + y,dstride,src + y*sstride + x,sstride);
+      //Edges
+      img_scalar16(dst,dstride,src,sstride,xb,xe,ty,ye);
+      img_scalar16(dst,dstride,src,sstride,tx,xb,yb,ye);
+#else
+      img_scalar16(dst,dstride,src,sstride,tx,xe,ty,ye);
+#endif
+    }
+  }
+}
@@ -0,0 +1,8 @@
+#ifndef _IMG_FUNCTIONS
+#define _IMG_FUNCTIONS
+
+//Function prototypes
+void img_transpose8(uint8 *dst, int dstride, const uint8 *src, int sstride, int nx, int ny);
+void img_transpose16(uint16 *dst, int dstride, const uint16 *src, int sstride, int nx, int ny);
+
+#endif
@@ -0,0 +1,298 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+/* piccflight headers */
+#include "controller.h"
+#include "common_functions.h"
+#include "watchdog.h"
+#include "log_functions.h"
+
+/* Event log rings
+ *
+ *  - Each process has a ring of LOG_RING_SIZE binary records in
+ *    shared memory. log_msg stores the timestamp, level, format string
+ *    pointer and raw arguments; nothing is formatted and no system
+ *    call is made, so it is safe in camera callbacks.
+ *  - Processes are forked from the watchdog without exec, so a format
+ *    string literal has the same address in every process and msg_proc
+ *    can format the record later.
+ *  - Slots carry a sequence number (bounded MPMC queue), so threads of
+ *    one process may log concurrently. msg_proc is the only reader.
+ *  - A full ring drops the new record and counts it, it never blocks.
+ *  - A writer killed between reserving and publishing a slot would
+ *    stall the reader on that ring. log_attach publishes such slots
+ *    as "record lost" when the process is relaunched.
+ */
+
+//Attached ring (NULL --> print directly)
+static logring_t *logring = NULL;
+static int        logproc = WATID;
+
+/**************************************************************/
+/* LOG_INIT                                                   */
+/*  - Initialize all rings, called once by the watchdog       */
+/**************************************************************/
+void log_init(sm_t *sm_p){
+  logring_t *ring;
+  int i,j;
+  for(i=0;i<NCLIENTS;i++){
+    ring = (logring_t *)&sm_p->logring[i];
+    memset(ring,0,sizeof(logring_t));
+    for(j=0;j<LOG_RING_SIZE;j++)
+      ring->rec[j].seq = j;
+  }
+}
+
+/**************************************************************/
+/* LOG_ATTACH                                                 */
+/*  - Attach this process to its ring                         */
+/*  - Publish slots left reserved by a previous instance of   */
+/*    this process so the reader can pass them                */
+/**************************************************************/
+void log_attach(sm_t *sm_p, int procid){
+  logring_t *ring = (logring_t *)&sm_p->logring[procid];
+  struct timespec now;
+  logrec_t *rec;
+  uint32 pos;
+
+  //The previous instance is dead, so we are the only writer
+  clock_gettime(CLOCK_REALTIME,&now);
+  for(pos=ring->tail;pos != ring->head;pos++){
+    rec = &ring->rec[pos & (LOG_RING_SIZE-1)];
+    if(rec->seq != pos) continue;
+    rec->procid = procid;
+    rec->level  = LOG_LVL_WARN;
+    rec->sec    = now.tv_sec;
+    rec->nsec   = now.tv_nsec;
+    rec->fmt    = "LOG: record lost, writer exited before publishing\n";
+    rec->str[0] = 0;
+    __sync_synchronize();
+    rec->seq = pos+1;
+  }
+
+  logring = ring;
+  logproc = procid;
+}
+
+/**************************************************************/
+/* LOG_PACK                                                   */
+/*  - Copy arguments into record per format string            */
+/*  - Numeric arguments past LOG_MAX_ARGS are consumed but    */
+/*    not stored                                              */
+/**************************************************************/
+static void log_pack(logrec_t *rec, const char *fmt, va_list ap){
+  const char *p;
+  logarg_t arg;
+  char *s;
+  int n=0,nstr=0,lng,dbl;
+
+  rec->str[0] = 0;
+  for(p=fmt;*p;p++){
+    if(*p != '%') continue;
+    if(*++p == '%') continue;
+    //Flags, width and precision
+    for(;*p && strchr("-+ #0123456789.*",*p);p++){
+      if(*p == '*'){
+	arg.i = va_arg(ap,int);
+	if(n < LOG_MAX_ARGS) rec->arg[n++] = arg;
+      }
+    }
+    //Length modifiers
+    for(lng=0,dbl=0;*p && strchr("hlLqjzt",*p);p++){
+      if(*p == 'L') dbl = 1;
+      else if(*p != 'h') lng = 1;
+    }
+    //Conversion
+    switch(*p){
+    case 'd': case 'i': case 'c':
+      arg.i = lng ? va_arg(ap,int64) : va_arg(ap,int);
+      break;
+    case 'u': case 'x': case 'X': case 'o':
+      arg.i = lng ? va_arg(ap,int64) : va_arg(ap,unsigned int);
+      break;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+      arg.f = dbl ? va_arg(ap,long double) : va_arg(ap,double);
+      break;
+    case 'p':
+      arg.i = (int64)va_arg(ap,void *);
+      break;
+    case 's':
+      s = va_arg(ap,char *);
+      if(!nstr++){
+	strncpy(rec->str,s ? s : "(null)",LOG_STR_LEN-1);
+	rec->str[LOG_STR_LEN-1] = 0;
+      }
+      continue;
+    case 0:
+      return;
+    default:
+      continue;
+    }
+    if(n < LOG_MAX_ARGS) rec->arg[n++] = arg;
+  }
+}
+
+/**************************************************************/
+/* LOG_MSG                                                    */
+/*  - Write a record to this process's ring                   */
+/*  - Return 1 if the record was dropped, 0 on success         */
+/**************************************************************/
+int log_msg(int level, const char *fmt, ...){
+  struct timespec now;
+  logrec_t *rec;
+  va_list ap;
+  uint32 pos;
+  int diff;
+
+  //Not attached: print directly
+  if(logring == NULL){
+    va_start(ap,fmt);
+    vprintf(fmt,ap);
+    va_end(ap);
+    return 0;
+  }
+
+  //Reserve a slot
+  pos = logring->head;
+  while(1){
+    rec  = &logring->rec[pos & (LOG_RING_SIZE-1)];
+    diff = (int)(rec->seq - pos);
+    if(diff == 0){
+      if(__sync_bool_compare_and_swap(&logring->head,pos,pos+1)) break;
+    }
+    else if(diff < 0){
+      //Ring full
+      __sync_fetch_and_add(&logring->ndrop,1);
+      return 1;
+    }
+    pos = logring->head;
+  }
+
+  //Fill record
+  clock_gettime(CLOCK_REALTIME,&now);
+  rec->procid = logproc;
+  rec->level  = level;
+  rec->sec    = now.tv_sec;
+  rec->nsec   = now.tv_nsec;
+  rec->fmt    = fmt;
+  va_start(ap,fmt);
+  log_pack(rec,fmt,ap);
+  va_end(ap);
+
+  //Publish
+  __sync_synchronize();
+  rec->seq = pos+1;
+  __sync_fetch_and_add(&logring->nwrite,1);
+  return 0;
+}
+
+/**************************************************************/
+/* LOG_READ                                                   */
+/*  - Copy the oldest record of a ring into rec               */
+/*  - Return 1 if a record was read, 0 if the ring is empty   */
+/**************************************************************/
+int log_read(sm_t *sm_p, int procid, logrec_t *rec){
+  logring_t *ring = (logring_t *)&sm_p->logring[procid];
+  logrec_t  *src;
+  uint32 pos;
+
+  pos = ring->tail;
+  src = &ring->rec[pos & (LOG_RING_SIZE-1)];
+  if(src->seq != pos+1) return 0;
+  __sync_synchronize();
+  memcpy(rec,src,sizeof(logrec_t));
+  __sync_synchronize();
+  //Release the slot to writers
+  src->seq   = pos + LOG_RING_SIZE;
+  ring->tail = pos+1;
+  return 1;
+}
+
+/**************************************************************/
+/* LOG_FORMAT                                                 */
+/*  - Format a record into buf                                */
+/*  - Return number of characters written                     */
+/**************************************************************/
+int log_format(logrec_t *rec, char *buf, int len){
+  const char *p,*start;
+  char spec[32];
+  int n=0,a=0,ns,nstr=0;
+
+  buf[0] = 0;
+  for(p=rec->fmt;*p && n < len-1;p++){
+    //Literal text
+    if(*p != '%' || p[1] == '%'){
+      buf[n++] = *p;
+      if(*p == '%') p++;
+      continue;
+    }
+    //Flags, width and precision, '*' takes a stored argument
+    start = p++;
+    ns = snprintf(spec,sizeof(spec),"%%");
+    for(;*p && strchr("-+ #0123456789.*",*p);p++){
+      if(*p == '*')
+	ns += snprintf(spec+ns,sizeof(spec)-ns,"%d",a < LOG_MAX_ARGS ? (int)rec->arg[a++].i : 0);
+      else if(ns < (int)sizeof(spec)-4)
+	spec[ns++] = *p;
+    }
+    for(;*p && strchr("hlLqjzt",*p);p++);
+    if(*p == 0) break;
+    spec[ns] = 0;
+    //Arguments past LOG_MAX_ARGS were not stored
+    if(*p != 's' && a == LOG_MAX_ARGS){
+      ns = snprintf(buf+n,len-n,"?");
+      n += ns < len-n ? ns : len-n-1;
+      continue;
+    }
+    //Conversion
+    switch(*p){
+    case 'd': case 'i': case 'u': case 'x': case 'X': case 'o':
+      snprintf(spec+ns,sizeof(spec)-ns,"ll%c",*p);
+      ns = snprintf(buf+n,len-n,spec,(long long)rec->arg[a++].i);
+      break;
+    case 'c':
+      snprintf(spec+ns,sizeof(spec)-ns,"c");
+      ns = snprintf(buf+n,len-n,spec,(int)rec->arg[a++].i);
+      break;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+      snprintf(spec+ns,sizeof(spec)-ns,"%c",*p);
+      ns = snprintf(buf+n,len-n,spec,rec->arg[a++].f);
+      break;
+    case 'p':
+      snprintf(spec+ns,sizeof(spec)-ns,"p");
+      ns = snprintf(buf+n,len-n,spec,(void *)rec->arg[a++].i);
+      break;
+    case 's':
+      snprintf(spec+ns,sizeof(spec)-ns,"s");
+      ns = snprintf(buf+n,len-n,spec,nstr++ ? "?" : rec->str);
+      break;
+    default:
+      //Unknown conversion: copy as text
+      ns = snprintf(buf+n,len-n,"%.*s",(int)(p-start+1),start);
+      break;
+    }
+    n += ns < len-n ? ns : len-n-1;
+  }
+  buf[n] = 0;
+  return n;
+}
+
+/**************************************************************/
+/* LOG_STATUS                                                 */
+/*  - Print ring statistics                                   */
+/**************************************************************/
+void log_status(sm_t *sm_p){
+  char *procnam[NCLIENTS] = PROCNAM;
+  logring_t *ring;
+  int i;
+  printf("************ Event Log Rings ************\n");
+  printf("%-6s %10s %10s %6s\n","Proc","Written","Dropped","Fill");
+  for(i=0;i<NCLIENTS;i++){
+    ring = (logring_t *)&sm_p->logring[i];
+    printf("%-6s %10u %10u %6u\n",procnam[i],ring->nwrite,ring->ndrop,ring->head-ring->tail);
+  }
+  printf("*****************************************\n");
+}
@@ -0,0 +1,12 @@
+#ifndef _LOG_FUNCTIONS
+#define _LOG_FUNCTIONS
+
+//Function prototypes
+void log_init(sm_t *sm_p);
+void log_attach(sm_t *sm_p, int procid);
+int  log_msg(int level, const char *fmt, ...) __attribute__((format(printf,2,3)));
+int  log_read(sm_t *sm_p, int procid, logrec_t *rec);
+int  log_format(logrec_t *rec, char *buf, int len);
+void log_status(sm_t *sm_p);
+
+#endif
@@ -13,13 +13,24 @@
 /* piccflight headers */
 #include "controller.h"
 #include "common_functions.h"
+#include "log_functions.h"
 #include "numeric.h"
 #include "phx_config.h"
 #include "fakemodes.h"
+#include "fake_functions.h"
+#include "plant_functions.h"
 #include "alp_functions.h"
 #include "hex_functions.h"
 #include "bmc_functions.h"
 #include "tgt_functions.h"
+#include "lyt_functions.h"
+#include "calstore.h"
+#include "frm_functions.h"
+
+//Float fit matrix rows must match the num_sgemv padding
+#if LYT_SMATRIX_LD != NUM_SGEMV_LD(LOWFS_N_ZERNIKE)
+#error "LYT_SMATRIX_LD must equal NUM_SGEMV_LD(LOWFS_N_ZERNIKE)"
+#endif
 
 /**************************************************************/
 /* LYT_XY2INDEX                                               */
@@ -222,6 +233,7 @@ int lyt_zernike_fit(lyt_t *image, lytref_t *lytref, double *zernikes, double *xc
   static int init=0;
   static double lyt2zern_matrix[LYTXS*LYTYS*LOWFS_N_ZERNIKE]={0}; //zernike fitting matrix (max size)
   static int lyt_npix=0;
+  static uint32 version=0;
   double lyt_delta[LYTXS*LYTYS]={0}; //measured image - reference (max size)
   double img_total,ref_total,value,xnum,ynum,xnum_ref,ynum_ref;
   double xhist[LYTXS]={0},xhist_ref[LYTXS]={0};
@@ -230,7 +242,7 @@ int lyt_zernike_fit(lyt_t *image, lytref_t *lytref, double *zernikes, double *xc
   uint16 maxpix;
 
   /* Initialize Fitting Matrix */
-  if(!init || reset){
+  if(!init || reset || version != cal_version(CAL_LYTPIX2ALPZER)){
 
     /****** COUNT NUMBER OF CONTROLED PIXELS ******/
     lyt_npix=0;
@@ -241,12 +253,12 @@ int lyt_zernike_fit(lyt_t *image, lytref_t *lytref, double *zernikes, double *xc
 
 
     /****** READ ZERNIKE MATRIX FILE ******/
-    if(read_file(LYTPIX2ALPZER_FILE,lyt2zern_matrix,lyt_npix*LOWFS_N_ZERNIKE*sizeof(double))){
+    if(cal_read(CAL_LYTPIX2ALPZER,lyt2zern_matrix,lyt_npix*LOWFS_N_ZERNIKE*sizeof(double),&version)){
       printf("LYT: ERROR reading lyt2zern file\n");
       memset(lyt2zern_matrix,0,sizeof(lyt2zern_matrix));
     }
     else
-      printf("LYT: Read: %s\n",LYTPIX2ALPZER_FILE);
+      printf("LYT: Read lyt2zern matrix v%u\n",version);
     
     //Set init flag
     init=1;
@@ -333,6 +345,266 @@ int lyt_zernike_fit(lyt_t *image, lytref_t *lytref, double *zernikes, double *xc
   return 1;
 }
 
+/**************************************************************/
+/* LYT_FIT_SETREF                                             */
+/*  - Precompute reference image terms of the fitting plan    */
+/**************************************************************/
+void lyt_fit_setref(lytfit_t *fit, lytref_t *lytref){
+  double *ref = &lytref->refimg[0][0];
+  double *col;
+  double value,xnum=0,ynum=0;
+  int k,z;
+
+  //Reference totals, centroid moments & zernikes
+  fit->ref_total=0;
+  memset(fit->zref,0,sizeof(fit->zref));
+  for(k=0;k<fit->npix;k++){
+    value = ref[fit->index[k]];
+    fit->ref_total += value;
+    xnum += fit->xw[k] * value;
+    ynum += fit->yw[k] * value;
+    col = &fit->matrix[k*LOWFS_N_ZERNIKE];
+    for(z=0;z<LOWFS_N_ZERNIKE;z++)
+      fit->zref[z] += col[z] * value;
+  }
+
+  //Normalize
+  if(fit->ref_total > 0){
+    fit->xref = xnum/fit->ref_total;
+    fit->yref = ynum/fit->ref_total;
+    for(z=0;z<LOWFS_N_ZERNIKE;z++)
+      fit->zref[z] /= fit->ref_total;
+  }
+  else{
+    fit->xref = 0;
+    fit->yref = 0;
+    memset(fit->zref,0,sizeof(fit->zref));
+  }
+}
+
+/**************************************************************/
+/* LYT_FIT_INIT                                               */
+/*  - Build fused Zernike fitting plan from pixel mask        */
+/*  - Return 1 on error, 0 on success                         */
+/**************************************************************/
+int lyt_fit_init(lytfit_t *fit, lytref_t *lytref){
+  int i,j,k,z,retval=0;
+
+  /****** BUILD CONTROLLED PIXEL LIST ******/
+  //--row majority to match IDL matrix
+  fit->npix=0;
+  for(j=0;j<LYTYS;j++){
+    for(i=0;i<LYTXS;i++){
+      if(lytref->pxmask[i][j]){
+	fit->index[fit->npix] = i*LYTYS + j;
+	fit->xw[fit->npix]    = i - LYTXS/2;
+	fit->yw[fit->npix]    = j - LYTYS/2;
+	fit->npix++;
+      }
+    }
+  }
+
+  /****** READ ZERNIKE MATRIX FILE ******/
+  if(cal_read(CAL_LYTPIX2ALPZER,fit->matrix,fit->npix*LOWFS_N_ZERNIKE*sizeof(double),&fit->version)){
+    printf("LYT: ERROR reading lyt2zern file\n");
+    memset(fit->matrix,0,sizeof(fit->matrix));
+    retval=1;
+  }
+  else
+    printf("LYT: Read lyt2zern matrix v%u\n",fit->version);
+
+  /****** BUILD FLOAT MATRIX ******/
+  for(k=0;k<fit->npix;k++)
+    for(z=0;z<LYT_SMATRIX_LD;z++)
+      fit->smatrix[k*LYT_SMATRIX_LD+z] = z < LOWFS_N_ZERNIKE ? fit->matrix[k*LOWFS_N_ZERNIKE+z] : 0;
+
+  /****** SET REFERENCE TERMS ******/
+  lyt_fit_setref(fit,lytref);
+
+  return retval;
+}
+
+/**************************************************************/
+/* LYT_READ_ROI                                               */
+/*  - Cut ROI out of raw readout buffer & subtract dark       */
+/*  - Return average background outside ROI                   */
+/**************************************************************/
+double lyt_read_roi(uint16 *buffer, int xorigin, int yorigin, lytdark_t *dark, lyt_t *roi){
+  const long nbkg = LYTREADXS*LYTREADYS - LYTXS*LYTYS;
+  uint64 total=0,roi_total=0;
+  uint16 *pix;
+  int i,j,k;
+
+  //Sum full readout in buffer order
+  for(k=0;k<LYTREADXS*LYTREADYS;k++)
+    total += buffer[k];
+
+  //Cut out ROI -- buffer is inverted, x runs backwards along each row
+  for(j=0;j<LYTYS;j++){
+    pix = buffer + lyt_xy2index(xorigin,yorigin+j);
+    for(i=0;i<LYTXS;i++){
+      roi_total += pix[-i];
+      roi->data[i][j] = pix[-i];
+      if(dark) roi->data[i][j] -= dark->data[xorigin+i][yorigin+j];
+    }
+  }
+
+  //Background is everything outside the ROI
+  return (double)(total - roi_total) / nbkg;
+}
+
+/**************************************************************/
+/* LYT_FIT_ZERNIKES                                           */
+/*  - Fused version of lyt_zernike_fit                        */
+/*  - Normalization, centroid & matrix multiply in one pass   */
+/*    over the controlled pixel list                          */
+/*  - Return 1 on success, 0 on error                         */
+/**************************************************************/
+int lyt_fit_zernikes(lytfit_t *fit, lyt_t *image, double *zernikes, double *xcentroid, double *ycentroid){
+  double *data = &image->data[0][0];
+  double *col;
+  double img_total=0,xnum=0,ynum=0,value;
+  double zsum[LOWFS_N_ZERNIKE]={0};
+  float  xf[LYTXS*LYTYS];
+  float  zf[LYT_SMATRIX_LD] __attribute__((aligned(64)));
+  uint16 maxpix=0;
+  int k,z;
+
+  //Find peak pixel
+  for(k=0;k<LYTXS*LYTYS;k++)
+    if(data[k] > maxpix) maxpix = data[k];
+
+  //Return error if below pixel threshold
+  if(maxpix <= LYT_PIXEL_THRESH){
+    for(z=0;z<LOWFS_N_ZERNIKE;z++)
+      zernikes[z] = 0;
+    *xcentroid = 0;
+    *ycentroid = 0;
+    return 0;
+  }
+
+  if(num_get_precision() == NUM_PRECISION_FLOAT){
+    //Image total, centroid moments & pixel gather
+    for(k=0;k<fit->npix;k++){
+      value = data[fit->index[k]];
+      img_total += value;
+      xnum += fit->xw[k] * value;
+      ynum += fit->yw[k] * value;
+      xf[k] = value;
+    }
+    //Unnormalized zernikes in single precision
+    num_sgemv(fit->smatrix,xf,zf,LYT_SMATRIX_LD,fit->npix);
+    for(z=0;z<LOWFS_N_ZERNIKE;z++)
+      zsum[z] = zf[z];
+  }
+  else{
+    //Image total, centroid moments & unnormalized zernikes
+    for(k=0;k<fit->npix;k++){
+      value = data[fit->index[k]];
+      img_total += value;
+      xnum += fit->xw[k] * value;
+      ynum += fit->yw[k] * value;
+      col = &fit->matrix[k*LOWFS_N_ZERNIKE];
+      for(z=0;z<LOWFS_N_ZERNIKE;z++)
+	zsum[z] += col[z] * value;
+    }
+  }
+
+  //Calculate centroid relative to reference image
+  if(img_total > 0){
+    *xcentroid = (xnum/img_total) - fit->xref;
+    *ycentroid = (ynum/img_total) - fit->yref;
+  }else{
+    *xcentroid = 0;
+    *ycentroid = 0;
+  }
+
+  //Normalize zernikes: M*(img/img_total - ref/ref_total)
+  for(z=0;z<LOWFS_N_ZERNIKE;z++){
+    zernikes[z] = 0;
+    if(img_total > 0 && fit->ref_total > 0)
+      zernikes[z] = zsum[z]/img_total - fit->zref[z];
+    //Limit zernikes
+    zernikes[z] = zernikes[z] < LYT_ZERNIKE_MIN ? LYT_ZERNIKE_MIN : zernikes[z];
+    zernikes[z] = zernikes[z] > LYT_ZERNIKE_MAX ? LYT_ZERNIKE_MAX : zernikes[z];
+  }
+
+  return 1;
+}
+
+/**************************************************************/
+/* LYT_MAG_PLAN                                               */
+/*  - Build bilinear resampling plan for image magnification  */
+/**************************************************************/
+void lyt_mag_plan(lytmag_t *plan, double mag, double xoff, double yoff, int xorigin, int yorigin){
+  double x,y;
+  int i,j,k,x1,x2,y1,y2;
+
+  for(i=0;i<LYTXS;i++){
+    for(j=0;j<LYTYS;j++){
+      k = i*LYTYS + j;
+      //Define location of interpolated pixel
+      x = (i - LYTXS/2)/mag + (LYTREADXS/2) + xorigin + xoff - (LYTREADXS-LYTXS)/2;
+      y = (j - LYTYS/2)/mag + (LYTREADYS/2) + yorigin + yoff - (LYTREADYS-LYTYS)/2;
+
+      //Pick 4 pixels for interpolation
+      x1 = (int)x;
+      x2 = x1 + 1;
+      y1 = (int)y;
+      y2 = y1 + 1;
+
+      if(x1 >= 0 && x1 < LYTREADXS && x2 >= 0 && x2 < LYTREADXS && y1 >= 0 && y1 < LYTREADYS && y2 >= 0 && y2 < LYTREADYS){
+	//Bilinear weights (x2-x1 = y2-y1 = 1)
+	plan->index[k][0]  = lyt_xy2index(x1,y1);
+	plan->index[k][1]  = lyt_xy2index(x2,y1);
+	plan->index[k][2]  = lyt_xy2index(x1,y2);
+	plan->index[k][3]  = lyt_xy2index(x2,y2);
+	plan->weight[k][0] = (x2 - x) * (y2 - y);
+	plan->weight[k][1] = (x - x1) * (y2 - y);
+	plan->weight[k][2] = (x2 - x) * (y - y1);
+	plan->weight[k][3] = (x - x1) * (y - y1);
+      }else{
+	//1 of 4 pixels is out of bounds --> use closest value
+	x = x < 0 ? 0 : x;
+	y = y < 0 ? 0 : y;
+	x = x >= LYTREADXS ? LYTREADXS-1 : x;
+	y = y >= LYTREADYS ? LYTREADYS-1 : y;
+	plan->index[k][0]  = lyt_xy2index((int)x,(int)y);
+	plan->index[k][1]  = plan->index[k][0];
+	plan->index[k][2]  = plan->index[k][0];
+	plan->index[k][3]  = plan->index[k][0];
+	plan->weight[k][0] = 1;
+	plan->weight[k][1] = 0;
+	plan->weight[k][2] = 0;
+	plan->weight[k][3] = 0;
+      }
+    }
+  }
+
+  //Save parameters
+  plan->mag     = mag;
+  plan->xoff    = xoff;
+  plan->yoff    = yoff;
+  plan->xorigin = xorigin;
+  plan->yorigin = yorigin;
+  plan->init    = 1;
+}
+
+/**************************************************************/
+/* LYT_MAG_APPLY                                              */
+/*  - Resample raw readout buffer into ROI using plan         */
+/**************************************************************/
+void lyt_mag_apply(lytmag_t *plan, uint16 *buffer, lyt_t *roi){
+  double *data = &roi->data[0][0];
+  int k;
+
+  for(k=0;k<LYTXS*LYTYS;k++)
+    data[k] = plan->weight[k][0] * buffer[plan->index[k][0]] +
+              plan->weight[k][1] * buffer[plan->index[k][1]] +
+              plan->weight[k][2] * buffer[plan->index[k][2]] +
+              plan->weight[k][3] * buffer[plan->index[k][3]];
+}
+
 /**************************************************************/
 /* LYT_PROCESS_IMAGE                                          */
 /*  - Main image processing function for LYT                  */
@@ -348,8 +620,10 @@ int lyt_process_image(stImageBuff *buffer,sm_t *sm_p){
   static uint32 frame_number=0, sample=0;
   static int init=0;
   static lytref_t lytref;
+  static lytfit_t lytfit;
+  fakecfg_t fakecfg;
+  static lytmag_t lytmag;
   static int pid_reset=FUNCTION_RESET;
-  static lytread_t readimage;
   static lytdark_t darkimage;
   static int darkcount=0;
   static int pid_single_init=0;
@@ -363,20 +637,17 @@ int lyt_process_image(stImageBuff *buffer,sm_t *sm_p){
   int zernike_switch[LOWFS_N_ZERNIKE] = {0};
   int cen_used=0;
   uint32_t n_dither=1;
-  double background=0;
-  const long nbkg = LYTREADXS*LYTREADYS - LYTXS*LYTYS;
   uint16 *image = (uint16 *)buffer->pvAddress;
 
-  //Image magnification
-  double x,y,f_x_y1,f_x_y2;
-  int x1,x2,y1,y2;
-  
   //Get time immidiately
   clock_gettime(CLOCK_REALTIME,&start);
 
   //Get state
   state = sm_p->state;
 
+  //Set reconstructor precision
+  num_set_precision(sm_p->w[LYTID].precision);
+
   //Check reset
   if(sm_p->lyt_reset){
     init=0;
@@ -389,6 +660,7 @@ int lyt_process_image(stImageBuff *buffer,sm_t *sm_p){
     memset(&lytevent,0,sizeof(lytevent_t));
     memset(&lytpkt,0,sizeof(lytpkt_t));
     memset(&darkimage,0,sizeof(lytdark_t));
+    memset(&lytmag,0,sizeof(lytmag_t));
     //Init frame number & sample
     frame_number=0;
     sample=0;
@@ -403,8 +675,8 @@ int lyt_process_image(stImageBuff *buffer,sm_t *sm_p){
     lyt_initref(&lytref);
     //Load dark image
     lyt_loaddark(&darkimage);
-    //Reset zernike fitter
-    lyt_zernike_fit(NULL,&lytref,NULL,NULL,NULL,FUNCTION_RESET_RETURN);
+    //Build zernike fitting plan
+    lyt_fit_init(&lytfit,&lytref);
     //Init ALP calmodes
     for(i=0;i<ALP_NCALMODES;i++)
       alp_init_calmode(i,&alpcalmodes[i]);
@@ -426,9 +698,13 @@ int lyt_process_image(stImageBuff *buffer,sm_t *sm_p){
     if(LYT_DEBUG) printf("LYT: Initialized\n");
   }
 
+  //Rebuild zernike fitting plan if a new matrix was loaded
+  if(lytfit.version != cal_version(CAL_LYTPIX2ALPZER))
+    lyt_fit_init(&lytfit,&lytref);
+
   //Measure exposure time
   if(timespec_subtract(&delta,&start,&last))
-    printf("LYT: lyt_process_image --> timespec_subtract error!\n");
+    log_msg(LOG_LVL_WARN,"LYT: lyt_process_image --> timespec_subtract error!\n");
   ts2double(&delta,&dt);
 
   //Save time
@@ -447,6 +723,7 @@ int lyt_process_image(stImageBuff *buffer,sm_t *sm_p){
   lytevent.hed.bmc_commander = sm_p->state_array[state].bmc_commander;
   lytevent.hed.start_sec     = start.tv_sec;
   lytevent.hed.start_nsec    = start.tv_nsec;
+  frm_header(sm_p,LYTID,&lytevent.hed);
   lytevent.hed.hex_calmode   = sm_p->hex_calmode;
   lytevent.hed.alp_calmode   = sm_p->alp_calmode;
   lytevent.hed.bmc_calmode   = sm_p->bmc_calmode;
@@ -479,60 +756,21 @@ int lyt_process_image(stImageBuff *buffer,sm_t *sm_p){
     if(lytevent.hed.tgt_calmode != TGT_CALMODE_NONE)
       sm_p->tgt_calmode = tgt_calibrate(sm_p,lytevent.hed.tgt_calmode,lytevent.zernike_target,&lytevent.hed.tgt_calstep,LYTID,FUNCTION_NO_RESET);
 
-  //Copy full readout image to event
-  for(i=0;i<LYTREADXS;i++)
-    for(j=0;j<LYTREADYS;j++)
-      readimage.data[i][j]=image[lyt_xy2index(i,j)];
- 
   //Init background
   lytevent.background = 0;
   
   //Copy ROI pixels
   if(sm_p->lyt_mag_enable){
+    //Rebuild resampling plan if magnification parameters changed
+    if(!lytmag.init || lytmag.mag != sm_p->lyt_mag || lytmag.xoff != sm_p->lyt_mag_xoff || lytmag.yoff != sm_p->lyt_mag_yoff ||
+       lytmag.xorigin != lytevent.xorigin || lytmag.yorigin != lytevent.yorigin)
+      lyt_mag_plan(&lytmag,sm_p->lyt_mag,sm_p->lyt_mag_xoff,sm_p->lyt_mag_yoff,lytevent.xorigin,lytevent.yorigin);
     //Run image magnification
-    for(i=0;i<LYTXS;i++){
-      for(j=0;j<LYTYS;j++){
-	//Define location of interpolated pixel
-	x = (i - LYTXS/2)/sm_p->lyt_mag + (LYTREADXS/2) + lytevent.xorigin + sm_p->lyt_mag_xoff - (LYTREADXS-LYTXS)/2;
-	y = (j - LYTYS/2)/sm_p->lyt_mag + (LYTREADYS/2) + lytevent.yorigin + sm_p->lyt_mag_yoff - (LYTREADYS-LYTYS)/2;
-	  
-	//Pick 4 pixels for interpolation
-	x1 = (int)x;
-	x2 = x1 + 1;
-	y1 = (int)y;
-	y2 = y1 + 1;
-
-	//Calculate interpolated value
-	if(x1 >= 0 && x1 < LYTREADXS && x2 >= 0 && x2 < LYTREADXS && y1 >= 0 && y1 < LYTREADYS && y2 >= 0 && y2 < LYTREADYS){
-	  f_x_y1  = (x2 - x) * readimage.data[x1][y1] / (x2 - x1) + (x - x1) * readimage.data[x2][y1] / (x2 - x1);
-	  f_x_y2  = (x2 - x) * readimage.data[x1][y2] / (x2 - x1) + (x - x1) * readimage.data[x2][y2] / (x2 - x1);
-	  lytevent.image.data[i][j] = (y2 - y) * f_x_y1 / (y2 - y1) + (y - y1) * f_x_y2 / (y2-y1);
-	}else{
-	  //1 of 4 pixels is out of bounds --> use closest value
-	  x = x < 0 ? 0 : x;
-	  y = y < 0 ? 0 : y;
-	  x = x >= LYTREADXS ? LYTREADXS-1 : x;
-	  y = y >= LYTREADYS ? LYTREADYS-1 : y;
-	  lytevent.image.data[i][j] = readimage.data[(int)x][(int)y];
-	}
-      }
-    }
+    lyt_mag_apply(&lytmag,image,&lytevent.image);
   }
   else{
-    //Cut out ROI & measure background
-    for(i=0;i<LYTREADXS;i++){
-      for(j=0;j<LYTREADYS;j++){
-	if((i >= lytevent.xorigin) && (i < lytevent.xorigin+LYTXS) && (j >= lytevent.yorigin) && (j < lytevent.yorigin+LYTYS)){
-	  lytevent.image.data[i-lytevent.xorigin][j-lytevent.yorigin]=(double)readimage.data[i][j];
-	  if(sm_p->lyt_subdark) lytevent.image.data[i-lytevent.xorigin][j-lytevent.yorigin] -= darkimage.data[i][j]; //dark subtraction
-	}
-	else{
-	  background += readimage.data[i][j];
-	}
-      }
-    }
-    //Take average
-    lytevent.background = background / nbkg;
+    //Cut out ROI, subtract dark & measure background
+    lytevent.background = lyt_read_roi(image,lytevent.xorigin,lytevent.yorigin,sm_p->lyt_subdark ? &darkimage : NULL,&lytevent.image);
   }
 
   
@@ -543,6 +781,7 @@ int lyt_process_image(stImageBuff *buffer,sm_t *sm_p){
       for(j=0;j<LYTYS;j++)
 	lytref.refimg[i][j] = lytevent.image.data[i][j];
     sm_p->lyt_setref=0;
+    lyt_fit_setref(&lytfit,&lytref);
   }
   
   //Command: lyt_defref 
@@ -550,6 +789,7 @@ int lyt_process_image(stImageBuff *buffer,sm_t *sm_p){
     //Switch to default reference image
     memcpy(&lytref.refimg[0][0],&lytref.refdef[0][0],sizeof(lytref.refimg));
     sm_p->lyt_defref=0;
+    lyt_fit_setref(&lytfit,&lytref);
   }
   
   //Command: lyt_modref 
@@ -557,6 +797,7 @@ int lyt_process_image(stImageBuff *buffer,sm_t *sm_p){
     //Switch to model reference image
     memcpy(&lytref.refimg[0][0],&lytref.refmod[0][0],sizeof(lytref.refimg));
     sm_p->lyt_modref=0;
+    lyt_fit_setref(&lytfit,&lytref);
   }
   
   //Command: lyt_saveref 
@@ -571,6 +812,7 @@ int lyt_process_image(stImageBuff *buffer,sm_t *sm_p){
     //Load saved reference image from disk
     lyt_loadref(&lytref);
     sm_p->lyt_loadref=0;
+    lyt_fit_setref(&lytfit,&lytref);
   }
   
   //Command: lyt_setdark 
@@ -580,11 +822,11 @@ int lyt_process_image(stImageBuff *buffer,sm_t *sm_p){
     //Add current full image to dark image average
     for(i=0;i<LYTREADXS;i++)
       for(j=0;j<LYTREADYS;j++)
-	darkimage.data[i][j] += (double)readimage.data[i][j] / LYT_NDARK;
+	darkimage.data[i][j] += (double)image[lyt_xy2index(i,j)] / LYT_NDARK;
     if(++darkcount == LYT_NDARK){
       sm_p->lyt_setdark=0;
       darkcount=0;
-      printf("LYT: %d frames averaged into dark image\n",LYT_NDARK);
+      log_msg(LOG_LVL_INFO,"LYT: %d frames averaged into dark image\n",LYT_NDARK);
     }
   }
   
@@ -593,7 +835,7 @@ int lyt_process_image(stImageBuff *buffer,sm_t *sm_p){
     //Clear current dark image
     memset(&darkimage,0,sizeof(darkimage));
     sm_p->lyt_zerodark=0;
-    printf("LYT: dark image set to zero\n");
+    log_msg(LOG_LVL_INFO,"LYT: dark image set to zero\n");
   }
   
   //Command: lyt_savedark 
@@ -624,11 +866,17 @@ int lyt_process_image(stImageBuff *buffer,sm_t *sm_p){
       memset(&lytevent.image,0,sizeof(lytevent.image));
       lytevent.image.data[CAM_IMREG_X][CAM_IMREG_Y] = 1;
     }
+    if(sm_p->w[LYTID].fakemode == FAKEMODE_ZERNIKE)
+      fake_lyt_image(&lytevent.image,&lytref,&lytfit,(fakecfg_t *)&sm_p->fakecfg);
+    if(sm_p->w[LYTID].fakemode == FAKEMODE_PLANT){
+      plant_fakecfg(sm_p,LYTID,&fakecfg);
+      fake_lyt_image(&lytevent.image,&lytref,&lytfit,&fakecfg);
+    }
   }
   
   //Fit Zernikes
   if(sm_p->state_array[state].lyt.fit_zernikes)
-    lytevent.status_valid = lyt_zernike_fit(&lytevent.image,&lytref,lytevent.zernike_measured, &lytevent.xcentroid, &lytevent.ycentroid, FUNCTION_NO_RESET);
+    lytevent.status_valid = lyt_fit_zernikes(&lytfit,&lytevent.image,lytevent.zernike_measured, &lytevent.xcentroid, &lytevent.ycentroid);
   
 
   /*************************************************************/
@@ -641,6 +889,7 @@ int lyt_process_image(stImageBuff *buffer,sm_t *sm_p){
     //Get last ALP command
     if(alp_get_command(sm_p,&alp)){
       //Skip this image
+      frm_skip(sm_p,LYTID,FRM_SKIP_LOCK);
       return 0;
     }
     memcpy(&alp_try,&alp,sizeof(alp_t));
@@ -748,7 +997,7 @@ int lyt_process_image(stImageBuff *buffer,sm_t *sm_p){
     
     //Get time since last packet write
     if(timespec_subtract(&delta,&start,&pkt_last))
-      printf("LYT: lyt_process_image --> timespec_subtract error!\n");
+      log_msg(LOG_LVL_WARN,"LYT: lyt_process_image --> timespec_subtract error!\n");
     ts2double(&delta,&dt);
     
     //Last sample, fill out rest of packet and write to circular buffer
@@ -0,0 +1,13 @@
+#ifndef _LYT_FUNCTIONS
+#define _LYT_FUNCTIONS
+
+//Function prototypes
+uint64 lyt_xy2index(int x, int y);
+void lyt_fit_setref(lytfit_t *fit, lytref_t *lytref);
+int lyt_fit_init(lytfit_t *fit, lytref_t *lytref);
+double lyt_read_roi(uint16 *buffer, int xorigin, int yorigin, lytdark_t *dark, lyt_t *roi);
+int lyt_fit_zernikes(lytfit_t *fit, lyt_t *image, double *zernikes, double *xcentroid, double *ycentroid);
+void lyt_mag_plan(lytmag_t *plan, double mag, double xoff, double yoff, int xorigin, int yorigin);
+void lyt_mag_apply(lytmag_t *plan, uint16 *buffer, lyt_t *roi);
+
+#endif
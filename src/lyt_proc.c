@@ -16,7 +16,10 @@
 /* piccflight headers */
 #include "controller.h"
 #include "common_functions.h"
+#include "log_functions.h"
 #include "phx_config.h"
+#include "frm_functions.h"
+#include "plant_functions.h"
 #include "phx_bobcat.h"
 #include "phx_phoenix_bobcat.h"
 #include "../drivers/phxdrv/picc_dio.h"
@@ -66,9 +69,14 @@ typedef struct {
 /*  - Exposure ISR callback function                          */
 /**************************************************************/
 static void lyt_callback( tHandle lytCamera, ui32 dwInterruptMask, void *pvParams ) {
+  //Count frames the grabber could not deliver
+  if ( dwInterruptMask & (PHX_INTRPT_FRAME_LOST | PHX_INTRPT_FIFO_OVERFLOW) )
+    frm_lost(((tContext *)pvParams)->sm_p,LYTID);
+  
   if ( dwInterruptMask & PHX_INTRPT_BUFFER_READY ) {
     stImageBuff stBuffer;
     tContext *aContext = (tContext *)pvParams;
+    ui32 frame_count = 0;
     //Set DIO bit B1
     #if PICC_DIO_ENABLE
     outb(0x02,PICC_DIO_BASE+PICC_DIO_PORTB);
@@ -76,9 +84,13 @@ static void lyt_callback( tHandle lytCamera, ui32 dwInterruptMask, void *pvParam
     
     etStat eStat = PHX_StreamRead( lytCamera, PHX_BUFFER_GET, &stBuffer );
     if ( PHX_OK == eStat ) {
+      //Hardware frame counter
+      PHX_ParameterGet( lytCamera, PHX_EVENTCOUNT, &frame_count );
+      frm_arrive(aContext->sm_p,LYTID,frame_count);
       //Process image
       if(lyt_process_image(&stBuffer,aContext->sm_p)){
-	printf("LYT: lyt_process_image error!\n");
+	frm_skip(aContext->sm_p,LYTID,FRM_SKIP_ERROR);
+	log_msg(LOG_LVL_ERROR,"LYT: lyt_process_image error!\n");
 	//can't call lytctrlC from here. ask to be restarted.
 	aContext->sm_p->w[LYTID].res=1;
 	sleep(5);
@@ -87,6 +99,8 @@ static void lyt_callback( tHandle lytCamera, ui32 dwInterruptMask, void *pvParam
       #if PICC_DIO_ENABLE
       outb(0x00,PICC_DIO_BASE+PICC_DIO_PORTB);
       #endif
+      //Frame accounting
+      frm_done(aContext->sm_p,LYTID,aContext->sm_p->lyt_frmtime);
       //Check in with watchdog
       checkin(aContext->sm_p,LYTID);
     }
@@ -117,9 +131,22 @@ int lyt_proc(void){
     lytctrlC(0);
   }
 
+  /* Attach to event log ring */
+  log_attach(sm_p,LYTID);
+
   /* Set soft interrupt handler */
   sigset(SIGINT, lytctrlC);	/* usually ^C */
 
+#ifdef PLANT_SIM
+  /* Simulated camera: frames come from the optical plant */
+  while(1){
+    checkin(sm_p,LYTID);
+    plant_camera(sm_p,LYTID);
+    if(sm_p->w[LYTID].die)
+      lytctrlC(0);
+  }
+#endif
+
   /* Set up context for callback */
   memset( &lytContext, 0, sizeof( tContext ) );
   lytContext.sm_p = sm_p;
@@ -160,6 +187,18 @@ int lyt_proc(void){
     lytctrlC(0);
   }
 
+  /* Count frames in hardware and interrupt on lost frames */
+  eParamValue = PHX_EVENTCOUNT_FRAME;
+  eStat = PHX_ParameterSet( lytCamera, PHX_EVENTCOUNT_SRC, &eParamValue );
+  if ( PHX_OK != eStat )
+    printf("LYT: Error PHX_ParameterSet --> PHX_EVENTCOUNT_SRC\n");
+  eStat = PHX_ParameterGet( lytCamera, PHX_INTRPT_SET, &eParamValue );
+  eParamValue |= PHX_INTRPT_FRAME_LOST | PHX_INTRPT_FIFO_OVERFLOW;
+  if ( PHX_OK == eStat )
+    eStat = PHX_ParameterSet( lytCamera, PHX_INTRPT_SET, &eParamValue );
+  if ( PHX_OK != eStat )
+    printf("LYT: Error PHX_ParameterSet --> PHX_INTRPT_SET\n");
+
   /* Get debugging info */
   if(LYT_DEBUG){
     eStat = PHX_ParameterGet( lytCamera, PHX_ROI_XLENGTH, &roiWidth );
@@ -261,6 +300,7 @@ int lyt_proc(void){
       
       /* Check if camera should start */
       if(!camera_running){
+	frm_restart(sm_p,LYTID);
 	eStat = PHX_StreamRead( lytCamera, PHX_START, (void*)lyt_callback );
 	if ( PHX_OK != eStat ){
 	  printf("LYT: PHX_StreamRead --> PHX_START\n");
@@ -18,9 +18,20 @@
 #include "controller.h"
 #include "common_functions.h"
 #include "watchdog.h"
+#include "log_functions.h"
 
 /* Process File Descriptor */
 
+/* Level tags, also mark lines already sent when reading stdout */
+static const char *msglevel[LOG_NLEVELS] = {"[I] ","[W] ","[E] "};
+
+/* Repeated message tracking */
+typedef struct msgrate_struct{
+  const char *fmt;     //format string
+  double      tstart;  //window start [s]
+  uint32      count;   //messages in window
+} msgrate_t;
+
 /* CTRL-C Function */
 void msgctrlC(int sig)
 {
@@ -30,16 +41,90 @@ void msgctrlC(int sig)
   exit(sig);
 }
 
-void msg_proc(void){
+/**************************************************************/
+/* MSG_SEND                                                   */
+/*  - Write a message into the msgevent circular buffer       */
+/**************************************************************/
+static void msg_send(sm_t *sm_p, char *text, uint32 sec, uint32 nsec){
   msgevent_t msgevent;
+  static uint32 count = 0;
+  int state = sm_p->state;
+
+  //Fill out event header
+  msgevent.hed.version       = PICC_PKT_VERSION;
+  msgevent.hed.type          = BUFFER_MSGEVENT;
+  msgevent.hed.frame_number  = count++;
+  msgevent.hed.state         = state;
+  msgevent.hed.alp_commander = sm_p->state_array[state].alp_commander;
+  msgevent.hed.hex_commander = sm_p->state_array[state].hex_commander;
+  msgevent.hed.bmc_commander = sm_p->state_array[state].bmc_commander;
+  msgevent.hed.start_sec     = sec;
+  msgevent.hed.start_nsec    = nsec;
+
+  //Copy message
+  memset(msgevent.message,0,sizeof(msgevent.message));
+  strncpy(msgevent.message,text,MAX_LINE-1);
+
+  //Write event to circular buffer
+  if(sm_p->circbuf[BUFFER_MSGEVENT].write) write_to_buffer(sm_p,&msgevent,BUFFER_MSGEVENT);
+}
+
+/**************************************************************/
+/* MSG_SUPPRESSED                                             */
+/*  - Report messages dropped during a rate window            */
+/**************************************************************/
+static void msg_suppressed(sm_t *sm_p, msgrate_t *rate, struct timespec *now){
+  char text[MAX_LINE];
+  int n;
+  if(rate->count <= LOG_RATE_MAX) return;
+  n = strcspn(rate->fmt,"\n");
+  snprintf(text,sizeof(text),"%sMSG: suppressed %u repeats of \"%.*s\"\n",msglevel[LOG_LVL_WARN],
+	   rate->count-LOG_RATE_MAX,n,rate->fmt);
+  printf("%s",text);
+  msg_send(sm_p,text,now->tv_sec,now->tv_nsec);
+}
+
+/**************************************************************/
+/* MSG_RATELIMIT                                              */
+/*  - Count a message against its format's window             */
+/*  - Return 1 if the message should be suppressed            */
+/**************************************************************/
+static int msg_ratelimit(sm_t *sm_p, msgrate_t *rate, const char *fmt, double t, struct timespec *now){
+  int i,slot=0;
+  //Find format, or reuse the oldest window
+  for(i=0;i<LOG_RATE_NFMT;i++){
+    if(rate[i].fmt == fmt){
+      slot = i;
+      break;
+    }
+    if(rate[i].tstart < rate[slot].tstart) slot = i;
+  }
+  if(rate[slot].fmt != fmt || (t - rate[slot].tstart) > LOG_RATE_PERIOD){
+    msg_suppressed(sm_p,&rate[slot],now);
+    rate[slot].fmt    = fmt;
+    rate[slot].tstart = t;
+    rate[slot].count  = 0;
+  }
+  return ++rate[slot].count > LOG_RATE_MAX;
+}
+
+/**************************************************************/
+/* MSG_PROC                                                   */
+/*  - Send messages to the ground                             */
+/*  - Event log rings are read directly                       */
+/*  - Plain stdout output is read back from the output file   */
+/**************************************************************/
+void msg_proc(void){
+  msgrate_t rate[LOG_RATE_NFMT];
+  logrec_t rec;
+  char text[MAX_LINE];
   int shmfd;
   FILE *input;
   size_t len;
-  ssize_t nread;
   char *line=NULL;
-  static struct timespec start;
-  static uint32 count = 0;
-  int state;
+  struct timespec now,poll = {0, LOG_POLL_PERIOD*ONE_BILLION};
+  double t;
+  int i,n,nmsg;
   
   /* Set soft interrupt handler */
   sigset(SIGINT, msgctrlC);	/* usually ^C */
@@ -59,40 +144,54 @@ void msg_proc(void){
     msgctrlC(0);
   }
   
+  /* Init rate limiting */
+  memset(rate,0,sizeof(rate));
+
   /* Start main loop */
   printf("MSG: Running message capture\n");
   
   while(1){
-    /* Get start time */
-    clock_gettime(CLOCK_REALTIME,&start);
-
-    //Get state
-    state = sm_p->state;
-
-    //Fill out event header
-    msgevent.hed.version       = PICC_PKT_VERSION;
-    msgevent.hed.type          = BUFFER_MSGEVENT;
-    msgevent.hed.frame_number  = count++;
-    msgevent.hed.state         = state;
-    msgevent.hed.alp_commander = sm_p->state_array[state].alp_commander;
-    msgevent.hed.hex_commander = sm_p->state_array[state].hex_commander;
-    msgevent.hed.bmc_commander = sm_p->state_array[state].bmc_commander;
-    msgevent.hed.start_sec     = start.tv_sec;
-    msgevent.hed.start_nsec    = start.tv_nsec;
-    memset(msgevent.message,0,sizeof(msgevent.message));
-    
-    //Read data
-    if(getline(&line,&len,input) > 0){
-      //Copy message
-      strncpy(msgevent.message,line,MAX_LINE);
-      free(line);
-      line=NULL;
-      //Write event to circular buffer
-      if(sm_p->circbuf[BUFFER_MSGEVENT].write) write_to_buffer(sm_p,&msgevent,BUFFER_MSGEVENT);
+    nmsg = 0;
+
+    /* Get time */
+    clock_gettime(CLOCK_REALTIME,&now);
+    ts2double(&now,&t);
+
+    /* Read event log rings */
+    for(i=0;i<NCLIENTS;i++){
+      while(log_read(sm_p,i,&rec)){
+	nmsg++;
+	if(msg_ratelimit(sm_p,rate,rec.fmt,t,&now)) continue;
+	n = snprintf(text,sizeof(text),"%s",msglevel[rec.level < LOG_NLEVELS ? rec.level : LOG_LVL_ERROR]);
+	log_format(&rec,text+n,sizeof(text)-n);
+	//Echo to stdout, send to ground
+	printf("%s",text);
+	msg_send(sm_p,text,rec.sec,rec.nsec);
+      }
+    }
+
+    /* Close expired rate windows */
+    for(i=0;i<LOG_RATE_NFMT;i++){
+      if(rate[i].fmt && (t - rate[i].tstart) > LOG_RATE_PERIOD){
+	msg_suppressed(sm_p,&rate[i],&now);
+	rate[i].fmt = NULL;
+      }
     }
-    else{
-      sleep(sm_p->w[MSGID].per);
+
+    /* Read stdout */
+    while(getline(&line,&len,input) > 0){
+      nmsg++;
+      //Skip ring messages echoed above
+      for(i=0;i<LOG_NLEVELS;i++)
+	if(!strncmp(line,msglevel[i],strlen(msglevel[i]))) break;
+      if(i == LOG_NLEVELS)
+	msg_send(sm_p,line,now.tv_sec,now.tv_nsec);
     }
+    clearerr(input);
+
+    /* Sleep if idle */
+    if(nmsg == 0)
+      nanosleep(&poll,NULL);
       
     //Check in with the watchdog
     checkin(sm_p,MSGID);
@@ -100,6 +199,7 @@ void msg_proc(void){
   
     
   /* Cleanup and exit */
+  free(line);
   close(shmfd);
   fclose(input);
   
@@ -8,12 +8,108 @@
 #include <fcntl.h>
 #include <ctype.h>
 #include <netdb.h>
-#include <mkl.h>
+#include <math.h>
 #include "numeric.h"
 
+//BLAS/LAPACK backend, selected at build time (see Makefile NUMERIC)
+#if defined(NUM_BACKEND_MKL)
+#include <mkl.h>
+#define NUM_BACKEND_NAME "mkl"
+#elif defined(NUM_BACKEND_OPENBLAS)
+#include <cblas.h>
+#include <lapacke.h>
+#define NUM_BACKEND_NAME "openblas"
+#else
+#ifndef NUM_BACKEND_REF
+#define NUM_BACKEND_REF
+#endif
+#define NUM_BACKEND_NAME "ref"
+#endif
+
+//The reference backend always uses the fixed shape kernels
+#if defined(NUM_BACKEND_REF) && !defined(NUM_FIXED_KERNELS)
+#define NUM_FIXED_KERNELS
+#endif
+
 #define NUMERIC_DEBUG 0
+#define NUM_SVD_MAXSWEEP 60
 #define MIN(A,B)   ((A) < (B) ? (A) : (B))
 
+//Compile float kernels for AVX-512, AVX2 & generic x86-64, selected at load time
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__)
+#define NUM_SIMD __attribute__((target_clones("avx512f","avx2","default")))
+#else
+#define NUM_SIMD
+#endif
+
+//Process reconstructor precision
+static int num_precision = NUM_PRECISION_DOUBLE;
+
+/******************************************************************************
+        num_backend
+******************************************************************************/
+/*Function: Return the name of the BLAS/LAPACK backend the code was built with
+*/
+const char *num_backend(void){
+#ifdef NUM_FIXED_KERNELS
+  return NUM_BACKEND_NAME "+fixed";
+#else
+  return NUM_BACKEND_NAME;
+#endif
+}
+
+/******************************************************************************
+        num_ref_dgemv
+******************************************************************************/
+/*Function: Reference C version of num_dgemv (same arguments)
+*/
+void num_ref_dgemv(double *A, double *b, double *result, int mm, int nn){
+  int i,k;
+  for(i=0;i<mm;i++)
+    result[i] = 0;
+  for(k=0;k<nn;k++)
+    for(i=0;i<mm;i++)
+      result[i] += A[k*mm+i] * b[k];
+}
+
+/******************************************************************************
+        num_fixed_dgemv
+******************************************************************************/
+/*Function: Hand written num_dgemv kernels for the fixed flight shapes
+  Same arguments as num_dgemv. The row count is a compile time constant so the
+  accumulators stay in registers (LOWFS) or L1 (EFC) while the columns stream by.
+  Returns 1 if the shape was handled, 0 otherwise.
+*/
+#define NUM_DGEMV_FIXED(MM)						\
+  NUM_SIMD static void num_dgemv_##MM(double *A, double *b, double *result, int nn){ \
+    double acc[MM] = {0};						\
+    int i,k;								\
+    for(k=0;k<nn;k++)							\
+      for(i=0;i<MM;i++)							\
+	acc[i] += A[k*MM+i] * b[k];					\
+    for(i=0;i<MM;i++)							\
+      result[i] = acc[i];						\
+  }
+
+NUM_DGEMV_FIXED(23)  //Zernikes
+NUM_DGEMV_FIXED(97)  //ALP actuators
+NUM_DGEMV_FIXED(856) //BMC active actuators
+
+int num_fixed_dgemv(double *A, double *b, double *result, int mm, int nn){
+  switch(mm){
+  case 23:
+    num_dgemv_23(A,b,result,nn);
+    return 1;
+  case 97:
+    num_dgemv_97(A,b,result,nn);
+    return 1;
+  case 856:
+    num_dgemv_856(A,b,result,nn);
+    return 1;
+  }
+  return 0;
+}
+
 /******************************************************************************
         num_dgemv
 ******************************************************************************/
@@ -26,15 +122,22 @@
   nn     --> number of columns of A (also number of elements of b)
 */
 void num_dgemv(double *A, double *b, double *result, int mm, int nn) {
+#ifdef NUM_FIXED_KERNELS
+  if(num_fixed_dgemv(A, b, result, mm, nn)) return;
+#endif
+#ifdef NUM_BACKEND_REF
+  num_ref_dgemv(A, b, result, mm, nn);
+#else
   const double alpha = 1.0, beta = 0.0;
   const int incx=1, incy=1;
   cblas_dgemv(CblasColMajor, CblasNoTrans, mm, nn, alpha, A, mm, b, incx, beta, result, incy );
+#endif
 }
 
 /******************************************************************************
         num_dgemm
 ******************************************************************************/
-/*Function: [result(mm x kk)] = [A(mm x nn)]*[B(nn x kk)]
+/*Function: [result(mm x nn)] = [A(mm x kk)]*[B(kk x nn)]
   A      --> double matrix of [mm x kk] elements stored in a 1d array in column major format
              (i.e. first mm elements are the mm elements of the first column of the matrix)
   B      --> double matrix of [kk x nn] elements stored in a 1d array in column major format
@@ -46,85 +149,392 @@ void num_dgemv(double *A, double *b, double *result, int mm, int nn) {
   nn     --> number of columns of B (also number of columns of result)
 */
 void num_dgemm(double *A, double *B, double *result, int mm, int kk, int nn) {
+#ifdef NUM_BACKEND_REF
+  int i,j,k;
+  for(j=0;j<nn;j++){
+    for(i=0;i<mm;i++)
+      result[j*mm+i] = 0;
+    for(k=0;k<kk;k++)
+      for(i=0;i<mm;i++)
+	result[j*mm+i] += A[k*mm+i] * B[j*kk+k];
+  }
+#else
   double alpha = 1.0, beta = 0.0;
-  cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, mm, nn, kk, alpha, A, mm, B, kk, beta, result, nn);
+  cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, mm, nn, kk, alpha, A, mm, B, kk, beta, result, mm);
+#endif
 }
 
+/******************************************************************************
+        num_ref_svd
+******************************************************************************/
+/*Function: Reference C thin SVD by one-sided Jacobi rotations, A = [u].diag(s).[vt]
+  A      --> double matrix of [mm x nn] elements stored in a 1d array in column major format (mm >= nn)
+  s      --> double vector of [nn] singular values, sorted in decreasing order
+  u      --> double matrix of [mm x nn] left singular vectors in column major format
+  vt     --> double matrix of [nn x nn] transposed right singular vectors in column major format
+  Returns 0 on success, 1 if the rotations did not converge
+*/
+int num_ref_svd(double *A, int mm, int nn, double *s, double *u, double *vt){
+  double alpha,beta,gamma,zeta,t,c,sn,up,uq,norm;
+  double *v;
+  int i,j,p,q,sweep,rotated=1;
+
+  if((v = malloc(nn*nn*sizeof(double))) == NULL){
+    perror("NUM: num_ref_svd --> malloc(v)");
+    return 1;
+  }
+
+  //Start from U = A, V = I
+  memcpy(u,A,mm*nn*sizeof(double));
+  for(j=0;j<nn;j++)
+    for(i=0;i<nn;i++)
+      v[j*nn+i] = (i == j);
+
+  //Orthogonalize column pairs until no rotation is needed
+  for(sweep=0;sweep<NUM_SVD_MAXSWEEP && rotated;sweep++){
+    rotated=0;
+    for(p=0;p<nn-1;p++){
+      for(q=p+1;q<nn;q++){
+	alpha=beta=gamma=0;
+	for(i=0;i<mm;i++){
+	  alpha += u[p*mm+i] * u[p*mm+i];
+	  beta  += u[q*mm+i] * u[q*mm+i];
+	  gamma += u[p*mm+i] * u[q*mm+i];
+	}
+	if(fabs(gamma) <= 1e-15 * sqrt(alpha*beta)) continue;
+	rotated=1;
+	zeta = (beta - alpha) / (2*gamma);
+	t    = (zeta >= 0 ? 1.0 : -1.0) / (fabs(zeta) + sqrt(1 + zeta*zeta));
+	c    = 1 / sqrt(1 + t*t);
+	sn   = c * t;
+	for(i=0;i<mm;i++){
+	  up = u[p*mm+i];
+	  uq = u[q*mm+i];
+	  u[p*mm+i] = c*up - sn*uq;
+	  u[q*mm+i] = sn*up + c*uq;
+	}
+	for(i=0;i<nn;i++){
+	  up = v[p*nn+i];
+	  uq = v[q*nn+i];
+	  v[p*nn+i] = c*up - sn*uq;
+	  v[q*nn+i] = sn*up + c*uq;
+	}
+      }
+    }
+  }
+
+  //Singular values are the column norms of U
+  for(j=0;j<nn;j++){
+    norm=0;
+    for(i=0;i<mm;i++)
+      norm += u[j*mm+i] * u[j*mm+i];
+    s[j] = sqrt(norm);
+    if(s[j] > 0)
+      for(i=0;i<mm;i++)
+	u[j*mm+i] /= s[j];
+  }
+
+  //Sort in decreasing order (selection sort, nn is small)
+  for(j=0;j<nn-1;j++){
+    p=j;
+    for(q=j+1;q<nn;q++)
+      if(s[q] > s[p]) p=q;
+    if(p != j){
+      t=s[j]; s[j]=s[p]; s[p]=t;
+      for(i=0;i<mm;i++){ t=u[j*mm+i]; u[j*mm+i]=u[p*mm+i]; u[p*mm+i]=t; }
+      for(i=0;i<nn;i++){ t=v[j*nn+i]; v[j*nn+i]=v[p*nn+i]; v[p*nn+i]=t; }
+    }
+  }
+
+  //Transpose V
+  for(j=0;j<nn;j++)
+    for(i=0;i<nn;i++)
+      vt[i*nn+j] = v[j*nn+i];
+
+  free(v);
+  return rotated;
+}
+
+/******************************************************************************
+        num_svd
+******************************************************************************/
+/*Function: Thin SVD with the build backend, same arguments as num_ref_svd
+  A is overwritten by the LAPACK backends
+  Returns 0 on success
+*/
+int num_svd(double *A, int mm, int nn, double *s, double *u, double *vt){
+#ifdef NUM_BACKEND_REF
+  return num_ref_svd(A, mm, nn, s, u, vt);
+#else
+  return LAPACKE_dgesdd(LAPACK_COL_MAJOR, 'S', mm, nn, A, mm, s, u, mm, vt, nn);
+#endif
+}
+
+
+/******************************************************************************
+        num_pinv_free
+******************************************************************************/
+/*Function: Free pseudo-inverse workspace
+*/
+void num_pinv_free(num_pinv_t *ws){
+  free(ws->a);
+  free(ws->s);
+  free(ws->u);
+  free(ws->vt);
+  free(ws->sinv);
+  memset(ws,0,sizeof(num_pinv_t));
+}
+
+/******************************************************************************
+        num_pinv
+******************************************************************************/
+/*Function: [A_inv(nn x mm)] = regularized pseudo-inverse of [A(mm x nn)]
+  ws     --> workspace (zero initialized before first use), reallocated only
+             when the shape changes
+  A      --> double matrix of [mm x nn] elements stored in a 1d array in column major format
+             (not modified, mm >= nn)
+  A_inv  --> double matrix of [nn x mm] elements stored in a 1d array in column major format
+  reg    --> regularization settings (NULL for no regularization)
+  diag   --> conditioning diagnostics (NULL if not wanted)
+  Returns 0 on success, 1 on error
+*/
+int num_pinv(num_pinv_t *ws, double *A, double *A_inv, int mm, int nn, num_pinv_reg_t *reg, num_pinv_diag_t *diag){
+  int method = reg ? reg->method : NUM_PINV_NONE;
+  double smax,smin,damp,sum;
+  int ii,jj,kk,nused;
+
+  if(mm < nn){
+    printf("NUM: num_pinv --> only supports mm >= nn\n");
+    return 1;
+  }
+
+  /* allocate workspace on shape change */
+  if(ws->mm != mm || ws->nn != nn){
+    num_pinv_free(ws);
+    ws->a    = malloc(mm*nn*sizeof(double));
+    ws->s    = malloc(nn*sizeof(double));
+    ws->u    = malloc(mm*nn*sizeof(double));
+    ws->vt   = malloc(nn*nn*sizeof(double));
+    ws->sinv = malloc(nn*sizeof(double));
+    if(!ws->a || !ws->s || !ws->u || !ws->vt || !ws->sinv){
+      perror("NUM: num_pinv --> malloc");
+      num_pinv_free(ws);
+      return 1;
+    }
+    ws->mm = mm;
+    ws->nn = nn;
+  }
+
+  /* singular value decompose A = [u].diagonal_matrix(s).[vt] */
+  memcpy(ws->a, A, mm*nn*sizeof(double));
+  if(num_svd(ws->a, mm, nn, ws->s, ws->u, ws->vt)){
+    printf("NUM: num_pinv --> SVD error\n");
+    return 1;
+  }
+
+  /* build the regularized s_inv array */
+  smax = ws->s[0];
+  smin = ws->s[0];
+  for(ii=0; ii<nn; ii++){
+    smax = ws->s[ii] > smax ? ws->s[ii] : smax;
+    smin = ws->s[ii] < smin ? ws->s[ii] : smin;
+  }
+  damp  = (reg ? reg->alpha : 0) * smax;
+  nused = 0;
+  if(NUMERIC_DEBUG) printf("NUM: Singular values : [ ");
+  for(ii=0; ii<nn; ii++){
+    ws->sinv[ii] = (ws->s[ii]==0) ? 0 : 1.0/ws->s[ii]; // no regularization
+    if(method == NUM_PINV_THRESH && ws->s[ii] < reg->thresh*smax)
+      ws->sinv[ii] = 0;                                               // cutoff regularization
+    if(method == NUM_PINV_NMODES && ws->s[ii] < smax){
+      // keep the nmodes largest (s is not assumed sorted)
+      for(jj=0,kk=0; jj<nn; jj++)
+	if(ws->s[jj] > ws->s[ii] || (ws->s[jj] == ws->s[ii] && jj < ii)) kk++;
+      if(kk >= reg->nmodes) ws->sinv[ii] = 0;
+    }
+    if(method == NUM_PINV_TIKHONOV)
+      ws->sinv[ii] = ws->s[ii]/(ws->s[ii]*ws->s[ii] + damp*damp);    // tikhonov regularization
+    if(ws->sinv[ii] != 0) nused++;
+    if(NUMERIC_DEBUG) printf("%.4f, ", ws->s[ii]);
+  }
+  if(NUMERIC_DEBUG) printf("\b\b ]\n");
+
+  /* multiply [(vt)t].diagonal_matrix(s_inv).[ut] */
+  for(ii=0; ii<mm; ii++){
+    for(jj=0; jj<nn; jj++){
+      sum = 0;
+      for(kk=0; kk<nn; kk++)
+	sum += ws->vt[jj*nn+kk] * ws->sinv[kk] * ws->u[kk*mm+ii];
+      A_inv[ii*nn+jj] = sum;
+    }
+  }
+
+  /* conditioning diagnostics */
+  if(diag){
+    diag->smax   = smax;
+    diag->smin   = smin;
+    diag->cond   = smin > 0 ? smax/smin : INFINITY;
+    diag->nmodes = nused;
+    diag->gain   = 0;
+    for(ii=0; ii<nn; ii++)
+      diag->gain = ws->sinv[ii] > diag->gain ? ws->sinv[ii] : diag->gain;
+  }
+
+  return 0;
+}
 
 /******************************************************************************
         num_dgesvdi
 ******************************************************************************/
-/*Function: [A_inv(nn x mm)] = svd_inverse([A(mm x nn)])
+/*Function: [A_inv(nn x mm)] = unregularized pseudo-inverse of [A(mm x nn)]
   A      --> double matrix of [mm x nn] elements stored in a 1d array in column major format
              (i.e. first mm elements are the mm elements of the first column of the matrix)
+             (not modified, mm >= nn)
   A_inv  --> double matrix of [nn x mm] elements stored in a 1d array in column major format
              (i.e. first nn elements are the nn elements of the first column of the matrix)
   mm      --> number of rows of A (also number of columns of A_inv)
   nn      --> number of columns of A (also number of rows of A_inv)
+  Returns 0 on success, 1 on error (A_inv is zeroed)
+
+  Calls num_pinv with no regularization and a static workspace, so it is not thread safe
 */
-void num_dgesvdi(double* A, double* A_inv, int mm, int nn) {
-  if (mm<=nn) return;  // only supports m>n case TODO m<=n case
-  int ii;
-  MKL_INT info;
-  double alpha = 1.0, beta = 0.0;
-  int idiag[1] = {0};
-  int ndiag = 1;
-
-  double *s, *u, *vt;
-  
-  if((s = malloc(nn*sizeof(double))) == NULL)
-    perror("malloc(s)");
-  memset(s, 0, nn*sizeof(double));
-  
-  if((u = malloc(mm*nn*sizeof(double))) == NULL)
-    perror("malloc(u)");
-  memset(u, 0, mm*nn*sizeof(double));
-
-  if((vt = malloc(nn*nn*sizeof(double))) == NULL)
-    perror("malloc(vt)");
-  memset(vt, 0, nn*nn*sizeof(double));
-
-  double *s_inv, *temp;
-  if((s_inv = malloc(nn*sizeof(double))) == NULL)
-    perror("malloc(s_inv)");
-  memset(s_inv, 0, nn*sizeof(double));
-
-  if((temp = malloc(nn*mm*sizeof(double))) == NULL)
-    perror("malloc(temp)");
-  memset(temp, 0, nn*mm*sizeof(double));
-
-  // for LAPACKE_dgesvd
-  // double* superb; 
-  // if((superb = malloc((MIN(m,n)-1)*sizeof(double))) == NULL) 
-  //   perror("malloc()"); 
-  
-  // singular value decompose
-  // A = [u].diagonal_matrix(s).[vt]
-  // info = LAPACKE_dgesvd(LAPACK_COL_MAJOR, 'A', 'A', mm, nn, A, mm, s, u, mm, vt, nn, superb);
-  info = LAPACKE_dgesdd(LAPACK_COL_MAJOR, 'S', mm, nn, A, mm, s, u, mm, vt, nn);
+int num_dgesvdi(double* A, double* A_inv, int mm, int nn) {
+  static num_pinv_t ws = {0};
+  if(num_pinv(&ws, A, A_inv, mm, nn, NULL, NULL)){
+    memset(A_inv, 0, mm*nn*sizeof(double));
+    return 1;
+  }
+  return 0;
+}
 
-  if(NUMERIC_DEBUG) printf("NUM: Singular values : [ ");
-  // build the s_inv array s_inv = 1/s
-  for(ii=0; ii<nn; ii++){
-    // s_inv[ii] = s[ii]/(pow(s[ii],2) + alpha^2); // tikhonov regularization
-    // s_inv[ii] = ((1.0/s[ii])>cutoff)?0.0:(1.0/s[ii]); // cutoff regularization
-    s_inv[ii] = (s[ii]==0)?0:1.0/s[ii]; // no Regularization
-    if(NUMERIC_DEBUG) printf("%.4f, ", s_inv[ii]);
+/******************************************************************************
+        num_sgemv
+******************************************************************************/
+/*Function: [result(ld)] = [A(ld x nn)]*[b(nn)] in single precision
+  A      --> float matrix of [ld x nn] elements stored in a 1d array in column major format,
+             64 byte aligned, rows zero padded to ld
+  b      --> float vector of [nn] elements stored in a 1d array
+  result --> float vector of [ld] elements stored in a 1d array
+  ld     --> padded number of rows of A, multiple of NUM_SGEMV_PAD
+  nn     --> number of columns of A (also number of elements of b)
+
+  Fixed size kernels are generated for the reconstructor shapes so the row loop
+  is fully unrolled and vectorized. Other shapes use the generic kernel.
+*/
+#define NUM_SGEMV_FIXED(LD)						\
+  NUM_SIMD static void num_sgemv_##LD(float *A, float *b, float *result, int nn){ \
+    float acc[LD] __attribute__((aligned(64))) = {0};			\
+    float *a = __builtin_assume_aligned(A,64);				\
+    int i,k;								\
+    for(k=0;k<nn;k++)							\
+      for(i=0;i<LD;i++)							\
+	acc[i] += a[k*LD+i] * b[k];					\
+    for(i=0;i<LD;i++)							\
+      result[i] = acc[i];						\
   }
-  if(NUMERIC_DEBUG) printf("\b\b ]\n");
-  /* transpose u, vt can be transposed at the multiplication cblas_dgemm*/
-  mkl_dimatcopy('C', 'T', mm, nn, alpha, u, mm, nn);
 
-  /* multiply diagonal_matrix(1/s).[ut] */
-  mkl_ddiamm("n", &nn, &mm, &nn, &alpha, "D NC", s_inv, &nn, idiag, &ndiag, u, &nn, &beta, temp, &nn);
+NUM_SGEMV_FIXED(32)  //Zernikes
+NUM_SGEMV_FIXED(112) //ALP actuators
+NUM_SGEMV_FIXED(304) //SHK cell slopes
 
-  /* multiply [(vt)t].diagonal_matrix(1/s).[ut] */
-  cblas_dgemm(CblasColMajor, CblasTrans, CblasNoTrans, nn, mm, nn, alpha, vt, nn, temp, nn, beta, A_inv, nn);
+NUM_SIMD static void num_sgemv_any(float *A, float *b, float *result, int ld, int nn){
+  float *a = __builtin_assume_aligned(A,64);
+  int i,k;
+  for(i=0;i<ld;i++)
+    result[i] = 0;
+  for(k=0;k<nn;k++)
+    for(i=0;i<ld;i++)
+      result[i] += a[k*ld+i] * b[k];
+}
 
-  free(s);
-  free(u);
-  free(vt);
-  free(s_inv);
-  free(temp);
+void num_sgemv(float *A, float *b, float *result, int ld, int nn){
+  switch(ld){
+  case 32:
+    num_sgemv_32(A,b,result,nn);
+    break;
+  case 112:
+    num_sgemv_112(A,b,result,nn);
+    break;
+  case 304:
+    num_sgemv_304(A,b,result,nn);
+    break;
+  default:
+    num_sgemv_any(A,b,result,ld,nn);
+  }
+}
 
+/******************************************************************************
+        num_set_precision / num_get_precision
+******************************************************************************/
+/*Function: Set or get the reconstructor precision of the calling process
+  precision --> NUM_PRECISION_DOUBLE or NUM_PRECISION_FLOAT
+*/
+void num_set_precision(int precision){
+  num_precision = precision;
+}
+
+int num_get_precision(void){
+  return num_precision;
+}
+
+/******************************************************************************
+        num_recon_init
+******************************************************************************/
+/*Function: Attach double matrix to reconstructor and build padded float copy
+  R      --> reconstructor structure (zero initialized before first use)
+  A      --> double matrix of [mm x nn] elements stored in a 1d array in column major format
+             (must stay valid, used by the double precision path)
+  mm     --> number of rows of A
+  nn     --> number of columns of A
+  Returns 1 on error (float path disabled), 0 on success
+*/
+int num_recon_init(num_recon_t *R, double *A, int mm, int nn){
+  int i,k,ld=NUM_SGEMV_LD(mm);
+
+  R->A  = A;
+  R->mm = mm;
+  R->nn = nn;
+
+  //Allocate aligned float matrix
+  if(R->S == NULL || R->ld*R->nn < ld*nn){
+    free(R->S);
+    R->S = NULL;
+    if(posix_memalign((void **)&R->S,64,ld*nn*sizeof(float))){
+      printf("NUM: num_recon_init --> posix_memalign failed\n");
+      R->S = NULL;
+      return 1;
+    }
+  }
+  R->ld = ld;
+
+  //Convert & pad
+  for(k=0;k<nn;k++)
+    for(i=0;i<ld;i++)
+      R->S[k*ld+i] = i < mm ? A[k*mm+i] : 0;
+
+  return 0;
+}
+
+/******************************************************************************
+        num_recon
+******************************************************************************/
+/*Function: [result(mm)] = [A(mm x nn)]*[b(nn)] in the process precision
+  R      --> reconstructor structure from num_recon_init
+  b      --> double vector of [nn] elements stored in a 1d array
+  result --> double vector of [mm] elements stored in a 1d array
+*/
+void num_recon(num_recon_t *R, double *b, double *result){
+  int i;
+
+  if(num_precision == NUM_PRECISION_FLOAT && R->S != NULL){
+    float bf[R->nn];
+    float rf[R->ld] __attribute__((aligned(64)));
+    for(i=0;i<R->nn;i++)
+      bf[i] = b[i];
+    num_sgemv(R->S,bf,rf,R->ld,R->nn);
+    for(i=0;i<R->mm;i++)
+      result[i] = rf[i];
+  }
+  else
+    num_dgemv(R->A,b,result,R->mm,R->nn);
 }
@@ -1,8 +1,71 @@
 #ifndef _NUMERIC
 #define _NUMERIC
 
+//Reconstructor precision
+#define NUM_PRECISION_DOUBLE 0
+#define NUM_PRECISION_FLOAT  1
+
+//Float reconstructor column padding (one AVX-512 register)
+#define NUM_SGEMV_PAD   16
+#define NUM_SGEMV_LD(mm) ((((mm)+NUM_SGEMV_PAD-1)/NUM_SGEMV_PAD)*NUM_SGEMV_PAD)
+
+//Pseudo-inverse regularization
+#define NUM_PINV_NONE     0 //invert all nonzero singular values
+#define NUM_PINV_THRESH   1 //drop singular values below thresh * s_max
+#define NUM_PINV_NMODES   2 //keep the nmodes largest singular values
+#define NUM_PINV_TIKHONOV 3 //damp with s/(s^2 + (alpha * s_max)^2)
+
+//Pseudo-inverse regularization settings
+typedef struct num_pinv_reg_struct{
+  int    method; //NUM_PINV_*
+  double thresh; //relative singular value threshold (NUM_PINV_THRESH)
+  int    nmodes; //number of modes kept (NUM_PINV_NMODES)
+  double alpha;  //relative Tikhonov parameter (NUM_PINV_TIKHONOV)
+} num_pinv_reg_t;
+
+//Pseudo-inverse conditioning diagnostics
+typedef struct num_pinv_diag_struct{
+  double smax;   //largest singular value
+  double smin;   //smallest singular value
+  double cond;   //condition number of the matrix (smax/smin)
+  int    nmodes; //number of modes kept
+  double gain;   //largest inverse singular value used (noise gain)
+} num_pinv_diag_t;
+
+//Pseudo-inverse workspace, reused while the shape is unchanged
+typedef struct num_pinv_struct{
+  int    mm;    //rows of workspace
+  int    nn;    //columns of workspace
+  double *a;    //copy of input matrix [mm x nn]
+  double *s;    //singular values [nn]
+  double *u;    //left singular vectors [mm x nn]
+  double *vt;   //right singular vectors [nn x nn]
+  double *sinv; //regularized inverse singular values [nn]
+} num_pinv_t;
+
+//Reconstructor matrix with float copy
+typedef struct num_recon_struct{
+  int    mm; //number of rows
+  int    nn; //number of columns
+  int    ld; //padded rows of float matrix
+  double *A; //double matrix (column major, owned by caller)
+  float  *S; //float matrix (column major, padded to ld rows, 64 byte aligned)
+} num_recon_t;
+
+const char *num_backend(void);
 void num_dgemv(double *A, double *b, double *result, int mm, int nn);
+void num_ref_dgemv(double *A, double *b, double *result, int mm, int nn);
+int  num_fixed_dgemv(double *A, double *b, double *result, int mm, int nn);
 void num_dgemm(double *A, double *B, double *result, int mm, int kk, int nn);
-void num_dgesvdi(double* A, double* A_inv, int mm, int nn);
+int  num_ref_svd(double *A, int mm, int nn, double *s, double *u, double *vt);
+int  num_svd(double *A, int mm, int nn, double *s, double *u, double *vt);
+int  num_pinv(num_pinv_t *ws, double *A, double *A_inv, int mm, int nn, num_pinv_reg_t *reg, num_pinv_diag_t *diag);
+void num_pinv_free(num_pinv_t *ws);
+int  num_dgesvdi(double* A, double* A_inv, int mm, int nn);
+void num_sgemv(float *A, float *b, float *result, int ld, int nn);
+void num_set_precision(int precision);
+int  num_get_precision(void);
+int  num_recon_init(num_recon_t *R, double *A, int mm, int nn);
+void num_recon(num_recon_t *R, double *b, double *result);
 
 #endif
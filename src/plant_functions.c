@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+/* piccflight headers */
+#include "controller.h"
+#include "common_functions.h"
+#include "alp_functions.h"
+#include "alpao_map.h"
+#include "bmc_functions.h"
+#include "hex_functions.h"
+#include "fake_functions.h"
+#include "plant_functions.h"
+
+/* Closed-loop optical plant (FAKEMODE_PLANT)
+ *
+ *  - The wavefront seen by SHK, LYT and SCI is the disturbance plus
+ *    the effect of the current ALP and HEX commands in shared memory.
+ *    The commands are applied relative to the ALP flat and the default
+ *    hexapod position through the measured influence matrices
+ *    ALPACT2SHKZER_FILE and HEXACT2SHKZER_FILE. The ALP falls back to
+ *    alp_alp2zern when its file is missing.
+ *  - Disturbance: the ZERNIKE_ERRORS_FILE time series times dist_scale
+ *    plus an optional sine on one zernike. Both run on the disturbance
+ *    clock: CLOCK_MONOTONIC since plant_reset times the speedup, so an
+ *    accelerated run sees the same disturbance per frame.
+ *  - SCI also sees the rms BMC offset from the current flat. Probes
+ *    and speckle pokes show up in the halo, flat updates do not.
+ *  - Frames of the ALP commander (SHK if there is none) feed the
+ *    residual statistics. Each DM command is timed against the last
+ *    plant frame of the process that sent it.
+ *  - Every process keeps its own copy of the influence matrices, the
+ *    shared state is plantcfg and plantstat.
+ */
+
+/**************************************************************/
+/* PLANT_NOW                                                  */
+/*  - Return monotonic time [s]                               */
+/**************************************************************/
+static double plant_now(void){
+  struct timespec now;
+  double t;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  ts2double(&now,&t);
+  return t;
+}
+
+/**************************************************************/
+/* PLANT_CPUTIME                                              */
+/*  - Return CPU time of a process [s], -1 on error           */
+/**************************************************************/
+static double plant_cputime(int pid){
+  char filename[MAX_FILENAME],line[1024],*p;
+  unsigned long utime,stime;
+  FILE *fd;
+
+  if(pid <= 0) return -1;
+  sprintf(filename,"/proc/%d/stat",pid);
+  if((fd = fopen(filename,"r")) == NULL) return -1;
+  p = fgets(line,sizeof(line),fd);
+  fclose(fd);
+  //Skip past the command name, fields 14 & 15 are utime & stime
+  if(p == NULL || (p = strrchr(line,')')) == NULL) return -1;
+  if(sscanf(p+2,"%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",&utime,&stime) != 2) return -1;
+  return (double)(utime + stime)/sysconf(_SC_CLK_TCK);
+}
+
+/**************************************************************/
+/* PLANT_RESET                                                */
+/*  - Restart the disturbance clock and zero the statistics   */
+/*  - The disturbance time series is the Zernike errors table */
+/*    loaded by alp_load_zernike_errors                       */
+/**************************************************************/
+void plant_reset(sm_t *sm_p){
+  volatile plantstat_t *stat = &sm_p->plantstat;
+  int i;
+
+  //Disturbance time series (shared with ALP_CALMODE_FLIGHT)
+  if(!sm_p->alpcal.zernike_errors_loaded)
+    printf("PLT: No disturbance time series, sine disturbance only\n");
+
+  //Statistics
+  memset((void *)stat,0,sizeof(plantstat_t));
+  for(i=0;i<NCLIENTS;i++){
+    stat->pid0[i] = sm_p->w[i].pid;
+    stat->cpu0[i] = plant_cputime(stat->pid0[i]);
+  }
+  stat->tstart = plant_now();
+  stat->treset = stat->tstart;
+  printf("PLT: Plant reset\n");
+}
+
+/**************************************************************/
+/* PLANT_SET_SPEEDUP                                          */
+/*  - Change the speedup, the disturbance clock carries on    */
+/*    from where it is                                        */
+/**************************************************************/
+void plant_set_speedup(sm_t *sm_p, double speedup){
+  double tnow = plant_now();
+  if(sm_p->plantstat.tstart > 0)
+    sm_p->plantstat.tstart = tnow - (tnow - sm_p->plantstat.tstart)*sm_p->plantcfg.speedup/speedup;
+  sm_p->plantcfg.speedup = speedup;
+}
+
+/**************************************************************/
+/* PLANT_ZERNIKE                                              */
+/*  - Current wavefront in zernikes [microns]                 */
+/*  - id: process rendering the frame                         */
+/**************************************************************/
+void plant_zernike(sm_t *sm_p, int id, double *zernike){
+  static double alp2zer[LOWFS_N_ZERNIKE*ALP_NACT];
+  static double hex2zer[LOWFS_N_HEX_ZERNIKE*HEX_NAXES];
+  static double alpref[ALP_NACT]=ALP_OFFSET;
+  static int    alpfile=0,init=0;
+  static alp_t  alp;
+  static hex_t  hex;
+  const double  hexref[HEX_NAXES]=HEX_POS_DEFAULT;
+  volatile plantstat_t *stat = &sm_p->plantstat;
+  plantcfg_t *cfg = (plantcfg_t *)&sm_p->plantcfg;
+  double dist[LOWFS_N_ZERNIKE]={0},dalp[ALP_NACT],zalp[LOWFS_N_ZERNIKE]={0};
+  double t,tnow,step;
+  alp_t  flat,cmd_alp;
+  hex_t  cmd_hex;
+  int    i,k,sampler;
+  long   index;
+
+  //Init
+  if(!init){
+    //Influence matrices
+    if(read_file(ALPACT2SHKZER_FILE,alp2zer,sizeof(alp2zer)) == 0)
+      alpfile = 1;
+    else
+      printf("PLT: Using alp2zern for the ALP influence\n");
+    if(read_file(HEXACT2SHKZER_FILE,hex2zer,sizeof(hex2zer))){
+      memset(hex2zer,0,sizeof(hex2zer));
+      printf("PLT: No HEX influence\n");
+    }
+    //ALP reference
+    if(read_file(ALP_FLAT_FILE,&flat,sizeof(flat)) == 0)
+      memcpy(alpref,flat.acmd,sizeof(alpref));
+    memcpy(alp.acmd,alpref,sizeof(alpref));
+    memcpy(hex.acmd,hexref,sizeof(hexref));
+    init=1;
+  }
+
+  //Current commands, keep the last ones if the lock is busy
+  //  - a DM that has never been commanded reads all zeros, leave it at the reference
+  if(alp_get_command(sm_p,&cmd_alp) == 0)
+    for(k=0;k<ALP_NACT;k++)
+      if(cmd_alp.acmd[k] != 0){
+	memcpy(&alp,&cmd_alp,sizeof(alp_t));
+	break;
+      }
+  if(hex_get_command(sm_p,&cmd_hex) == 0)
+    for(k=0;k<HEX_NAXES;k++)
+      if(cmd_hex.acmd[k] != 0){
+	memcpy(&hex,&cmd_hex,sizeof(hex_t));
+	break;
+      }
+
+  //Disturbance clock
+  tnow = plant_now();
+  if(stat->tstart == 0) stat->tstart = tnow;
+  t = (tnow - stat->tstart)*cfg->speedup;
+
+  //Disturbance time series
+  if(cfg->dist_scale != 0){
+    step  = fmod(t,ZERNIKE_ERRORS_LENGTH)/ZERNIKE_ERRORS_PERIOD;
+    index = (long)step;
+    step -= index;
+    if(index >= ZERNIKE_ERRORS_NUMBER-1){
+      index = ZERNIKE_ERRORS_NUMBER-2;
+      step  = 1;
+    }
+    for(i=0;i<LOWFS_N_ZERNIKE;i++)
+      dist[i] = cfg->dist_scale*((1-step)*sm_p->alpcal.zernike_errors[i][index] + step*sm_p->alpcal.zernike_errors[i][index+1]);
+  }
+
+  //Sine disturbance
+  if(cfg->sine_zernike >= 0 && cfg->sine_zernike < LOWFS_N_ZERNIKE)
+    dist[cfg->sine_zernike] += cfg->sine_amp*sin(2*M_PI*cfg->sine_freq*t);
+
+  //ALP
+  for(k=0;k<ALP_NACT;k++)
+    dalp[k] = alp.acmd[k] - alpref[k];
+  if(alpfile){
+    for(k=0;k<ALP_NACT;k++)
+      for(i=0;i<LOWFS_N_ZERNIKE;i++)
+	zalp[i] += alp2zer[k*LOWFS_N_ZERNIKE+i]*dalp[k];
+  }
+  else alp_alp2zern(dalp,zalp,FUNCTION_NO_RESET);
+
+  //Wavefront
+  for(i=0;i<LOWFS_N_ZERNIKE;i++)
+    zernike[i] = dist[i] + zalp[i];
+
+  //HEX
+  for(k=0;k<HEX_NAXES;k++)
+    for(i=0;i<LOWFS_N_HEX_ZERNIKE;i++)
+      zernike[i] += hex2zer[k*LOWFS_N_HEX_ZERNIKE+i]*(hex.acmd[k] - hexref[k]);
+
+  //Statistics
+  stat->tframe[id] = tnow;
+  sampler = sm_p->state_array[sm_p->state].alp_commander;
+  if(sampler != SHKID && sampler != LYTID && sampler != SCIID) sampler = SHKID;
+  if(id == sampler){
+    for(i=0;i<LOWFS_N_ZERNIKE;i++){
+      stat->dist_ss[i]  += dist[i]*dist[i];
+      stat->resid_ss[i] += zernike[i]*zernike[i];
+    }
+    stat->nsample++;
+  }
+}
+
+/**************************************************************/
+/* PLANT_FAKECFG                                              */
+/*  - Fake frame settings with the plant wavefront added      */
+/**************************************************************/
+void plant_fakecfg(sm_t *sm_p, int id, fakecfg_t *cfg){
+  double zernike[LOWFS_N_ZERNIKE];
+  int i;
+
+  memcpy(cfg,(fakecfg_t *)&sm_p->fakecfg,sizeof(fakecfg_t));
+  plant_zernike(sm_p,id,zernike);
+  for(i=0;i<LOWFS_N_ZERNIKE;i++)
+    cfg->zernike[i] += zernike[i];
+}
+
+/**************************************************************/
+/* PLANT_SCI_IMAGE                                            */
+/*  - Render SCI bands from the plant                         */
+/**************************************************************/
+void plant_sci_image(sm_t *sm_p, sci_bands_t *bands, double exptime){
+  static bmc_t bmc,flat;
+  fakecfg_t cfg;
+  double rms=0,d;
+  int i;
+
+  //Wavefront
+  plant_fakecfg(sm_p,SCIID,&cfg);
+
+  //BMC offset from the flat, keep the last ones if the lock is busy
+  //  - a BMC that has never been commanded sits at the flat
+  bmc_get_command(sm_p,&bmc);
+  bmc_get_flat(sm_p,&flat,0);
+  for(i=0;i<BMC_NACT;i++)
+    if(bmc.acmd[i] != 0) break;
+  if(i < BMC_NACT){
+    for(i=0;i<BMC_NACT;i++){
+      d = bmc.acmd[i] - flat.acmd[i];
+      rms += d*d;
+    }
+    rms = PLANT_BMC_SCALE*sqrt(rms/BMC_NACTIVE);
+  }
+
+  fake_sci_image(bands,cfg.zernike,rms,exptime,&cfg);
+}
+
+/**************************************************************/
+/* PLANT_COMMAND                                              */
+/*  - Time a DM command against the last plant frame of the   */
+/*    commanding process                                      */
+/*  - Only the first command after each frame is timed        */
+/**************************************************************/
+void plant_command(sm_t *sm_p, int dm, int proc_id){
+  volatile plantstat_t *stat = &sm_p->plantstat;
+  double latency;
+
+  if(dm < 0 || dm >= PLANT_NDM || proc_id < 0 || proc_id >= NCLIENTS) return;
+  if(stat->tframe[proc_id] == 0 || stat->tframe[proc_id] == stat->tcount[dm]) return;
+  latency = plant_now() - stat->tframe[proc_id];
+  stat->tcount[dm]       = stat->tframe[proc_id];
+  stat->latency[dm]      = latency;
+  stat->latency_sum[dm] += latency;
+  if(latency > stat->latency_max[dm]) stat->latency_max[dm] = latency;
+  stat->ncmd[dm]++;
+}
+
+/**************************************************************/
+/* PLANT_STATUS                                               */
+/*  - Print plant settings and statistics                     */
+/**************************************************************/
+void plant_status(sm_t *sm_p){
+  const char *dmname[PLANT_NDM] = {"ALP","BMC"};
+  volatile plantstat_t *stat = &sm_p->plantstat;
+  plantcfg_t *cfg = (plantcfg_t *)&sm_p->plantcfg;
+  double dist,resid,tclock,twall,cpu;
+  int i;
+
+  tclock = stat->tstart > 0 ? (plant_now() - stat->tstart)*cfg->speedup : 0;
+  twall  = stat->treset > 0 ? plant_now() - stat->treset : 0;
+  printf("PLT: Speedup %.2fx, disturbance scale %.2f, clock %.1f s\n",cfg->speedup,cfg->dist_scale,tclock);
+  if(cfg->sine_zernike >= 0)
+    printf("PLT: Sine on zernike %d: %.3f microns at %.2f Hz\n",cfg->sine_zernike,cfg->sine_amp,cfg->sine_freq);
+
+  //Disturbance rejection
+  if(stat->nsample){
+    printf("%-7s %10s %10s %9s\n","Zernike","Dist[nm]","Resid[nm]","Rej[dB]");
+    for(i=0;i<LOWFS_N_ZERNIKE;i++){
+      dist  = 1000*sqrt(stat->dist_ss[i]/stat->nsample);
+      resid = 1000*sqrt(stat->resid_ss[i]/stat->nsample);
+      if(dist > 0 && resid > 0)
+	printf("%-7d %10.2f %10.2f %9.1f\n",i,dist,resid,20*log10(resid/dist));
+      else
+	printf("%-7d %10.2f %10.2f %9s\n",i,dist,resid,"-");
+    }
+  }
+
+  //Command latency
+  printf("%-7s %10s %10s %10s %10s\n","DM","Commands","Last[ms]","Avg[ms]","Max[ms]");
+  for(i=0;i<PLANT_NDM;i++)
+    printf("%-7s %10lu %10.3f %10.3f %10.3f\n",dmname[i],(unsigned long)stat->ncmd[i],stat->latency[i]*1000,
+	   stat->ncmd[i] ? stat->latency_sum[i]/stat->ncmd[i]*1000 : 0,stat->latency_max[i]*1000);
+
+  //CPU usage since reset
+  if(twall > 0){
+    printf("%-7s %10s\n","Proc","CPU[%]");
+    for(i=0;i<NCLIENTS;i++){
+      if((cpu = plant_cputime(sm_p->w[i].pid)) < 0) continue;
+      if(sm_p->w[i].pid == stat->pid0[i] && stat->cpu0[i] > 0) cpu -= stat->cpu0[i];
+      printf("%-7s %10.1f\n",sm_p->w[i].name,100*cpu/twall);
+    }
+  }
+}
@@ -0,0 +1,14 @@
+#ifndef _PLANT_FUNCTIONS
+#define _PLANT_FUNCTIONS
+
+//Function prototypes
+void plant_reset(sm_t *sm_p);
+void plant_set_speedup(sm_t *sm_p, double speedup);
+void plant_zernike(sm_t *sm_p, int id, double *zernike);
+void plant_fakecfg(sm_t *sm_p, int id, fakecfg_t *cfg);
+void plant_sci_image(sm_t *sm_p, sci_bands_t *bands, double exptime);
+void plant_command(sm_t *sm_p, int dm, int proc_id);
+void plant_status(sm_t *sm_p);
+void plant_camera(sm_t *sm_p, int id);
+
+#endif
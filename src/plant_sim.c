@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <libbmc.h>
+#include <libfli.h>
+#include <phx_api.h>
+
+/* piccflight headers */
+#include "controller.h"
+#include "common_functions.h"
+#include "frm_functions.h"
+#include "sci_functions.h"
+#include "plant_functions.h"
+
+/* Closed-loop plant simulator
+ *
+ *  - Build with "make PLANTSIM=1" to run the full flight software
+ *    with no hardware. HEXSIM and THMSIM are switched on as well.
+ *  - The camera processes call plant_camera in place of the frame
+ *    grabber and FLI setup. Frames are rendered from the optical
+ *    plant (FAKEMODE_PLANT) at the commanded frame time divided by
+ *    the plant speedup and run through the flight process functions.
+ *  - The BMC controller is replaced by the libbmc calls used in
+ *    bmc_functions.c, the RTD board is stubbed out in rtd_functions.c
+ */
+#ifdef PLANT_SIM
+
+int  shk_process_image(stImageBuff *buffer,sm_t *sm_p);
+int  lyt_process_image(stImageBuff *buffer,sm_t *sm_p);
+
+/**************************************************************/
+/* PLANT_CAMERA                                               */
+/*  - Simulated camera loop for SHK, LYT and SCI              */
+/*  - Frames are paced to absolute deadlines, frames missed   */
+/*    while processing overran are dropped like the grabber   */
+/*    would and show up as sequence gaps                      */
+/*  - Returns when the camera is asked to reset               */
+/**************************************************************/
+void plant_camera(sm_t *sm_p, int id){
+  static uint8  shkframe[SHKXS*SHKYS];
+  static uint16 lytframe[LYTREADXS*LYTREADYS];
+  static uint16 *sciframe=NULL;
+  stImageBuff buffer;
+  struct timespec now,deadline;
+  volatile int *reset;
+  double tnow,tnext,frmtime,period,speedup;
+  uint32 n=0;
+  int retval;
+
+  //Select camera
+  memset(&buffer,0,sizeof(buffer));
+  switch(id){
+  case SHKID:
+    buffer.pvAddress = shkframe;
+    reset = &sm_p->shk_reset_camera;
+    break;
+  case LYTID:
+    buffer.pvAddress = lytframe;
+    reset = &sm_p->lyt_reset_camera;
+    break;
+  case SCIID:
+    if(sciframe == NULL){
+      if((sciframe = (uint16 *)calloc(SCI_ROI_XSIZE*SCI_ROI_YSIZE,sizeof(uint16))) == NULL){
+	printf("PLT: Failed to malloc SCI frame buffer\n");
+	return;
+      }
+    }
+    reset = &sm_p->sci_reset_camera;
+    break;
+  default:
+    printf("PLT: No simulated camera for %s\n",sm_p->w[id].name);
+    return;
+  }
+
+  //Start frame accounting
+  frm_restart(sm_p,id);
+  printf("PLT: %s camera started\n",sm_p->w[id].name);
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  ts2double(&now,&tnext);
+
+  while(1){
+    //Frame period, may be changed while running
+    if(id == SHKID)      frmtime = sm_p->shk_frmtime;
+    else if(id == LYTID) frmtime = sm_p->lyt_frmtime;
+    else                 frmtime = sm_p->sci_frmtime > sm_p->sci_exptime ? sm_p->sci_frmtime : sm_p->sci_exptime;
+    speedup = sm_p->plantcfg.speedup > 0 ? sm_p->plantcfg.speedup : 1;
+    period  = frmtime/speedup;
+
+    //Wait for the next frame time
+    tnext += period;
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    ts2double(&now,&tnow);
+    if(period > 0 && tnow > tnext + period){
+      //Processing overran: skip the frames that were missed
+      n    += (uint32)((tnow - tnext)/period);
+      tnext = tnow;
+    }
+    double2ts(&tnext,&deadline);
+    while(clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&deadline,NULL) == EINTR);
+
+    //Check in with the watchdog
+    checkin(sm_p,id);
+
+    //Check if we've been asked to exit
+    if(sm_p->w[id].die)
+      return;
+
+    //Check if we've been asked to reset the exposure
+    if(*reset){
+      *reset = 0;
+      return;
+    }
+
+    //Process frame
+    frm_arrive(sm_p,id,n++);
+    retval = 0;
+    if(id == SHKID) retval = shk_process_image(&buffer,sm_p);
+    if(id == LYTID) retval = lyt_process_image(&buffer,sm_p);
+    if(id == SCIID) sci_process_image(sciframe,sm_p->sci_exptime,0,sm_p);
+    if(retval){
+      frm_skip(sm_p,id,FRM_SKIP_ERROR);
+      printf("PLT: %s process_image error\n",sm_p->w[id].name);
+    }
+    frm_done(sm_p,id,period);
+  }
+}
+
+/**************************************************************/
+/* LIBBMC                                                     */
+/*  - Simulated BMC controller, commands always succeed       */
+/**************************************************************/
+libbmc_error_t libbmc_open_device(libbmc_device_t *dev){
+  memset(&dev->status,0,sizeof(dev->status));
+  dev->status.power = 1;
+  dev->status.supply_5va = 1;
+  dev->status.supply_5vd = 1;
+  return LIBBMC_SUCCESS;
+}
+
+libbmc_error_t libbmc_close_device(libbmc_device_t *dev){
+  dev->status.power = 0;
+  return LIBBMC_SUCCESS;
+}
+
+libbmc_error_t libbmc_toggle_leds_on(libbmc_device_t *dev){
+  dev->status.leds = 1;
+  return LIBBMC_SUCCESS;
+}
+
+libbmc_error_t libbmc_toggle_leds_off(libbmc_device_t *dev){
+  dev->status.leds = 0;
+  return LIBBMC_SUCCESS;
+}
+
+libbmc_error_t libbmc_hv_on(libbmc_device_t *dev, int range){
+  dev->status.supply_hv = 1;
+  dev->status.range = range;
+  return LIBBMC_SUCCESS;
+}
+
+libbmc_error_t libbmc_hv_off(libbmc_device_t *dev){
+  dev->status.supply_hv = 0;
+  return LIBBMC_SUCCESS;
+}
+
+libbmc_error_t libbmc_set_acts_tstpnts(libbmc_device_t *dev, float acts[LIBBMC_NACT], float tstpnts[LIBBMC_NTSTPNT]){
+  if(!dev->status.supply_hv) return LIBBMC_ERROR_CONTROLLER_DISABLED;
+  return LIBBMC_SUCCESS;
+}
+
+libbmc_error_t libbmc_get_status(libbmc_device_t *dev){
+  return LIBBMC_SUCCESS;
+}
+
+const char *libbmc_error_name(libbmc_error_t err){
+  return err == LIBBMC_SUCCESS ? "LIBBMC_SUCCESS" : "LIBBMC_ERROR_PLANTSIM";
+}
+
+const char *libbmc_strerror(libbmc_error_t err){
+  return err == LIBBMC_SUCCESS ? "Success" : "Simulated controller error";
+}
+
+#endif
@@ -18,6 +18,14 @@
 #include "rtd_functions.h"
 #include "alpao_map.h"
 
+/* Board simulation (make PLANTSIM=1)
+ *
+ *  - PLANT_SIM stubs out the DM7820 calls: the DMA buffers live in
+ *    ordinary memory and every FIFO write succeeds immediately.
+ *  - ALP commands still run through the full dither and checksum path
+ *    so the command timing includes the frame building.
+ */
+
 //DMA Buffers
 uint16_t *rtd_alp_dma_buffer=NULL;     // ALP DMA buffer pointer
 uint16_t *rtd_tlm_dma_buffer=NULL;     // TLM DMA buffer pointer
@@ -30,6 +38,11 @@ int       rtd_alp_dithers_per_frame=1; // Number of dither steps per frame
 /*  - Open the RTD board                                      */
 /**************************************************************/
 int rtd_open(unsigned long minor_number, DM7820_Board_Descriptor** p_p_rtd_board) {
+#ifdef PLANT_SIM
+  static DM7820_Board_Descriptor rtd_sim_board;
+  *p_p_rtd_board = &rtd_sim_board;
+  return 0;
+#endif
   if(DM7820_General_Open_Board(minor_number, p_p_rtd_board)){
     perror("RTD: DM7820_General_Open_Board");
     return 1;
@@ -42,6 +55,9 @@ int rtd_open(unsigned long minor_number, DM7820_Board_Descriptor** p_p_rtd_board
 /*  - Reset the RTD board                                     */
 /**************************************************************/
 int rtd_reset(DM7820_Board_Descriptor* p_rtd_board) {
+#ifdef PLANT_SIM
+  return 0;
+#endif
   if(DM7820_General_Reset(p_rtd_board)){
     perror("RTD: DM7820_General_Reset");
     return 1;
@@ -54,6 +70,9 @@ int rtd_reset(DM7820_Board_Descriptor* p_rtd_board) {
 /*  - Close the RTD board                                     */
 /**************************************************************/
 int rtd_close(DM7820_Board_Descriptor* p_rtd_board) {
+#ifdef PLANT_SIM
+  return 0;
+#endif
   if(DM7820_General_Close_Board(p_rtd_board)){
     perror("RTD: DM7820_General_Close_Board");
     return 1;
@@ -67,6 +86,12 @@ int rtd_close(DM7820_Board_Descriptor* p_rtd_board) {
 /**************************************************************/
 int rtd_alp_cleanup(DM7820_Board_Descriptor* p_rtd_board) {
   int retval=0;
+
+#ifdef PLANT_SIM
+  free(rtd_alp_dma_buffer);
+  rtd_alp_dma_buffer = NULL;
+  return 0;
+#endif
   
   //Disable DMA
   if(DM7820_FIFO_DMA_Enable(p_rtd_board, DM7820_FIFO_QUEUE_0, 0x00, 0x00)){
@@ -103,6 +128,12 @@ int rtd_alp_cleanup(DM7820_Board_Descriptor* p_rtd_board) {
 /**************************************************************/
 int rtd_tlm_cleanup(DM7820_Board_Descriptor* p_rtd_board) {
   int retval=0;
+
+#ifdef PLANT_SIM
+  free(rtd_tlm_dma_buffer);
+  rtd_tlm_dma_buffer = NULL;
+  return 0;
+#endif
   
   //Disable DMA
   if(DM7820_FIFO_DMA_Enable(p_rtd_board, DM7820_FIFO_QUEUE_1, 0x00, 0x00)){
@@ -316,6 +347,10 @@ static int rtd_alp_write_dma_fifo(DM7820_Board_Descriptor* p_rtd_board) {
   uint32_t count=0;
   
   //NOTE: This function DOES NOT block waiting for the next DMA transfer
+
+#ifdef PLANT_SIM
+  return 0;
+#endif
   
   //DMA should ALWAYS be done
   if(DM7820_General_Check_DMA_0_Transfer(p_rtd_board) == 0){
@@ -366,6 +401,10 @@ static int rtd_tlm_write_dma_fifo(DM7820_Board_Descriptor* p_rtd_board) {
   uint32_t count=0;
   
   //NOTE: This function BLOCKS wating for the next DMA transfer
+
+#ifdef PLANT_SIM
+  return 0;
+#endif
   
   //Sleep until current DMA transfer is done
   count=0;
@@ -568,6 +607,12 @@ int rtd_init_alp(DM7820_Board_Descriptor* p_rtd_board, int dithers_per_frame) {
   rtd_alp_dma_buffer_size = dma_buffer_size;
   rtd_alp_dithers_per_frame = dithers_per_frame;
 
+#ifdef PLANT_SIM
+  if((rtd_alp_dma_buffer = (uint16_t *)calloc(1,rtd_alp_dma_buffer_size)) == NULL)
+    return 1;
+  return 0;
+#endif
+
   /* ================================ Standard output initialization ================================ */
 
   /* Set Port 0 to peripheral output */
@@ -696,6 +741,13 @@ int rtd_init_tlm(DM7820_Board_Descriptor* p_rtd_board, uint32_t dma_size){
   //Set global DMA buffer size
   rtd_tlm_dma_buffer_size = dma_size;
 
+#ifdef PLANT_SIM
+  free(rtd_tlm_dma_buffer);
+  if((rtd_tlm_dma_buffer = (uint16_t *)calloc(1,rtd_tlm_dma_buffer_size)) == NULL)
+    return 1;
+  return 0;
+#endif
+
   
   /*============================== Strobe Initialization ================================*/
 
@@ -26,6 +26,9 @@
 #include "numeric.h"
 #include "sinefit.h"
 #include "sci_functions.h"
+#include "img_functions.h"
+#include "plant_functions.h"
+#include "calsnap.h"
 
 
 /**************************************************************/
@@ -348,13 +351,21 @@ double sci_get_tec_power(flidev_t dev){
 /**************************************************************/
 /* SCI_EXPOSE                                                 */
 /*  - Run image exposure                                      */
+/*  - Sleep until the predicted end of the exposure, waking   */
+/*    at least every SCI_EXP_MAXSLEEP to check in             */
 /**************************************************************/
 int sci_expose(sm_t *sm_p, flidev_t dev, uint16 *img_buffer){
   int row,sleepcount=0;
   uint32 err;
   long int timeleft=0;
-  int nmod;
+  long int sleeptime;
+  struct timespec start,end,delta;
+  double dt;
   
+  /* Wait for DM command to complete */
+  if(bmc_wait_command(sm_p,sm_p->bmc_seq_sent,BMC_ASYNC_TIMEOUT))
+    printf("SCI: BMC async command %u failed\n",sm_p->bmc_seq_sent);
+
   /* Start exposure */
   if((err = FLIExposeFrame(dev))){
     fprintf(stderr, "SCI: Error FLIExposeFrame: %s\n", strerror((int)-err));
@@ -376,13 +387,6 @@ int sci_expose(sm_t *sm_p, flidev_t dev, uint16 *img_buffer){
     /* Check in with the watchdog */
     checkin(sm_p,SCIID);
     
-    //Sleep
-    if(sm_p->sci_fastmode)
-      usleep(10000);
-    else
-      usleep(100000);
-    sleepcount++;
-    
     //Get exposure status
     if((err = FLIGetExposureStatus(dev,&timeleft))){
       fprintf(stderr, "SCI: Error FLIGetExposureStatus: %s\n", strerror((int)-err));
@@ -392,24 +396,32 @@ int sci_expose(sm_t *sm_p, flidev_t dev, uint16 *img_buffer){
       if(SCI_DEBUG) printf("SCI: Exposure done after %d checks\n",sleepcount+1);
       break;
     }
+
     //Print exposure countdown
-    nmod = 10;
-    if(sm_p->sci_fastmode)
-      nmod = 100;
-    
     if(sm_p->sci_exptime >= 5){
-      if(sleepcount % nmod == 1){
+      if(sleepcount % 10 == 1){
 	printf("\rSCI: %d seconds remaining",(int)lround((double)timeleft / 1000));
 	fflush(stdout);
       }
     }
+
+    //Sleep until predicted end of exposure (timeleft is in ms)
+    sleeptime = timeleft*1000 + SCI_EXP_MINSLEEP;
+    if(sleeptime > SCI_EXP_MAXSLEEP) sleeptime = SCI_EXP_MAXSLEEP;
+    usleep(sleeptime);
+    sleepcount++;
   }
   if(sm_p->sci_exptime >= 5)
     printf("\n");
   
-  /* Grab data one row at a time */
+  /* Get readout start time */
+  clock_gettime(CLOCK_REALTIME,&start);
+
+  /* Grab data one row at a time, stop on first error */
+  //NOTE: FLIGrabFrame is not implemented in libfli for this camera
   for(row=0;row<SCI_ROI_YSIZE;row++)
-    err = err | FLIGrabRow(dev, img_buffer+(row*SCI_ROI_XSIZE), SCI_ROI_XSIZE);
+    if((err = FLIGrabRow(dev, img_buffer+(row*SCI_ROI_XSIZE), SCI_ROI_XSIZE)))
+      break;
 
   /* Error checking */
   if(err){
@@ -418,6 +430,14 @@ int sci_expose(sm_t *sm_p, flidev_t dev, uint16 *img_buffer){
   }else{
     if(SCI_DEBUG) printf("SCI: FLI rows grabbed\n");
   }
+
+  /* Record readout time */
+  clock_gettime(CLOCK_REALTIME,&end);
+  if(timespec_subtract(&delta,&end,&start))
+    printf("SCI: sci_expose --> timespec_subtract error!\n");
+  ts2double(&delta,&dt);
+  sm_p->sci_readtime = dt;
+  
   return 0;
 }
 
@@ -616,6 +636,155 @@ void sci_howfs_efc(sm_t *sm_p, sci_field_t *field, double *delta_length, int res
   return;
 }
 
+/**************************************************************/
+/* SCI_READ_CUTOUT                                            */
+/*  - Read band cutouts from a full frame double image file   */
+/*  - Only the rows covering each band are read               */
+/*  - Return 0 on success and 1 on failure                    */
+/**************************************************************/
+int sci_read_cutout(char *filename, float cut[SCI_NBANDS][SCIXS][SCIYS], uint32 *xorigin, uint32 *yorigin){
+  FILE   *fd=NULL;
+  uint64 fsize;
+  double row[SCIXS];
+  int    xbl,ybl,b,i,j;
+  
+  //Open file
+  if((fd = fopen(filename,"r")) == NULL)
+    return 1;
+  
+  //Check file size
+  fseek(fd, 0L, SEEK_END);
+  fsize = ftell(fd);
+  if(fsize != sizeof(double)*SCI_ROI_XSIZE*SCI_ROI_YSIZE){
+    printf("SCI: sci_read_cutout --> incorrect file size %lu != %lu\n",fsize,sizeof(double)*SCI_ROI_XSIZE*SCI_ROI_YSIZE);
+    printf("SCI: %s\n",filename);
+    fclose(fd);
+    return 1;
+  }
+
+  //Read the rows of each band
+  for(b=0;b<SCI_NBANDS;b++){
+    //Set bottom left corner in full image
+    xbl = xorigin[b]-(SCIXS/2);
+    ybl = yorigin[b]-(SCIYS/2);
+    for(j=0;j<SCIYS;j++){
+      fseek(fd, sizeof(double)*sci_xy2index_full(0,j,xbl,ybl), SEEK_SET);
+      if(fread(row,sizeof(row),1,fd) != 1){
+	perror("SCI: sci_read_cutout --> fread");
+	printf("SCI: %s\n",filename);
+	fclose(fd);
+	return 1;
+      }
+      for(i=0;i<SCIXS;i++)
+	cut[b][i][j] = row[i];
+    }
+  }
+  
+  fclose(fd);
+  return 0;
+}
+
+/**************************************************************/
+/* SCI_CAL_UPDATE                                             */
+/*  - Crop SCI dark, bias and flat to the band cutouts        */
+/*  - Reloads when the temperature or band origins change     */
+/*  - Cutouts are taken from the calibration snapshot when it */
+/*    holds the same temperature and origins                 */
+/**************************************************************/
+void sci_cal_update(sci_cal_t *cal, int temp, uint32 *xorigin, uint32 *yorigin, sm_t *sm_p){
+  static scicalsnap_t snap;
+  char filename[MAX_FILENAME];
+  int newtemp;
+  int b,i,j;
+
+  //Check if cutouts are current
+  newtemp = !cal->init || (cal->temp != temp);
+  if(!newtemp &&
+     !memcmp(cal->xorigin,xorigin,sizeof(cal->xorigin)) &&
+     !memcmp(cal->yorigin,yorigin,sizeof(cal->yorigin)))
+    return;
+
+  //Use the calibration snapshot if it matches
+  if(!calsnap_get(sm_p,CALSNAP_SCICAL,&snap) && snap.cal.init && snap.cal.temp == temp &&
+     !memcmp(snap.cal.xorigin,xorigin,sizeof(snap.cal.xorigin)) &&
+     !memcmp(snap.cal.yorigin,yorigin,sizeof(snap.cal.yorigin))){
+    memcpy(cal,&snap.cal,sizeof(sci_cal_t));
+    if(newtemp) printf("SCI: Calibration data for %dC from snapshot\n",temp);
+    return;
+  }
+  if(newtemp) printf("SCI: Reading calibration data for %dC\n",temp);
+
+  //Source files, stamped before reading for the snapshot
+  memset(snap.source,0,sizeof(snap.source));
+  sprintf(snap.source[0].file,SCI_DARK_FILE,temp);
+  sprintf(snap.source[1].file,SCI_BIAS_FILE,temp);
+  sprintf(snap.source[2].file,SCI_FLAT_FILE);
+  for(i=0;i<3;i++)
+    calsnap_stamp(snap.source[i].file,&snap.source[i].stamp);
+  
+  //Dark
+  sprintf(filename,SCI_DARK_FILE,temp);
+  if(sci_read_cutout(filename,cal->dark,xorigin,yorigin)){
+    memset(cal->dark,0,sizeof(cal->dark));
+    if(newtemp) printf("SCI: Failed to read %s\n",filename);
+  }
+  else if(newtemp) printf("SCI: Read %s\n",filename);
+
+  //Bias
+  sprintf(filename,SCI_BIAS_FILE,temp);
+  if(sci_read_cutout(filename,cal->bias,xorigin,yorigin)){
+    memset(cal->bias,0,sizeof(cal->bias));
+    if(newtemp) printf("SCI: Failed to read %s\n",filename);
+  }
+  else if(newtemp) printf("SCI: Read %s\n",filename);
+
+  //Flat -- stored as inverse so calibration is a multiply
+  sprintf(filename,SCI_FLAT_FILE);
+  if(sci_read_cutout(filename,cal->gain,xorigin,yorigin)){
+    for(b=0;b<SCI_NBANDS;b++)
+      for(i=0;i<SCIXS;i++)
+	for(j=0;j<SCIYS;j++)
+	  cal->gain[b][i][j] = 1;
+  }
+  else{
+    for(b=0;b<SCI_NBANDS;b++)
+      for(i=0;i<SCIXS;i++)
+	for(j=0;j<SCIYS;j++)
+	  cal->gain[b][i][j] = (cal->gain[b][i][j] > 0) ? 1.0/cal->gain[b][i][j] : 0;
+    if(newtemp) printf("SCI: Read %s\n",filename);
+  }
+
+  //Save cutout settings
+  memcpy(cal->xorigin,xorigin,sizeof(cal->xorigin));
+  memcpy(cal->yorigin,yorigin,sizeof(cal->yorigin));
+  cal->temp = temp;
+  cal->init = 1;
+
+  //Publish to the calibration snapshot
+  memcpy(&snap.cal,cal,sizeof(sci_cal_t));
+  calsnap_put(sm_p,CALSNAP_SCICAL,&snap);
+}
+
+/**************************************************************/
+/* SCI_CAL_PIXEL                                              */
+/*  - Bias, dark and flat correct a single band pixel         */
+/**************************************************************/
+double sci_cal_pixel(sci_cal_t *cal, int b, int i, int j, double px, double exptime){
+  return (px - cal->bias[b][i][j] - cal->dark[b][i][j]*exptime) * cal->gain[b][i][j];
+}
+
+/**************************************************************/
+/* SCI_CAL_BAND                                               */
+/*  - Bias, dark and flat correct a full band in one pass     */
+/**************************************************************/
+void sci_cal_band(sci_cal_t *cal, int b, sci_t *band, double exptime, double out[SCIXS][SCIYS]){
+  int i,j;
+  
+  for(i=0;i<SCIXS;i++)
+    for(j=0;j<SCIYS;j++)
+      out[i][j] = (band->data[i][j] - cal->bias[b][i][j] - cal->dark[b][i][j]*exptime) * cal->gain[b][i][j];
+}
+
 /**************************************************************/
 /* SCI_SPECKLE_MEASURE                                        */
 /*  - Finds and measures the brightest speckle                */
@@ -624,8 +793,8 @@ double sci_speckle_measure(scievent_t *scievent, sci_cal_t *sci_cal, double *spe
   static int init=0,dhrot=0;
   static int xind[SCI_NPIX], yind[SCI_NPIX];
   uint8_t scimask[SCIXS][SCIYS];
-  int i,j,k,l,c,xbl,ybl;
-  double maxval,val,bkg;
+  int i,j,k,l,c;
+  double maxval,val;
   double x,y;
   char filename[MAX_FILENAME];
 
@@ -656,19 +825,13 @@ double sci_speckle_measure(scievent_t *scievent, sci_cal_t *sci_cal, double *spe
     init=1;
   }
 
-  //Set bottom left corner in full image
-  xbl = scievent->xorigin[0]-(SCIXS/2);
-  ybl = scievent->yorigin[0]-(SCIYS/2);
-  
   //First iteration: find brightest speckle
   if(scievent->ispeckle == 0){
     maxval=0;
     for(c=0;c<SCI_NPIX;c++){
       i    = xind[c];
       j    = yind[c];
-      val  = scievent->bands.band[0].data[i][j];
-      bkg  = sci_cal->bias[sci_xy2index_full(i,j,xbl,ybl)] + sci_cal->dark[sci_xy2index_full(i,j,xbl,ybl)]*scievent->hed.exptime;
-      val -= bkg;
+      val  = sci_cal_pixel(sci_cal,0,i,j,scievent->bands.band[0].data[i][j],scievent->hed.exptime);
       if((val > maxval) && (speckle_count[scievent->speckle_pixel] < 5)){
 	scievent->speckle_pixel = c;
 	maxval = val;
@@ -685,8 +848,7 @@ double sci_speckle_measure(scievent_t *scievent, sci_cal_t *sci_cal, double *spe
     for(l=-1;l<=1;l++){
       i = xind[c] + k;
       j = yind[c] + l;
-      bkg  = sci_cal->bias[sci_xy2index_full(i,j,xbl,ybl)] + sci_cal->dark[sci_xy2index_full(i,j,xbl,ybl)]*scievent->hed.exptime;
-      val += scievent->bands.band[0].data[i][j] - bkg;
+      val += sci_cal_pixel(sci_cal,0,i,j,scievent->bands.band[0].data[i][j],scievent->hed.exptime);
     }
   }
   val /= 9;
@@ -728,13 +890,13 @@ int sci_speckle_fit_sine(double *data, double *amp, double *phi, double *off){
   d.t = t;
   d.y = data;
 
-  //fill out guess
+  //fill out guess [amp,phi,offset] -- only used by the nonlinear fallback
   guess[0] = max - avg;
-  guess[1] = avg;
-  guess[2] = 0;
+  guess[1] = 0;
+  guess[2] = avg;
   //printf("SCI: guess: %f, %f, %f\n",guess[0],guess[1],guess[2]);
   
-  ret=sinefit(&d,&f,guess);
+  ret=sinefit_fast(&d,&f,guess);
   if(ret){
     printf("SCI: sinefit error\n");
     return 1;
@@ -765,15 +927,15 @@ int sci_speckle_fit_sine(double *data, double *amp, double *phi, double *off){
 /**************************************************************/
 /* SCI_PROCESS_IMAGE                                          */
 /*  - Process SCI camera image                                */
+/*  - img_readtime: readout time of this frame [s]            */
 /**************************************************************/
-void sci_process_image(uint16 *img_buffer, float img_exptime, sm_t *sm_p){
+void sci_process_image(uint16 *img_buffer, float img_exptime, float img_readtime, sm_t *sm_p){
   static scievent_t scievent={};
   static wfsevent_t wfsevent={};
   static struct timespec start,end,delta,last;
-  static int init = 0,sci_cal_init=0;
+  static int init = 0;
   static int howfs_init = 0,speckle_init=0;
   static sci_howfs_t howfs_frames;
-  static int ccd_temp_init=0;
   static sci_cal_t sci_cal;
   static double speckle_phase_brightness[SCI_SPECKLE_NPHASE];
   static double speckle_amp_brightness[SCI_SPECKLE_NAMP];
@@ -786,13 +948,10 @@ void sci_process_image(uint16 *img_buffer, float img_exptime, sm_t *sm_p){
   double px[3],py[3],pv[2];
   int    speckle_bmc_reset=0;
   const  double sci_sim_max[SCI_NBANDS] = SCI_SIM_MAX;
-  const  size_t sci_cal_size = sizeof(double) * SCI_ROI_YSIZE * SCI_ROI_XSIZE;
   double dt;
   double delta_length[BMC_NACT]={0};
   uint16 fakepx=0;
   uint32 i,j,k,b,iphase,iamp;
-  int xbl,ybl;
-  double dpx,bkg;
   static long unsigned int frame_number=0,wfs_frame_number=0,howfs_istart=0,howfs_ilast=0,iefc=0,speckle_istart=0,speckle_ilast=0;
   int print_origin=0;
   int state;
@@ -800,6 +959,7 @@ void sci_process_image(uint16 *img_buffer, float img_exptime, sm_t *sm_p){
   int bmc_calibrate_delta=0;
   static bmc_t bmc, bmc_flat;
   int bmc_set_flat=BMC_NOSET_FLAT;
+  uint32_t bmc_seq;
   bmc_t bmc_try;
   int rc;
   time_t t;
@@ -811,6 +971,7 @@ void sci_process_image(uint16 *img_buffer, float img_exptime, sm_t *sm_p){
   double shk_zernike_target[LOWFS_N_ZERNIKE];
   static double target[SCIXS][SCIYS];
   uint64_t (*sci_xy2index)(int x, int y, int lrx, int lry);
+  uint64_t bandstart,bandstride;
   
    //Get time immidiately
   clock_gettime(CLOCK_REALTIME,&start);
@@ -833,7 +994,7 @@ void sci_process_image(uint16 *img_buffer, float img_exptime, sm_t *sm_p){
   //Initialize 
   if(!init){
     memcpy(&last,&start,sizeof(struct timespec));
-    ccd_temp_init=1000;
+    sci_cal.init=0;
     //Reset BMC & SCI functions
     bmc_function_reset(sm_p);
     sci_function_reset(sm_p);
@@ -847,35 +1008,8 @@ void sci_process_image(uint16 *img_buffer, float img_exptime, sm_t *sm_p){
     printf("SCI: Initialized\n");
   }
 
-  //Initialize sci_cal
-  if(!sci_cal_init){
-    //Malloc SCI calibration
-    sci_cal.dark = (double *)malloc(sci_cal_size);
-    sci_cal.bias = (double *)malloc(sci_cal_size);
-    if((sci_cal.dark != NULL) && (sci_cal.bias != NULL))
-      sci_cal_init=1;
-    else
-      printf("SCI: sci_cal malloc failed!\n");
-  }
-  
-  //Read SCI calibration data for this temperature
+  //Get CCD temperature
   scievent.ccd_temp = sm_p->sci_ccd_temp;
-  if(sci_cal_init){
-    if(SCI_TEMP_INC * lround(scievent.ccd_temp/SCI_TEMP_INC) != ccd_temp_init){
-      ccd_temp_init = SCI_TEMP_INC * lround(scievent.ccd_temp/SCI_TEMP_INC);
-      printf("SCI: Reading calibration data for %dC\n",ccd_temp_init);
-      sprintf(filename,SCI_DARK_FILE,ccd_temp_init);
-      if(read_file(filename,sci_cal.dark,sci_cal_size))
-	memset(sci_cal.dark,0,sci_cal_size);
-      else
-	printf("SCI: Read %s\n",filename);
-      sprintf(filename,SCI_BIAS_FILE,ccd_temp_init);
-      if(read_file(filename,sci_cal.bias,sci_cal_size))
-	memset(sci_cal.bias,0,sci_cal_size);
-      else
-	printf("SCI: Read %s\n",filename);
-    }
-  }
 
   //Measure exposure time 
   if(timespec_subtract(&delta,&start,&last))
@@ -945,6 +1079,9 @@ void sci_process_image(uint16 *img_buffer, float img_exptime, sm_t *sm_p){
     printf("\n");
   }
 
+  //Crop SCI calibration data for this temperature and origin
+  sci_cal_update(&sci_cal,SCI_TEMP_INC * lround(scievent.ccd_temp/SCI_TEMP_INC),scievent.xorigin,scievent.yorigin,sm_p);
+
   //Fill out event header 
   scievent.hed.version       = PICC_PKT_VERSION;
   scievent.hed.type          = BUFFER_SCIEVENT;
@@ -952,6 +1089,9 @@ void sci_process_image(uint16 *img_buffer, float img_exptime, sm_t *sm_p){
   scievent.hed.exptime       = img_exptime;
   scievent.hed.frmtime       = dt;
   scievent.hed.ontime        = dt;
+  scievent.readtime          = img_readtime;
+  scievent.dutycycle         = (dt > 0) ? img_exptime / dt : 0;
+  sm_p->sci_dutycycle        = scievent.dutycycle;
   scievent.hed.state         = state;
   scievent.hed.alp_commander = sm_p->state_array[state].alp_commander;
   scievent.hed.hex_commander = sm_p->state_array[state].hex_commander;
@@ -1062,13 +1202,16 @@ void sci_process_image(uint16 *img_buffer, float img_exptime, sm_t *sm_p){
 	for(j=0;j<SCIYS;j++)
     	  scievent.bands.band[0].data[i][j] = target[i][j]*60000;
     }
+    if(sm_p->w[SCIID].fakemode == FAKEMODE_PLANT)
+      plant_sci_image(sm_p,&scievent.bands,scievent.hed.exptime);
   }
   else{
     //Real data: cut out bands 
-    for(b=0;b<SCI_NBANDS;b++)
-      for(i=0;i<SCIXS;i++)
-	for(j=0;j<SCIYS;j++)
-    	  scievent.bands.band[b].data[i][j] = img_buffer[sci_xy2index(i,j,scievent.xorigin[b]-(SCIXS/2),scievent.yorigin[b]-(SCIYS/2))];
+    for(b=0;b<SCI_NBANDS;b++){
+      bandstart  = sci_xy2index(0,0,scievent.xorigin[b]-(SCIXS/2),scievent.yorigin[b]-(SCIYS/2));
+      bandstride = sci_xy2index(0,1,scievent.xorigin[b]-(SCIXS/2),scievent.yorigin[b]-(SCIYS/2)) - bandstart;
+      img_transpose16(&scievent.bands.band[b].data[0][0],SCIYS,img_buffer+bandstart,bandstride,SCIXS,SCIYS);
+    }
   }
   
   //Command: sci_setref 
@@ -1076,18 +1219,12 @@ void sci_process_image(uint16 *img_buffer, float img_exptime, sm_t *sm_p){
     for(b=0;b<SCI_NBANDS;b++){
       //Find max pixel for this band
       scievent.refmax[b] = -1;
-      //Set bottom left corner in full image
-      xbl = scievent.xorigin[b]-(SCIXS/2);
-      ybl = scievent.yorigin[b]-(SCIYS/2);
-      for(i=0;i<SCIXS;i++){
-	for(j=0;j<SCIYS;j++){
-	  dpx = (double)scievent.bands.band[b].data[i][j];
-	  bkg = sci_cal.bias[sci_xy2index_full(i,j,xbl,ybl)] + sci_cal.dark[sci_xy2index_full(i,j,xbl,ybl)]*scievent.hed.exptime;
-	  dpx -= bkg;
-	  if(dpx > scievent.refmax[b])
-	    scievent.refmax[b] = dpx;
-	}
-      }
+      //Calibrate band
+      sci_cal_band(&sci_cal,b,&scievent.bands.band[b],scievent.hed.exptime,target);
+      for(i=0;i<SCIXS;i++)
+	for(j=0;j<SCIYS;j++)
+	  if(target[i][j] > scievent.refmax[b])
+	    scievent.refmax[b] = target[i][j];
       //Divide by exposure time
       scievent.refmax[b] /= scievent.hed.exptime; //ADU/second
       //Multiply by ref scale
@@ -1115,19 +1252,17 @@ void sci_process_image(uint16 *img_buffer, float img_exptime, sm_t *sm_p){
 
   //Record phase flatting images
   if(sm_p->sci_phasemode != SCI_PHASEMODE_NONE){
-    //Set bottom left corner in full image
-    xbl = scievent.xorigin[0]-(SCIXS/2);
-    ybl = scievent.yorigin[0]-(SCIYS/2);
-    for(i=0;i<SCIXS;i++){
-      for(j=0;j<SCIYS;j++){
-	dpx = (double)scievent.bands.band[0].data[i][j];
-	bkg = sci_cal.bias[sci_xy2index_full(i,j,xbl,ybl)] + sci_cal.dark[sci_xy2index_full(i,j,xbl,ybl)]*scievent.hed.exptime;
-	dpx -= bkg;
-	target[i][j]=dpx/scievent.hed.exptime;
-	//If we are faking the data, don't do background subtraction
-	if(sm_p->w[SCIID].fakemode == FAKEMODE_PHASE)
+    //If we are faking the data, don't do background subtraction
+    if(sm_p->w[SCIID].fakemode == FAKEMODE_PHASE){
+      for(i=0;i<SCIXS;i++)
+	for(j=0;j<SCIYS;j++)
 	  target[i][j]=(double)scievent.bands.band[0].data[i][j];
-      }
+    }
+    else{
+      sci_cal_band(&sci_cal,0,&scievent.bands.band[0],scievent.hed.exptime,target);
+      for(i=0;i<SCIXS;i++)
+	for(j=0;j<SCIYS;j++)
+	  target[i][j] /= scievent.hed.exptime;
     }
     if(scievent.iphase == 0) sprintf(filename,SCI_PHASE_IMAGE_B_FILE);
     if(scievent.iphase == 1) sprintf(filename,SCI_PHASE_IMAGE_C_FILE);
@@ -1348,8 +1483,15 @@ void sci_process_image(uint16 *img_buffer, float img_exptime, sm_t *sm_p){
       sm_p->bmc_calmode = bmc_calibrate(sm_p,scievent.hed.bmc_calmode,&bmc_try,&scievent.hed.bmc_calstep,bmc_calibrate_advance,bmc_calibrate_delta,SCIID,FUNCTION_NO_RESET);
 
     //Send command to BMC
-    if(bmc_send_command(sm_p,&bmc_try,SCIID,bmc_set_flat))
-      printf("SCI: BMC_SEND_COMMAND failed\n");
+    if(sm_p->bmc_async){
+      //Queue command, sci_expose waits for it to complete before the next exposure
+      if(bmc_send_command_async(sm_p,&bmc_try,SCIID,bmc_set_flat,&bmc_seq))
+	printf("SCI: BMC_SEND_COMMAND_ASYNC failed\n");
+    }
+    else{
+      if(bmc_send_command(sm_p,&bmc_try,SCIID,bmc_set_flat))
+	printf("SCI: BMC_SEND_COMMAND failed\n");
+    }
     
   }
   
@@ -1360,10 +1502,9 @@ void sci_process_image(uint16 *img_buffer, float img_exptime, sm_t *sm_p){
   //BMC Housekeeping
   if(sm_p->bmc_ready){
     //Get BMC Status
-    if(libbmc_get_status((libbmc_device_t *)&sm_p->libbmc_device))
+    //NOTE: In async mode this is the status read after the last completed command
+    if(bmc_get_status(sm_p,&scievent.bmc_status))
       printf("SCI: Failed to get BMC status\n");
-    else
-      memcpy((void *)&scievent.bmc_status,(void *)&sm_p->libbmc_device.status,sizeof(bmc_status_t));
   }
   
   //Write SCIEVENT to circular buffer 
@@ -8,10 +8,14 @@ void sci_saveorigin(sm_t *sm_p);
 void sci_revertorigin(sm_t *sm_p);
 double sci_get_temp(flidev_t dev);
 double sci_get_tec_power(flidev_t dev);
+int sci_read_cutout(char *filename, float cut[SCI_NBANDS][SCIXS][SCIYS], uint32 *xorigin, uint32 *yorigin);
+void sci_cal_update(sci_cal_t *cal, int temp, uint32 *xorigin, uint32 *yorigin, sm_t *sm_p);
+double sci_cal_pixel(sci_cal_t *cal, int b, int i, int j, double px, double exptime);
+void sci_cal_band(sci_cal_t *cal, int b, sci_t *band, double exptime, double out[SCIXS][SCIYS]);
 int sci_expose(sm_t *sm_p, flidev_t dev, uint16 *img_buffer);
 void sci_howfs_construct_field(sm_t *sm_p,sci_howfs_t *frames,scievent_t *scievent,sci_field_t *field,int reset);
 void sci_howfs_efc(sm_t *sm_p,sci_field_t *field, double *delta_length,int reset);
-void sci_process_image(uint16 *img_buffer, float img_exptime, sm_t *sm_p);
+void sci_process_image(uint16 *img_buffer, float img_exptime, float img_readtime, sm_t *sm_p);
 
 
 
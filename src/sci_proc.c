@@ -14,13 +14,16 @@
 #include <libgen.h>
 #include <sys/stat.h>
 #include <gsl_multimin.h>
+#include <pthread.h>
 
 /* piccflight headers */
 #include "controller.h"
 #include "common_functions.h"
+#include "log_functions.h"
 #include "sci_functions.h"
 #include "alp_functions.h"
 #include "fakemodes.h"
+#include "plant_functions.h"
 
 /* Process File Descriptor */
 int sci_shmfd;
@@ -28,6 +31,20 @@ int sci_shmfd;
 /* FLI File Descriptor */
 flidev_t dev;
 
+/* Frame ring for pipelined processing */
+typedef struct sci_ring_struct{
+  uint16_t *img[SCI_NFRAMEBUF]; //frame buffers
+  float    exptime[SCI_NFRAMEBUF];
+  float    readtime[SCI_NFRAMEBUF];
+  uint32_t head;                //frames exposed
+  uint32_t tail;                //frames processed
+  int      running;             //worker thread started
+  pthread_t       thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t  cond;
+} sci_ring_t;
+sci_ring_t sci_ring = {.mutex = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER};
+
 typedef struct opt_param{
   sm_t *sm_p;
   uint16_t *img_buffer;
@@ -44,6 +61,7 @@ typedef struct opt_param{
 void scictrlC(int sig){
   uint32 err = 0;
 
+#ifndef PLANT_SIM
   /* Cancel Exposure */
   if((err = FLICancelExposure(dev))){
     fprintf(stderr, "SCI: Error FLICancelExposure: %s\n", strerror((int)-err));
@@ -68,6 +86,7 @@ void scictrlC(int sig){
   }else{
     if(SCI_DEBUG) printf("SCI: FLI closed\n");
   }
+#endif
   
   /* Close shared memory */
   close(sci_shmfd);
@@ -240,7 +259,7 @@ double sci_phase_f(const gsl_vector *v, void *params){
     }
     else{
       /* Process Image */
-      sci_process_image(img_buffer,exptime,sm_p);
+      sci_process_image(img_buffer,exptime,sm_p->sci_readtime,sm_p);
     }
   }
   
@@ -362,6 +381,75 @@ void sci_phase_fdf (const gsl_vector *v, void *params, double *f, gsl_vector *df
   sci_phase_df(v, params, df);
 }
 
+/**************************************************************/
+/* SCI_WORKER                                                 */
+/*  - Process exposed frames from the ring                    */
+/**************************************************************/
+void *sci_worker(void *arg){
+  sm_t *sm_p = (sm_t *)arg;
+  int i;
+
+  while(1){
+    //Wait for a frame
+    pthread_mutex_lock(&sci_ring.mutex);
+    while(sci_ring.head == sci_ring.tail)
+      pthread_cond_wait(&sci_ring.cond,&sci_ring.mutex);
+    i = sci_ring.tail % SCI_NFRAMEBUF;
+    pthread_mutex_unlock(&sci_ring.mutex);
+
+    //Process image
+    sci_process_image(sci_ring.img[i],sci_ring.exptime[i],sci_ring.readtime[i],sm_p);
+
+    //Release buffer
+    pthread_mutex_lock(&sci_ring.mutex);
+    sci_ring.tail++;
+    pthread_cond_broadcast(&sci_ring.cond);
+    pthread_mutex_unlock(&sci_ring.mutex);
+  }
+  return NULL;
+}
+
+/**************************************************************/
+/* SCI_RING_DRAIN                                             */
+/*  - Wait for the worker to process all queued frames        */
+/**************************************************************/
+void sci_ring_drain(void){
+  pthread_mutex_lock(&sci_ring.mutex);
+  while(sci_ring.head != sci_ring.tail)
+    pthread_cond_wait(&sci_ring.cond,&sci_ring.mutex);
+  pthread_mutex_unlock(&sci_ring.mutex);
+}
+
+/**************************************************************/
+/* SCI_RING_START                                             */
+/*  - Allocate frame buffers and start the worker thread      */
+/*  - Return 0 on success and 1 on failure                    */
+/**************************************************************/
+int sci_ring_start(sm_t *sm_p){
+  int i;
+
+  if(sci_ring.running)
+    return 0;
+
+  //Malloc frame buffers
+  for(i=0;i<SCI_NFRAMEBUF;i++){
+    if(sci_ring.img[i] == NULL)
+      if((sci_ring.img[i] = (uint16_t *)malloc(SCI_ROI_XSIZE*SCI_ROI_YSIZE*sizeof(uint16_t))) == NULL){
+	printf("SCI: Failed to malloc frame buffer %d\n",i);
+	return 1;
+      }
+  }
+
+  //Start worker thread
+  if(pthread_create(&sci_ring.thread,NULL,sci_worker,(void *)sm_p)){
+    printf("SCI: Failed to start worker thread\n");
+    return 1;
+  }
+  sci_ring.running = 1;
+  printf("SCI: Started worker thread\n");
+  return 0;
+}
+
 /**************************************************************/
 /* SCI_PROC                                                   */
 /*  - Main SCI camera process                                 */
@@ -411,9 +499,22 @@ void sci_proc(void){
     scictrlC(0);
   }
 
+  /* Attach to event log ring */
+  log_attach(sm_p,SCIID);
+
   /* Set soft interrupt handler */
   sigset(SIGINT, scictrlC);	/* usually ^C */
 
+#ifdef PLANT_SIM
+  /* Simulated camera: frames come from the optical plant, no phase or pipeline modes */
+  while(1){
+    checkin(sm_p,SCIID);
+    plant_camera(sm_p,SCIID);
+    if(sm_p->w[SCIID].die)
+      scictrlC(0);
+  }
+#endif
+
 
   /**************************************************************/
   /*                      FLI Camera Setup                      */
@@ -592,6 +693,9 @@ void sci_proc(void){
       /* Perform Phase Flattening */
       phasemode = sm_p->sci_phasemode;
       if(phasemode != SCI_PHASEMODE_NONE){
+	//Wait for any pipelined frames to finish
+	sci_ring_drain();
+
 	//Initialize Optimizer
 	if(opt_iter == 0){
 
@@ -773,18 +877,55 @@ void sci_proc(void){
 	/* Reset Optimizer */
 	opt_iter=0;
 	
-	/* Run Normal Exposure */
-	if((rc=sci_expose(sm_p,dev,img_buffer))){
-	  if(rc==SCI_EXP_RETURN_FAIL)
-	    printf("SCI: Exposure failed\n");
-	  if(rc==SCI_EXP_RETURN_KILL)
-	    scictrlC(0);
-	  if(rc==SCI_EXP_RETURN_ABORT)
-	    printf("SCI: Exposure aborted\n");
+	/* Pipelined Exposure: process frame N on the worker thread while exposing frame N+1 */
+	//NOTE: Only when SCI is not commanding a DM, since the next exposure must see the new command
+	if(sm_p->sci_pipeline &&
+	   (sm_p->state_array[sm_p->state].bmc_commander != SCIID) &&
+	   (sm_p->state_array[sm_p->state].alp_commander != SCIID) &&
+	   !sci_ring_start(sm_p)){
+	  //Wait for a free buffer
+	  pthread_mutex_lock(&sci_ring.mutex);
+	  while((sci_ring.head - sci_ring.tail) >= SCI_NFRAMEBUF)
+	    pthread_cond_wait(&sci_ring.cond,&sci_ring.mutex);
+	  i = sci_ring.head % SCI_NFRAMEBUF;
+	  pthread_mutex_unlock(&sci_ring.mutex);
+
+	  //Run exposure
+	  if((rc=sci_expose(sm_p,dev,sci_ring.img[i]))){
+	    if(rc==SCI_EXP_RETURN_FAIL)
+	      printf("SCI: Exposure failed\n");
+	    if(rc==SCI_EXP_RETURN_KILL)
+	      scictrlC(0);
+	    if(rc==SCI_EXP_RETURN_ABORT)
+	      printf("SCI: Exposure aborted\n");
+	  }
+	  else{
+	    //Queue frame for processing
+	    pthread_mutex_lock(&sci_ring.mutex);
+	    sci_ring.exptime[i]  = exptime;
+	    sci_ring.readtime[i] = sm_p->sci_readtime; //set by sci_expose on this thread
+	    sci_ring.head++;
+	    pthread_cond_broadcast(&sci_ring.cond);
+	    pthread_mutex_unlock(&sci_ring.mutex);
+	  }
 	}
 	else{
-	  /* Process Image */
-	  sci_process_image(img_buffer,exptime,sm_p);
+	  /* Wait for any pipelined frames to finish */
+	  sci_ring_drain();
+
+	  /* Run Normal Exposure */
+	  if((rc=sci_expose(sm_p,dev,img_buffer))){
+	    if(rc==SCI_EXP_RETURN_FAIL)
+	      printf("SCI: Exposure failed\n");
+	    if(rc==SCI_EXP_RETURN_KILL)
+	      scictrlC(0);
+	    if(rc==SCI_EXP_RETURN_ABORT)
+	      printf("SCI: Exposure aborted\n");
+	  }
+	  else{
+	    /* Process Image */
+	    sci_process_image(img_buffer,exptime,sm_p->sci_readtime,sm_p);
+	  }
 	}
       }
     }
@@ -0,0 +1,652 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+/* piccflight headers */
+#include "controller.h"
+#include "common_functions.h"
+#include "handle_command.h"
+#include "scr_functions.h"
+
+/* Prototypes */
+int handle_command(char *line, sm_t *sm_p);
+
+/* Command script engine
+ *
+ *  - A script is a text file in SCR_PATH or a buffer built with
+ *    "script add" over the uplink. Statements are separated by new
+ *    lines or ';'. Lines starting with '#' are comments.
+ *  - Statements:
+ *      <command>                           run through handle_command
+ *      wait <sec>                          timed wait
+ *      waitfor <var> <op> <value> [tmo]    wait on a condition
+ *      waitframes <buffer> <n> [tmo]       wait for n new frames
+ *      loop <n> ... end                    repeat a block n times
+ *  - The watchdog foreground loop calls scr_run when scr_timeout
+ *    expires, so commands from the console and uplink still work
+ *    while a script runs.
+ *  - Waits are scheduled from the previous statement's scheduled
+ *    time, so loop timing does not drift with command execution time.
+ *    A command that blocks (e.g. "shk calibrate alp") moves the
+ *    schedule to its completion time.
+ */
+
+//Statement types
+enum scrops {SCR_OP_CMD, SCR_OP_WAIT, SCR_OP_WAITFOR, SCR_OP_WAITFRAMES, SCR_OP_LOOP, SCR_OP_END};
+
+//Condition variables
+enum scrvars {SCR_VAR_ALP_CALMODE, SCR_VAR_HEX_CALMODE, SCR_VAR_BMC_CALMODE, SCR_VAR_TGT_CALMODE,
+	      SCR_VAR_STATE, SCR_VAR_HEX_MOVING, SCR_VAR_DIA_RUNNING, SCR_NVARS};
+static const char *scrvarname[SCR_NVARS] = {"alp_calmode","hex_calmode","bmc_calmode","tgt_calmode",
+					    "state","hex_moving","dia_running"};
+
+//Comparisons
+enum scrcmps {SCR_CMP_EQ, SCR_CMP_NE, SCR_CMP_LE, SCR_CMP_GE, SCR_CMP_LT, SCR_CMP_GT, SCR_NCMPS};
+static const char *scrcmpname[SCR_NCMPS] = {"==","!=","<=",">=","<",">"};
+
+//Script statement
+typedef struct scrstep_struct{
+  int    op;                  //statement type
+  int    line;                //source line
+  char   cmd[CMD_MAX_LENGTH]; //command text or buffer name
+  double value;               //wait time, compare value, frame count or loop count
+  double timeout;             //condition timeout [s]
+  int    var;                 //condition variable or circular buffer
+  int    cmp;                 //condition comparison
+  int    jump;                //matching loop or end statement
+  int    remain;              //loop iterations remaining
+} scrstep_t;
+
+//Loaded program
+static scrstep_t scrprog[SCR_MAX_STEPS];
+static int       scrnstep=0;
+static char      scrname[MAX_FILENAME];
+
+//Upload buffer
+static char      scrupload[SCR_MAX_SIZE];
+
+//Execution state
+static int       scrrunning=0;  //script running
+static int       scrpc=0;       //next statement
+static int       scrwaiting=0;  //in a waitfor or waitframes
+static double    scrnext=0;     //time of next statement [s]
+static double    scrwait0=0;    //condition wait start [s]
+static double    scrstart=0;    //script start [s]
+static uint32    scrframe0=0;   //frame number at waitframes start
+static uint32    scrncmd=0;     //commands executed
+
+/**************************************************************/
+/* SCR_NOW                                                    */
+/*  - Return monotonic time [s]                               */
+/**************************************************************/
+static double scr_now(void){
+  struct timespec now;
+  double t;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  ts2double(&now,&t);
+  return t;
+}
+
+/**************************************************************/
+/* SCR_NUMBER                                                 */
+/*  - Parse a number, return 1 on error                       */
+/**************************************************************/
+static int scr_number(char *word, double *value){
+  char *end;
+  if(word == NULL) return 1;
+  *value = strtod(word,&end);
+  return (end == word || *end);
+}
+
+/**************************************************************/
+/* SCR_VALUE                                                  */
+/*  - Parse a condition value: number, "none" or state cmd    */
+/*  - Return 1 on error                                       */
+/**************************************************************/
+static int scr_value(sm_t *sm_p, char *word, double *value){
+  int i;
+  if(word == NULL) return 1;
+  if(!scr_number(word,value)) return 0;
+  if(!strcasecmp(word,"none")){
+    *value = 0;
+    return 0;
+  }
+  for(i=0;i<NSTATES;i++)
+    if(!strcasecmp(word,(char *)sm_p->state_array[i].cmd)){
+      *value = i;
+      return 0;
+    }
+  return 1;
+}
+
+/**************************************************************/
+/* SCR_FRAME                                                  */
+/*  - Return frame number of the newest circbuf entry         */
+/**************************************************************/
+static uint32 scr_frame(sm_t *sm_p, int buf){
+  volatile circbuf_t *cb = &sm_p->circbuf[buf];
+  uint32 index = (cb->write_offset + cb->bufsize - 1) % cb->bufsize;
+  return ((pkthed_t *)((char *)cb->buffer + index*cb->nbytes))->frame_number;
+}
+
+/**************************************************************/
+/* SCR_VAR                                                    */
+/*  - Return current value of a condition variable            */
+/**************************************************************/
+static double scr_var(sm_t *sm_p, int var){
+  switch(var){
+  case SCR_VAR_ALP_CALMODE: return sm_p->alp_calmode;
+  case SCR_VAR_HEX_CALMODE: return sm_p->hex_calmode;
+  case SCR_VAR_BMC_CALMODE: return sm_p->bmc_calmode;
+  case SCR_VAR_TGT_CALMODE: return sm_p->tgt_calmode;
+  case SCR_VAR_STATE:       return sm_p->state;
+  case SCR_VAR_HEX_MOVING:  return sm_p->hex_moving;
+  case SCR_VAR_DIA_RUNNING: return sm_p->w[DIAID].pid != -1;
+  }
+  return 0;
+}
+
+/**************************************************************/
+/* SCR_TEST                                                   */
+/*  - Evaluate a waitfor condition                            */
+/**************************************************************/
+static int scr_test(sm_t *sm_p, scrstep_t *step){
+  double v = scr_var(sm_p,step->var);
+  switch(step->cmp){
+  case SCR_CMP_EQ: return v == step->value;
+  case SCR_CMP_NE: return v != step->value;
+  case SCR_CMP_LE: return v <= step->value;
+  case SCR_CMP_GE: return v >= step->value;
+  case SCR_CMP_LT: return v <  step->value;
+  case SCR_CMP_GT: return v >  step->value;
+  }
+  return 0;
+}
+
+/**************************************************************/
+/* SCR_STATEMENT                                              */
+/*  - Parse one statement into step                           */
+/*  - Return 1 on error                                       */
+/**************************************************************/
+static int scr_statement(sm_t *sm_p, char *text, scrstep_t *step){
+  char buf[CMD_MAX_LENGTH];
+  char *word[6],*save=NULL;
+  int i,n;
+
+  //Split words
+  strncpy(buf,text,sizeof(buf)-1);
+  buf[sizeof(buf)-1] = 0;
+  for(n=0;n<6;n++)
+    word[n] = strtok_r(n ? NULL : buf," \t",&save);
+  for(n=0;n<6 && word[n];n++);
+  step->timeout = SCR_WAIT_TIMEOUT;
+
+  //wait <sec>
+  if(!strcasecmp(word[0],"wait")){
+    step->op = SCR_OP_WAIT;
+    if(n != 2 || scr_number(word[1],&step->value) || step->value < 0 || step->value > SCR_WAIT_MAX){
+      printf("SCR: usage: wait <sec> [0,%d]\n",SCR_WAIT_MAX);
+      return 1;
+    }
+    return 0;
+  }
+
+  //waitfor <var> <op> <value> [timeout]
+  if(!strcasecmp(word[0],"waitfor")){
+    step->op = SCR_OP_WAITFOR;
+    if(n < 4 || n > 5){
+      printf("SCR: usage: waitfor <var> <op> <value> [timeout]\n");
+      return 1;
+    }
+    for(step->var=0;step->var<SCR_NVARS;step->var++)
+      if(!strcasecmp(word[1],scrvarname[step->var])) break;
+    if(step->var == SCR_NVARS){
+      printf("SCR: unknown variable %s. Options:",word[1]);
+      for(i=0;i<SCR_NVARS;i++) printf(" %s",scrvarname[i]);
+      printf("\n");
+      return 1;
+    }
+    for(step->cmp=0;step->cmp<SCR_NCMPS;step->cmp++)
+      if(!strcmp(word[2],scrcmpname[step->cmp])) break;
+    if(step->cmp == SCR_NCMPS){
+      printf("SCR: unknown comparison %s\n",word[2]);
+      return 1;
+    }
+    if(scr_value(sm_p,word[3],&step->value)){
+      printf("SCR: bad value %s\n",word[3]);
+      return 1;
+    }
+    if(n == 5 && (scr_number(word[4],&step->timeout) || step->timeout <= 0 || step->timeout > SCR_WAIT_MAX)){
+      printf("SCR: timeout must be in (0,%d] seconds\n",SCR_WAIT_MAX);
+      return 1;
+    }
+    return 0;
+  }
+
+  //waitframes <buffer> <n> [timeout]
+  if(!strcasecmp(word[0],"waitframes")){
+    step->op = SCR_OP_WAITFRAMES;
+    if(n < 3 || n > 4){
+      printf("SCR: usage: waitframes <buffer> <n> [timeout]\n");
+      return 1;
+    }
+    for(step->var=0;step->var<NCIRCBUF;step->var++)
+      if(!strcasecmp(word[1],(char *)sm_p->circbuf[step->var].name)) break;
+    if(step->var == NCIRCBUF){
+      printf("SCR: unknown buffer %s\n",word[1]);
+      return 1;
+    }
+    strcpy(step->cmd,word[1]);
+    if(scr_number(word[2],&step->value) || step->value < 1){
+      printf("SCR: frame count must be >= 1\n");
+      return 1;
+    }
+    if(n == 4 && (scr_number(word[3],&step->timeout) || step->timeout <= 0 || step->timeout > SCR_WAIT_MAX)){
+      printf("SCR: timeout must be in (0,%d] seconds\n",SCR_WAIT_MAX);
+      return 1;
+    }
+    return 0;
+  }
+
+  //loop <n>
+  if(!strcasecmp(word[0],"loop")){
+    step->op = SCR_OP_LOOP;
+    if(n != 2 || scr_number(word[1],&step->value) || step->value < 0 || step->value != (int)step->value){
+      printf("SCR: usage: loop <n>\n");
+      return 1;
+    }
+    return 0;
+  }
+
+  //end
+  if(!strcasecmp(word[0],"end")){
+    step->op = SCR_OP_END;
+    return 0;
+  }
+
+  //Commands that would exit the watchdog or recurse
+  if(!strcasecmp(word[0],"exit") || !strcasecmp(word[0],"shutdown") ||
+     !strcasecmp(word[0],"reboot") || !strcasecmp(word[0],"script")){
+    printf("SCR: %s not allowed in scripts\n",word[0]);
+    return 1;
+  }
+
+  //Command
+  step->op = SCR_OP_CMD;
+  strcpy(step->cmd,text);
+  return 0;
+}
+
+/**************************************************************/
+/* SCR_PARSE                                                  */
+/*  - Compile script text into the program                    */
+/*  - Return 1 on error                                       */
+/**************************************************************/
+static int scr_parse(sm_t *sm_p, char *text, char *name){
+  int stack[SCR_MAX_DEPTH];
+  int depth=0,line=0;
+  char *pline,*pstmt,*end,*lsave=NULL,*ssave=NULL;
+
+  scrnstep = 0;
+  for(pline=text;pline && *pline;pline=end){
+    //Next line
+    line++;
+    if((end = strchr(pline,'\n')) != NULL) *end++ = 0;
+    if(strchr(pline,'#')) *strchr(pline,'#') = 0;
+    //Statements on this line
+    for(pstmt=strtok_r(pline,";",&ssave);pstmt;pstmt=strtok_r(NULL,";",&ssave)){
+      //Trim
+      while(isspace(*pstmt)) pstmt++;
+      while(*pstmt && isspace(pstmt[strlen(pstmt)-1])) pstmt[strlen(pstmt)-1] = 0;
+      if(*pstmt == 0) continue;
+      if(strlen(pstmt) >= CMD_MAX_LENGTH){
+	printf("SCR: %s:%d: statement too long\n",name,line);
+	goto error;
+      }
+      if(scrnstep == SCR_MAX_STEPS){
+	printf("SCR: %s:%d: more than %d statements\n",name,line,SCR_MAX_STEPS);
+	goto error;
+      }
+      memset(&scrprog[scrnstep],0,sizeof(scrstep_t));
+      scrprog[scrnstep].line = line;
+      if(scr_statement(sm_p,pstmt,&scrprog[scrnstep])){
+	printf("SCR: %s:%d: %s\n",name,line,pstmt);
+	goto error;
+      }
+      //Match loops
+      if(scrprog[scrnstep].op == SCR_OP_LOOP){
+	if(depth == SCR_MAX_DEPTH){
+	  printf("SCR: %s:%d: loops nested deeper than %d\n",name,line,SCR_MAX_DEPTH);
+	  goto error;
+	}
+	stack[depth++] = scrnstep;
+      }
+      if(scrprog[scrnstep].op == SCR_OP_END){
+	if(depth == 0){
+	  printf("SCR: %s:%d: end without loop\n",name,line);
+	  goto error;
+	}
+	depth--;
+	scrprog[scrnstep].jump = stack[depth];
+	scrprog[stack[depth]].jump = scrnstep;
+      }
+      scrnstep++;
+    }
+  }
+  if(depth){
+    printf("SCR: %s:%d: loop without end\n",name,scrprog[stack[depth-1]].line);
+    goto error;
+  }
+  if(scrnstep == 0){
+    printf("SCR: %s: no statements\n",name);
+    goto error;
+  }
+  strncpy(scrname,name,sizeof(scrname)-1);
+  scrname[sizeof(scrname)-1] = 0;
+  return 0;
+
+ error:
+  scrnstep = 0;
+  scrname[0] = 0;
+  return 1;
+}
+
+/**************************************************************/
+/* SCR_PATHNAME                                               */
+/*  - Build script path under SCR_PATH from name              */
+/*  - Names may not leave the script directory                */
+/*  - Return 1 on error, 0 on success                         */
+/**************************************************************/
+static int scr_pathname(char *name, char *path){
+  if(name[0] == 0 || strchr(name,'/') || strstr(name,"..")){
+    printf("SCR: Bad script name: %s\n",name);
+    return 1;
+  }
+  snprintf(path,MAX_FILENAME,"%s%s",SCR_PATH,name);
+  return 0;
+}
+
+/**************************************************************/
+/* SCR_LOAD                                                   */
+/*  - Load a script file, "upload" loads the upload buffer    */
+/*  - Return 1 on error, 0 on success                         */
+/**************************************************************/
+int scr_load(sm_t *sm_p, char *name){
+  static char text[SCR_MAX_SIZE];
+  char path[MAX_FILENAME];
+  FILE *fd;
+  size_t n;
+
+  if(scrrunning){
+    printf("SCR: %s is running, stop it first\n",scrname);
+    return 1;
+  }
+
+  //Upload buffer
+  if(!strcasecmp(name,"upload")){
+    strcpy(text,scrupload);
+  }
+  else{
+    //Script file
+    if(scr_pathname(name,path))
+      return 1;
+    if((fd = fopen(path,"r")) == NULL){
+      perror("SCR: fopen");
+      printf("SCR: %s\n",path);
+      return 1;
+    }
+    n = fread(text,1,sizeof(text),fd);
+    fclose(fd);
+    if(n == sizeof(text)){
+      printf("SCR: %s larger than %d bytes\n",path,SCR_MAX_SIZE-1);
+      return 1;
+    }
+    text[n] = 0;
+  }
+
+  //Compile
+  if(scr_parse(sm_p,text,name))
+    return 1;
+  printf("SCR: Loaded %s (%d statements)\n",scrname,scrnstep);
+  return 0;
+}
+
+/**************************************************************/
+/* SCR_ADD                                                    */
+/*  - Append statements to the upload buffer                  */
+/*  - Return 1 on error, 0 on success                         */
+/**************************************************************/
+int scr_add(char *text){
+  if(strlen(scrupload) + strlen(text) + 2 > sizeof(scrupload)){
+    printf("SCR: Upload buffer full (%d bytes)\n",SCR_MAX_SIZE);
+    return 1;
+  }
+  strcat(scrupload,text);
+  strcat(scrupload,"\n");
+  return 0;
+}
+
+/**************************************************************/
+/* SCR_CLEAR                                                  */
+/*  - Clear the upload buffer                                 */
+/**************************************************************/
+void scr_clear(void){
+  scrupload[0] = 0;
+}
+
+/**************************************************************/
+/* SCR_SAVE                                                   */
+/*  - Save the upload buffer to a script file                 */
+/*  - Return 1 on error, 0 on success                         */
+/**************************************************************/
+int scr_save(char *name){
+  char path[MAX_FILENAME];
+  FILE *fd;
+
+  if(scr_pathname(name,path))
+    return 1;
+  if((fd = fopen(path,"w")) == NULL){
+    perror("SCR: fopen");
+    printf("SCR: %s\n",path);
+    return 1;
+  }
+  if(fputs(scrupload,fd) == EOF){
+    perror("SCR: fputs");
+    fclose(fd);
+    return 1;
+  }
+  fclose(fd);
+  printf("SCR: Saved upload buffer to %s (%lu bytes)\n",path,strlen(scrupload));
+  return 0;
+}
+
+/**************************************************************/
+/* SCR_LIST                                                   */
+/*  - Print the loaded program                                */
+/**************************************************************/
+void scr_list(void){
+  int i,depth=0;
+  scrstep_t *step;
+
+  if(scrnstep == 0){
+    printf("SCR: No script loaded\n");
+    return;
+  }
+  printf("SCR: %s\n",scrname);
+  for(i=0;i<scrnstep;i++){
+    step = &scrprog[i];
+    if(step->op == SCR_OP_END) depth--;
+    printf("%c%4d  %*s",(scrrunning && i == scrpc) ? '>' : ' ',step->line,2*depth,"");
+    switch(step->op){
+    case SCR_OP_CMD:        printf("%s\n",step->cmd); break;
+    case SCR_OP_WAIT:       printf("wait %g\n",step->value); break;
+    case SCR_OP_WAITFOR:    printf("waitfor %s %s %g [%g s]\n",scrvarname[step->var],scrcmpname[step->cmp],step->value,step->timeout); break;
+    case SCR_OP_WAITFRAMES: printf("waitframes %s %d [%g s]\n",step->cmd,(int)step->value,step->timeout); break;
+    case SCR_OP_LOOP:       printf("loop %d\n",(int)step->value); break;
+    case SCR_OP_END:        printf("end\n"); break;
+    }
+    if(step->op == SCR_OP_LOOP) depth++;
+  }
+}
+
+/**************************************************************/
+/* SCR_START                                                  */
+/*  - Start the loaded program                                */
+/*  - Return 1 on error, 0 on success                         */
+/**************************************************************/
+int scr_start(sm_t *sm_p){
+  if(scrrunning){
+    printf("SCR: %s already running\n",scrname);
+    return 1;
+  }
+  if(scrnstep == 0){
+    printf("SCR: No script loaded\n");
+    return 1;
+  }
+  scrpc      = 0;
+  scrwaiting = 0;
+  scrncmd    = 0;
+  scrstart   = scr_now();
+  scrnext    = scrstart;
+  scrrunning = 1;
+  printf("SCR: Running %s\n",scrname);
+  return 0;
+}
+
+/**************************************************************/
+/* SCR_STOP                                                   */
+/*  - Stop the running script                                 */
+/**************************************************************/
+void scr_stop(char *reason){
+  if(!scrrunning) return;
+  scrrunning = 0;
+  printf("SCR: %s stopped at line %d after %.3f s: %s\n",scrname,
+	 scrpc < scrnstep ? scrprog[scrpc].line : 0,scr_now()-scrstart,reason);
+}
+
+/**************************************************************/
+/* SCR_STATUS                                                 */
+/*  - Print script engine status                              */
+/**************************************************************/
+void scr_status(void){
+  printf("SCR: Upload buffer %lu/%d bytes\n",strlen(scrupload),SCR_MAX_SIZE);
+  if(scrnstep == 0){
+    printf("SCR: No script loaded\n");
+    return;
+  }
+  if(!scrrunning){
+    printf("SCR: %s loaded (%d statements), not running\n",scrname,scrnstep);
+    return;
+  }
+  printf("SCR: %s running for %.3f s, %u commands, at line %d%s\n",scrname,scr_now()-scrstart,
+	 scrncmd,scrpc < scrnstep ? scrprog[scrpc].line : 0,scrwaiting ? " (waiting)" : "");
+}
+
+/**************************************************************/
+/* SCR_TIMEOUT                                                */
+/*  - Return seconds until the next statement, -1 if idle     */
+/**************************************************************/
+double scr_timeout(void){
+  double dt;
+  if(!scrrunning) return -1;
+  dt = scrnext - scr_now();
+  return dt > 0 ? dt : 0;
+}
+
+/**************************************************************/
+/* SCR_RUN                                                    */
+/*  - Execute all statements that are due                     */
+/**************************************************************/
+void scr_run(sm_t *sm_p){
+  char line[CMD_MAX_LENGTH];
+  scrstep_t *step;
+  double t;
+  uint32 frame;
+  int n,ret;
+
+  if(!scrrunning) return;
+  t = scr_now();
+
+  //Run statements until a wait, yield after SCR_MAX_STEPS to keep commands responsive
+  for(n=0;scrrunning && t >= scrnext && n < SCR_MAX_STEPS;n++){
+    //End of script
+    if(scrpc >= scrnstep){
+      scrrunning = 0;
+      printf("SCR: %s done: %u commands in %.3f s\n",scrname,scrncmd,t-scrstart);
+      return;
+    }
+    step = &scrprog[scrpc];
+
+    switch(step->op){
+    case SCR_OP_CMD:
+      //handle_command may modify the line
+      strcpy(line,step->cmd);
+      printf("SCR: [%d] %s\n",step->line,step->cmd);
+      ret = handle_command(line,sm_p);
+      scrncmd++;
+      if(ret == CMD_NOT_FOUND){
+	printf("Command not found: %s\n",step->cmd);
+	scr_stop("command not found");
+	return;
+      }
+      scrpc++;
+      //Blocking command: continue the schedule from its completion
+      t = scr_now();
+      if(t - scrnext > SCR_POLL_PERIOD) scrnext = t;
+      break;
+
+    case SCR_OP_WAIT:
+      scrnext += step->value;
+      scrpc++;
+      break;
+
+    case SCR_OP_WAITFOR:
+    case SCR_OP_WAITFRAMES:
+      if(!scrwaiting){
+	scrwaiting = 1;
+	scrwait0   = scrnext;
+	if(step->op == SCR_OP_WAITFRAMES){
+	  scrframe0 = scr_frame(sm_p,step->var);
+	  if(!sm_p->circbuf[step->var].write)
+	    printf("SCR: [%d] warning: %s writing is off\n",step->line,sm_p->circbuf[step->var].name);
+	}
+      }
+      //Check condition
+      if(step->op == SCR_OP_WAITFOR){
+	ret = scr_test(sm_p,step);
+      }
+      else{
+	frame = scr_frame(sm_p,step->var);
+	//Frame counter restarted with its process
+	if((int)(frame - scrframe0) < 0) scrframe0 = frame;
+	ret = (frame - scrframe0) >= step->value;
+      }
+      if(ret){
+	printf("SCR: [%d] condition met after %.3f s\n",step->line,t-scrwait0);
+	scrwaiting = 0;
+	scrnext    = t;
+	scrpc++;
+      }
+      else if(t - scrwait0 > step->timeout){
+	scrwaiting = 0;
+	scr_stop("wait timeout");
+	return;
+      }
+      else{
+	scrnext = t + SCR_POLL_PERIOD;
+      }
+      break;
+
+    case SCR_OP_LOOP:
+      step->remain = step->value;
+      scrpc = (step->remain > 0) ? scrpc+1 : step->jump+1;
+      break;
+
+    case SCR_OP_END:
+      scrpc = (--scrprog[step->jump].remain > 0) ? step->jump+1 : scrpc+1;
+      break;
+    }
+  }
+}
@@ -0,0 +1,16 @@
+#ifndef _SCR_FUNCTIONS
+#define _SCR_FUNCTIONS
+
+//Function prototypes
+int    scr_load(sm_t *sm_p, char *name);
+int    scr_add(char *text);
+void   scr_clear(void);
+int    scr_save(char *name);
+void   scr_list(void);
+int    scr_start(sm_t *sm_p);
+void   scr_stop(char *reason);
+void   scr_status(void);
+double scr_timeout(void);
+void   scr_run(sm_t *sm_p);
+
+#endif
@@ -13,6 +13,7 @@
 /* piccflight headers */
 #include "controller.h"
 #include "common_functions.h"
+#include "log_functions.h"
 #include "numeric.h"
 #include "hex_functions.h"
 #include "alp_functions.h"
@@ -21,13 +22,32 @@
 #include "phx_config.h"
 #include "rtd_functions.h"
 #include "fakemodes.h"
+#include "calstore.h"
+#include "calsnap.h"
+#include "img_functions.h"
+#include "frm_functions.h"
+#include "fake_functions.h"
+#include "plant_functions.h"
+
+/* Camera readout window. Cell geometry stays in full frame
+   coordinates and is translated into the window here. */
+static shkroi_t shkroi = {0,0,SHKXS,SHKYS};
 
 /**************************************************************/
 /* SHK_XY2INDEX                                               */
-/*  - Transform x,y to buffer index                           */
+/*  - Transform full frame x,y to buffer index                */
 /**************************************************************/
 uint64 shk_xy2index(int x, int y){
-  return (uint64)x + ((uint64)y)*SHKXS;
+  return (uint64)(x - shkroi.xoff) + ((uint64)(y - shkroi.yoff))*shkroi.xs;
+}
+
+/**************************************************************/
+/* SHK_ROI_SET                                                */
+/*  - Set the camera readout window used for pixel indexing   */
+/*  - Only call while the camera is stopped                   */
+/**************************************************************/
+void shk_roi_set(shkroi_t *roi){
+  memcpy(&shkroi,roi,sizeof(shkroi_t));
 }
 
 /**************************************************************/
@@ -187,18 +207,71 @@ void shk_loadorigin(shkevent_t*shkevent){
   return;
 }
 
+/**************************************************************/
+/* SHK_ROI_BEAM                                               */
+/*  - Readout window around the beam cells                    */
+/*  - Uses the default cells and the saved origin file        */
+/**************************************************************/
+void shk_roi_beam(shkroi_t *roi){
+  static shkevent_t shkevent;
+  double xmin=SHKXS*SHKBIN,ymin=SHKYS*SHKBIN,xmax=0,ymax=0;
+  int i,blx,bly,trx,try;
+
+  //Cell origins (unbinned coordinates)
+  memset(&shkevent,0,sizeof(shkevent_t));
+  shk_init_cells(&shkevent);
+  shk_loadorigin(&shkevent);
+
+  //Bounding box of the largest centroid boxes
+  for(i=0;i<SHK_BEAM_NCELLS;i++){
+    xmin = shkevent.cells[i].xorigin < xmin ? shkevent.cells[i].xorigin : xmin;
+    ymin = shkevent.cells[i].yorigin < ymin ? shkevent.cells[i].yorigin : ymin;
+    xmax = shkevent.cells[i].xorigin > xmax ? shkevent.cells[i].xorigin : xmax;
+    ymax = shkevent.cells[i].yorigin > ymax ? shkevent.cells[i].yorigin : ymax;
+  }
+
+  //Add margin (binned coordinates)
+  blx = floor((xmin - SHK_MAX_BOXSIZE)/SHKBIN) - SHK_ROI_MARGIN;
+  bly = floor((ymin - SHK_MAX_BOXSIZE)/SHKBIN) - SHK_ROI_MARGIN;
+  trx = floor((xmax + SHK_MAX_BOXSIZE)/SHKBIN) + SHK_ROI_MARGIN + 1;
+  try = floor((ymax + SHK_MAX_BOXSIZE)/SHKBIN) + SHK_ROI_MARGIN + 1;
+
+  //Impose limits
+  blx = blx < 0 ? 0 : blx;
+  bly = bly < 0 ? 0 : bly;
+  trx = trx > SHKXS ? SHKXS : trx;
+  try = try > SHKYS ? SHKYS : try;
+
+  //Align window to camera readout steps
+  blx = (blx/SHK_ROI_ALIGN)*SHK_ROI_ALIGN;
+  bly = (bly/SHK_ROI_ALIGN)*SHK_ROI_ALIGN;
+  trx = ((trx + SHK_ROI_ALIGN - 1)/SHK_ROI_ALIGN)*SHK_ROI_ALIGN;
+  try = ((try + SHK_ROI_ALIGN - 1)/SHK_ROI_ALIGN)*SHK_ROI_ALIGN;
+  trx = trx > SHKXS ? SHKXS : trx;
+  try = try > SHKYS ? SHKYS : try;
+
+  roi->xoff = blx;
+  roi->yoff = bly;
+  roi->xs   = trx - blx;
+  roi->ys   = try - bly;
+}
+
 
 
 /**************************************************************/
 /* SHK_CENTROID_CELL                                          */
 /*  - Measure the centroid of a single SHK cell               */
+/*  - spot_base: level the spot found/lost thresholds are     */
+/*    measured from (0 = raw maximum)                         */
 /**************************************************************/
-void shk_centroid_cell(uint8 *image, shkcell_t *cell, int cmd_boxsize){
+void shk_centroid_cell(uint8 *image, shkcell_t *cell, int cmd_boxsize, double spot_base){
   double xnum,ynum,total,intensity;
   uint16 maxval;
   double xhist[SHKXS]={0};
   double yhist[SHKYS]={0};
   int    x,y,blx,bly,trx,try,boxsize;
+  int    xmin = shkroi.xoff, xmax = shkroi.xoff + shkroi.xs - 1;
+  int    ymin = shkroi.yoff, ymax = shkroi.yoff + shkroi.ys - 1;
   uint64 px;
   double wave2surf = 1;
   double xcentroid=0,ycentroid=0,xdeviation=0,ydeviation=0;
@@ -226,15 +299,15 @@ void shk_centroid_cell(uint8 *image, shkcell_t *cell, int cmd_boxsize){
   trx = floor((cell->xtarget + boxsize)/SHKBIN);
   try = floor((cell->ytarget + boxsize)/SHKBIN);
   
-  //Impose limits (binned coordinates)
-  blx = blx > SHK_XMAX ? SHK_XMAX : blx;
-  bly = bly > SHK_YMAX ? SHK_YMAX : bly;
-  blx = blx < SHK_XMIN ? SHK_XMIN : blx;
-  bly = bly < SHK_YMIN ? SHK_YMIN : bly;
-  trx = trx > SHK_XMAX ? SHK_XMAX : trx;
-  try = try > SHK_YMAX ? SHK_YMAX : try;
-  trx = trx < SHK_XMIN ? SHK_XMIN : trx;
-  try = try < SHK_YMIN ? SHK_YMIN : try;
+  //Impose readout window limits (binned coordinates)
+  blx = blx > xmax ? xmax : blx;
+  bly = bly > ymax ? ymax : bly;
+  blx = blx < xmin ? xmin : blx;
+  bly = bly < ymin ? ymin : bly;
+  trx = trx > xmax ? xmax : trx;
+  try = try > ymax ? ymax : try;
+  trx = trx < xmin ? xmin : trx;
+  try = try < ymin ? ymin : try;
 
 
   //Set centroid as brightest pixel
@@ -253,11 +326,11 @@ void shk_centroid_cell(uint8 *image, shkcell_t *cell, int cmd_boxsize){
   }
   
   //Check if spot is above or below deadband threshold
-  if(maxval > SHK_SPOT_UPPER_THRESH){
+  if(maxval - spot_base > SHK_SPOT_UPPER_THRESH){
     cell->spot_found=1;
     //Centroid will be re-calculated below
   }
-  if(maxval < SHK_SPOT_LOWER_THRESH){
+  if(maxval - spot_base < SHK_SPOT_LOWER_THRESH){
     //Reset values
     cell->spot_found=0;
     cell->spot_captured=0;
@@ -301,15 +374,15 @@ void shk_centroid_cell(uint8 *image, shkcell_t *cell, int cmd_boxsize){
     trx = floor((cell->xtarget + boxsize)/SHKBIN);
     try = floor((cell->ytarget + boxsize)/SHKBIN);
 
-    //Impose limits (binned coordinates)
-    blx = blx > SHK_XMAX ? SHK_XMAX : blx;
-    bly = bly > SHK_YMAX ? SHK_YMAX : bly;
-    blx = blx < SHK_XMIN ? SHK_XMIN : blx;
-    bly = bly < SHK_YMIN ? SHK_YMIN : bly;
-    trx = trx > SHK_XMAX ? SHK_XMAX : trx;
-    try = try > SHK_YMAX ? SHK_YMAX : try;
-    trx = trx < SHK_XMIN ? SHK_XMIN : trx;
-    try = try < SHK_YMIN ? SHK_YMIN : try;
+    //Impose readout window limits (binned coordinates)
+    blx = blx > xmax ? xmax : blx;
+    bly = bly > ymax ? ymax : bly;
+    blx = blx < xmin ? xmin : blx;
+    bly = bly < ymin ? ymin : bly;
+    trx = trx > xmax ? xmax : trx;
+    try = try > ymax ? ymax : try;
+    trx = trx < xmin ? xmin : trx;
+    try = try < ymin ? ymin : try;
 
     //Build x,y histograms
     intensity=0;
@@ -395,52 +468,124 @@ void shk_centroid_cell(uint8 *image, shkcell_t *cell, int cmd_boxsize){
   cell->yorigin_deviation *= wave2surf;
 }
 
+/**************************************************************/
+/* SHK_CELL_BACKGROUND                                        */
+/*  - Measure the local background of a single SHK cell       */
+/*  - Mean of the max centroid box border. A second pass      */
+/*    rejects border pixels lit by the spot or a neighbor.    */
+/**************************************************************/
+static double shk_cell_background(uint8 *image, shkcell_t *cell){
+  int    xmin = shkroi.xoff, xmax = shkroi.xoff + shkroi.xs - 1;
+  int    ymin = shkroi.yoff, ymax = shkroi.yoff + shkroi.ys - 1;
+  int    x,y,blx,bly,trx,try,pass,npix;
+  double sum,limit=255,background=0;
+  uint8  value;
+
+  //Corners of the max centroid box (binned coordinates)
+  blx = floor((cell->xtarget - SHK_MAX_BOXSIZE)/SHKBIN);
+  bly = floor((cell->ytarget - SHK_MAX_BOXSIZE)/SHKBIN);
+  trx = floor((cell->xtarget + SHK_MAX_BOXSIZE)/SHKBIN);
+  try = floor((cell->ytarget + SHK_MAX_BOXSIZE)/SHKBIN);
+
+  //Impose readout window limits (binned coordinates)
+  blx = blx > xmax ? xmax : blx;
+  bly = bly > ymax ? ymax : bly;
+  blx = blx < xmin ? xmin : blx;
+  bly = bly < ymin ? ymin : bly;
+  trx = trx > xmax ? xmax : trx;
+  try = try > ymax ? ymax : try;
+  trx = trx < xmin ? xmin : trx;
+  try = try < ymin ? ymin : try;
+
+  for(pass=0;pass<2;pass++){
+    sum  = 0;
+    npix = 0;
+    //Bottom and top rows
+    for(x=blx;x<=trx;x++){
+      value = image[shk_xy2index(x,bly)];
+      if(value <= limit){ sum += value; npix++; }
+      value = image[shk_xy2index(x,try)];
+      if(value <= limit){ sum += value; npix++; }
+    }
+    //Left and right columns
+    for(y=bly+1;y<try;y++){
+      value = image[shk_xy2index(blx,y)];
+      if(value <= limit){ sum += value; npix++; }
+      value = image[shk_xy2index(trx,y)];
+      if(value <= limit){ sum += value; npix++; }
+    }
+    if(npix == 0) break;
+    background = sum/npix;
+    limit = background + SHK_SPOT_UPPER_THRESH;
+  }
+  return background;
+}
+
 /**************************************************************/
 /* SHK_CENTROID                                               */
 /*  - Measure centroids of all SHK cells                      */
+/*  - SHK_BKG_GLOBAL: one background from a fixed region,     */
+/*    measured every frame                                    */
+/*  - SHK_BKG_LOCAL: per-cell backgrounds, measured when      */
+/*    bkg_update is set and reused between updates            */
 /**************************************************************/
-void shk_centroid(uint8 *image, shkevent_t *shkevent){
-  int i,j;
+void shk_centroid(uint8 *image, shkevent_t *shkevent, int bkg_mode, int bkg_update){
+  int i,j,bx,by;
   uint64 px;
   int npix=0;
   double background=0;
   
-  //Calculate detector background
-  for(i=20/SHKBIN;i<50/SHKBIN;i++){
-    for(j=20/SHKBIN;j<50/SHKBIN;j++){
-      px = i + j*SHKXS;
-      background += (double)image[px];
-      npix++;
+  if(bkg_mode == SHK_BKG_LOCAL){
+    //Update per-cell background map
+    if(bkg_update)
+      for(i=0;i<SHK_BEAM_NCELLS;i++)
+	shkevent->cells[i].background = shk_cell_background(image,&shkevent->cells[i]);
+  }
+  else{
+    //Background region: fixed in the full frame, window corner in ROI mode
+    bx = shkroi.xoff;
+    by = shkroi.yoff;
+    if(shkroi.xs == SHKXS && shkroi.ys == SHKYS)
+      bx = by = 20/SHKBIN;
+    
+    //Calculate detector background
+    for(i=bx;i<bx+30/SHKBIN;i++){
+      for(j=by;j<by+30/SHKBIN;j++){
+	px = shk_xy2index(i,j);
+	background += (double)image[px];
+	npix++;
+      }
     }
+    background /= npix;
+    for(i=0;i<SHK_BEAM_NCELLS;i++)
+      shkevent->cells[i].background = background;
   }
-  background /= npix;
 
   //Init # spot found and captured
   shkevent->nspot_found = 0;
   shkevent->nspot_captured = 0;
   
   //Centroid cells
+  //--spot thresholds were tuned on raw maxima, keep that in global mode
   for(i=0;i<SHK_BEAM_NCELLS;i++){
-    shkevent->cells[i].background = background;
-    shk_centroid_cell(image,&shkevent->cells[i],shkevent->boxsize);
+    shk_centroid_cell(image,&shkevent->cells[i],shkevent->boxsize,bkg_mode == SHK_BKG_LOCAL ? shkevent->cells[i].background : 0);
     shkevent->nspot_found    += shkevent->cells[i].spot_found;
     shkevent->nspot_captured += shkevent->cells[i].spot_captured;
   }
 }
 
 /**************************************************************/
-/* SHK_ZERNIKE_MATRIX                                         */
-/*  - Build SHK Zernike fitting matrix                        */
+/* SHK_ZERNIKE_FWD                                            */
+/*  - Build SHK Zernike forward matrix                        */
+/*  - Cell displacement [px] per unit zernike [um]            */
 /**************************************************************/
-void shk_zernike_matrix(shkcell_t *cells, double *matrix_fwd, double *matrix_inv){
+void shk_zernike_fwd(shkcell_t *cells, double *matrix_fwd){
   int i;
   double max_x = 0, max_y = 0, min_x = SHKXS*SHKBIN, min_y = SHKYS*SHKBIN;
   double beam_xcenter,beam_ycenter,beam_radius,beam_radius_m,unit_conversion;
   double dz_dxdy[2*SHK_BEAM_NCELLS*LOWFS_N_ZERNIKE] = {0};
-  double dxdy_dz[2*SHK_BEAM_NCELLS*LOWFS_N_ZERNIKE] = {0};
   double x_1 = 0, x_2 = 0, x_3 = 0, x_4 = 0, x_5=0;
   double y_1 = 0, y_2 = 0, y_3 = 0, y_4 = 0, y_5=0;
-  FILE *fd=NULL;
   double cell_size_px = SHK_LENSLET_PITCH_UM/SHK_PX_PITCH_UM;
   
   
@@ -460,7 +605,6 @@ void shk_zernike_matrix(shkcell_t *cells, double *matrix_fwd, double *matrix_inv
   //bake in the conversion from pixels to wavefront slope
   unit_conversion = (SHK_FOCAL_LENGTH_UM/SHK_PX_PITCH_UM) * (1./(beam_radius*SHK_PX_PITCH_UM));
   
-  printf("SHK: Building Zernike matrix for %d cells\n",SHK_BEAM_NCELLS);
   if(SHK_DEBUG) printf("SHK: (MinX,MaxX): (%f, %f) [px]\n",min_x,max_x);
   if(SHK_DEBUG) printf("SHK: (MinY,MaxY): (%f, %f) [px]\n",min_y,max_y);
   if(SHK_DEBUG) printf("SHK: Beam center: (%f, %f) [px]\n",beam_xcenter,beam_ycenter);
@@ -539,6 +683,57 @@ void shk_zernike_matrix(shkcell_t *cells, double *matrix_fwd, double *matrix_inv
 
   }
 
+  //Copy forward matrix to calling routine
+  memcpy(matrix_fwd,dz_dxdy,sizeof(dz_dxdy));
+}
+
+/**************************************************************/
+/* SHK_ZERNIKE_MATRIX                                         */
+/*  - Build SHK Zernike fitting matrix                        */
+/**************************************************************/
+void shk_zernike_matrix(shkcell_t *cells, double *matrix_fwd, double *matrix_inv, sm_t *sm_p){
+  static num_pinv_t pinv={0};
+  static shkzmat_t zmat;
+  num_pinv_reg_t reg;
+  num_pinv_diag_t diag;
+  double dz_dxdy[2*SHK_BEAM_NCELLS*LOWFS_N_ZERNIKE] = {0};
+  double dxdy_dz[2*SHK_BEAM_NCELLS*LOWFS_N_ZERNIKE] = {0};
+  double keydata[2*SHK_BEAM_NCELLS+4];
+  uint64 key;
+  int i;
+
+  //Set regularization
+  reg.method = sm_p->shk_pinv_method;
+  reg.thresh = sm_p->shk_pinv_thresh;
+  reg.nmodes = sm_p->shk_pinv_nmodes;
+  reg.alpha  = sm_p->shk_pinv_alpha;
+
+  //Snapshot key: cell origins and regularization
+  for(i=0;i<SHK_BEAM_NCELLS;i++){
+    keydata[2*i + 0] = cells[i].xorigin;
+    keydata[2*i + 1] = cells[i].yorigin;
+  }
+  keydata[2*SHK_BEAM_NCELLS + 0] = reg.method;
+  keydata[2*SHK_BEAM_NCELLS + 1] = reg.thresh;
+  keydata[2*SHK_BEAM_NCELLS + 2] = reg.nmodes;
+  keydata[2*SHK_BEAM_NCELLS + 3] = reg.alpha;
+  key = calsnap_checksum(keydata,sizeof(keydata));
+
+  //Use the calibration snapshot if it matches
+  if(!calsnap_get(sm_p,CALSNAP_SHKZMAT,&zmat) && zmat.key == key){
+    memcpy(matrix_fwd,zmat.fwd,sizeof(zmat.fwd));
+    memcpy(matrix_inv,zmat.inv,sizeof(zmat.inv));
+    sm_p->shk_pinv_cond  = zmat.cond;
+    sm_p->shk_pinv_gain  = zmat.gain;
+    sm_p->shk_pinv_nused = zmat.nused;
+    printf("SHK: Zernike matrix from snapshot, cond = %.3e, modes = %d/%d, gain = %.3e\n",zmat.cond,zmat.nused,LOWFS_N_ZERNIKE,zmat.gain);
+    return;
+  }
+
+  //Build forward matrix
+  printf("SHK: Building Zernike matrix for %d cells\n",SHK_BEAM_NCELLS);
+  shk_zernike_fwd(cells,dz_dxdy);
+
   /* Write forward matrix to file */
   if(SHK_SAVE_ZMATRIX){
     if(write_file(SHKZER2SHKCEL_OUTFILE,dz_dxdy,sizeof(dz_dxdy))){
@@ -552,9 +747,26 @@ void shk_zernike_matrix(shkcell_t *cells, double *matrix_fwd, double *matrix_inv
   //Copy forward matrix to calling routine
   memcpy(matrix_fwd,dz_dxdy,sizeof(dz_dxdy));
   
-  //Invert Matrix NOTE: This changes the forward matrix
+  //Invert Matrix
   if(SHK_DEBUG) printf("SHK: Inverting the Zernike matrix\n");
-  num_dgesvdi(dz_dxdy, dxdy_dz, 2*SHK_BEAM_NCELLS, LOWFS_N_ZERNIKE);
+  if(num_pinv(&pinv, dz_dxdy, dxdy_dz, 2*SHK_BEAM_NCELLS, LOWFS_N_ZERNIKE, &reg, &diag)){
+    printf("SHK: ERROR: Zernike matrix inversion failed\n");
+    memset(dxdy_dz,0,sizeof(dxdy_dz));
+  }
+  else{
+    sm_p->shk_pinv_cond  = diag.cond;
+    sm_p->shk_pinv_gain  = diag.gain;
+    sm_p->shk_pinv_nused = diag.nmodes;
+    printf("SHK: Zernike matrix cond = %.3e, modes = %d/%d, gain = %.3e\n",diag.cond,diag.nmodes,LOWFS_N_ZERNIKE,diag.gain);
+    //Publish to the calibration snapshot
+    zmat.key   = key;
+    zmat.cond  = diag.cond;
+    zmat.gain  = diag.gain;
+    zmat.nused = diag.nmodes;
+    memcpy(zmat.fwd,dz_dxdy,sizeof(zmat.fwd));
+    memcpy(zmat.inv,dxdy_dz,sizeof(zmat.inv));
+    calsnap_put(sm_p,CALSNAP_SHKZMAT,&zmat);
+  }
     
   //Copy inverse matrix to calling routine
   memcpy(matrix_inv,dxdy_dz,sizeof(dxdy_dz));
@@ -576,9 +788,11 @@ void shk_zernike_matrix(shkcell_t *cells, double *matrix_fwd, double *matrix_inv
 /*  - Fit Zernikes to SHK centroids                           */
 /*  - Set cell targets based on zernike targets               */
 /**************************************************************/
-void shk_zernike_ops(shkevent_t *shkevent, int fit_zernikes, int set_targets, int reset){
+void shk_zernike_ops(shkevent_t *shkevent, int fit_zernikes, int set_targets, int reset, sm_t *sm_p){
   static double shk2zern[2*SHK_BEAM_NCELLS*LOWFS_N_ZERNIKE]={0};
   static double zern2shk[2*SHK_BEAM_NCELLS*LOWFS_N_ZERNIKE]={0};
+  static num_recon_t shk2zern_recon={0};
+  static num_recon_t zern2shk_recon={0};
   double shk_xydev[2*SHK_BEAM_NCELLS]={0};
   int i;
   double surf2wave=1;
@@ -587,7 +801,10 @@ void shk_zernike_ops(shkevent_t *shkevent, int fit_zernikes, int set_targets, in
   /* Initialize Fitting Matrix */
   if(!init || reset){
     //Generate the zernike matrix
-    shk_zernike_matrix(shkevent->cells, zern2shk, shk2zern);
+    shk_zernike_matrix(shkevent->cells, zern2shk, shk2zern, sm_p);
+    //Build reconstructors
+    num_recon_init(&shk2zern_recon,shk2zern,LOWFS_N_ZERNIKE,2*SHK_BEAM_NCELLS);
+    num_recon_init(&zern2shk_recon,zern2shk,2*SHK_BEAM_NCELLS,LOWFS_N_ZERNIKE);
     //Set init flag
     init = 1;
     //Return if reset
@@ -605,7 +822,7 @@ void shk_zernike_ops(shkevent_t *shkevent, int fit_zernikes, int set_targets, in
     }
     //Do Zernike fit matrix multiply
     if(shkevent->nspot_found >= SHK_ZFIT_MIN_CELLS){
-      num_dgemv(shk2zern, shk_xydev, shkevent->zernike_measured, LOWFS_N_ZERNIKE, 2*SHK_BEAM_NCELLS);
+      num_recon(&shk2zern_recon, shk_xydev, shkevent->zernike_measured);
     }else{
       //Zero out fit values
       for(i=0;i<LOWFS_N_ZERNIKE;i++)
@@ -616,7 +833,7 @@ void shk_zernike_ops(shkevent_t *shkevent, int fit_zernikes, int set_targets, in
   /* Set Targets */
   if(set_targets){
     //Do Zernike target to cell target matrix multiply 
-    num_dgemv(zern2shk, shkevent->zernike_target, shk_xydev, 2*SHK_BEAM_NCELLS, LOWFS_N_ZERNIKE);
+    num_recon(&zern2shk_recon, shkevent->zernike_target, shk_xydev);
     //Convert xydev from pixels/surface back to pixels
     if(INSTRUMENT_INPUT_TYPE == INPUT_TYPE_SINGLE_PASS) surf2wave = 2.0;
     if(INSTRUMENT_INPUT_TYPE == INPUT_TYPE_DOUBLE_PASS) surf2wave = 4.0;
@@ -635,16 +852,21 @@ void shk_zernike_ops(shkevent_t *shkevent, int fit_zernikes, int set_targets, in
 void shk_cells2alp(shkcell_t *cells, double *actuators, int reset){
   static int init=0;
   static double cells2alp_matrix[2*SHK_BEAM_NCELLS*ALP_NACT]={0};
+  static num_recon_t cells2alp_recon={0};
+  static uint32 version=0;
   double shk_xydev[2*SHK_BEAM_NCELLS]={0};
   int i;
     
   /* Initialize */
-  if(!init || reset){
-    //Read matrix file
-    if(read_file(SHKCEL2ALPACT_FILE,cells2alp_matrix,sizeof(cells2alp_matrix)))
+  if(!init || reset || version != cal_version(CAL_SHKCEL2ALPACT)){
+    //Copy matrix from calibration store
+    if(cal_read(CAL_SHKCEL2ALPACT,cells2alp_matrix,sizeof(cells2alp_matrix),&version))
       memset(cells2alp_matrix,0,sizeof(cells2alp_matrix));
     else
-      printf("SHK: Read: %s\n",SHKCEL2ALPACT_FILE);
+      printf("SHK: Read cells2alp matrix v%u\n",version);
+
+    //Build reconstructor
+    num_recon_init(&cells2alp_recon,cells2alp_matrix,ALP_NACT,2*SHK_BEAM_NCELLS);
     
     //Set init flag
     init=1;
@@ -659,7 +881,7 @@ void shk_cells2alp(shkcell_t *cells, double *actuators, int reset){
   }
 
   //Do Matrix Multiply
-  num_dgemv(cells2alp_matrix, shk_xydev, actuators, ALP_NACT, 2*SHK_BEAM_NCELLS);
+  num_recon(&cells2alp_recon, shk_xydev, actuators);
 }
 
 /**************************************************************/
@@ -794,6 +1016,8 @@ int shk_process_image(stImageBuff *buffer,sm_t *sm_p){
   static struct timespec start,end,delta,last,full_last,hex_last,pkt_last;
   static uint32 frame_number=0,sample=0;
   static int init=0;
+  static double fakefwd[2*SHK_BEAM_NCELLS*LOWFS_N_ZERNIKE];
+  fakecfg_t fakecfg;
   double dt;
   int i,j;
   uint16_t fakepx=0;
@@ -815,6 +1039,9 @@ int shk_process_image(stImageBuff *buffer,sm_t *sm_p){
   //Get state
   state = sm_p->state;
 
+  //Set reconstructor precision
+  num_set_precision(sm_p->w[SHKID].precision);
+
   //Check reset
   if(sm_p->shk_reset){
     init=0;
@@ -834,8 +1061,10 @@ int shk_process_image(stImageBuff *buffer,sm_t *sm_p){
     shk_init_cells(&shkevent);
     //Load cell origins
     shk_loadorigin(&shkevent);
+    //Fake frame forward matrix
+    shk_zernike_fwd(shkevent.cells,fakefwd);
     //Reset zernike matrix
-    shk_zernike_ops(&shkevent,0,0,FUNCTION_RESET_RETURN);
+    shk_zernike_ops(&shkevent,0,0,FUNCTION_RESET_RETURN,sm_p);
     //Reset cells2alp mapping
     shk_cells2alp(shkevent.cells,NULL,FUNCTION_RESET_RETURN);
     //Reset zern2alp mapping
@@ -874,7 +1103,7 @@ int shk_process_image(stImageBuff *buffer,sm_t *sm_p){
   
   //Measure exposure time
   if(timespec_subtract(&delta,&start,&last))
-    printf("SHK: shk_process_image --> timespec_subtract error!\n");
+    log_msg(LOG_LVL_WARN,"SHK: shk_process_image --> timespec_subtract error!\n");
   ts2double(&delta,&dt);
 
   //Save time
@@ -893,6 +1122,7 @@ int shk_process_image(stImageBuff *buffer,sm_t *sm_p){
   shkevent.hed.bmc_commander = sm_p->state_array[state].bmc_commander;
   shkevent.hed.start_sec     = start.tv_sec;
   shkevent.hed.start_nsec    = start.tv_nsec;
+  frm_header(sm_p,SHKID,&shkevent.hed);
   
   //Increment frame_number
   frame_number++;
@@ -922,7 +1152,7 @@ int shk_process_image(stImageBuff *buffer,sm_t *sm_p){
       sm_p->tgt_calmode = tgt_calibrate(sm_p,shkevent.hed.tgt_calmode,shkevent.zernike_target,&shkevent.hed.tgt_calstep,SHKID,FUNCTION_NO_RESET);
   
   //Set centroid targets based on zernike targets
-  shk_zernike_ops(&shkevent,0,1,FUNCTION_NO_RESET);
+  shk_zernike_ops(&shkevent,0,1,FUNCTION_NO_RESET,sm_p);
   
   //Set centroid boxsize based on calmode
   shkevent.boxsize = sm_p->shk_boxsize;
@@ -936,8 +1166,18 @@ int shk_process_image(stImageBuff *buffer,sm_t *sm_p){
   //Set centroid boxsize to max in STATE_STANDBY
   if(state == STATE_STANDBY) shkevent.boxsize = SHK_MAX_BOXSIZE;
 
-  //Calculate centroids
-  shk_centroid(buffer->pvAddress,&shkevent);
+  //Fake data: render frame from fake zernikes
+  if(sm_p->w[SHKID].fakemode == FAKEMODE_ZERNIKE)
+    image = fake_shk_image(&shkroi,shkevent.cells,fakefwd,(fakecfg_t *)&sm_p->fakecfg);
+
+  //Fake data: render frame from the optical plant
+  if(sm_p->w[SHKID].fakemode == FAKEMODE_PLANT){
+    plant_fakecfg(sm_p,SHKID,&fakecfg);
+    image = fake_shk_image(&shkroi,shkevent.cells,fakefwd,&fakecfg);
+  }
+
+  //Calculate centroids, local background map is updated every SHK_BKG_NFRAMES
+  shk_centroid(image,&shkevent,sm_p->shk_bkg_mode,(shkevent.hed.frame_number % SHK_BKG_NFRAMES) == 0);
  
   //Command: Set cell origins
   if(sm_p->shk_setorigin){
@@ -972,7 +1212,7 @@ int shk_process_image(stImageBuff *buffer,sm_t *sm_p){
   if(sm_p->shk_xshiftorigin){
     for(i=0;i<SHK_BEAM_NCELLS;i++)
       shkevent.cells[i].xorigin += sm_p->shk_xshiftorigin;
-    printf("SHK: Shifted origin %d pixels in X\n",sm_p->shk_xshiftorigin);
+    log_msg(LOG_LVL_INFO,"SHK: Shifted origin %d pixels in X\n",sm_p->shk_xshiftorigin);
     sm_p->shk_xshiftorigin = 0;
     //Trigger zernike reset
     reset_zernike=1;
@@ -982,18 +1222,27 @@ int shk_process_image(stImageBuff *buffer,sm_t *sm_p){
   if(sm_p->shk_yshiftorigin){
     for(i=0;i<SHK_BEAM_NCELLS;i++)
       shkevent.cells[i].yorigin += sm_p->shk_yshiftorigin;
-    printf("SHK: Shifted origin %d pixels in Y\n",sm_p->shk_yshiftorigin);
+    log_msg(LOG_LVL_INFO,"SHK: Shifted origin %d pixels in Y\n",sm_p->shk_yshiftorigin);
     sm_p->shk_yshiftorigin = 0;
     //Trigger zernike reset
     reset_zernike=1;
   }
   
+  //Command: Rebuild zernike matrix with new regularization
+  if(sm_p->shk_pinv_update){
+    sm_p->shk_pinv_update = 0;
+    reset_zernike=1;
+  }
+  
   //Reset zernike matrix if cell origins have changed
-  if(reset_zernike) shk_zernike_ops(&shkevent,0,0,FUNCTION_RESET);
+  if(reset_zernike){
+    shk_zernike_ops(&shkevent,0,0,FUNCTION_RESET,sm_p);
+    shk_zernike_fwd(shkevent.cells,fakefwd);
+  }
   
   //Fit zernikes
   if(sm_p->state_array[state].shk.fit_zernikes)
-    shk_zernike_ops(&shkevent,1,0,FUNCTION_NO_RESET);
+    shk_zernike_ops(&shkevent,1,0,FUNCTION_NO_RESET,sm_p);
   
   /************************************************************/
   /*******************  Hexapod Control Code  *****************/
@@ -1001,13 +1250,14 @@ int shk_process_image(stImageBuff *buffer,sm_t *sm_p){
 
   //Check time since last command
   if(timespec_subtract(&delta,&start,&hex_last))
-    printf("SHK: shk_process_image --> timespec_subtract error!\n");
+    log_msg(LOG_LVL_WARN,"SHK: shk_process_image --> timespec_subtract error!\n");
   ts2double(&delta,&dt);
   
   //Get HEX command for user control
   if(sm_p->state_array[state].hex_commander == WATID){
     if(hex_get_command(sm_p,&hex)){
       //Skip this image
+      frm_skip(sm_p,SHKID,FRM_SKIP_LOCK);
       return 0;
     }
   }
@@ -1018,6 +1268,7 @@ int shk_process_image(stImageBuff *buffer,sm_t *sm_p){
     //Get last HEX command -- everytime through for event packets
     if(hex_get_command(sm_p,&hex)){
       //Skip this image
+      frm_skip(sm_p,SHKID,FRM_SKIP_LOCK);
       return 0;
     }
     memcpy(&hex_try,&hex,sizeof(hex_t));
@@ -1075,7 +1326,7 @@ int shk_process_image(stImageBuff *buffer,sm_t *sm_p){
       }else{
 	// - copy command to current position
 	memcpy(&hex,&hex_try,sizeof(hex_t));
-	printf("HEX: {%f,%f,%f,%f,%f,%f}\n",hex.acmd[0],hex.acmd[1],hex.acmd[2],hex.acmd[3],hex.acmd[4],hex.acmd[5]);
+	log_msg(LOG_LVL_INFO,"HEX: {%f,%f,%f,%f,%f,%f}\n",hex.acmd[0],hex.acmd[1],hex.acmd[2],hex.acmd[3],hex.acmd[4],hex.acmd[5]);
       }
       
       //Reset time
@@ -1092,6 +1343,7 @@ int shk_process_image(stImageBuff *buffer,sm_t *sm_p){
   if(sm_p->state_array[state].alp_commander == WATID){
     if(alp_get_command(sm_p,&alp)){
       //Skip this image
+      frm_skip(sm_p,SHKID,FRM_SKIP_LOCK);
       return 0;
     }
   }
@@ -1102,6 +1354,7 @@ int shk_process_image(stImageBuff *buffer,sm_t *sm_p){
     //Get last ALP command
     if(alp_get_command(sm_p,&alp)){
       //Skip this image
+      frm_skip(sm_p,SHKID,FRM_SKIP_LOCK);
       return 0;
     }
     memcpy(&alp_try,&alp,sizeof(alp_t));
@@ -1208,7 +1461,7 @@ int shk_process_image(stImageBuff *buffer,sm_t *sm_p){
 
     //Get time since last packet write
     if(timespec_subtract(&delta,&start,&pkt_last))
-      printf("SHK: shk_process_image --> timespec_subtract error!\n");
+      log_msg(LOG_LVL_WARN,"SHK: shk_process_image --> timespec_subtract error!\n");
     ts2double(&delta,&dt);
         
     //Last sample, fill out rest of packet and write to circular buffer
@@ -1269,6 +1522,7 @@ int shk_process_image(stImageBuff *buffer,sm_t *sm_p){
       
       //CCD Temp
       shkpkt.ccd_temp = shkevent.ccd_temp;
+      shkpkt.background_mode = sm_p->shk_bkg_mode;
       
       //Number of samples
       shkpkt.nsamples = sample;
@@ -1289,15 +1543,15 @@ int shk_process_image(stImageBuff *buffer,sm_t *sm_p){
   /*************************************************************/
   if(sm_p->circbuf[BUFFER_SHKFULL].write){
     if(timespec_subtract(&delta,&start,&full_last))
-      printf("SHK: shk_process_image --> timespec_subtract error!\n");
+      log_msg(LOG_LVL_WARN,"SHK: shk_process_image --> timespec_subtract error!\n");
     ts2double(&delta,&dt);
     if(dt > SHK_FULL_IMAGE_TIME){
       //Copy packet header
       memcpy(&shkfull.hed,&shkevent.hed,sizeof(pkthed_t));
       shkfull.hed.type = BUFFER_SHKFULL;
     
-      //Fake data
-      if(sm_p->w[SHKID].fakemode != FAKEMODE_NONE){
+      //Fake data (FAKEMODE_ZERNIKE & FAKEMODE_PLANT frames are copied like camera frames)
+      if(sm_p->w[SHKID].fakemode != FAKEMODE_NONE && sm_p->w[SHKID].fakemode != FAKEMODE_ZERNIKE && sm_p->w[SHKID].fakemode != FAKEMODE_PLANT){
 	if(sm_p->w[SHKID].fakemode == FAKEMODE_TEST_PATTERN)
 	  for(i=0;i<SHKXS;i++)
 	    for(j=0;j<SHKYS;j++)
@@ -1308,10 +1562,10 @@ int shk_process_image(stImageBuff *buffer,sm_t *sm_p){
 	}
       }
       else{
-	//Copy full image
-	for(i=0;i<SHKXS;i++)
-	  for(j=0;j<SHKYS;j++)
-	    shkfull.image.data[i][j] = image[shk_xy2index(i,j)];
+	//Copy full image, only the readout window is valid in ROI mode
+	if(shkroi.xs != SHKXS || shkroi.ys != SHKYS)
+	  memset(&shkfull.image,0,sizeof(shkfull.image));
+	img_transpose8(&shkfull.image.data[shkroi.xoff][shkroi.yoff],SHKYS,image,shkroi.xs,shkroi.xs,shkroi.ys);
       }
       
       //Copy shkevent
@@ -16,7 +16,12 @@
 /* piccflight headers */
 #include "controller.h"
 #include "common_functions.h"
+#include "log_functions.h"
 #include "phx_config.h"
+#include "phx_bobcat.h"
+#include "phx_phoenix_bobcat.h"
+#include "frm_functions.h"
+#include "plant_functions.h"
 #include "../drivers/phxdrv/picc_dio.h"
 
 /* SHK board number */
@@ -30,6 +35,8 @@ tHandle shkCamera = 0; /* Camera Handle   */
 
 /* Prototypes */
 int shk_process_image(stImageBuff *buffer,sm_t *sm_p);
+void shk_roi_beam(shkroi_t *roi);
+void shk_roi_set(shkroi_t *roi);
 float BOBCAT_GetTemp(tHandle hCamera);
 
 /**************************************************************/
@@ -64,9 +71,14 @@ typedef struct {
 /*  - Exposure ISR callback function                          */
 /**************************************************************/
 static void shk_callback( tHandle shkCamera, ui32 dwInterruptMask, void *pvParams ) {
+  //Count frames the grabber could not deliver
+  if ( dwInterruptMask & (PHX_INTRPT_FRAME_LOST | PHX_INTRPT_FIFO_OVERFLOW) )
+    frm_lost(((tContext *)pvParams)->sm_p,SHKID);
+  
   if ( dwInterruptMask & PHX_INTRPT_BUFFER_READY ) {
     stImageBuff stBuffer;
     tContext *aContext = (tContext *)pvParams;
+    ui32 frame_count = 0;
     //Set DIO bit C1
     #if PICC_DIO_ENABLE
     outb(0x02,PICC_DIO_BASE+PICC_DIO_PORTC);
@@ -74,9 +86,13 @@ static void shk_callback( tHandle shkCamera, ui32 dwInterruptMask, void *pvParam
     
     etStat eStat = PHX_StreamRead( shkCamera, PHX_BUFFER_GET, &stBuffer );
     if ( PHX_OK == eStat ) {
+      //Hardware frame counter
+      PHX_ParameterGet( shkCamera, PHX_EVENTCOUNT, &frame_count );
+      frm_arrive(aContext->sm_p,SHKID,frame_count);
       //Process image
       if(shk_process_image(&stBuffer,aContext->sm_p)){
-	printf("SHK: shk_process_image error!\n");
+	frm_skip(aContext->sm_p,SHKID,FRM_SKIP_ERROR);
+	log_msg(LOG_LVL_ERROR,"SHK: shk_process_image error!\n");
 	//can't call shkctrlC from here. ask to be restarted.
 	aContext->sm_p->w[SHKID].res=1;
 	sleep(5);
@@ -85,6 +101,8 @@ static void shk_callback( tHandle shkCamera, ui32 dwInterruptMask, void *pvParam
       #if PICC_DIO_ENABLE
       outb(0x00,PICC_DIO_BASE+PICC_DIO_PORTC);
       #endif
+      //Frame accounting
+      frm_done(aContext->sm_p,SHKID,aContext->sm_p->shk_frmtime);
       //Check in with watchdog
       checkin(aContext->sm_p,SHKID);
     }
@@ -106,6 +124,9 @@ int shk_proc(void){
   ui64 dwParamValue;
   etParamValue roiWidth, roiHeight, bufferWidth, bufferHeight;
   int camera_running = 0;
+  int camroi_set = 0;
+  shkroi_t roi;
+  region camroi;
    
   /* Open Shared Memory */
   sm_t *sm_p;
@@ -114,9 +135,30 @@ int shk_proc(void){
     shkctrlC(0);
   }
 
+  /* Attach to event log ring */
+  log_attach(sm_p,SHKID);
+
   /* Set soft interrupt handler */
   sigset(SIGINT, shkctrlC);	/* usually ^C */
 
+#ifdef PLANT_SIM
+  /* Simulated camera: frames come from the optical plant */
+  while(1){
+    checkin(sm_p,SHKID);
+    roi.xoff = 0;
+    roi.yoff = 0;
+    roi.xs   = SHKXS;
+    roi.ys   = SHKYS;
+    if(sm_p->shk_roimode)
+      shk_roi_beam(&roi);
+    shk_roi_set(&roi);
+    memcpy((shkroi_t *)&sm_p->shk_roi,&roi,sizeof(shkroi_t));
+    plant_camera(sm_p,SHKID);
+    if(sm_p->w[SHKID].die)
+      shkctrlC(0);
+  }
+#endif
+
   /* Set up context for callback */
   memset( &shkContext, 0, sizeof( tContext ) );
   shkContext.sm_p = sm_p;
@@ -157,6 +199,18 @@ int shk_proc(void){
     shkctrlC(0);
   }
 
+  /* Count frames in hardware and interrupt on lost frames */
+  eParamValue = PHX_EVENTCOUNT_FRAME;
+  eStat = PHX_ParameterSet( shkCamera, PHX_EVENTCOUNT_SRC, &eParamValue );
+  if ( PHX_OK != eStat )
+    printf("SHK: Error PHX_ParameterSet --> PHX_EVENTCOUNT_SRC\n");
+  eStat = PHX_ParameterGet( shkCamera, PHX_INTRPT_SET, &eParamValue );
+  eParamValue |= PHX_INTRPT_FRAME_LOST | PHX_INTRPT_FIFO_OVERFLOW;
+  if ( PHX_OK == eStat )
+    eStat = PHX_ParameterSet( shkCamera, PHX_INTRPT_SET, &eParamValue );
+  if ( PHX_OK != eStat )
+    printf("SHK: Error PHX_ParameterSet --> PHX_INTRPT_SET\n");
+
   /* Get debugging info */
   if(SHK_DEBUG){
     eStat = PHX_ParameterGet( shkCamera, PHX_ROI_XLENGTH, &roiWidth );
@@ -187,6 +241,47 @@ int shk_proc(void){
     }
     camera_running = 0;
     printf("SHK: Camera stopped\n");
+
+    /* Set readout window */
+    roi.xoff = 0;
+    roi.yoff = 0;
+    roi.xs   = SHKXS;
+    roi.ys   = SHKYS;
+    if(sm_p->shk_roimode){
+      //Window the camera around the beam
+      shk_roi_beam(&roi);
+      camroi.x_offset  = roi.xoff;
+      camroi.y_offset  = roi.yoff;
+      camroi.x_length  = roi.xs;
+      camroi.y_length  = roi.ys;
+      camroi.x_binning = BOBCAT_BINNING_2X;
+      camroi.y_binning = BOBCAT_BINNING_2X;
+      eStat = PHX_BOBCAT_Configure( shkCamera, PHX_BOBCAT_ROI, &camroi );
+      if ( PHX_OK != eStat ){
+	printf("SHK: PHX_BOBCAT_Configure --> PHX_BOBCAT_ROI\n");
+	shkctrlC(0);
+      }
+      camroi_set = 1;
+    }
+    else if(camroi_set){
+      //Full frame geometry is defined by the config file
+      eStat = CONFIG_RunFile( shkCamera, configFileName );
+      if ( PHX_OK != eStat ){
+	printf("SHK: Error CONFIG_RunFile\n");
+	shkctrlC(0);
+      }
+      //--config file resets the interrupt mask
+      eStat = PHX_ParameterGet( shkCamera, PHX_INTRPT_SET, &eParamValue );
+      eParamValue |= PHX_INTRPT_FRAME_LOST | PHX_INTRPT_FIFO_OVERFLOW;
+      if ( PHX_OK == eStat )
+	eStat = PHX_ParameterSet( shkCamera, PHX_INTRPT_SET, &eParamValue );
+      if ( PHX_OK != eStat )
+	printf("SHK: Error PHX_ParameterSet --> PHX_INTRPT_SET\n");
+      camroi_set = 0;
+    }
+    shk_roi_set(&roi);
+    memcpy((shkroi_t *)&sm_p->shk_roi,&roi,sizeof(shkroi_t));
+    printf("SHK: Setting ROI [%d, %d, %d, %d]\n",roi.xoff,roi.yoff,roi.xs,roi.ys);
       
     /* Setup exposure */
     usleep(500000);
@@ -246,6 +341,7 @@ int shk_proc(void){
       
       /* Check if camera should start */
       if(!camera_running){
+	frm_restart(sm_p,SHKID);
 	eStat = PHX_StreamRead( shkCamera, PHX_START, (void*)shk_callback );
 	if ( PHX_OK != eStat ){
 	  printf("SHK: PHX_StreamRead --> PHX_START\n");
@@ -1,5 +1,7 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
 #include <gsl/gsl_rng.h>
 #include <gsl/gsl_randist.h>
 #include <gsl/gsl_matrix.h>
@@ -171,3 +173,99 @@ int sinefit(sinefit_data_t *data, sinefit_fit_t *fit, double *guess){
 
   return status;
 }
+
+/* Linear least squares sine fit
+ *
+ * Yi = a * sin(t + p) + b = c0 * sin(t) + c1 * cos(t) + b
+ *   with c0 = a * cos(p), c1 = a * sin(p)
+ *
+ * For fixed sample phases t the solution is x = P * y, where
+ * P = (A^T A)^-1 A^T is the 3xN pseudo-inverse of A = [sin(t) cos(t) 1].
+ * P is computed once per set of sample phases.
+ */
+
+int sinefit_plan(sinefit_plan_t *plan, double *t, size_t n){
+  double ata[3][3]={{0}},inv[3][3];
+  double row[3];
+  double det,norm=0;
+  size_t i,j,k;
+
+  if(n < 3 || n > SINEFIT_NMAX)
+    return 1;
+  
+  /* A^T A */
+  for(i=0;i<n;i++){
+    row[0] = sin(t[i]);
+    row[1] = cos(t[i]);
+    row[2] = 1;
+    for(j=0;j<3;j++)
+      for(k=0;k<3;k++)
+	ata[j][k] += row[j]*row[k];
+  }
+  
+  /* Invert 3x3 by cofactors */
+  inv[0][0] =   ata[1][1]*ata[2][2] - ata[1][2]*ata[2][1];
+  inv[0][1] = -(ata[0][1]*ata[2][2] - ata[0][2]*ata[2][1]);
+  inv[0][2] =   ata[0][1]*ata[1][2] - ata[0][2]*ata[1][1];
+  inv[1][0] = -(ata[1][0]*ata[2][2] - ata[1][2]*ata[2][0]);
+  inv[1][1] =   ata[0][0]*ata[2][2] - ata[0][2]*ata[2][0];
+  inv[1][2] = -(ata[0][0]*ata[1][2] - ata[0][2]*ata[1][0]);
+  inv[2][0] =   ata[1][0]*ata[2][1] - ata[1][1]*ata[2][0];
+  inv[2][1] = -(ata[0][0]*ata[2][1] - ata[0][1]*ata[2][0]);
+  inv[2][2] =   ata[0][0]*ata[1][1] - ata[0][1]*ata[1][0];
+  det = ata[0][0]*inv[0][0] + ata[0][1]*inv[1][0] + ata[0][2]*inv[2][0];
+
+  /* Reject (nearly) singular sampling, e.g. all samples at one phase */
+  for(j=0;j<3;j++)
+    for(k=0;k<3;k++)
+      norm += fabs(ata[j][k]);
+  if(fabs(det) < 1e-9 * norm * norm * norm)
+    return 1;
+  
+  /* P = (A^T A)^-1 A^T */
+  for(i=0;i<n;i++){
+    row[0] = sin(t[i]);
+    row[1] = cos(t[i]);
+    row[2] = 1;
+    for(j=0;j<3;j++)
+      plan->pinv[j][i] = (inv[j][0]*row[0] + inv[j][1]*row[1] + inv[j][2]*row[2]) / det;
+    plan->t[i] = t[i];
+  }
+  plan->n = n;
+  
+  return 0;
+}
+
+void sinefit_linear(sinefit_plan_t *plan, double *y, sinefit_fit_t *fit){
+  double c0=0,c1=0,b=0;
+  size_t i;
+
+  for(i=0;i<plan->n;i++){
+    c0 += plan->pinv[0][i] * y[i];
+    c1 += plan->pinv[1][i] * y[i];
+    b  += plan->pinv[2][i] * y[i];
+  }
+  
+  fit->a = sqrt(c0*c0 + c1*c1);
+  fit->p = atan2(c1,c0);
+  fit->b = b;
+}
+
+int sinefit_fast(sinefit_data_t *data, sinefit_fit_t *fit, double *guess){
+  //Linear fit with a cached plan, falls back to sinefit() for unusable sampling
+  static sinefit_plan_t plan;
+  static int plan_ok=0;
+  
+  /* Rebuild plan if the sample phases changed */
+  if(!plan_ok || plan.n != data->n || memcmp(plan.t,data->t,data->n*sizeof(double))){
+    plan_ok = 0;
+    if(sinefit_plan(&plan,data->t,data->n)){
+      if(DEBUG) fprintf(stderr,"sinefit_fast: using nonlinear fit\n");
+      return sinefit(data,fit,guess);
+    }
+    plan_ok = 1;
+  }
+
+  sinefit_linear(&plan,data->y,fit);
+  return 0;
+}
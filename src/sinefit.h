@@ -10,4 +10,15 @@ typedef struct sinefit_fit {
   double b;
 } sinefit_fit_t;
 
+#define SINEFIT_NMAX 64
+
+typedef struct sinefit_plan {
+  size_t n;
+  double t[SINEFIT_NMAX];
+  double pinv[3][SINEFIT_NMAX];
+} sinefit_plan_t;
+
 int sinefit(sinefit_data_t *data,sinefit_fit_t *fit, double *guess);
+int sinefit_plan(sinefit_plan_t *plan, double *t, size_t n);
+void sinefit_linear(sinefit_plan_t *plan, double *y, sinefit_fit_t *fit);
+int sinefit_fast(sinefit_data_t *data,sinefit_fit_t *fit, double *guess);
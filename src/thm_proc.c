@@ -17,29 +17,11 @@
 /* piccflight headers */
 #include "controller.h"
 #include "common_functions.h"
-#include "dscud.h"
+#include "adc_functions.h"
+#include "htr_functions.h"
 #include "../drivers/phxdrv/picc_dio.h"
 #include <libhdc.h>
 
-/* settings */
-#define MAX_AD_OFFSET   2
-#define MAX_AD_GAIN     2
-#define AD_CONFIG_MODE  3
-#define AD_RANGE_CODE   3    
-#define HTR_NSTEPS      100  //Heater resolution (0-100%)
-#define HTR_NCYCLES     10   //Number of heater output cycles
-#define ADC_NAVG        10   //Number of temperature reads to average
-#define ADC_VREF_SENSOR 15
-
-
-/* temperature conversion */
-#define VREF_DEFAULT    5.0     //volts
-#define ADC1_R1         1000.0  //ohms
-#define ADC2_R1         2000.0  //ohms
-#define ADC3_R1         2000.0  //ohms
-#define RTD_ALPHA       0.00385 //ohms/ohms/degC
-#define RTD_OHMS        100.0   //ohms
-
 /* Process File Descriptors */
 int thm_shmfd;
 int thm_humfd;
@@ -48,10 +30,9 @@ int thm_humfd;
 void thmctrlC(int sig)
 {
   //turn off all heaters
-  if(HTR_ENABLE){
-    outb(0xFF,SSR_BASE+0);
-    outb(0xFF,SSR_BASE+4);
-  }
+  if(HTR_ENABLE) htr_port(0);
+  //stop ADC acquisition
+  adc_cleanup();
   //cleanup humidity sensors
   hdc_cleanup(thm_humfd);
   //cleanup cpu sensors
@@ -113,14 +94,9 @@ void thm_proc(void){
   static struct timespec start, end;
   static int init = 0;
   static unsigned long count=0;
-  double resistance;              // calculated RTD resistance
-  double vref;                    // calculated using the reference resistor RTD_OHMS
-  uint16_t htr_command;           // heater command word
-  unsigned char htr_lsb=0,htr_msb=0;
-  const long htr_sleep = ONE_MILLION / HTR_NSTEPS / HTR_NCYCLES; //us
-  int i, j, k, iavg, dev;
+  int i, dev, retval, adc_ready;
   static int pulse_index[HTR_NSTEPS];
-  int htr_pulse[SSR_NCHAN][HTR_NSTEPS];
+  htrsched_t htr_sched;
   int state;
   char hum_device[128];
   double delta,tdir;
@@ -142,18 +118,6 @@ void thm_proc(void){
   int chip_nr=0;
   double cpuval;
 
-  //DSCUD Variables
-  BYTE result;                    // returned error code
-  DSCB board1, board2, board3;    // handle used to refer to the board
-  ERRPARAMS errorParams;          // structure for returning error code and error string
-  DSCSAMPLE samples1[ADC1_NCHAN]; // digital readings
-  DSCSAMPLE samples2[ADC2_NCHAN]; // digital readings
-  DSCSAMPLE samples3[ADC3_NCHAN]; // digital readings
-  DFLOAT voltage;                 // voltage value
-  DFLOAT voltage1[ADC1_NCHAN];    // voltage values
-  DFLOAT voltage2[ADC2_NCHAN];    // voltage values
-  DFLOAT voltage3[ADC3_NCHAN];    // voltage values
-
   /* Initialize */
   if(!init){
     memset(&thmevent,0,sizeof(thmevent));
@@ -212,200 +176,12 @@ void thm_proc(void){
     }
   }
   
-  /* Define structures containing board settings */
-  DSCCB dsccb1 = {
-    .base_address = ADC1_BASE,
-    .int_level = 5
-  };
-  DSCCB dsccb2 = {
-    .base_address = ADC2_BASE,
-    .int_level = 5
-  };
-  DSCCB dsccb3 = {
-    .base_address = ADC3_BASE,
-    .int_level = 5
-  };
-
-  /* Define structure containing A/D conversion settings */
-  DSCADSETTINGS dscadsettings1 = {
-    .range = RANGE_5,
-    .polarity = BIPOLAR,
-    .gain = GAIN_8,
-    .load_cal = (BYTE)TRUE,
-    .current_channel = 0,
-    .scan_interval = SCAN_INTERVAL_10 // allows the channel switching to be 10 microseconds
-  };
-  DSCADSETTINGS dscadsettings2 = {
-    .range = RANGE_5,
-    .polarity = BIPOLAR,
-    .gain = GAIN_8,
-    .load_cal = (BYTE)TRUE,
-    .current_channel = 0,
-    .scan_interval = SCAN_INTERVAL_10 // allows the channel switching to be 10 microseconds
-  };
-  DSCADSETTINGS dscadsettings3 = {
-    .range = RANGE_5,
-    .polarity = BIPOLAR,
-    .gain = GAIN_8,
-    .load_cal = (BYTE)TRUE,
-    .current_channel = 0,
-    .scan_interval = SCAN_INTERVAL_10 // allows the channel switching to be 10 microseconds
-  };
-
-
-  /* Define structure containing A/D scan settings */
-  DSCADSCAN dscadscan1 = {
-    .low_channel = 0, 
-    .high_channel = ADC1_NCHAN-1,
-    .gain = dscadsettings1.gain
-  };
-  DSCADSCAN dscadscan2 = {
-    .low_channel = 0, 
-    .high_channel = ADC2_NCHAN-1,
-    .gain = dscadsettings2.gain
-  };
-  DSCADSCAN dscadscan3 = {
-    .low_channel = 0, 
-    .high_channel = ADC3_NCHAN-1,
-    .gain = dscadsettings3.gain
-  };
-
-  
-  /* Define structure containing auto-calibration settings */
-  DSCAUTOCAL dscautocal1 = {
-    .adrange = AD_RANGE_CODE, // see page 42
-    .boot_adrange = AD_RANGE_CODE // see page 42
-  };
-  DSCAUTOCAL dscautocal2 = {
-    .adrange = AD_RANGE_CODE, // see page 42
-    .boot_adrange = AD_RANGE_CODE // see page 42
-  };
-  DSCAUTOCAL dscautocal3 = {
-    .adrange = AD_RANGE_CODE, // see page 42
-    .boot_adrange = AD_RANGE_CODE // see page 42
-  };
-
-  
-  
-  //=========================================================================
-  // LIBRARY INITIALIZATION
-  //=========================================================================
-  if(dscInit(DSC_VERSION) != DE_NONE) {
-    dscGetLastError(&errorParams);
-    fprintf(stderr, "dscInit error: %s %s\n", dscGetErrorString(errorParams.ErrCode), errorParams.errstring);
-    thmctrlC(0);
-  }
-  
-  //=========================================================================
-  // BOARD 1 CONFIGURATION
-  //=========================================================================
-  #if PICC_DIO_ENABLE == 0
-  //-- Init Board
-  if(dscInitBoard(DSC_DMM32X, &dsccb1, &board1) != DE_NONE) {
-    dscGetLastError(&errorParams);
-    fprintf(stderr, "THM: Board 1 dscInitBoard error: %s %s\n", dscGetErrorString(errorParams.ErrCode), errorParams.errstring);
+  /* Init ADC boards and start acquisition */
+  if(adc_init()){
+    printf("THM: adc_init failed\n");
     thmctrlC(0);
   }
-  //-- ADC Settings
-  if((result = dscADSetSettings(board1, &dscadsettings1)) != DE_NONE) {
-    dscGetLastError(&errorParams);
-    fprintf(stderr, "THM: Board 1 dscADSetSettings error: %s %s\n", dscGetErrorString(errorParams.ErrCode), errorParams.errstring);
-    thmctrlC(0);
-  }
-  //-- Auto Calibration Settings
-  if(dscADAutoCal(board1, &dscautocal1) != DE_NONE) {
-    dscGetLastError(&errorParams);
-    fprintf(stderr, "THM: Board 1 dscADAutoCal error: %s %s\n", dscGetErrorString(errorParams.ErrCode), errorParams.errstring);
-    thmctrlC(0);
-  }
-  //-- Verify Auto Calibration
-  if((result = dscADCalVerify(board1, &dscautocal1)) != DE_NONE) {
-    dscGetLastError(&errorParams);
-    fprintf(stderr, "THM: Board 1 dscADCalVerify error: %s %s\n", dscGetErrorString(errorParams.ErrCode), errorParams.errstring);
-    thmctrlC(0);
-  }
-  if((fabs(dscautocal1.ad_offset) > MAX_AD_OFFSET) || (fabs(dscautocal1.ad_gain) > MAX_AD_GAIN)){
-    fprintf(stderr, "THM: Board 1 Configuration Mode: %d, Offset Error: %9.3f, Gain Error: %9.3f\n", AD_CONFIG_MODE, dscautocal1.ad_offset, dscautocal1.ad_gain);
-    fprintf(stderr, "THM: Board 1 values for offset or gain exceeded specified tolerance\n" );
-    thmctrlC(0);
-  }
-  //-- Check in with watchdog
   checkin(sm_p,THMID);
-  #else
-  printf("THM: ADC Board 1 disabled for PICC_DIO\n");
-  #endif
-
-  //=========================================================================
-  // BOARD 2 CONFIGURATION
-  //=========================================================================
-  //-- Init Board
-  if(dscInitBoard(DSC_DMM32X, &dsccb2, &board2) != DE_NONE) {
-    dscGetLastError(&errorParams);
-    fprintf(stderr, "THM: Board 2 dscInitBoard error: %s %s\n", dscGetErrorString(errorParams.ErrCode), errorParams.errstring);
-    thmctrlC(0);
-  }
-  //-- ADC Settings
-  if((result = dscADSetSettings(board2, &dscadsettings2)) != DE_NONE) {
-    dscGetLastError(&errorParams);
-    fprintf(stderr, "THM: Board 2 dscADSetSettings error: %s %s\n", dscGetErrorString(errorParams.ErrCode), errorParams.errstring);
-    thmctrlC(0);
-  }
-  //-- Auto Calibration Settings
-  if(dscADAutoCal(board2, &dscautocal2) != DE_NONE) {
-    dscGetLastError(&errorParams);
-    fprintf(stderr, "THM: Board 2 dscADAutoCal error: %s %s\n", dscGetErrorString(errorParams.ErrCode), errorParams.errstring);
-    thmctrlC(0);
-  }
-  //-- Verify Auto Calibration
-  if((result = dscADCalVerify(board2, &dscautocal2)) != DE_NONE) {
-    dscGetLastError(&errorParams);
-    fprintf(stderr, "THM: Board 2 dscADCalVerify error: %s %s\n", dscGetErrorString(errorParams.ErrCode), errorParams.errstring);
-    thmctrlC(0);
-  }
-  if((fabs(dscautocal2.ad_offset) > MAX_AD_OFFSET) || (fabs(dscautocal2.ad_gain) > MAX_AD_GAIN)){
-    fprintf(stderr, "THM: Board 2 Configuration Mode: %d, Offset Error: %9.3f, Gain Error: %9.3f\n", AD_CONFIG_MODE, dscautocal2.ad_offset, dscautocal2.ad_gain);
-    fprintf(stderr, "THM: Board 2 values for offset or gain exceeded specified tolerance\n" );
-    thmctrlC(0);
-  }
-  //-- Check in with watchdog
-  checkin(sm_p,THMID);
-
-  //=========================================================================
-  // BOARD 3 CONFIGURATION
-  //=========================================================================
-  //-- Init Board
-  if(dscInitBoard(DSC_DMM32X, &dsccb3, &board3) != DE_NONE) {
-    dscGetLastError(&errorParams);
-    fprintf(stderr, "THM: Board 3 dscInitBoard error: %s %s\n", dscGetErrorString(errorParams.ErrCode), errorParams.errstring);
-    thmctrlC(0);
-  }
-  //-- ADC Settings
-  if((result = dscADSetSettings(board3, &dscadsettings3)) != DE_NONE) {
-    dscGetLastError(&errorParams);
-    fprintf(stderr, "THM: Board 3 dscADSetSettings error: %s %s\n", dscGetErrorString(errorParams.ErrCode), errorParams.errstring);
-    thmctrlC(0);
-  }
-  //-- Auto Calibration Settings
-  if(dscADAutoCal(board3, &dscautocal3) != DE_NONE) {
-    dscGetLastError(&errorParams);
-    fprintf(stderr, "THM: Board 3 dscADAutoCal error: %s %s\n", dscGetErrorString(errorParams.ErrCode), errorParams.errstring);
-    thmctrlC(0);
-  }
-  //-- Verify Auto Calibration
-  if((result = dscADCalVerify(board3, &dscautocal3)) != DE_NONE) {
-    dscGetLastError(&errorParams);
-    fprintf(stderr, "THM: Board 3 dscADCalVerify error: %s %s\n", dscGetErrorString(errorParams.ErrCode), errorParams.errstring);
-    thmctrlC(0);
-  }
-  if((fabs(dscautocal3.ad_offset) > MAX_AD_OFFSET) || (fabs(dscautocal3.ad_gain) > MAX_AD_GAIN)){
-    fprintf(stderr, "THM: Board 3 Configuration Mode: %d, Offset Error: %9.3f, Gain Error: %9.3f\n", AD_CONFIG_MODE, dscautocal3.ad_offset, dscautocal3.ad_gain);
-    fprintf(stderr, "THM: Board 3 values for offset or gain exceeded specified tolerance\n" );
-    thmctrlC(0);
-  }
-  //-- Check in with watchdog
-  checkin(sm_p,THMID);
-  printf("THM: 3 ADC Boards Initialized\n");
-
 
   //=========================================================================
   // BEGIN MAIN LOOP
@@ -435,90 +211,10 @@ void thm_proc(void){
     thmevent.hed.start_sec     = start.tv_sec;
     thmevent.hed.start_nsec    = start.tv_nsec;
 
-    //Init VREF
-    vref = VREF_DEFAULT;
-    
-    //=========================================================================
-    // SCANNING AND OUTPUT
-    // Perform the actual sampling and then output the results.
-    // To calculate the voltages, convert the sample code (cast as short)
-    // and then plug it into one of the formulas located in the manual for
-    // your board (under "A/D Conversion Formulas"). 
-    //=========================================================================
-
-    //Run through averaging loop
-    for(iavg=0;iavg<ADC_NAVG;iavg++){
-      //Board ADC1
-      #if PICC_DIO_ENABLE == 0
-      if((result = dscADScan(board1, &dscadscan1, samples1 )) != DE_NONE){
-	dscGetLastError(&errorParams);
-	fprintf(stderr, "THM: Board ADC1 dscADScan error: %s %s\n", dscGetErrorString(errorParams.ErrCode), errorParams.errstring);
-	thmctrlC(0);
-      }       
-      for(i = 0; i < ADC1_NCHAN; i++){
-	if(dscADCodeToVoltage(board1, dscadsettings1, dscadscan1.sample_values[i], &voltage) != DE_NONE) {
-	  dscGetLastError(&errorParams);
-	  fprintf(stderr, "THM: Board ADC1 dscADCodeToVoltage error: %s %s\n", dscGetErrorString(errorParams.ErrCode), errorParams.errstring);
-	  fprintf(stderr, "THM: Gain = %d\n",dscadsettings1.gain);
-	  thmctrlC(0);
-	}
-	if(iavg == 0) voltage1[i] = 0; //reset voltages to zero for averaging
-	voltage1[i] += voltage/ADC_NAVG;
-      }
-      //Get reference voltage
-      if(sm_p->thm_enable_vref) vref = voltage1[ADC_VREF_SENSOR]*(ADC1_R1+RTD_OHMS)/RTD_OHMS;
-      #endif
-    
-      //Board ADC2
-      if((result = dscADScan(board2, &dscadscan2, samples2 )) != DE_NONE){
-	dscGetLastError(&errorParams);
-	fprintf(stderr, "THM: Board ADC2 dscADScan error: %s %s\n", dscGetErrorString(errorParams.ErrCode), errorParams.errstring);
-	thmctrlC(0);
-      }
-      for(i = 0; i < ADC2_NCHAN; i++){
-	if(dscADCodeToVoltage(board2, dscadsettings2, dscadscan2.sample_values[i], &voltage) != DE_NONE) {
-	  dscGetLastError(&errorParams);
-	  fprintf(stderr, "THM: Board ADC2 dscADCodeToVoltage error: %s %s\n", dscGetErrorString(errorParams.ErrCode), errorParams.errstring);
-	  fprintf(stderr, "THM: Gain = %d\n",dscadsettings2.gain);
-	  thmctrlC(0);
-	}
-	if(iavg == 0) voltage2[i] = 0; //reset voltages to zero for averaging
-	voltage2[i] += voltage/ADC_NAVG;
-      }
-
-      //Board ADC3
-      if((result = dscADScan(board3, &dscadscan3, samples3 )) != DE_NONE){
-	dscGetLastError(&errorParams);
-	fprintf(stderr, "THM: Board ADC3 dscADScan error: %s %s\n", dscGetErrorString(errorParams.ErrCode), errorParams.errstring);
-	thmctrlC(0);
-      }
-      for(i = 0; i < ADC3_NCHAN; i++){
-	if(dscADCodeToVoltage(board3, dscadsettings3, dscadscan3.sample_values[i], &voltage) != DE_NONE) {
-	  dscGetLastError(&errorParams);
-	  fprintf(stderr, "THM: Board ADC3 dscADCodeToVoltage error: %s %s\n", dscGetErrorString(errorParams.ErrCode), errorParams.errstring);
-	  fprintf(stderr, "THM: Gain = %d\n",dscadsettings3.gain);
-	  thmctrlC(0);
-	}
-	if(iavg == 0) voltage3[i] = 0; //reset voltages to zero for averaging
-	voltage3[i] += voltage/ADC_NAVG;
-      }
-    }
-    
-    /* Convert voltage to temperature */
-    for(i = 0; i < ADC1_NCHAN; i++){
-      resistance = (voltage1[i] * ADC1_R1) / (vref - voltage1[i]);
-      thmevent.adc1_temp[i] = (resistance - RTD_OHMS) / (RTD_ALPHA * RTD_OHMS);
-      if(i==ADC_VREF_SENSOR) thmevent.adc1_temp[i] = vref;
-    }
-    for(i = 0; i < ADC2_NCHAN; i++){
-      resistance = (voltage2[i] * ADC2_R1) / (vref - voltage2[i]);
-      thmevent.adc2_temp[i] = (resistance - RTD_OHMS) / (RTD_ALPHA * RTD_OHMS);
-    }
-    for(i = 0; i < ADC3_NCHAN; i++){
-      resistance = (voltage3[i] * ADC3_R1) / (vref - voltage3[i]);
-      thmevent.adc3_temp[i] = (resistance - RTD_OHMS) / (RTD_ALPHA * RTD_OHMS);
-    }
-    
+    /* Read temperatures from the ADC scan buffers */
+    if((retval = adc_read(&thmevent,sm_p->thm_enable_vref)) > 0)
+      thmctrlC(0);
+    adc_ready = (retval == 0); //buffers still filling after a (re)start
 
     /* Read humidity sensors */
     if(thm_humfd >= 0){
@@ -582,7 +278,7 @@ void thm_proc(void){
 	  
     
     /* Run Temperature Control */
-    for(i=0;i<SSR_NCHAN;i++){
+    for(i=0;i<SSR_NCHAN && adc_ready;i++){
       if(!thmevent.htr[i].override){
 	//Get temperature error
 	delta = thmevent.htr[i].setpoint - thmevent.htr[i].temp;
@@ -628,39 +324,14 @@ void thm_proc(void){
       power[i] = power[i] > thmevent.htr[i].maxpower ? thmevent.htr[i].maxpower : power[i];
       power[i] = power[i] < 0 ? 0 : power[i];
       power[i] = power[i] > HTR_POWER_MAX ? HTR_POWER_MAX : power[i];
-      thmevent.htr[i].power = lround(power[i]);
+      thmevent.htr[i].power = adc_ready ? lround(power[i]) : 0; //heaters off until temperatures are valid
     }
     
-    /* Fill out heater pulses */
-    memset(htr_pulse,0,sizeof(htr_pulse));
-    for(i=0;i<SSR_NCHAN;i++)
-      for(j=0;j<thmevent.htr[i].power;j++)
-	htr_pulse[i][pulse_index[j]] = 1;
-	
     /* Command heaters */
     if(HTR_ENABLE){
-      for(i=0;i<HTR_NCYCLES;i++){
-	for(j=0;j<HTR_NSTEPS;j++){
-	  htr_command = 0;
-	  for(k=0;k<SSR_NCHAN;k++){
-	    htr_command |= htr_pulse[k][j] << k;
-	  }
-	
-	  //htr_command: 1 = ON,  0 = OFF
-	  //SRR Board:   1 = OFF, 0 = ON
-	  //Take ones complement of htr_command
-	  //Seperate LSB and MSB
-	  //Send to board
-	  htr_lsb = ~htr_command & 0x00FF;
-	  htr_msb = (~htr_command & 0xFF00) >> 8;
-	  outb(htr_lsb,SSR_BASE+0);
-	  outb(htr_msb,SSR_BASE+4);
-	
-	  //sleep
-	  usleep(htr_sleep);
-	}
-      }
-      if(THM_DEBUG) printf("THM: MSB: 0x%2.2x  LSB: 0x%2.2x\n",htr_msb,htr_lsb);
+      htr_schedule(&htr_sched,thmevent.htr,pulse_index);
+      htr_run(sm_p,&htr_sched,thmevent.htr);
+      if(THM_DEBUG) printf("THM: PWM edges: %d  wakeups: %u  duty error: %.2f%%\n",htr_sched.nedge,sm_p->htr_nwake,sm_p->htr_duty_error);
     }
     
     /* Copy values back to shared memory */
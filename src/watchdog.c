@@ -14,6 +14,12 @@
 #include <sys/sem.h>
 #include <sys/io.h>
 #include <sys/prctl.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+#include <stdint.h>
+#include <time.h>
 #include <dm7820_library.h>
 #include <libbmc.h>
 
@@ -27,6 +33,12 @@
 #include "hex_functions.h"
 #include "thm_functions.h"
 #include "fakemodes.h"
+#include "numeric.h"
+#include "calstore.h"
+#include "calsnap.h"
+#include "log_functions.h"
+#include "scr_functions.h"
+#include "plant_functions.h"
 
 /* STDIN file descriptor */
 #define STDIN 0
@@ -48,49 +60,72 @@ extern void mtr_proc(void); //motor controller
 extern void thm_proc(void); //thermal controller
 extern void msg_proc(void); //message capture
 extern void dia_proc(void); //diagnostic program
+extern void hex_proc(void); //hexapod motion engine
 
-/* Kill Process */
-void kill_proc(sm_t *sm_p,int id){
-  char rmmod[100] = "modprobe -r ";
-  int i;
-  int keep_going=1;
+/* pidfd_open syscall number for older headers */
+#ifndef __NR_pidfd_open
+#define __NR_pidfd_open 434
+#endif
 
-  if(WAT_DEBUG) printf("WAT: killing: %s\n",sm_p->w[id].name);
-  keep_going=1;
-  if(sm_p->w[id].ask){
-    //ask process to die
-    sm_p->w[id].die=1;
-    //wait for process to exit
-    if(!procwait(sm_p->w[id].pid,PROC_TIMEOUT)){
-      if(WAT_DEBUG) printf("WAT: unloaded: %s\n",sm_p->w[id].name);
-      keep_going=0;
-    }
-  }
-  if(keep_going){
-    //interrupt process with SIGINT
-    kill(sm_p->w[id].pid,SIGINT);
-    //wait for process to exit
-    if(procwait(sm_p->w[id].pid,PROC_TIMEOUT)){
-      //kill process with SIGKILL
-      kill(sm_p->w[id].pid,SIGKILL);
-      //wait for process to exit
-      if(procwait(sm_p->w[id].pid,PROC_TIMEOUT)){
-	printf(WARNING);
-	printf("WAT: could not kill %s!\n",sm_p->w[id].name);
-      }
-      else{
-	printf("WAT: unloaded with SIGKILL: %s\n",sm_p->w[id].name);
-      }
-    }
-    else{
-      if(WAT_DEBUG) printf("WAT: unloaded with SIGINT: %s\n",sm_p->w[id].name);
-    }
-  }
+/* Supervision event types (epoll data = type << 8 | process id) */
+enum watevents {WAT_EV_SIGNAL, WAT_EV_TICK, WAT_EV_PID, WAT_EV_TIMER};
+#define WAT_EVENT(type,id) (((type) << 8) | (id))
 
-  //setup for next time
-  sm_p->w[id].pid = -1;
+/* Termination stages */
+enum watstages {WAT_STAGE_RUN, WAT_STAGE_ASK, WAT_STAGE_INT, WAT_STAGE_KILL};
+
+/* Supervision state -- only valid inside wat_proc */
+static int      wat_supervisor=0;    //set in wat_proc
+static int      wat_epfd=-1;         //epoll instance
+static int      wat_sigfd=-1;        //SIGCHLD signalfd
+static int      wat_tickfd=-1;       //control tick timerfd
+static int      wat_pidfd[NCLIENTS]; //process pidfds (-1 = none)
+static int      wat_timfd[NCLIENTS]; //checkin and kill deadline timerfds
+static int      wat_stage[NCLIENTS]; //termination stage
+static double   wat_tstart[NCLIENTS];//launch time
+static sigset_t wat_sigmask;         //signal mask before blocking SIGCHLD
+
+/**************************************************************/
+/* WAT_NOW                                                    */
+/*  - Return current time                                     */
+/**************************************************************/
+static double wat_now(void){
+  struct timespec now;
+  double t;
+  clock_gettime(CLOCK_REALTIME,&now);
+  ts2double(&now,&t);
+  return t;
 }
 
+/**************************************************************/
+/* WAT_ARM                                                    */
+/*  - Arm timerfd with first expiration and interval [s]      */
+/**************************************************************/
+static int wat_arm(int fd, double value, double interval){
+  struct itimerspec its;
+  its.it_value.tv_sec     = (time_t)value;
+  its.it_value.tv_nsec    = (long)((value - its.it_value.tv_sec)*ONE_BILLION);
+  its.it_interval.tv_sec  = (time_t)interval;
+  its.it_interval.tv_nsec = (long)((interval - its.it_interval.tv_sec)*ONE_BILLION);
+  return timerfd_settime(fd,0,&its,NULL);
+}
+
+/**************************************************************/
+/* WAT_CLOSEFDS                                               */
+/*  - Release supervision resources in a launched child       */
+/**************************************************************/
+static void wat_closefds(void){
+  int i;
+  for(i=0;i<NCLIENTS;i++){
+    if(wat_pidfd[i] >= 0) close(wat_pidfd[i]);
+    if(wat_timfd[i] >= 0) close(wat_timfd[i]);
+  }
+  close(wat_tickfd);
+  close(wat_sigfd);
+  close(wat_epfd);
+  sigprocmask(SIG_SETMASK,&wat_sigmask,NULL);
+  wat_supervisor = 0;
+}
 
 /* Launch Process */
 void launch_proc(sm_t *sm_p,int id){
@@ -125,6 +160,8 @@ void launch_proc(sm_t *sm_p,int id){
   }
   else{
     //we are the child
+    //--drop the supervisor's descriptors and signal mask
+    if(wat_supervisor) wat_closefds();
     //--set the process name (as shown in top)
     prctl(PR_SET_NAME, (unsigned long)procname, 0, 0, 0);
     //--launch the process routine
@@ -134,13 +171,249 @@ void launch_proc(sm_t *sm_p,int id){
   }
 }
 
+/**************************************************************/
+/* WAT_LAUNCH                                                 */
+/*  - Launch process and start watching it                    */
+/**************************************************************/
+static void wat_launch(sm_t *sm_p,int id){
+  struct epoll_event ev;
+  double t;
+
+  launch_proc(sm_p,id);
+  if(sm_p->w[id].pid < 0){
+    sm_p->w[id].pid = -1;
+    return;
+  }
+  t = wat_now();
+  wat_tstart[id] = t;
+  wat_stage[id]  = WAT_STAGE_RUN;
+  sm_p->w[id].nstart++;
+
+  //Restart statistics
+  if(sm_p->w[id].tdown > 0){
+    sm_p->w[id].restart_last = t - sm_p->w[id].tdown;
+    if(sm_p->w[id].restart_last > sm_p->w[id].restart_max)
+      sm_p->w[id].restart_max = sm_p->w[id].restart_last;
+    sm_p->w[id].restart_sum += sm_p->w[id].restart_last;
+    sm_p->w[id].nrestart++;
+    sm_p->w[id].tdown = 0;
+  }
+
+  //Watch for exit -- without pidfd support the SIGCHLD signalfd reaps
+  if((wat_pidfd[id] = syscall(__NR_pidfd_open,sm_p->w[id].pid,0)) >= 0){
+    ev.events   = EPOLLIN;
+    ev.data.u32 = WAT_EVENT(WAT_EV_PID,id);
+    if(epoll_ctl(wat_epfd,EPOLL_CTL_ADD,wat_pidfd[id],&ev)){
+      perror("WAT: epoll_ctl (pidfd)");
+      close(wat_pidfd[id]);
+      wat_pidfd[id] = -1;
+    }
+  }
+
+  //Start checkin timer
+  if(wat_arm(wat_timfd[id],sm_p->w[id].per,sm_p->w[id].per))
+    perror("WAT: timerfd_settime");
+}
+
+/**************************************************************/
+/* WAT_KILL                                                   */
+/*  - Start asking a process to exit                          */
+/*  - Escalates to SIGINT then SIGKILL on the deadline timer  */
+/**************************************************************/
+static void wat_kill(sm_t *sm_p,int id){
+  if(sm_p->w[id].pid == -1 || wat_stage[id] != WAT_STAGE_RUN) return;
+  if(WAT_DEBUG) printf("WAT: killing: %s\n",sm_p->w[id].name);
+  if(sm_p->w[id].tdown == 0) sm_p->w[id].tdown = wat_now();
+  if(sm_p->w[id].ask){
+    //ask process to die
+    sm_p->w[id].die = 1;
+    wat_stage[id] = WAT_STAGE_ASK;
+  }
+  else{
+    //interrupt process with SIGINT
+    kill(sm_p->w[id].pid,SIGINT);
+    wat_stage[id] = WAT_STAGE_INT;
+  }
+  wat_arm(wat_timfd[id],PROC_TIMEOUT,0);
+}
+
+/**************************************************************/
+/* WAT_FORGET                                                 */
+/*  - Stop watching a process                                 */
+/**************************************************************/
+static void wat_forget(sm_t *sm_p,int id){
+  if(wat_pidfd[id] >= 0) close(wat_pidfd[id]);
+  wat_pidfd[id] = -1;
+  wat_arm(wat_timfd[id],0,0);
+  wat_stage[id] = WAT_STAGE_RUN;
+  sm_p->w[id].pid = -1;
+}
+
+/**************************************************************/
+/* WAT_EXIT                                                   */
+/*  - Handle a reaped process and relaunch it if needed       */
+/**************************************************************/
+static void wat_exit(sm_t *sm_p,int id,int status){
+  double t = wat_now();
+
+  if(wat_stage[id] == WAT_STAGE_RUN){
+    //unexpected exit
+    if(WIFSIGNALED(status))
+      printf("WAT: %s crashed! (signal %d)\n",sm_p->w[id].name,WTERMSIG(status));
+    else
+      printf("WAT: %s crashed! (exit %d)\n",sm_p->w[id].name,WEXITSTATUS(status));
+    sm_p->w[id].ncrash++;
+    sm_p->w[id].tdown = t;
+  }
+  else if(wat_stage[id] == WAT_STAGE_KILL){
+    printf("WAT: unloaded with SIGKILL: %s\n",sm_p->w[id].name);
+  }
+  else{
+    if(WAT_DEBUG) printf("WAT: unloaded: %s\n",sm_p->w[id].name);
+  }
+  wat_forget(sm_p,id);
+
+  //Relaunch right away unless it is cycling faster than the holdoff
+  if(sm_p->w[id].run && sm_p->w[id].ena && !sm_p->die)
+    if(t - wat_tstart[id] >= WAT_RESTART_HOLDOFF)
+      wat_launch(sm_p,id);
+}
+
+/**************************************************************/
+/* WAT_REAP                                                   */
+/*  - Reap exited children                                    */
+/*  - id >= 0: check one process (pidfd event)                */
+/*  - id <  0: reap all exited children (SIGCHLD)             */
+/**************************************************************/
+static void wat_reap(sm_t *sm_p,int id){
+  int i,pid,status;
+  if(id >= 0){
+    if(sm_p->w[id].pid > 0)
+      if(waitpid(sm_p->w[id].pid,&status,WNOHANG) == sm_p->w[id].pid)
+	wat_exit(sm_p,id,status);
+    return;
+  }
+  while((pid = waitpid(-1,&status,WNOHANG)) > 0)
+    for(i=0;i<NCLIENTS;i++)
+      if(i != WATID && sm_p->w[i].pid == pid){
+	wat_exit(sm_p,i,status);
+	break;
+      }
+}
+
+/**************************************************************/
+/* WAT_TIMER                                                  */
+/*  - Process timer: checkin count or termination deadline    */
+/**************************************************************/
+static void wat_timer(sm_t *sm_p,int id){
+  uint64_t nexp;
+  uint32 chk;
+
+  if(read(wat_timfd[id],&nexp,sizeof(nexp)) != sizeof(nexp)) return;
+  if(sm_p->w[id].pid == -1) return;
+
+  switch(wat_stage[id]){
+  case WAT_STAGE_RUN:
+    //If loop is dead-> Increment COUNT. Else-> save checkin count and zero cnt
+    if(!sm_p->w[id].run) break;
+    chk = sm_p->w[id].chk;
+    if(chk == sm_p->w[id].rec){
+      sm_p->w[id].cnt += nexp;
+    }
+    else{
+      sm_p->w[id].rec = chk;
+      sm_p->w[id].cnt = 0;
+    }
+    if(WAT_DEBUG) printf("WAT: %s chk:rec:cnt:tmo = %d:%d:%d:%d\n",sm_p->w[id].name,sm_p->w[id].chk,sm_p->w[id].rec,sm_p->w[id].cnt,sm_p->w[id].tmo);
+    //If loop has been dead for the last tmo checks: KILL
+    if((sm_p->w[id].cnt > sm_p->w[id].tmo) && (sm_p->w[id].tmo > 0)){
+      printf("WAT: %s timeout: %d > %d\n",sm_p->w[id].name,sm_p->w[id].cnt,sm_p->w[id].tmo);
+      sm_p->w[id].ntimeout++;
+      wat_kill(sm_p,id);
+    }
+    break;
+  case WAT_STAGE_ASK:
+    //interrupt process with SIGINT
+    kill(sm_p->w[id].pid,SIGINT);
+    wat_stage[id] = WAT_STAGE_INT;
+    wat_arm(wat_timfd[id],PROC_TIMEOUT,0);
+    break;
+  case WAT_STAGE_INT:
+    //kill process with SIGKILL
+    kill(sm_p->w[id].pid,SIGKILL);
+    wat_stage[id] = WAT_STAGE_KILL;
+    wat_arm(wat_timfd[id],PROC_TIMEOUT,0);
+    break;
+  case WAT_STAGE_KILL:
+    printf(WARNING);
+    printf("WAT: could not kill %s!\n",sm_p->w[id].name);
+    wat_forget(sm_p,id);
+    break;
+  }
+}
+
+/**************************************************************/
+/* WAT_TICK                                                   */
+/*  - Act on process control flags set by commands            */
+/*  - Return 1 when shutdown is complete                      */
+/**************************************************************/
+static int wat_tick(sm_t *sm_p){
+  uint64_t nexp;
+  double t;
+  int i,alive=0;
+
+  if(read(wat_tickfd,&nexp,sizeof(nexp)) != sizeof(nexp)) return 0;
+  t = wat_now();
 
+  for(i=0;i<NCLIENTS;i++){
+    if(i == WATID) continue;
+
+    //Check process enable flags
+    if(!sm_p->w[i].ena)
+      sm_p->w[i].run=0;
+
+    //Kill everything if we've been turned off
+    if(sm_p->die){
+      if(sm_p->w[i].pid != -1){
+	wat_kill(sm_p,i);
+	alive++;
+      }
+      continue;
+    }
+
+    if(sm_p->w[i].pid == -1){
+      //If loop is not running and should be: LAUNCH
+      if(sm_p->w[i].run && (t - wat_tstart[i]) >= WAT_RESTART_HOLDOFF)
+	wat_launch(sm_p,i);
+    }
+    else{
+      //If loop is running and shouldn't be, asked to die or needs restart: KILL
+      if(!sm_p->w[i].run || sm_p->w[i].die || sm_p->w[i].res == 1)
+	wat_kill(sm_p,i);
+    }
+  }
+
+  //Save calibration snapshot once changes settle
+  if(!sm_p->die) calsnap_autosave(sm_p);
+
+  return sm_p->die && !alive;
+}
+
+/**************************************************************/
+/* WAT_PROC                                                   */
+/*  - Process supervisor                                      */
+/*  - Child exits wake the loop through pidfd and SIGCHLD     */
+/*    signalfd events and are relaunched immediately          */
+/*  - Per-process timerfds count missed checkins and enforce  */
+/*    kill deadlines, so processes are stopped concurrently   */
+/*  - A control tick picks up command flags                   */
+/**************************************************************/
 void wat_proc(void){
-  int i;
-  volatile uint32 chk;
+  struct epoll_event ev,events[WAT_MAX_EVENTS];
+  sigset_t mask;
   sm_t *sm_p;
   int shmfd;
-  int state;
+  int i,n,id,done=0;
 
   /**********************************
    *     Open shared memory
@@ -154,97 +427,81 @@ void wat_proc(void){
     exit(1);
   }
 
-
-  /* Start Watchdog */
-  while(1){
-    
-    //Check process enable flags
-    for(i=0;i<NCLIENTS;i++)
-      if(!sm_p->w[i].ena)
-	sm_p->w[i].run=0;
-
-    /*(SECTION 0): If process has died, reset its pid*/
-    for(i=0;i<NCLIENTS;i++)
-      if(i != WATID)
-	if(sm_p->w[i].pid != -1)
-	  if(waitpid(sm_p->w[i].pid,NULL,WNOHANG) == sm_p->w[i].pid){
-	    sm_p->w[i].pid = -1;
-	    printf("WAT: %s crashed!\n",sm_p->w[i].name);
-	  }
-
-    /*(SECTION 1): Kill everything if we've been turned off*/
-    if(sm_p->die){
-      for(i=0;i<NCLIENTS;i++)
-	if(i != WATID)
-	  if(sm_p->w[i].pid != -1)
-	    kill_proc(sm_p,i);
-      break;
+  /**********************************
+   *     Setup event sources
+   *********************************/
+  for(i=0;i<NCLIENTS;i++){
+    wat_pidfd[i]  = -1;
+    wat_timfd[i]  = -1;
+    wat_stage[i]  = WAT_STAGE_RUN;
+    wat_tstart[i] = 0;
+  }
+  if((wat_epfd = epoll_create1(0)) < 0){
+    perror("WAT: epoll_create1");
+    printf(WARNING);
+    close(shmfd);
+    exit(1);
+  }
+  //SIGCHLD
+  sigemptyset(&mask);
+  sigaddset(&mask,SIGCHLD);
+  sigprocmask(SIG_BLOCK,&mask,&wat_sigmask);
+  if((wat_sigfd = signalfd(-1,&mask,SFD_NONBLOCK)) < 0)
+    perror("WAT: signalfd");
+  ev.events   = EPOLLIN;
+  ev.data.u32 = WAT_EVENT(WAT_EV_SIGNAL,0);
+  if(wat_sigfd >= 0 && epoll_ctl(wat_epfd,EPOLL_CTL_ADD,wat_sigfd,&ev))
+    perror("WAT: epoll_ctl (signalfd)");
+  //Control tick
+  if((wat_tickfd = timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK)) < 0)
+    perror("WAT: timerfd_create (tick)");
+  ev.data.u32 = WAT_EVENT(WAT_EV_TICK,0);
+  if(epoll_ctl(wat_epfd,EPOLL_CTL_ADD,wat_tickfd,&ev))
+    perror("WAT: epoll_ctl (tick)");
+  wat_arm(wat_tickfd,WAT_TICK_PERIOD,WAT_TICK_PERIOD);
+  //Process timers
+  for(i=0;i<NCLIENTS;i++){
+    if(i == WATID) continue;
+    if((wat_timfd[i] = timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK)) < 0){
+      perror("WAT: timerfd_create");
+      continue;
     }
+    ev.data.u32 = WAT_EVENT(WAT_EV_TIMER,i);
+    if(epoll_ctl(wat_epfd,EPOLL_CTL_ADD,wat_timfd[i],&ev))
+      perror("WAT: epoll_ctl (timer)");
+  }
+  wat_supervisor = 1;
 
-    /*(SECTION 2): If loop has died or been dead for last LOOP_TIMEOUT checks: KILL */
-    for(i=0;i<NCLIENTS;i++)
-      if(i != WATID)
-	if(sm_p->w[i].run){
-	  if((((sm_p->w[i].cnt > sm_p->w[i].tmo) && (sm_p->w[i].tmo > 0)) || sm_p->w[i].die) && sm_p->w[i].pid != -1){
-	    printf("WAT: %s timeout: %d > %d\n",sm_p->w[i].name,sm_p->w[i].cnt,sm_p->w[i].tmo);
-	    kill_proc(sm_p,i);
-	  }
-	}
-
-    /*(SECTION 3): If loop is not running and should be: LAUNCH */
-    for(i=0;i<NCLIENTS;i++)
-      if(i != WATID)
-	if(sm_p->w[i].run)
-	  if(sm_p->w[i].pid == -1)
-	    launch_proc(sm_p,i);
-
-    /*(SECTION 4): If loop is running and shouldn't be: KILL */
-    for(i=0;i<NCLIENTS;i++)
-      if(i != WATID)
-	if(!sm_p->w[i].run)
-	  if(sm_p->w[i].pid != -1)
-	    kill_proc(sm_p,i);
-
-    /*(SECTION 5): If loop returned and needs to be restarted */
-    for(i=0;i<NCLIENTS;i++)
-      if(i != WATID)
-	if(sm_p->w[i].run)
-	  if(sm_p->w[i].pid != -1)
-	    if(sm_p->w[i].res == 1){
-	      kill_proc(sm_p,i);
-	      launch_proc(sm_p,i);
-	    }
-
-    /*(SECTION 6): If loop is dead-> Increment COUNT. Else-> save checkin count and zero cnt */
-    /* Loops will increment chk every time thru*/
-    for(i=0;i<NCLIENTS;i++){
-      if(i != WATID){
-	if(sm_p->w[i].run){
-	  chk = sm_p->w[i].chk;
-	  if((chk == sm_p->w[i].rec) && (sm_p->w[i].pid != -1)){
-	    sm_p->w[i].cnt++;
-	  }
-	  else{
-	    sm_p->w[i].rec = chk;
-	    sm_p->w[i].cnt = 0;
-	  }
-	}
-      }
+  /* Start Watchdog */
+  while(!done){
+    if((n = epoll_wait(wat_epfd,events,WAT_MAX_EVENTS,-1)) < 0){
+      if(errno != EINTR) perror("WAT: epoll_wait");
+      continue;
     }
-
-    /*(SECTION 7): Print checkin counts*/
-    if(WAT_DEBUG){
-      printf("\n");
-      for(i=0;i<NCLIENTS;i++){
-	if(i != WATID){
-	  printf("WAT: %s chk:rec:cnt:tmo = %d:%d:%d:%d\n",sm_p->w[i].name,sm_p->w[i].chk,sm_p->w[i].rec,sm_p->w[i].cnt,sm_p->w[i].tmo);
+    for(i=0;i<n;i++){
+      id = events[i].data.u32 & 0xFF;
+      switch(events[i].data.u32 >> 8){
+      case WAT_EV_SIGNAL:
+	{
+	  struct signalfd_siginfo si;
+	  while(read(wat_sigfd,&si,sizeof(si)) == sizeof(si));
 	}
+	wat_reap(sm_p,-1);
+	break;
+      case WAT_EV_PID:
+	wat_reap(sm_p,id);
+	break;
+      case WAT_EV_TIMER:
+	wat_timer(sm_p,id);
+	break;
+      case WAT_EV_TICK:
+	done = wat_tick(sm_p);
+	break;
       }
-      printf("\n");
     }
-    /*(SECTION 8): Sleep*/
-    sleep(sm_p->w[WATID].per);
   }
+
+  wat_closefds();
   close(shmfd);
   return;
 }
@@ -262,6 +519,8 @@ int main(int argc,char **argv){
   DM7820_Board_Descriptor* p_rtd_tlm_board;
   int irq;
   fd_set readset;
+  struct timeval tv,*ptv;
+  double scrwait;
   int fdcmd;
   struct termios t;
   
@@ -279,6 +538,12 @@ int main(int argc,char **argv){
   /* Erase Shared Memory */
   memset((char *)sm_p,0,sizeof(sm_t));
 
+  /* Startup timing */
+  calsnap_mark(sm_p,WATID,CALSNAP_EVENT_BOOT);
+
+  /* Init event log rings */
+  log_init(sm_p);
+
   /* Set stdout to line buffering */
   setvbuf(stdout,NULL,_IOLBF,0);
 
@@ -301,6 +566,11 @@ int main(int argc,char **argv){
     sm_p->w[i].per  =  procper[i];
     sm_p->w[i].name =  procnam[i];
     sm_p->w[i].fakemode = FAKEMODE_NONE;
+    sm_p->w[i].precision = NUM_PRECISION_DOUBLE;
+#ifdef PLANT_SIM
+    if(i == SHKID || i == LYTID || i == SCIID)
+      sm_p->w[i].fakemode = FAKEMODE_PLANT;
+#endif
 
 
     /* Assign Sub-Processes */
@@ -315,6 +585,7 @@ int main(int argc,char **argv){
     case THMID:sm_p->w[i].launch = thm_proc; break;
     case MSGID:sm_p->w[i].launch = msg_proc; break;
     case DIAID:sm_p->w[i].launch = dia_proc; break;
+    case HEXID:sm_p->w[i].launch = hex_proc; break;
     }
   }
 
@@ -330,17 +601,36 @@ int main(int argc,char **argv){
   sm_p->acq_exptime          = ACQ_EXPTIME_DEFAULT;
   sm_p->acq_frmtime          = ACQ_FRMTIME_DEFAULT;
   sm_p->shk_boxsize          = SHK_BOXSIZE_DEFAULT;
+  sm_p->shk_pinv_method      = SHK_PINV_METHOD_DEFAULT;
+  sm_p->shk_pinv_thresh      = SHK_PINV_THRESH_DEFAULT;
+  sm_p->shk_pinv_nmodes      = SHK_PINV_NMODES_DEFAULT;
+  sm_p->shk_pinv_alpha       = SHK_PINV_ALPHA_DEFAULT;
+  sm_p->shk_bkg_mode         = SHK_BKG_MODE_DEFAULT;
+  sm_p->fakecfg.shk_flux     = FAKE_SHK_FLUX_DEFAULT;
+  sm_p->fakecfg.lyt_flux     = FAKE_LYT_FLUX_DEFAULT;
+  sm_p->fakecfg.read_noise   = FAKE_READ_NOISE_DEFAULT;
+  sm_p->fakecfg.background   = FAKE_BACKGROUND_DEFAULT;
+  sm_p->fakecfg.xgradient    = FAKE_XGRADIENT_DEFAULT;
+  sm_p->fakecfg.ygradient    = FAKE_YGRADIENT_DEFAULT;
+  sm_p->fakecfg.dropout      = FAKE_DROPOUT_DEFAULT;
+  sm_p->plantcfg.speedup     = PLANT_SPEEDUP_DEFAULT;
+  sm_p->plantcfg.dist_scale  = PLANT_DIST_SCALE_DEFAULT;
+  sm_p->plantcfg.sine_zernike = PLANT_SINE_ZERNIKE_DEFAULT;
+  sm_p->plantcfg.sine_amp    = PLANT_SINE_AMP_DEFAULT;
+  sm_p->plantcfg.sine_freq   = PLANT_SINE_FREQ_DEFAULT;
   sm_p->alp_n_dither         = -1;
   sm_p->alp_proc_id          = -1;
   sm_p->sci_tec_enable       = SCI_TEC_ENABLE_DEFAULT;
   sm_p->sci_tec_setpoint     = SCI_TEC_SETPOINT_DEFAULT;
   sm_p->sci_phase_n_zernike  = SCI_PHASE_N_ZERNIKE_DEFAULT;
   sm_p->sci_phase_expscale   = SCI_PHASE_EXPSCALE_DEFAULT;
+  sm_p->sci_pipeline         = SCI_PIPELINE_DEFAULT;
   sm_p->sci_optmode          = SCI_OPTMODE_NMSIMPLEX2;
   sm_p->sci_refscale         = 1;
   sm_p->acq_thresh           = ACQ_THRESH_DEFAULT;
   sm_p->thm_enable_vref      = THM_ENABLE_VREF_DEFAULT;
   sm_p->hex_spiral_autostop  = HEX_SPIRAL_AUTOSTOP_DEFAULT;
+  sm_p->bmc_async            = BMC_ASYNC_DEFAULT;
   sm_p->lyt_xorigin          = LYT_XORIGIN_DEFAULT;
   sm_p->lyt_yorigin          = LYT_YORIGIN_DEFAULT;
   sm_p->lyt_mag_enable       = 0;
@@ -399,6 +689,23 @@ int main(int argc,char **argv){
   memcpy((uint32 *)sm_p->sci_xorigin,sci_xorigin,sizeof(sci_xorigin));
   memcpy((uint32 *)sm_p->sci_yorigin,sci_yorigin,sizeof(sci_yorigin));
 
+  /* Restore Calibration Snapshot */
+  calsnap_restore(sm_p);
+
+  /* Load Calibration Matrix Store */
+  if(!sm_p->calsnap.restored[CALSNAP_CALSTORE] && cal_load_all())
+    printf("WAT: Calibration store incomplete\n");
+
+  /* Load Zernike Errors Table */
+  if(alp_load_zernike_errors(sm_p))
+    printf("WAT: No Zernike errors table: %s\n",ZERNIKE_ERRORS_FILE);
+  calsnap_mark(sm_p,WATID,CALSNAP_EVENT_CAL);
+
+#ifdef PLANT_SIM
+  /* Start the optical plant */
+  plant_reset(sm_p);
+#endif
+
   /* Initialize States */
   for(i=0;i<NSTATES;i++)
     init_state(i,(state_t *)&sm_p->state_array[i]);
@@ -472,6 +779,14 @@ int main(int argc,char **argv){
   sm_p->circbuf[BUFFER_MSGEVENT].send    = SEND_MSGEVENT_DEFAULT;
   sm_p->circbuf[BUFFER_MSGEVENT].save    = SAVE_MSGEVENT_DEFAULT;
   sprintf((char *)sm_p->circbuf[BUFFER_MSGEVENT].name,"msgevent");
+  sm_p->circbuf[BUFFER_FRMEVENT].buffer  = (void *)sm_p->frmevent;
+  sm_p->circbuf[BUFFER_FRMEVENT].nbytes  = sizeof(frmevent_t);
+  sm_p->circbuf[BUFFER_FRMEVENT].bufsize = FRMEVENTSIZE;
+  sm_p->circbuf[BUFFER_FRMEVENT].write   = WRITE_FRMEVENT_DEFAULT;
+  sm_p->circbuf[BUFFER_FRMEVENT].read    = READ_FRMEVENT_DEFAULT;
+  sm_p->circbuf[BUFFER_FRMEVENT].send    = SEND_FRMEVENT_DEFAULT;
+  sm_p->circbuf[BUFFER_FRMEVENT].save    = SAVE_FRMEVENT_DEFAULT;
+  sprintf((char *)sm_p->circbuf[BUFFER_FRMEVENT].name,"frmevent");
 
   //-- Packet buffers
   sm_p->circbuf[BUFFER_SHKPKT].buffer  = (void *)sm_p->shkpkt;
@@ -609,19 +924,6 @@ int main(int argc,char **argv){
     }
   }
 
-  /* Init HEX Driver */
-  if(HEX_ENABLE){
-    printf("WAT: Opening HEX driver\n");
-    if(hex_init((int *)&sm_p->hexfd)){
-      sm_p->hex_ready = 0;
-      printf("WAT: ERROR: HEX init failed!\n");
-    }
-    else{
-      sm_p->hex_ready = 1;
-      printf("WAT: HEX ready\n");
-    }
-  }
-
   /* Initialize BMC DM */
   if(BMC_ENABLE){
     /* Open Device */
@@ -696,9 +998,16 @@ int main(int argc,char **argv){
     //Clear line
     memset(line,0,sizeof(line));
     
-    //Select on readset with no timeout (blocking)
-    if(select(FD_SETSIZE,&readset,NULL,NULL,NULL) < 0){
+    //Select on readset, wake up for the next script statement
+    ptv = NULL;
+    if((scrwait = scr_timeout()) >= 0){
+      tv.tv_sec  = (long)scrwait;
+      tv.tv_usec = (long)((scrwait - tv.tv_sec)*ONE_MILLION);
+      ptv = &tv;
+    }
+    if(select(FD_SETSIZE,&readset,NULL,NULL,ptv) < 0){
       perror("select");
+      FD_ZERO(&readset);
     }
     for(i=0;i<FD_SETSIZE;i++){
       if(FD_ISSET(i,&readset)){
@@ -723,6 +1032,9 @@ int main(int argc,char **argv){
       }
     }
     
+    /* Run command script */
+    scr_run(sm_p);
+    
     /* Check return value */
     if(retval == CMD_NORMAL){
       //Normal command -- do nothing
@@ -819,14 +1131,6 @@ int main(int argc,char **argv){
     }
   }
   
-  //Cleanup HEX
-  if(HEX_ENABLE){
-    if(sm_p->hex_ready){
-      hex_disconnect(sm_p->hexfd);
-      printf("WAT: HEX closed\n");
-    }
-  }
-
   //Cleanup BMC
   if(BMC_ENABLE){
     if(sm_p->bmc_ready){
@@ -6,12 +6,12 @@
  *************************************************/
 
 /*!!!!!!!!!! ALL NUMBERS MUST BE < 255 !!!!!!!!!*/
-//      procids {WATID, SCIID, SHKID, LYTID, TLMID, ACQID, MTRID, THMID, MSGID, DIAID};
-#define PROCRUN {    1,     1,     1,     1,     1,     1,     1,     1,     1,     0}
-#define PROCASK {    0,     0,     0,     0,     0,     0,     0,     0,     0,     1}
-#define PROCTMO {   10,    10,    10,    10,    10,    10,    10,    10,    10,    10}
-#define PROCNAM {"WAT", "SCI", "SHK", "LYT", "TLM", "ACQ", "MTR", "THM", "MSG", "DIA"}
-#define PROCPER {    1,     1,     1,     1,     1,     1,     1,     1,     1,     1}
+//      procids {WATID, SCIID, SHKID, LYTID, TLMID, ACQID, MTRID, THMID, MSGID, DIAID, HEXID};
+#define PROCRUN {    1,     1,     1,     1,     1,     1,     1,     1,     1,     0,     1}
+#define PROCASK {    0,     0,     0,     0,     0,     0,     0,     0,     0,     1,     0}
+#define PROCTMO {   10,    10,    10,    10,    10,    10,    10,    10,    10,    10,    60}
+#define PROCNAM {"WAT", "SCI", "SHK", "LYT", "TLM", "ACQ", "MTR", "THM", "MSG", "DIA", "HEX"}
+#define PROCPER {    1,     1,     1,     1,     1,     1,     1,     1,     1,     1,     1}
 
 
 /*************************************************
@@ -27,6 +27,7 @@
 #define WRITE_THMEVENT_DEFAULT     1
 #define WRITE_MTREVENT_DEFAULT     1
 #define WRITE_MSGEVENT_DEFAULT     1
+#define WRITE_FRMEVENT_DEFAULT     1
 #define WRITE_SHKPKT_DEFAULT       1
 #define WRITE_LYTPKT_DEFAULT       1
 #define WRITE_SHKFULL_DEFAULT      0
@@ -40,6 +41,7 @@
 #define READ_THMEVENT_DEFAULT      1
 #define READ_MTREVENT_DEFAULT      1
 #define READ_MSGEVENT_DEFAULT      1
+#define READ_FRMEVENT_DEFAULT      1
 #define READ_SHKPKT_DEFAULT        1
 #define READ_LYTPKT_DEFAULT        1
 #define READ_SHKFULL_DEFAULT       0
@@ -53,6 +55,7 @@
 #define SEND_THMEVENT_DEFAULT      1
 #define SEND_MTREVENT_DEFAULT      1
 #define SEND_MSGEVENT_DEFAULT      1
+#define SEND_FRMEVENT_DEFAULT      1
 #define SEND_SHKPKT_DEFAULT        1
 #define SEND_LYTPKT_DEFAULT        1
 #define SEND_SHKFULL_DEFAULT       0
@@ -66,6 +69,7 @@
 #define SAVE_THMEVENT_DEFAULT      1
 #define SAVE_MTREVENT_DEFAULT      1
 #define SAVE_MSGEVENT_DEFAULT      1
+#define SAVE_FRMEVENT_DEFAULT      1
 #define SAVE_SHKPKT_DEFAULT        1
 #define SAVE_LYTPKT_DEFAULT        1
 #define SAVE_SHKFULL_DEFAULT       0
@@ -113,6 +117,7 @@
 #define SCI_TEC_SETPOINT_DEFAULT   20
 #define SCI_PHASE_N_ZERNIKE_DEFAULT 10
 #define SCI_PHASE_EXPSCALE_DEFAULT  50
+#define SCI_PIPELINE_DEFAULT        0 //1 --> process frames on a worker thread
 
 //Timers
 #define ALP_CAL_TIMER_LENGTH_DEFAULT 30
@@ -120,6 +125,27 @@
 
 //Shack-Hartmann Settings
 #define SHK_BOXSIZE_DEFAULT        7
+#define SHK_PINV_METHOD_DEFAULT    NUM_PINV_NONE
+#define SHK_PINV_THRESH_DEFAULT    1e-3
+#define SHK_PINV_NMODES_DEFAULT    LOWFS_N_ZERNIKE
+#define SHK_PINV_ALPHA_DEFAULT     1e-2
+#define SHK_BKG_MODE_DEFAULT       SHK_BKG_LOCAL
+
+//Synthetic Frame Settings (FAKEMODE_ZERNIKE)
+#define FAKE_SHK_FLUX_DEFAULT      180  //ADU
+#define FAKE_LYT_FLUX_DEFAULT      0    //ADU, 0 --> reference image as is
+#define FAKE_READ_NOISE_DEFAULT    2.0  //ADU
+#define FAKE_BACKGROUND_DEFAULT    10.0 //ADU
+#define FAKE_XGRADIENT_DEFAULT     0.0  //ADU/pixel
+#define FAKE_YGRADIENT_DEFAULT     0.0  //ADU/pixel
+#define FAKE_DROPOUT_DEFAULT       0.0
+
+//Optical Plant (FAKEMODE_PLANT)
+#define PLANT_SPEEDUP_DEFAULT      1.0
+#define PLANT_DIST_SCALE_DEFAULT   1.0
+#define PLANT_SINE_ZERNIKE_DEFAULT -1   //off
+#define PLANT_SINE_AMP_DEFAULT     0.0  //microns
+#define PLANT_SINE_FREQ_DEFAULT    0.0  //Hz
 
 //SHK LOWFS Gains                       P           I            D
 #define SHK_GAIN_HEX_ZERN_DEFAULT {     -0.04,       0.0,       0.0}
@@ -176,6 +202,9 @@
 				     {-0.010000,  -0.000000,       0.0}, \
 				     {-0.010000,  -0.000000,       0.0}}  
 
+//BMC Settings
+#define BMC_ASYNC_DEFAULT         0  //1 --> SCI sends BMC commands asynchronously
+
 //ACQ Settings
 #define ACQ_THRESH_DEFAULT        5
 